@@ -0,0 +1,866 @@
+// Headless benchmark for the growth and meshing phases. Runs every phase on canonical, seeded attractor point clouds and reports
+// wall time, throughput, heap allocations and peak RSS, optionally comparing against a stored baseline.
+// Never touches OpenGL or the GPU, so it runs on build machines without a display or a CUDA device.
+//
+// Usage (run from the directory containing OBJs/):
+//   TreesBenchmark [--fixtures helixRot,sphere,danHead] [--sizes 10000,100000,1000000] [--max-points N] [--iterations N]
+//                  [--repetitions N] [--seed N] [--generation-points N] [--contains-queries N] [--cache-dir DIR]
+//                  [--space-colonization full|incremental] [--environment points|shadow] [--resolution-levels N] [--ensemble-variants N]
+//                  [--batch-trees N] [--preview-size N] [--preview-dir DIR] [--forest-trees N] [--forest-tiles X,Y,Z]
+//                  [--output results.json] [--baseline baseline.json] [--tolerance 0.1]
+// Save a results file from a known-good build and pass it as --baseline later; the exit code is 2 if any phase regressed.
+
+#include "../Scene/Globals.h"
+#include "../Scene/AttractorBrickStore.h"
+#include "../Scene/AttractorPointCloud.h"
+#include "../Scene/Tree.h"
+#include "../Scene/GrowthEnsemble.h"
+#include "../Scene/Forest.h"
+#include "../Scene/TiledForest.h"
+#include "../Threading/BatchPipeline.h"
+#include "../Scene/TreePreviewRenderer.h"
+#include "../Raytracing/PngWriter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+#define BENCHMARK_DEFAULT_SEED 101
+#define BENCHMARK_DEFAULT_GENERATION_POINTS 10000
+#define BENCHMARK_DEFAULT_CONTAINS_QUERIES 100000
+#define BENCHMARK_DEFAULT_TOLERANCE 0.1
+#define BENCHMARK_DEFAULT_ENSEMBLE_VARIANTS 4
+#define BENCHMARK_DEFAULT_BATCH_TREES 8
+#define BENCHMARK_DEFAULT_PREVIEW_SIZE 512
+#define BENCHMARK_DEFAULT_FOREST_TREES 4
+#define BENCHMARK_DEFAULT_FOREST_TILES glm::ivec3(2, 1, 2)
+#define BENCHMARK_NOISE_FLOOR_SECONDS 0.001 // phases faster than this are never flagged as regressions
+
+/// Allocation tracking: every global new / delete in the process goes through these counters
+
+static std::atomic<unsigned long long> numAllocations(0);
+static std::atomic<unsigned long long> numAllocatedBytes(0);
+
+void* operator new(std::size_t size) {
+    numAllocations.fetch_add(1, std::memory_order_relaxed);
+    numAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    void* p = std::malloc(size > 0 ? size : 1);
+    if (!p) { throw std::bad_alloc(); }
+    return p;
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+static unsigned long long GetPeakRSSBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return (unsigned long long)counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return (unsigned long long)usage.ru_maxrss; // bytes on macOS
+#else
+    return (unsigned long long)usage.ru_maxrss * 1024ull; // kilobytes on Linux
+#endif
+#endif
+}
+
+/// Results
+
+struct BenchmarkResult {
+    std::string fixture;
+    unsigned int numPoints;
+    std::string phase;
+    double seconds;
+    unsigned long long items; // what the phase processed (points, buds or queries), for throughput
+    unsigned long long allocations;
+    unsigned long long allocatedBytes;
+    unsigned long long peakRSSBytes; // process high-water mark when the phase finished
+    unsigned long long numBuds; // size of the tree afterwards, so a baseline from a different growth result is easy to spot
+
+    std::string Name() const {
+        std::ostringstream name;
+        name << fixture << "/" << numPoints << "/" << phase;
+        return name.str();
+    }
+    double ItemsPerSecond() const { return seconds > 0.0 ? (double)items / seconds : 0.0; }
+};
+
+// Times one phase and records its allocations. Accumulates over repeated calls (e.g. every growth iteration) so a whole
+// run of a phase ends up in one result.
+class PhaseTimer {
+private:
+    BenchmarkResult& result;
+    std::chrono::steady_clock::time_point start;
+    unsigned long long allocationsBefore;
+    unsigned long long bytesBefore;
+public:
+    PhaseTimer(BenchmarkResult& r, unsigned long long items) : result(r) {
+        result.items += items;
+        allocationsBefore = numAllocations.load(std::memory_order_relaxed);
+        bytesBefore = numAllocatedBytes.load(std::memory_order_relaxed);
+        start = std::chrono::steady_clock::now();
+    }
+    ~PhaseTimer() {
+        result.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.allocations += numAllocations.load(std::memory_order_relaxed) - allocationsBefore;
+        result.allocatedBytes += numAllocatedBytes.load(std::memory_order_relaxed) - bytesBefore;
+        result.peakRSSBytes = GetPeakRSSBytes();
+    }
+};
+
+struct BenchmarkFixture {
+    const char* name;
+    const char* meshPath;
+};
+
+static const BenchmarkFixture fixtures[] = {
+    { "helixRot", "OBJs/helixRot.obj" },
+    { "sphere",   "OBJs/sphere.obj" },
+    { "danHead",  "OBJs/danHead.obj" },
+};
+
+struct BenchmarkOptions {
+    std::vector<std::string> fixtureNames;
+    std::vector<unsigned int> sizes;
+    unsigned int maxPoints;
+    int numIterations;
+    int numRepetitions;
+    unsigned long long seed;
+    unsigned int numGenerationPoints;
+    unsigned int numContainsQueries;
+    std::string cacheDir;
+    bool incrementalSpaceColonization;
+    ENVIRONMENT_MODEL environmentModel;
+    int numResolutionLevels;
+    unsigned int numEnsembleVariants;
+    unsigned int numBatchTrees;
+    unsigned int previewSize;
+    std::string previewDir; // empty to render the previews without writing them
+    unsigned int numForestTrees;
+    glm::ivec3 numForestTiles;
+    std::string outputPath;
+    std::string baselinePath;
+    double tolerance;
+
+    BenchmarkOptions() : maxPoints(10000000), numIterations(TreeParameters().numSpaceColonizationIterations), numRepetitions(1), seed(BENCHMARK_DEFAULT_SEED),
+        numGenerationPoints(BENCHMARK_DEFAULT_GENERATION_POINTS), numContainsQueries(BENCHMARK_DEFAULT_CONTAINS_QUERIES), cacheDir(""),
+        incrementalSpaceColonization(TreeParameters().incrementalSpaceColonization), environmentModel(TreeParameters().environmentModel),
+        numResolutionLevels(TreeParameters().numResolutionLevels),
+        numEnsembleVariants(BENCHMARK_DEFAULT_ENSEMBLE_VARIANTS), numBatchTrees(BENCHMARK_DEFAULT_BATCH_TREES),
+        previewSize(BENCHMARK_DEFAULT_PREVIEW_SIZE), previewDir(""),
+        numForestTrees(BENCHMARK_DEFAULT_FOREST_TREES), numForestTiles(BENCHMARK_DEFAULT_FOREST_TILES), outputPath("benchmark_results.json"), baselinePath(""), tolerance(BENCHMARK_DEFAULT_TOLERANCE) {
+        fixtureNames = std::vector<std::string>();
+        for (unsigned int f = 0; f < sizeof(fixtures) / sizeof(fixtures[0]); ++f) {
+            fixtureNames.emplace_back(fixtures[f].name);
+        }
+        // 10M is supported but takes a long time on the CPU path; pass --sizes to include it
+        sizes = std::vector<unsigned int>();
+        sizes.emplace_back(10000);
+        sizes.emplace_back(100000);
+        sizes.emplace_back(1000000);
+    }
+};
+
+static std::vector<std::string> SplitList(const std::string& list) {
+    std::vector<std::string> items = std::vector<std::string>();
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (item.size() > 0) { items.emplace_back(item); }
+    }
+    return items;
+}
+
+static bool ParseOptions(int argc, char** argv, BenchmarkOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        const std::string value = argv[++i];
+        if (arg == "--fixtures") {
+            options.fixtureNames = SplitList(value);
+        } else if (arg == "--sizes") {
+            options.sizes.clear();
+            const std::vector<std::string> sizes = SplitList(value);
+            for (unsigned int s = 0; s < (unsigned int)sizes.size(); ++s) {
+                options.sizes.emplace_back((unsigned int)std::strtoul(sizes[s].c_str(), nullptr, 10));
+            }
+        } else if (arg == "--max-points") {
+            options.maxPoints = (unsigned int)std::strtoul(value.c_str(), nullptr, 10);
+        } else if (arg == "--iterations") {
+            options.numIterations = std::atoi(value.c_str());
+        } else if (arg == "--repetitions") {
+            options.numRepetitions = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--seed") {
+            options.seed = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--generation-points") {
+            options.numGenerationPoints = (unsigned int)std::strtoul(value.c_str(), nullptr, 10);
+        } else if (arg == "--contains-queries") {
+            options.numContainsQueries = (unsigned int)std::strtoul(value.c_str(), nullptr, 10);
+        } else if (arg == "--cache-dir") {
+            options.cacheDir = value;
+        } else if (arg == "--space-colonization") {
+            options.incrementalSpaceColonization = (value == "incremental");
+        } else if (arg == "--environment") {
+            options.environmentModel = (value == "shadow") ? ENVIRONMENT_SHADOW_PROPAGATION : ENVIRONMENT_SPACE_COLONIZATION;
+        } else if (arg == "--resolution-levels") {
+            options.numResolutionLevels = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--ensemble-variants") {
+            options.numEnsembleVariants = (unsigned int)std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--batch-trees") {
+            options.numBatchTrees = (unsigned int)std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--preview-size") {
+            options.previewSize = (unsigned int)std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--preview-dir") {
+            options.previewDir = value;
+        } else if (arg == "--forest-trees") {
+            options.numForestTrees = (unsigned int)std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--forest-tiles") {
+            const std::vector<std::string> tiles = SplitList(value);
+            for (unsigned int d = 0; d < 3; ++d) {
+                options.numForestTiles[d] = (d < (unsigned int)tiles.size()) ? std::max(1, std::atoi(tiles[d].c_str())) : 1;
+            }
+        } else if (arg == "--output") {
+            options.outputPath = value;
+        } else if (arg == "--baseline") {
+            options.baselinePath = value;
+        } else if (arg == "--tolerance") {
+            options.tolerance = std::atof(value.c_str());
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Fixtures
+
+// Generating millions of points inside a mesh is slow, so fixtures can be cached on disk. The cache key includes the seed,
+// and the generator is deterministic for a given seed, so a cached fixture is identical to a freshly generated one.
+static std::string FixtureCachePath(const BenchmarkOptions& options, const BenchmarkFixture& fixture, unsigned int numPoints) {
+    std::ostringstream path;
+    path << options.cacheDir << "/" << fixture.name << "_" << numPoints << "_seed" << options.seed << ".bin";
+    return path.str();
+}
+
+// Scratch file for the out-of-core growth phase, removed again right after
+static std::string BrickStorePath(const BenchmarkOptions& options, const BenchmarkFixture& fixture, unsigned int numPoints) {
+    std::ostringstream path;
+    path << (options.cacheDir.size() > 0 ? options.cacheDir : std::string(".")) << "/" << fixture.name << "_" << numPoints << "_bricks.bin";
+    return path.str();
+}
+
+static bool LoadFixture(const std::string& path, std::vector<AttractorPoint>& points) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) { return false; }
+    unsigned int numPoints = 0;
+    file.read((char*)&numPoints, sizeof(numPoints));
+    std::vector<glm::vec3> positions = std::vector<glm::vec3>(numPoints);
+    file.read((char*)positions.data(), sizeof(glm::vec3) * numPoints);
+    if (!file) { return false; }
+    points.clear();
+    points.reserve(numPoints);
+    for (unsigned int i = 0; i < numPoints; ++i) {
+        points.emplace_back(AttractorPoint(positions[i]));
+    }
+    return true;
+}
+
+static void SaveFixture(const std::string& path, const std::vector<AttractorPoint>& points) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not write fixture cache " << path << std::endl;
+        return;
+    }
+    const unsigned int numPoints = (unsigned int)points.size();
+    file.write((const char*)&numPoints, sizeof(numPoints));
+    for (unsigned int i = 0; i < numPoints; ++i) {
+        file.write((const char*)&points[i].point, sizeof(glm::vec3));
+    }
+}
+
+static void GetFixturePoints(const BenchmarkOptions& options, const BenchmarkFixture& fixture, unsigned int numPoints, std::vector<AttractorPoint>& points) {
+    const std::string cachePath = FixtureCachePath(options, fixture, numPoints);
+    if (options.cacheDir.size() > 0 && LoadFixture(cachePath, points)) { return; }
+
+    AttractorPointCloud cloud = AttractorPointCloud();
+    cloud.Seed(options.seed);
+    cloud.GeneratePointsInMesh(numPoints, fixture.meshPath);
+    points = cloud.GetPointsConst();
+    if (options.cacheDir.size() > 0) { SaveFixture(cachePath, points); }
+}
+
+/// Phases
+
+static unsigned long long CountBuds(const Tree& tree) {
+    unsigned long long numBuds = 0;
+    const CowChunkedArray<TreeBranch>& branches = tree.GetBranches();
+    for (unsigned int br = 0; br < (unsigned int)branches.size(); ++br) {
+        numBuds += branches[br].GetNumBuds();
+    }
+    return numBuds;
+}
+
+static BenchmarkResult MakeResult(const BenchmarkFixture& fixture, unsigned int numPoints, const char* phase) {
+    BenchmarkResult result;
+    result.fixture = fixture.name;
+    result.numPoints = numPoints;
+    result.phase = phase;
+    result.seconds = 0.0;
+    result.items = 0;
+    result.allocations = 0;
+    result.allocatedBytes = 0;
+    result.peakRSSBytes = 0;
+    result.numBuds = 0;
+    return result;
+}
+
+// Keep the fastest repetition of each phase
+static void KeepBest(BenchmarkResult& best, const BenchmarkResult& candidate, int repetition) {
+    if (repetition == 0 || candidate.seconds < best.seconds) { best = candidate; }
+}
+
+static void BenchmarkCloudGeneration(const BenchmarkOptions& options, const BenchmarkFixture& fixture, std::vector<BenchmarkResult>& results) {
+    BenchmarkResult best = MakeResult(fixture, options.numGenerationPoints, "Cloud Generation");
+    for (int rep = 0; rep < options.numRepetitions; ++rep) {
+        BenchmarkResult result = MakeResult(fixture, options.numGenerationPoints, "Cloud Generation");
+        AttractorPointCloud cloud = AttractorPointCloud();
+        cloud.Seed(options.seed);
+        {
+            PhaseTimer timer(result, options.numGenerationPoints);
+            cloud.GeneratePointsInMesh(options.numGenerationPoints, fixture.meshPath);
+        }
+        KeepBest(best, result, rep);
+    }
+    results.emplace_back(best);
+}
+
+static void BenchmarkMeshContains(const BenchmarkOptions& options, const BenchmarkFixture& fixture, std::vector<BenchmarkResult>& results) {
+    Mesh mesh = Mesh();
+    mesh.LoadFromFile(fixture.meshPath, true);
+    const std::vector<glm::vec3>& positions = mesh.GetPositions();
+    if (positions.size() == 0) {
+        std::cerr << "Could not load " << fixture.meshPath << std::endl;
+        return;
+    }
+    glm::vec3 meshMin = positions[0];
+    glm::vec3 meshMax = positions[0];
+    for (unsigned int i = 1; i < (unsigned int)positions.size(); ++i) {
+        meshMin = glm::min(meshMin, positions[i]);
+        meshMax = glm::max(meshMax, positions[i]);
+    }
+
+    // Same query points every run
+    pcg32 rng(options.seed);
+    std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+    std::vector<glm::vec3> queries = std::vector<glm::vec3>();
+    queries.reserve(options.numContainsQueries);
+    for (unsigned int i = 0; i < options.numContainsQueries; ++i) {
+        queries.emplace_back(meshMin + (meshMax - meshMin) * glm::vec3(dis(rng), dis(rng), dis(rng)));
+    }
+
+    BenchmarkResult best = MakeResult(fixture, options.numContainsQueries, "Mesh::Contains");
+    for (int rep = 0; rep < options.numRepetitions; ++rep) {
+        BenchmarkResult result = MakeResult(fixture, options.numContainsQueries, "Mesh::Contains");
+        unsigned long long numInside = 0;
+        {
+            PhaseTimer timer(result, queries.size());
+            for (unsigned int i = 0; i < (unsigned int)queries.size(); ++i) {
+                numInside += mesh.Contains(queries[i]) ? 1 : 0;
+            }
+        }
+        result.numBuds = numInside; // not buds, but still a cheap check that the answer didn't change
+        KeepBest(best, result, rep);
+    }
+    results.emplace_back(best);
+}
+
+static glm::vec3 NearestAttractorPoint(const std::vector<AttractorPoint>& points, const glm::vec3& target) {
+    glm::vec3 nearest = points[0].point;
+    for (unsigned int i = 1; i < (unsigned int)points.size(); ++i) {
+        if (glm::length2(points[i].point - target) < glm::length2(nearest - target)) { nearest = points[i].point; }
+    }
+    return nearest;
+}
+
+// The root sits on the attractor point nearest the bottom of the cloud's central axis, so every fixture starts with points in
+// perception range and grows up through the middle of the volume
+static glm::vec3 ChooseRootPoint(const std::vector<AttractorPoint>& points, const glm::vec3& minAttrPt) {
+    glm::vec3 centroid = glm::vec3(0.0f);
+    for (unsigned int i = 0; i < (unsigned int)points.size(); ++i) {
+        centroid += points[i].point;
+    }
+    centroid /= (float)points.size();
+    return NearestAttractorPoint(points, glm::vec3(centroid.x, minAttrPt.y, centroid.z));
+}
+
+// Whether two trees have the same branches with the same buds, bit for bit
+static bool IsSameGrowth(const Tree& a, const Tree& b) {
+    if (a.GetBranches().size() != b.GetBranches().size()) { return false; }
+    for (unsigned int br = 0; br < (unsigned int)a.GetBranches().size(); ++br) {
+        const unsigned int numBuds = a.GetBranches()[br].GetNumBuds();
+        if (numBuds != b.GetBranches()[br].GetNumBuds()) { return false; }
+        for (unsigned int bu = 0; bu < numBuds; ++bu) {
+            const Bud& budA = a.GetBudConst(br, bu);
+            const Bud& budB = b.GetBudConst(br, bu);
+            if (budA.point != budB.point || budA.branchRadius != budB.branchRadius) { return false; }
+        }
+    }
+    return true;
+}
+
+// Grows one tree phase by phase, timing each phase separately. Mirrors the loop in Tree::IterateGrowth (CPU path); the
+// end-to-end IterateGrowth run afterwards doubles as a check that the two haven't drifted apart.
+static void BenchmarkGrowth(const BenchmarkOptions& options, const BenchmarkFixture& fixture, unsigned int numPoints,
+                            const std::vector<AttractorPoint>& fixturePoints, std::vector<BenchmarkResult>& results) {
+    TreeParameters treeParams = TreeParameters();
+    treeParams.numSpaceColonizationIterations = options.numIterations;
+    treeParams.reconstructUniformGridOnGPU = false;
+    treeParams.incrementalSpaceColonization = options.incrementalSpaceColonization;
+    treeParams.environmentModel = options.environmentModel;
+    treeParams.numResolutionLevels = options.numResolutionLevels;
+
+    glm::vec3 minAttrPt = glm::vec3(999999.0f);
+    glm::vec3 maxAttrPt = glm::vec3(-999999.0f);
+    for (unsigned int i = 0; i < (unsigned int)fixturePoints.size(); ++i) {
+        minAttrPt = glm::min(minAttrPt, fixturePoints[i].point);
+        maxAttrPt = glm::max(maxAttrPt, fixturePoints[i].point);
+    }
+    const glm::vec3 rootPoint = ChooseRootPoint(fixturePoints, minAttrPt);
+
+    const char* phaseNames[] = { "Growth Setup", "Space Colonization", "BH Model", "Append New Shoots", "Reset State", "Compute Branch Radii", "Bake Meshes", "Fork Tree", "Iterate Growth",
+                                 "Iterate Growth Out Of Core", "Grow Coarse Levels", "Iterate Growth Quantized",
+                                 "Grow Ensemble", "Batch Sequential", "Batch Pipelined", "Render Preview" };
+    const unsigned int numPhases = sizeof(phaseNames) / sizeof(phaseNames[0]);
+    std::vector<BenchmarkResult> best = std::vector<BenchmarkResult>();
+    for (unsigned int ph = 0; ph < numPhases; ++ph) {
+        best.emplace_back(MakeResult(fixture, numPoints, phaseNames[ph]));
+    }
+
+    for (int rep = 0; rep < options.numRepetitions; ++rep) {
+        std::vector<BenchmarkResult> phases = std::vector<BenchmarkResult>();
+        for (unsigned int ph = 0; ph < numPhases; ++ph) {
+            phases.emplace_back(MakeResult(fixture, numPoints, phaseNames[ph]));
+        }
+
+        AttractorPointMask aliveMask = AttractorPointMask();
+        aliveMask.Reset((unsigned int)fixturePoints.size());
+        Tree tree = Tree(rootPoint);
+        int numCoarseIterations = 0;
+        if (treeParams.numResolutionLevels > 1) { // otherwise GrowCoarseLevels returns right away, and the phase isn't reported
+            PhaseTimer timer(phases[10], fixturePoints.size());
+            numCoarseIterations = tree.GrowCoarseLevels(fixturePoints, aliveMask, minAttrPt, maxAttrPt, treeParams, false);
+        }
+        {
+            PhaseTimer timer(phases[0], fixturePoints.size());
+            tree.BeginGrowth(fixturePoints, minAttrPt, maxAttrPt, treeParams, false);
+        }
+        for (int n = numCoarseIterations; n < treeParams.numSpaceColonizationIterations; ++n) {
+            {
+                PhaseTimer timer(phases[1], aliveMask.GetNumAlive());
+                tree.PerformSpaceColonization(fixturePoints, aliveMask, minAttrPt, maxAttrPt, treeParams, false);
+            }
+            {
+                PhaseTimer timer(phases[2], CountBuds(tree));
+                tree.ComputeBHModelBasipetalPass();
+                tree.ComputeBHModelAcropetalPass(treeParams);
+            }
+            {
+                PhaseTimer timer(phases[3], CountBuds(tree));
+                tree.AppendNewShoots(n, treeParams);
+            }
+            {
+                PhaseTimer timer(phases[4], tree.GetNumActiveBuds());
+                tree.ResetState(treeParams, false);
+            }
+            if (!tree.DidUpdate() || aliveMask.GetNumAlive() == 0) { break; }
+        }
+        {
+            PhaseTimer timer(phases[0], 0);
+            tree.EndGrowth(treeParams, false);
+        }
+        {
+            PhaseTimer timer(phases[5], CountBuds(tree));
+            tree.ComputeBranchRadii(treeParams);
+        }
+        {
+            PhaseTimer timer(phases[6], CountBuds(tree));
+            tree.BakeMeshes();
+        }
+        const unsigned long long numBudsPhased = CountBuds(tree);
+        {
+            // What a parameter sweep pays per branch-off: the tree's branches are shared, only the alive mask is copied
+            PhaseTimer timer(phases[7], tree.GetBranches().size());
+            Tree fork = tree.Fork();
+            AttractorPointMask forkMask = aliveMask;
+        }
+
+        // End to end, through the same entry point the application uses
+        AttractorPointMask aliveMaskEndToEnd = AttractorPointMask();
+        aliveMaskEndToEnd.Reset((unsigned int)fixturePoints.size());
+        Tree treeEndToEnd = Tree(rootPoint);
+        {
+            PhaseTimer timer(phases[8], fixturePoints.size());
+            treeEndToEnd.IterateGrowth(fixturePoints, aliveMaskEndToEnd, minAttrPt, maxAttrPt, treeParams, false);
+        }
+        const unsigned long long numBudsEndToEnd = CountBuds(treeEndToEnd);
+        if (numBudsEndToEnd != numBudsPhased) {
+            std::cerr << "Warning: " << fixture.name << "/" << numPoints << ": phase-by-phase growth produced " << numBudsPhased
+                      << " buds but Tree::IterateGrowth produced " << numBudsEndToEnd << ". The benchmark loop is out of date." << std::endl;
+        }
+
+        // The same growth with the points paged in from a brick store on disk. Writing the store isn't timed.
+        const std::string storePath = BrickStorePath(options, fixture, numPoints);
+        Tree treeOutOfCore = Tree(rootPoint);
+        if (AttractorBrickStore::WritePoints(storePath, fixturePoints, ATTRACTOR_BRICK_STORE_DEFAULT_BRICK_SIZE)) {
+            {
+                AttractorBrickStore store;
+                if (store.Open(storePath)) {
+                    PhaseTimer timer(phases[9], fixturePoints.size());
+                    treeOutOfCore.IterateGrowthOutOfCore(store, treeParams, false);
+                }
+            }
+            std::remove(storePath.c_str());
+        }
+        const unsigned long long numBudsOutOfCore = CountBuds(treeOutOfCore);
+        if (numBudsOutOfCore != numBudsEndToEnd && treeParams.numResolutionLevels <= 1) { // out-of-core growth has no coarse levels
+            std::cerr << "Warning: " << fixture.name << "/" << numPoints << ": Tree::IterateGrowthOutOfCore produced " << numBudsOutOfCore
+                      << " buds but Tree::IterateGrowth produced " << numBudsEndToEnd << "." << std::endl;
+        }
+
+        // The same growth into the quantized points, encoding included. Decoded positions are off by up to half a step of 1/65536 of a cell, so
+        // the tree may differ in a bud or two: no check against the others.
+        Tree treeQuantized = Tree(rootPoint);
+        {
+            PhaseTimer timer(phases[11], fixturePoints.size());
+            QuantizedAttractorPoints quantizedPoints;
+            quantizedPoints.Build(fixturePoints, PERCEPTION_RADIUS * treeParams.internodeScale); // the grid's cell width, see Tree::BeginGrowth
+            treeQuantized.IterateGrowth(quantizedPoints, treeParams);
+        }
+        const unsigned long long numBudsQuantized = CountBuds(treeQuantized);
+
+        // A parameter sweep grown as an ensemble over one shared grid: variant 0 is the tree above, the others vary the BH model's lambda.
+        // Sharing the points with the ensemble isn't timed, the application's clouds already hold them in a shared_ptr.
+        const std::shared_ptr<const std::vector<AttractorPoint>> sharedPoints = std::make_shared<const std::vector<AttractorPoint>>(fixturePoints);
+        std::vector<TreeParameters> variantParams = std::vector<TreeParameters>(options.numEnsembleVariants, treeParams);
+        std::vector<Tree> variantTrees = std::vector<Tree>();
+        std::vector<AttractorPointMask> variantMasks = std::vector<AttractorPointMask>(options.numEnsembleVariants);
+        for (unsigned int v = 0; v < options.numEnsembleVariants; ++v) {
+            variantParams[v].BHLambda = glm::clamp(treeParams.BHLambda + 0.05f * (float)v, 0.0f, 1.0f);
+            variantTrees.emplace_back(Tree(rootPoint));
+            variantMasks[v].Reset((unsigned int)fixturePoints.size());
+        }
+        variantParams[0] = treeParams;
+        {
+            PhaseTimer timer(phases[12], (unsigned long long)options.numEnsembleVariants * fixturePoints.size());
+            GrowthEnsemble ensemble = GrowthEnsemble(variantTrees);
+            ensemble.SetAttractorPoints(sharedPoints, minAttrPt, maxAttrPt, treeParams.internodeScale);
+            ensemble.IterateGrowth(variantParams, variantMasks);
+        }
+        const unsigned long long numBudsEnsemble = CountBuds(variantTrees[0]);
+        if (numBudsEnsemble != numBudsEndToEnd && treeParams.incrementalSpaceColonization && treeParams.numResolutionLevels <= 1) {
+            std::cerr << "Warning: " << fixture.name << "/" << numPoints << ": GrowthEnsemble produced " << numBudsEnsemble
+                      << " buds but Tree::IterateGrowth produced " << numBudsEndToEnd << "." << std::endl;
+        }
+
+        // A batch grown, meshed and exported tree after tree, the way a batch export used to run, and then pipelined (see BatchPipeline).
+        // Same trees, a sweep over the BH model's lambda, written next to the brick store and removed again.
+        const Tree batchTemplate = Tree(rootPoint); // copied per tree, so the branch and leaf meshes are read from disk once
+        const std::string batchPrefix = BrickStorePath(options, fixture, numPoints) + "_batch";
+        const BatchTreeSource batchSource = [&](unsigned int i, BatchTree& batchTree) {
+            batchTree.tree.reset(new Tree(batchTemplate));
+            batchTree.attractorPoints = sharedPoints;
+            batchTree.minAttrPt = minAttrPt;
+            batchTree.maxAttrPt = maxAttrPt;
+            batchTree.treeParams = treeParams;
+            batchTree.treeParams.BHLambda = glm::clamp(treeParams.BHLambda + 0.05f * (float)(i % 4), 0.0f, 1.0f);
+            batchTree.outputPrefix = batchPrefix + std::to_string(i) + "_";
+        };
+        {
+            PhaseTimer timer(phases[13], options.numBatchTrees);
+            for (unsigned int i = 0; i < options.numBatchTrees; ++i) {
+                BatchTree batchTree = BatchTree();
+                batchSource(i, batchTree);
+                batchTree.aliveMask.Reset((unsigned int)fixturePoints.size());
+                batchTree.tree->IterateGrowth(fixturePoints, batchTree.aliveMask, minAttrPt, maxAttrPt, batchTree.treeParams, false);
+                batchTree.tree->BakeMeshes();
+                batchTree.tree->ExportAsObj(batchTree.outputPrefix);
+            }
+        }
+        BatchPipeline pipeline;
+        {
+            PhaseTimer timer(phases[14], options.numBatchTrees);
+            pipeline.Run(options.numBatchTrees, batchSource);
+        }
+        if (rep == options.numRepetitions - 1) { pipeline.PrintStats(); }
+        for (unsigned int i = 0; i < options.numBatchTrees; ++i) {
+            const std::string outputPrefix = batchPrefix + std::to_string(i) + "_";
+            std::remove((outputPrefix + "tree_mesh.obj").c_str());
+            std::remove((outputPrefix + "leaves_mesh.obj").c_str());
+        }
+
+        // A thumbnail of the phase-by-phase tree, traced on the CPU (see TreePreviewRenderer). Building the capsule BVH is part of it.
+        std::vector<unsigned char> previewPixels = std::vector<unsigned char>();
+        {
+            PhaseTimer timer(phases[15], (unsigned long long)options.previewSize * options.previewSize);
+            TreePreviewRenderer previewRenderer;
+            previewRenderer.Build(tree);
+            previewRenderer.Render(options.previewSize, options.previewSize, 0.0f, previewPixels);
+        }
+        if (options.previewDir.size() > 0 && rep == options.numRepetitions - 1) {
+            PngWriter::Write(options.previewDir + "/" + fixture.name + "_" + std::to_string(numPoints) + ".png", options.previewSize, options.previewSize, previewPixels);
+        }
+
+        for (unsigned int ph = 0; ph < numPhases; ++ph) {
+            phases[ph].numBuds = (ph == 8) ? numBudsEndToEnd : ((ph == 9) ? numBudsOutOfCore : ((ph == 11) ? numBudsQuantized : ((ph == 12) ? numBudsEnsemble : numBudsPhased)));
+            KeepBest(best[ph], phases[ph], rep);
+        }
+    }
+    for (unsigned int ph = 0; ph < numPhases; ++ph) {
+        if (ph == 10 && treeParams.numResolutionLevels <= 1) { continue; }
+        results.emplace_back(best[ph]);
+    }
+}
+
+// The tiled growth paths have to grow exactly the trees a Forest grows, across tile borders included
+static void WarnIfDifferentForest(const BenchmarkOptions& options, const BenchmarkFixture& fixture, unsigned int numPoints, const char* what,
+                                  const std::vector<Tree>& forestTrees, const AttractorPointMask& forestMask, const std::vector<Tree>& tiledTrees,
+                                  const AttractorPointMask& tiledMask) {
+    for (unsigned int t = 0; t < (unsigned int)forestTrees.size(); ++t) {
+        if (!IsSameGrowth(forestTrees[t], tiledTrees[t])) {
+            std::cerr << "Warning: " << fixture.name << "/" << numPoints << ": tree " << t << " grown by a " << what << " of " << options.numForestTiles.x << "x"
+                      << options.numForestTiles.y << "x" << options.numForestTiles.z << " tiles differs from the one grown by a Forest." << std::endl;
+        }
+    }
+    if (forestMask.GetNumAlive() != tiledMask.GetNumAlive()) {
+        std::cerr << "Warning: " << fixture.name << "/" << numPoints << ": a " << what << " left " << tiledMask.GetNumAlive() << " points alive but a Forest left "
+                  << forestMask.GetNumAlive() << "." << std::endl;
+    }
+}
+
+// Grows a forest with a Forest, again with a TiledForest whose tiles exchange halo buds and point claims over the loopback transport, and
+// once more with one process per tile over sockets, except on Windows. The roots sit on the points nearest a grid across the bottom of the
+// cloud. All must grow the same trees, bit for bit.
+static void BenchmarkForestGrowth(const BenchmarkOptions& options, const BenchmarkFixture& fixture, unsigned int numPoints,
+                                  const std::vector<AttractorPoint>& fixturePoints, std::vector<BenchmarkResult>& results) {
+    TreeParameters treeParams = TreeParameters();
+    treeParams.numSpaceColonizationIterations = options.numIterations;
+    treeParams.reconstructUniformGridOnGPU = false;
+
+    glm::vec3 minAttrPt = glm::vec3(999999.0f);
+    glm::vec3 maxAttrPt = glm::vec3(-999999.0f);
+    for (unsigned int i = 0; i < (unsigned int)fixturePoints.size(); ++i) {
+        minAttrPt = glm::min(minAttrPt, fixturePoints[i].point);
+        maxAttrPt = glm::max(maxAttrPt, fixturePoints[i].point);
+    }
+    unsigned int side = 1;
+    while (side * side < options.numForestTrees) { ++side; }
+    std::vector<glm::vec3> rootPoints = std::vector<glm::vec3>();
+    for (unsigned int t = 0; t < options.numForestTrees; ++t) {
+        const float u = ((float)(t % side) + 0.5f) / (float)side;
+        const float v = ((float)(t / side) + 0.5f) / (float)side;
+        rootPoints.emplace_back(NearestAttractorPoint(fixturePoints, glm::vec3(glm::mix(minAttrPt.x, maxAttrPt.x, u), minAttrPt.y, glm::mix(minAttrPt.z, maxAttrPt.z, v))));
+    }
+
+    BenchmarkResult bestForest = MakeResult(fixture, numPoints, "Grow Forest");
+    BenchmarkResult bestTiled = MakeResult(fixture, numPoints, "Grow Tiled Forest");
+    BenchmarkResult bestProcesses = MakeResult(fixture, numPoints, "Grow Tiled Forest In Processes");
+    bool processesRan = true;
+    for (int rep = 0; rep < options.numRepetitions; ++rep) {
+        BenchmarkResult forestResult = MakeResult(fixture, numPoints, "Grow Forest");
+        BenchmarkResult tiledResult = MakeResult(fixture, numPoints, "Grow Tiled Forest");
+        BenchmarkResult processesResult = MakeResult(fixture, numPoints, "Grow Tiled Forest In Processes");
+        std::vector<Tree> forestTrees = std::vector<Tree>();
+        std::vector<Tree> tiledTrees = std::vector<Tree>();
+        std::vector<Tree> processesTrees = std::vector<Tree>();
+        for (unsigned int t = 0; t < options.numForestTrees; ++t) {
+            forestTrees.emplace_back(Tree(rootPoints[t]));
+            tiledTrees.emplace_back(forestTrees.back());
+            processesTrees.emplace_back(forestTrees.back());
+        }
+
+        AttractorPointMask forestMask = AttractorPointMask();
+        forestMask.Reset((unsigned int)fixturePoints.size());
+        {
+            PhaseTimer timer(forestResult, fixturePoints.size());
+            Forest forest = Forest(forestTrees);
+            forest.IterateGrowth(fixturePoints, forestMask, minAttrPt, maxAttrPt, treeParams);
+        }
+        AttractorPointMask tiledMask = AttractorPointMask();
+        tiledMask.Reset((unsigned int)fixturePoints.size());
+        {
+            PhaseTimer timer(tiledResult, fixturePoints.size());
+            TiledForest tiledForest = TiledForest(tiledTrees, options.numForestTiles);
+            tiledForest.IterateGrowth(fixturePoints, tiledMask, minAttrPt, maxAttrPt, treeParams);
+        }
+        // Allocations and peak RSS only cover this process, i.e. partitioning the tiles and taking the results over
+        AttractorPointMask processesMask = AttractorPointMask();
+        processesMask.Reset((unsigned int)fixturePoints.size());
+        {
+            PhaseTimer timer(processesResult, fixturePoints.size());
+            TiledForest tiledForest = TiledForest(processesTrees, options.numForestTiles);
+            processesRan = processesRan && tiledForest.IterateGrowthInProcesses(fixturePoints, processesMask, minAttrPt, maxAttrPt, treeParams);
+        }
+
+        for (unsigned int t = 0; t < options.numForestTrees; ++t) {
+            forestResult.numBuds += CountBuds(forestTrees[t]);
+            tiledResult.numBuds += CountBuds(tiledTrees[t]);
+            processesResult.numBuds += CountBuds(processesTrees[t]);
+        }
+        WarnIfDifferentForest(options, fixture, numPoints, "TiledForest", forestTrees, forestMask, tiledTrees, tiledMask);
+        if (processesRan) {
+            WarnIfDifferentForest(options, fixture, numPoints, "TiledForest in processes", forestTrees, forestMask, processesTrees, processesMask);
+        }
+        KeepBest(bestForest, forestResult, rep);
+        KeepBest(bestTiled, tiledResult, rep);
+        KeepBest(bestProcesses, processesResult, rep);
+    }
+    results.emplace_back(bestForest);
+    results.emplace_back(bestTiled);
+    if (processesRan) {
+        results.emplace_back(bestProcesses);
+    }
+}
+
+/// Output and baseline comparison
+
+// One result per line so the baseline reader doesn't need a full JSON parser
+static bool WriteResults(const BenchmarkOptions& options, const std::vector<BenchmarkResult>& results) {
+    std::ofstream file(options.outputPath);
+    if (!file.is_open()) { return false; }
+    file.precision(9);
+    file << "{\n\"seed\": " << options.seed << ",\n\"iterations\": " << options.numIterations << ",\n\"results\": [\n";
+    for (unsigned int i = 0; i < (unsigned int)results.size(); ++i) {
+        const BenchmarkResult& r = results[i];
+        file << "{\"name\":\"" << r.Name() << "\",\"fixture\":\"" << r.fixture << "\",\"points\":" << r.numPoints << ",\"phase\":\"" << r.phase
+             << "\",\"seconds\":" << r.seconds << ",\"items\":" << r.items << ",\"itemsPerSecond\":" << r.ItemsPerSecond()
+             << ",\"allocations\":" << r.allocations << ",\"allocatedBytes\":" << r.allocatedBytes << ",\"peakRSSBytes\":" << r.peakRSSBytes
+             << ",\"buds\":" << r.numBuds << "}" << (i + 1 < (unsigned int)results.size() ? ",\n" : "\n");
+    }
+    file << "]\n}\n";
+    return true;
+}
+
+static bool ReadJsonNumber(const std::string& line, const char* key, double& value) {
+    const std::string pattern = std::string("\"") + key + "\":";
+    const size_t pos = line.find(pattern);
+    if (pos == std::string::npos) { return false; }
+    value = std::atof(line.c_str() + pos + pattern.size());
+    return true;
+}
+
+// Prints the comparison and returns the number of phases slower than baseline by more than the tolerance
+static int CompareAgainstBaseline(const BenchmarkOptions& options, const std::vector<BenchmarkResult>& results) {
+    std::ifstream file(options.baselinePath);
+    if (!file.is_open()) {
+        std::cerr << "Could not open baseline " << options.baselinePath << std::endl;
+        return 0;
+    }
+    std::map<std::string, std::pair<double, double>> baseline = std::map<std::string, std::pair<double, double>>(); // name -> (seconds, buds)
+    std::string line;
+    while (std::getline(file, line)) {
+        const size_t nameStart = line.find("\"name\":\"");
+        if (nameStart == std::string::npos) { continue; }
+        const size_t nameEnd = line.find('"', nameStart + 8);
+        double seconds = 0.0;
+        double buds = 0.0;
+        if (nameEnd == std::string::npos || !ReadJsonNumber(line, "seconds", seconds)) { continue; }
+        ReadJsonNumber(line, "buds", buds);
+        baseline[line.substr(nameStart + 8, nameEnd - nameStart - 8)] = std::make_pair(seconds, buds);
+    }
+
+    int numRegressions = 0;
+    std::cout << std::endl << "Comparison against " << options.baselinePath << " (tolerance " << options.tolerance * 100.0 << "%)" << std::endl;
+    for (unsigned int i = 0; i < (unsigned int)results.size(); ++i) {
+        const BenchmarkResult& r = results[i];
+        std::map<std::string, std::pair<double, double>>::const_iterator it = baseline.find(r.Name());
+        if (it == baseline.end()) { continue; }
+        const double baselineSeconds = it->second.first;
+        const double ratio = baselineSeconds > 0.0 ? r.seconds / baselineSeconds : 1.0;
+        const bool regressed = ratio > 1.0 + options.tolerance && r.seconds > BENCHMARK_NOISE_FLOOR_SECONDS;
+        numRegressions += regressed ? 1 : 0;
+        std::cout << (regressed ? "  REGRESSED " : "            ") << r.Name() << ": " << baselineSeconds << "s -> " << r.seconds << "s (x" << ratio << ")";
+        if ((unsigned long long)it->second.second != r.numBuds) {
+            std::cout << " [result differs from baseline: " << (unsigned long long)it->second.second << " -> " << r.numBuds << "]";
+        }
+        std::cout << std::endl;
+    }
+    return numRegressions;
+}
+
+int main(int argc, char** argv) {
+    BenchmarkOptions options = BenchmarkOptions();
+    if (!ParseOptions(argc, argv, options)) {
+        return 1;
+    }
+
+    std::vector<BenchmarkResult> results = std::vector<BenchmarkResult>();
+    for (unsigned int f = 0; f < sizeof(fixtures) / sizeof(fixtures[0]); ++f) {
+        const BenchmarkFixture& fixture = fixtures[f];
+        if (std::find(options.fixtureNames.begin(), options.fixtureNames.end(), fixture.name) == options.fixtureNames.end()) { continue; }
+
+        std::cout << fixture.name << ": cloud generation and Mesh::Contains" << std::endl;
+        BenchmarkCloudGeneration(options, fixture, results);
+        BenchmarkMeshContains(options, fixture, results);
+
+        for (unsigned int s = 0; s < (unsigned int)options.sizes.size(); ++s) {
+            const unsigned int numPoints = options.sizes[s];
+            if (numPoints > options.maxPoints) { continue; }
+            std::vector<AttractorPoint> fixturePoints = std::vector<AttractorPoint>();
+            GetFixturePoints(options, fixture, numPoints, fixturePoints);
+            if (fixturePoints.size() == 0) {
+                std::cerr << "Could not generate points in " << fixture.meshPath << std::endl;
+                continue;
+            }
+            std::cout << fixture.name << ": growing in " << fixturePoints.size() << " points" << std::endl;
+            BenchmarkGrowth(options, fixture, numPoints, fixturePoints, results);
+            BenchmarkForestGrowth(options, fixture, numPoints, fixturePoints, results);
+        }
+    }
+
+    std::cout << std::endl;
+    for (unsigned int i = 0; i < (unsigned int)results.size(); ++i) {
+        const BenchmarkResult& r = results[i];
+        std::cout << r.Name() << ": " << r.seconds * 1000.0 << " ms, " << r.ItemsPerSecond() << " items/s, " << r.allocations << " allocations ("
+                  << r.allocatedBytes / (1024 * 1024) << " MB), peak RSS " << r.peakRSSBytes / (1024 * 1024) << " MB" << std::endl;
+    }
+
+    if (!WriteResults(options, results)) {
+        std::cerr << "Could not write " << options.outputPath << std::endl;
+    }
+    if (options.baselinePath.size() > 0 && CompareAgainstBaseline(options, results) > 0) {
+        return 2;
+    }
+    return 0;
+}
@@ -3,10 +3,15 @@
 #include "device_launch_parameters.h"
 #include "kernels.h"
 #include "../Scene/Tree.h"
+#include "../Profiling/Profiler.h"
 
 #include <stdio.h>
 
 #define checkCUDAErrorWithLine(msg) checkCUDAError(msg, __LINE__)
+#define UNIFORM_GRID_MAX_DEAD_FRACTION 0.5f // of the points in the grid, before it is rebuilt without them
+#define UNIFORM_GRID_MAX_PENDING_POINTS 2048 // appended points that every bud scans, before they are merged into the cells
+#define UNIFORM_GRID_POINT_SLACK 0.25f // room for appended points in the per-point buffers, in multiples of the points at the last allocation
+#define UNIFORM_GRID_FRAME_PADDING 0.0625f // of the grid's side, added on every side so that points appended just past the bounds still fit
 
 // Uniform grid for attractor points
 AttractorPoint* dev_attrPts = 0;
@@ -16,6 +21,34 @@ int* dev_gridCellIndices = 0; // grid cell index of each attractor point
 int* dev_gridCellStartIndices = 0; // start index of a grid cell
 int* dev_gridCellEndIndices = 0; // end index of a grid cell
 int* dev_mutex = 0;
+unsigned int* dev_aliveMask = 0; // one bit per attractor point, indexed like the host points (not the memory coherent ones)
+
+// What the grid on the device was built from. Growth only ever removes points, and the alive mask takes care of that by itself, so the grid
+// can be reused for as long as the points keep their revision (see TreeParameters::attractorPointsRevision) and fit in the grid frame.
+// Points appended under the same revision go to a pending bucket behind the others, which every bud scans in full until the next rebuild
+// merges them into the cells. The memory coherent points are laid out as
+// [0, gridNumIndexedPoints): alive at the last build, sorted by cell
+// [gridNumIndexedPoints, gridNumBuiltPoints): dead at the last build, in no cell
+// [gridNumBuiltPoints, gridNumSourcePoints): the pending bucket, in host order
+unsigned int gridPointsRevision = 0; // 0 while there is no grid
+int gridNumAllocatedPoints = 0; // size of the per-point device buffers
+int gridNumAllocatedCells = 0; // size of the per-cell device buffers, without the cell for dead points
+int gridNumSourcePoints = 0; // host points on the device
+int gridNumBuiltPoints = 0; // host points at the last build
+int gridNumIndexedPoints = 0; // points that were alive at the last build
+glm::vec3 gridBuiltMin = glm::vec3(0.0f); // padded, see UNIFORM_GRID_FRAME_PADDING
+float gridBuiltCellWidth = 0.0f;
+int gridBuiltSideCount = 0;
+int* dev_revivedFlag = 0; // set if a point that was dead at the last build is alive again
+
+// Algorithmic counters accumulated on the device, only used when ENABLE_PROFILING is defined
+enum PROFILE_COUNTER_INDEX {
+    GRID_CELLS_VISITED,
+    DISTANCE_TESTS,
+    POINTS_KILLED,
+    NUM_PROFILE_COUNTERS
+};
+unsigned long long* dev_profileCounters = 0;
 
 /**
 * Check for CUDA errors; print and exit if there was a problem.
@@ -37,7 +70,7 @@ __device__ int gridIndex3Dto1D(int x, int y, int z, int gridResolution) {
 
 __global__ void kernMarkAttractorPointsAsRemoved(Bud* dev_buds, const glm::vec3 gridMin, const int gridResolution, const float inverseCellWidth, const int numBuds,
     AttractorPoint* dev_attrPts_memCoherent, const int numAttractorPoints, int* dev_mutex, int* gridCellStartIndices,
-    int* gridCellEndIndices) {
+    int* gridCellEndIndices, const int firstPendingAttrPt, const int endPendingAttrPt, unsigned long long* profileCounters) {
     int index = threadIdx.x + blockIdx.x * blockDim.x;
     if (index >= numBuds) {
         return;
@@ -46,7 +79,21 @@ __global__ void kernMarkAttractorPointsAsRemoved(Bud* dev_buds, const glm::vec3
 
     const glm::vec3 budPosLocalToGrid = currentBud.point - gridMin;
     const glm::vec3 index3D = glm::floor(budPosLocalToGrid * inverseCellWidth);
-    const int lookupRadius = (int)glm::ceil(3.74165738677f * currentBud.internodeLength * inverseCellWidth); // sqrt(14) as used in space col nearby point lookup
+    const int lookupRadius = (int)glm::ceil(PERCEPTION_RADIUS * currentBud.internodeLength * inverseCellWidth); // as used in space col nearby point lookup
+    #ifdef ENABLE_PROFILING
+    unsigned long long numPointsKilled = 0;
+    #endif
+
+    auto markIfRemoved = [&](int g) {
+        AttractorPoint& currentAttrPt = dev_attrPts_memCoherent[g];
+        const float budToPtDist = glm::length2(currentAttrPt.point - currentBud.point);
+        if (budToPtDist < KILL_RADIUS_SQUARED * currentBud.internodeLength * currentBud.internodeLength) {
+            #ifdef ENABLE_PROFILING
+            numPointsKilled += currentAttrPt.removed ? 0 : 1; // approximate, two buds may kill the same point at once
+            #endif
+            currentAttrPt.removed = true;
+        }
+    };
 
     if (currentBud.internodeLength > 0.0f && currentBud.fate == DORMANT) {
         for (int x = -lookupRadius; x <= lookupRadius; ++x) {
@@ -60,21 +107,21 @@ __global__ void kernMarkAttractorPointsAsRemoved(Bud* dev_buds, const glm::vec3
                         int index1D = gridIndex3Dto1D(currentGridIndex.x, currentGridIndex.y, currentGridIndex.z, gridResolution);
                         for (int g = gridCellStartIndices[index1D]; g <= gridCellEndIndices[index1D]; ++g) {
                             if (g < 0) { break; }
-                            AttractorPoint& currentAttrPt = dev_attrPts_memCoherent[g];
-                            glm::vec3 budToPtDir = currentAttrPt.point - currentBud.point;
-                            const float budToPtDist2 = glm::length2(budToPtDir);
-                            budToPtDir = glm::normalize(budToPtDir);
-                            const float dotProd = glm::dot(budToPtDir, currentBud.naturalGrowthDir);
-                            const float budToPtDist = glm::length2(currentAttrPt.point - currentBud.point);
-                            if (budToPtDist < 5.1f * currentBud.internodeLength * currentBud.internodeLength) { // ~2x internode length - use distance squared
-                                currentAttrPt.removed = true;
-                            }
+                            markIfRemoved(g);
                         }
                     }
                 }
             }
         }
+        for (int g = firstPendingAttrPt; g < endPendingAttrPt; ++g) { // in no cell yet
+            markIfRemoved(g);
+        }
     }
+    #ifdef ENABLE_PROFILING
+    if (numPointsKilled > 0) {
+        atomicAdd(profileCounters + POINTS_KILLED, numPointsKilled);
+    }
+    #endif
 }
 
 // Note: this implementation uses the "nearestBudIdx" field differently than the CPU implementation. This is because on the GPU, we don't
@@ -82,7 +129,8 @@ __global__ void kernMarkAttractorPointsAsRemoved(Bud* dev_buds, const glm::vec3
 // of buds for a certain branch.
 __global__ void kernSetNearestBudForAttractorPoints(Bud* dev_buds, const glm::vec3 gridMin, const int gridResolution, const float inverseCellWidth, const int numBuds,
                                                     AttractorPoint* dev_attrPts_memCoherent, const int numAttractorPoints, int* dev_mutex, int* gridCellStartIndices,
-                                                    int* gridCellEndIndices) {
+                                                    int* gridCellEndIndices, const int firstPendingAttrPt, const int endPendingAttrPt, const float perceptionCosTheta,
+                                                    unsigned long long* profileCounters) {
     int index = threadIdx.x + blockIdx.x * blockDim.x;
     if (index >= numBuds) {
         return;
@@ -91,7 +139,38 @@ __global__ void kernSetNearestBudForAttractorPoints(Bud* dev_buds, const glm::ve
     
     const glm::vec3 budPosLocalToGrid = currentBud.point - gridMin;
     const glm::vec3 index3D = glm::floor(budPosLocalToGrid * inverseCellWidth);
-    const int lookupRadius = (int)glm::ceil(3.74165738677f * currentBud.internodeLength * inverseCellWidth); // sqrt(14) as used below
+    const int lookupRadius = (int)glm::ceil(PERCEPTION_RADIUS * currentBud.internodeLength * inverseCellWidth); // as used below
+    #ifdef ENABLE_PROFILING
+    unsigned long long numCellsVisited = 0;
+    unsigned long long numDistanceTests = 0;
+    #endif
+
+    auto claimIfPerceived = [&](int g) {
+        AttractorPoint& currentAttrPt = dev_attrPts_memCoherent[g];
+        glm::vec3 budToPtDir = currentAttrPt.point - currentBud.point;
+        const float budToPtDist2 = glm::length2(budToPtDir);
+        #ifdef ENABLE_PROFILING
+        ++numDistanceTests;
+        #endif
+        if (currentAttrPt.removed) { return; }
+        budToPtDir = glm::normalize(budToPtDir);
+        const float dotProd = glm::dot(budToPtDir, currentBud.naturalGrowthDir);
+        if (budToPtDist2 < (PERCEPTION_RADIUS_SQUARED * currentBud.internodeLength * currentBud.internodeLength) && dotProd > perceptionCosTheta) {
+            ++currentBud.numPerceivedAttrPts; // only this thread touches this bud
+            int* mutex = dev_mutex + g;
+            bool isSet = false;
+            do {
+                isSet = (atomicCAS(mutex, 0, 1) == 0);
+                if (isSet) {
+                    if (budToPtDist2 < currentAttrPt.nearestBudDist2) {
+                        currentAttrPt.nearestBudDist2 = budToPtDist2;
+                        currentAttrPt.nearestBudIdx = index;
+                    }
+                    *mutex = 0;
+                }
+            } while (!isSet);
+        }
+    };
 
     if (currentBud.internodeLength > 0.0f && currentBud.fate == DORMANT) {
         for (int x = -lookupRadius; x <= lookupRadius; ++x) {
@@ -103,43 +182,30 @@ __global__ void kernSetNearestBudForAttractorPoints(Bud* dev_buds, const glm::ve
                         (((int)currentGridIndex.y) >= 0 && ((int)currentGridIndex.y) < gridResolution)) &&
                         (((int)currentGridIndex.z) >= 0 && ((int)currentGridIndex.z) < gridResolution)) {
                         int index1D = gridIndex3Dto1D(currentGridIndex.x, currentGridIndex.y, currentGridIndex.z, gridResolution);
+                        #ifdef ENABLE_PROFILING
+                        ++numCellsVisited;
+                        #endif
                         for (int g = gridCellStartIndices[index1D]; g <= gridCellEndIndices[index1D]; ++g) {
                             if (g < 0) { break; }
-                            AttractorPoint& currentAttrPt = dev_attrPts_memCoherent[g];
-                            glm::vec3 budToPtDir = currentAttrPt.point - currentBud.point;
-                            const float budToPtDist2 = glm::length2(budToPtDir);
-                            /*if (budToPtDist2 < 5.1f * currentBud.internodeLength * currentBud.internodeLength) { // ~2x internode length - use distance squared
-                                currentAttrPt.removed = true;
-                                printf("Removing a point\n");
-                            }*/
-                            if (currentAttrPt.removed) { continue; }
-                            budToPtDir = glm::normalize(budToPtDir);
-                            const float dotProd = glm::dot(budToPtDir, currentBud.naturalGrowthDir);
-                            if (budToPtDist2 < (14.0f * currentBud.internodeLength * currentBud.internodeLength) && dotProd > std::abs(COS_THETA_SMALL)) {
-                                int* mutex = dev_mutex + g;
-                                bool isSet = false;
-                                do {
-                                    isSet = (atomicCAS(mutex, 0, 1) == 0);
-                                    if (isSet) {
-                                        if (budToPtDist2 < currentAttrPt.nearestBudDist2) {
-                                            currentAttrPt.nearestBudDist2 = budToPtDist2;
-                                            currentAttrPt.nearestBudIdx = index;
-                                        }
-                                        *mutex = 0;
-                                    }
-                                } while (!isSet);
-                            }
+                            claimIfPerceived(g);
                         }
                     }
                 }
             }
         }
+        for (int g = firstPendingAttrPt; g < endPendingAttrPt; ++g) { // in no cell yet
+            claimIfPerceived(g);
+        }
     }
+    #ifdef ENABLE_PROFILING
+    atomicAdd(profileCounters + GRID_CELLS_VISITED, numCellsVisited);
+    atomicAdd(profileCounters + DISTANCE_TESTS, numDistanceTests);
+    #endif
 }
 
 __global__ void kernSpaceCol(Bud* dev_buds, const glm::vec3 gridMin, const int gridResolution, const float inverseCellWidth, const int numBuds,
     AttractorPoint* dev_attrPts_memCoherent, const int numAttractorPoints, int* dev_mutex, int* gridCellStartIndices,
-    int* gridCellEndIndices) {
+    int* gridCellEndIndices, const int firstPendingAttrPt, const int endPendingAttrPt, const float perceptionCosTheta) {
     int index = threadIdx.x + blockIdx.x * blockDim.x;
     if (index >= numBuds) {
         return;
@@ -149,7 +215,23 @@ __global__ void kernSpaceCol(Bud* dev_buds, const glm::vec3 gridMin, const int g
     
     const glm::vec3 budPosLocalToGrid = currentBud.point - gridMin;
     const glm::vec3 index3D = floor(budPosLocalToGrid * inverseCellWidth);
-    const int lookupRadius = (int)glm::ceil(3.74165738677f * currentBud.internodeLength * inverseCellWidth); // sqrt(14) as used below
+    const int lookupRadius = (int)glm::ceil(PERCEPTION_RADIUS * currentBud.internodeLength * inverseCellWidth); // as used below
+
+    auto accumulateIfClaimed = [&](int g) {
+        const AttractorPoint& currentAttrPt = dev_attrPts_memCoherent[g];
+        if (currentAttrPt.removed) { return; }
+        glm::vec3 budToPtDir = currentAttrPt.point - currentBud.point;
+        const float budToPtDist2 = glm::length2(budToPtDir);
+        budToPtDir = glm::normalize(budToPtDir);
+        const float dotProd = glm::dot(budToPtDir, currentBud.naturalGrowthDir);
+        if (budToPtDist2 < (PERCEPTION_RADIUS_SQUARED * currentBud.internodeLength * currentBud.internodeLength) && dotProd > perceptionCosTheta) {
+            if (currentAttrPt.nearestBudIdx == index) {
+                currentBud.optimalGrowthDir += currentAttrPt.weight * budToPtDir;
+                ++currentBud.numNearbyAttrPts;
+                currentBud.environmentQuality = 1.0f;
+            }
+        }
+    };
 
     // Space Colonization
     if (currentBud.internodeLength > 0.0f && currentBud.fate == DORMANT) {
@@ -164,41 +246,36 @@ __global__ void kernSpaceCol(Bud* dev_buds, const glm::vec3 gridMin, const int g
                         int index1D = gridIndex3Dto1D(currentGridIndex.x, currentGridIndex.y, currentGridIndex.z, gridResolution);
                         for (int g = gridCellStartIndices[index1D]; g <= gridCellEndIndices[index1D]; ++g) {
                             if (g < 0) break;
-                            const AttractorPoint& currentAttrPt = dev_attrPts_memCoherent[g];
-                            if (currentAttrPt.removed) { continue; }
-                            glm::vec3 budToPtDir = currentAttrPt.point - currentBud.point;
-                            const float budToPtDist2 = glm::length2(budToPtDir);
-                            budToPtDir = glm::normalize(budToPtDir);
-                            const float dotProd = glm::dot(budToPtDir, currentBud.naturalGrowthDir);
-                            if (budToPtDist2 < (14.0f * currentBud.internodeLength * currentBud.internodeLength) && dotProd > std::abs(COS_THETA_SMALL)) {
-                                if (currentAttrPt.nearestBudIdx == index) {
-                                    currentBud.optimalGrowthDir += budToPtDir;
-                                    ++currentBud.numNearbyAttrPts;
-                                    currentBud.environmentQuality = 1.0f;
-                                }
-                            }
+                            accumulateIfClaimed(g);
                         }
                     }
                 }
             }
         }
+        for (int g = firstPendingAttrPt; g < endPendingAttrPt; ++g) { // in no cell yet
+            accumulateIfClaimed(g);
+        }
     }
     currentBud.optimalGrowthDir = currentBud.numNearbyAttrPts > 0 ? glm::normalize(currentBud.optimalGrowthDir) : glm::vec3(0.0f);
 }
 
 // Uniform Grid Implementation functions
 
+// Dead points go to the extra cell past the grid, which sorts them behind all others and which no lookup ever visits
 __global__ void kernComputeIndices(const int numAttrPts, const int gridResolution,
     const glm::vec3 gridMin, const float inverseCellWidth,
-    const AttractorPoint* attrPts, int* attrPtIndices, int* gridIndices) {
+    const AttractorPoint* attrPts, const unsigned int* aliveMask, int* attrPtIndices, int* gridIndices) {
     int index = threadIdx.x + blockIdx.x * blockDim.x;
     if (index >= numAttrPts) {
         return;
     }
-    glm::vec3 index3D = floor((attrPts[index].point - gridMin) * inverseCellWidth);
-    int index1D = gridIndex3Dto1D(index3D.x, index3D.y, index3D.z, gridResolution);
-    gridIndices[index] = index1D;
     attrPtIndices[index] = index;
+    if (((aliveMask[index >> 5] >> (index & 31)) & 1u) == 0) {
+        gridIndices[index] = gridResolution * gridResolution * gridResolution;
+        return;
+    }
+    const glm::vec3 index3D = glm::clamp(floor((attrPts[index].point - gridMin) * inverseCellWidth), glm::vec3(0.0f), glm::vec3((float)(gridResolution - 1)));
+    gridIndices[index] = gridIndex3Dto1D(index3D.x, index3D.y, index3D.z, gridResolution);
 }
 
 __global__ void kernMakeDataMemoryCoherent(const int numAttrPts, const int* attrPtIndices,
@@ -237,32 +314,63 @@ __global__ void kernIdentifyCellStartEnd(const int numAttrPts, int* gridCellIndi
     }
 }
 
-__global__ void kernResetAttractorPointRemovalState(AttractorPoint* attractorPoints, AttractorPoint* attractorPoints_memCoherent, const int numAttrPts) {
-    int index = threadIdx.x + blockIdx.x * blockDim.x;
-    if (index >= numAttrPts) {
+// The host's alive mask is the authoritative removal state, so it is applied anew every call instead of keeping the device copy in sync
+__global__ void kernApplyAliveMask(const int firstAttrPt, const int endAttrPt, const int* attrPtIndices, const unsigned int* aliveMask, AttractorPoint* attrPts_memCoherent) {
+    int index = firstAttrPt + threadIdx.x + blockIdx.x * blockDim.x;
+    if (index >= endAttrPt) {
         return;
     }
-    attractorPoints_memCoherent[index].removed = false;
-    attractorPoints[index].removed = false;
+    const int attrPtIdx = attrPtIndices[index];
+    attrPts_memCoherent[index].removed = ((aliveMask[attrPtIdx >> 5] >> (attrPtIdx & 31)) & 1u) == 0;
 }
 
-__global__ void kernResetAttractorPointSpaceColState(AttractorPoint* attractorPoints, AttractorPoint* attractorPoints_memCoherent, const int numAttrPts) {
-    int index = threadIdx.x + blockIdx.x * blockDim.x;
-    if (index >= numAttrPts) {
+__global__ void kernClearRemovedInAliveMask(const int firstAttrPt, const int endAttrPt, const int* attrPtIndices, const AttractorPoint* attrPts_memCoherent, unsigned int* aliveMask) {
+    int index = firstAttrPt + threadIdx.x + blockIdx.x * blockDim.x;
+    if (index >= endAttrPt) {
+        return;
+    }
+    if (attrPts_memCoherent[index].removed) {
+        const int attrPtIdx = attrPtIndices[index];
+        atomicAnd(aliveMask + (attrPtIdx >> 5), ~(1u << (attrPtIdx & 31)));
+    }
+}
+
+// Only the memory coherent points are ever read by the space colonization kernels, the others are just the source for building the grid
+__global__ void kernResetAttractorPointSpaceColState(AttractorPoint* attractorPoints_memCoherent, const int firstAttrPt, const int endAttrPt) {
+    int index = firstAttrPt + threadIdx.x + blockIdx.x * blockDim.x;
+    if (index >= endAttrPt) {
         return;
     }
-    AttractorPoint& currAttrPt = attractorPoints[index];
-    currAttrPt.nearestBudDist2 = 9999999.0f;
-    currAttrPt.nearestBudBranchIdx = -1;
-    currAttrPt.nearestBudIdx = -1;
     AttractorPoint& currAttrPt_memCoherent = attractorPoints_memCoherent[index];
     currAttrPt_memCoherent.nearestBudDist2 = 9999999.0f;
     currAttrPt_memCoherent.nearestBudBranchIdx = -1;
     currAttrPt_memCoherent.nearestBudIdx = -1;
 }
 
-cudaError_t RunSpaceColonizationKernel(Bud* buds, const int numBuds, AttractorPoint* attractorPoints, const int numAttractorPoints,
-                                       const int gridSideCount, const int numTotalGridCells, const glm::vec3& gridMin, const float gridCellWidth, bool& reconstructUniformGrid, bool& resetAttrPtState) {
+// A pending point sits at its host index in the memory coherent points too
+__global__ void kernSetPendingIndices(const int firstAttrPt, const int endAttrPt, int* attrPtIndices) {
+    int index = firstAttrPt + threadIdx.x + blockIdx.x * blockDim.x;
+    if (index >= endAttrPt) {
+        return;
+    }
+    attrPtIndices[index] = index;
+}
+
+// Flags the points that were dead at the last build but are alive again, e.g. after a regrow reset the mask: no cell holds them
+__global__ void kernFindRevivedPoints(const int firstAttrPt, const int endAttrPt, const int* attrPtIndices, const unsigned int* aliveMask, int* revivedFlag) {
+    int index = firstAttrPt + threadIdx.x + blockIdx.x * blockDim.x;
+    if (index >= endAttrPt) {
+        return;
+    }
+    const int attrPtIdx = attrPtIndices[index];
+    if ((aliveMask[attrPtIdx >> 5] >> (attrPtIdx & 31)) & 1u) {
+        *revivedFlag = 1;
+    }
+}
+
+cudaError_t RunSpaceColonizationKernel(Bud* buds, const int numBuds, const AttractorPoint* attractorPoints, const int numAttractorPoints, unsigned int* aliveMask, const int numAliveAttractorPoints,
+                                       const int gridSideCount, const int numTotalGridCells, const glm::vec3& gridMin, const float gridCellWidth, const float perceptionCosTheta,
+                                       const unsigned int pointsRevision, bool& reconstructUniformGrid) {
     cudaError_t cudaStatus;
 
     Bud* dev_buds = 0;
@@ -271,14 +379,25 @@ cudaError_t RunSpaceColonizationKernel(Bud* buds, const int numBuds, AttractorPo
     dim3 fullBlocksPerGrid_Buds((numBuds + blockSize - 1) / blockSize);
     dim3 fullBlocksPerGrid_AttrPts((numAttractorPoints + blockSize - 1) / blockSize);
 
-    const float gridInverseCellWidth = 1.0f / gridCellWidth;
+    const int numAliveMaskWords = (numAttractorPoints + 31) / 32;
 
     // Device
     cudaStatus = cudaSetDevice(0);
     checkCUDAErrorWithLine("cudaSetDevice failed! Do you have a CUDA-capable GPU installed?");
 
-    // Create the uniform grid if it hasn't been created / needs to be recreated
-    if (reconstructUniformGrid | resetAttrPtState) {
+    // Rebuild the uniform grid if it was built from other points, if they outgrew its buffers or its frame, if too many of its points are dead
+    // by now, or if too many wait in the pending bucket
+    const bool sameSource = pointsRevision != 0 && pointsRevision == gridPointsRevision && numAttractorPoints >= gridNumSourcePoints;
+    const bool outgrown = numAttractorPoints > gridNumAllocatedPoints || numTotalGridCells != gridNumAllocatedCells || !dev_attrPts;
+    const glm::vec3 gridMax = gridMin + glm::vec3(gridCellWidth * gridSideCount);
+    const glm::vec3 gridBuiltMax = gridBuiltMin + glm::vec3(gridBuiltCellWidth * gridBuiltSideCount);
+    const bool framed = gridSideCount == gridBuiltSideCount && glm::all(glm::greaterThanEqual(gridMin, gridBuiltMin)) && glm::all(glm::lessThanEqual(gridMax, gridBuiltMax));
+    const int numPendingAttractorPoints = numAttractorPoints - gridNumBuiltPoints;
+    const bool fragmented = (float)numAliveAttractorPoints < (1.0f - UNIFORM_GRID_MAX_DEAD_FRACTION) * (float)(gridNumIndexedPoints + numPendingAttractorPoints);
+    const bool uploadPoints = reconstructUniformGrid || !sameSource || outgrown;
+    reconstructUniformGrid = reconstructUniformGrid || !sameSource || outgrown || !framed || fragmented || numPendingAttractorPoints > UNIFORM_GRID_MAX_PENDING_POINTS;
+
+    if (outgrown) {
         // Free old grid info
         cudaFree(dev_attrPts);
         cudaFree(dev_attrPts_memCoherent);
@@ -287,40 +406,58 @@ cudaError_t RunSpaceColonizationKernel(Bud* buds, const int numBuds, AttractorPo
         cudaFree(dev_gridCellStartIndices);
         cudaFree(dev_gridCellEndIndices);
         cudaFree(dev_mutex);
+        cudaFree(dev_aliveMask);
+
+        const int numAllocatedPoints = numAttractorPoints + (int)(UNIFORM_GRID_POINT_SLACK * numAttractorPoints);
+        const int numAllocatedMaskWords = (numAllocatedPoints + 31) / 32;
 
-        cudaStatus = cudaMalloc((void**)&dev_attrPts, numAttractorPoints * sizeof(AttractorPoint));
+        cudaStatus = cudaMalloc((void**)&dev_attrPts, numAllocatedPoints * sizeof(AttractorPoint));
         checkCUDAErrorWithLine("cudaMalloc dev_attrPts failed!");
 
-        cudaStatus = cudaMalloc((void**)&dev_attrPts_memCoherent, numAttractorPoints * sizeof(AttractorPoint));
+        cudaStatus = cudaMalloc((void**)&dev_attrPts_memCoherent, numAllocatedPoints * sizeof(AttractorPoint));
         checkCUDAErrorWithLine("cudaMalloc dev_attrPts_memCoherent failed!");
 
-        cudaStatus = cudaMalloc((void**)&dev_attrPtIndices, numAttractorPoints * sizeof(int));
+        cudaStatus = cudaMalloc((void**)&dev_attrPtIndices, numAllocatedPoints * sizeof(int));
         checkCUDAErrorWithLine("cudaMalloc dev_attrPtIndices failed!");
 
-        cudaStatus = cudaMalloc((void**)&dev_gridCellIndices, numAttractorPoints * sizeof(int));
+        cudaStatus = cudaMalloc((void**)&dev_gridCellIndices, numAllocatedPoints * sizeof(int));
         checkCUDAErrorWithLine("cudaMalloc dev_gridCellIndices failed!");
 
-        cudaStatus = cudaMalloc((void**)&dev_gridCellStartIndices, numTotalGridCells * sizeof(int));
+        // One more cell than the grid has, for the dead points (see kernComputeIndices)
+        cudaStatus = cudaMalloc((void**)&dev_gridCellStartIndices, (numTotalGridCells + 1) * sizeof(int));
         checkCUDAErrorWithLine("cudaMalloc dev_gridCellStartIndices failed!");
 
-        cudaStatus = cudaMalloc((void**)&dev_gridCellEndIndices, numTotalGridCells * sizeof(int));
+        cudaStatus = cudaMalloc((void**)&dev_gridCellEndIndices, (numTotalGridCells + 1) * sizeof(int));
         checkCUDAErrorWithLine("cudaMalloc dev_gridCellEndIndices failed!");
 
-        cudaStatus = cudaMalloc((void**)&dev_mutex, numAttractorPoints * sizeof(int));
+        cudaStatus = cudaMalloc((void**)&dev_mutex, numAllocatedPoints * sizeof(int));
         checkCUDAErrorWithLine("cudaMalloc dev_mutex failed!");
 
-        cudaMemset(dev_gridCellIndices, -1, numAttractorPoints * sizeof(int));
-        checkCUDAErrorWithLine("Cuda memset failed");
-        cudaMemset(dev_gridCellStartIndices, -1, numTotalGridCells * sizeof(int));
-        checkCUDAErrorWithLine("Cuda memset failed");
-        cudaMemset(dev_gridCellEndIndices, -1, numTotalGridCells * sizeof(int));
-        checkCUDAErrorWithLine("Cuda memset failed");
-        cudaMemset(dev_mutex, 0, numAttractorPoints * sizeof(int));
+        cudaStatus = cudaMalloc((void**)&dev_aliveMask, numAllocatedMaskWords * sizeof(unsigned int));
+        checkCUDAErrorWithLine("cudaMalloc dev_aliveMask failed!");
+
+        cudaMemset(dev_mutex, 0, numAllocatedPoints * sizeof(int));
         checkCUDAErrorWithLine("Cuda memset failed");
+        gridNumAllocatedPoints = numAllocatedPoints;
+        gridNumAllocatedCells = numTotalGridCells;
+    }
 
+    if (uploadPoints) {
         cudaStatus = cudaMemcpy(dev_attrPts, attractorPoints, numAttractorPoints * sizeof(AttractorPoint), cudaMemcpyHostToDevice);
         checkCUDAErrorWithLine("cudaMemcpy dev_attrPts failed!");
+    } else if (numAttractorPoints > gridNumSourcePoints) {
+        // Just the points appended since. They go to the pending bucket, unless the rebuild below takes them into the cells right away.
+        const int numAppendedAttrPts = numAttractorPoints - gridNumSourcePoints;
+        cudaStatus = cudaMemcpy(dev_attrPts + gridNumSourcePoints, attractorPoints + gridNumSourcePoints, numAppendedAttrPts * sizeof(AttractorPoint), cudaMemcpyHostToDevice);
+        checkCUDAErrorWithLine("cudaMemcpy appended dev_attrPts failed!");
+        if (!reconstructUniformGrid) {
+            cudaStatus = cudaMemcpy(dev_attrPts_memCoherent + gridNumSourcePoints, dev_attrPts + gridNumSourcePoints, numAppendedAttrPts * sizeof(AttractorPoint), cudaMemcpyDeviceToDevice);
+            checkCUDAErrorWithLine("cudaMemcpy pending dev_attrPts_memCoherent failed!");
+            kernSetPendingIndices << <(numAppendedAttrPts + blockSize - 1) / blockSize, blockSize >> > (gridNumSourcePoints, numAttractorPoints, dev_attrPtIndices);
+            checkCUDAErrorWithLine("After kernSetPendingIndices");
+        }
     }
+    gridNumSourcePoints = numAttractorPoints;
 
     // Cuda Malloc
     cudaStatus = cudaMalloc((void**)&dev_buds, numBuds * sizeof(Bud));
@@ -330,14 +467,41 @@ cudaError_t RunSpaceColonizationKernel(Bud* buds, const int numBuds, AttractorPo
     cudaStatus = cudaMemcpy(dev_buds, buds, numBuds * sizeof(Bud), cudaMemcpyHostToDevice);
     checkCUDAErrorWithLine("cudaMemcpy dev_buds failed!");
 
-    kernResetAttractorPointSpaceColState << < fullBlocksPerGrid_AttrPts, blockSize >> > (dev_attrPts, dev_attrPts_memCoherent, numAttractorPoints);
+    cudaStatus = cudaMemcpy(dev_aliveMask, aliveMask, numAliveMaskWords * sizeof(unsigned int), cudaMemcpyHostToDevice);
+    checkCUDAErrorWithLine("cudaMemcpy dev_aliveMask failed!");
 
-    if (resetAttrPtState) {
-        kernResetAttractorPointRemovalState << < fullBlocksPerGrid_AttrPts, blockSize >> > (dev_attrPts, dev_attrPts_memCoherent, numAttractorPoints);
+    // The same points may come back with a mask that was reset, or that belongs to another tree: then some of the points the last build left out
+    // are alive, and only a rebuild puts them in a cell
+    if (!reconstructUniformGrid && gridNumIndexedPoints < gridNumBuiltPoints) {
+        if (!dev_revivedFlag) {
+            cudaStatus = cudaMalloc((void**)&dev_revivedFlag, sizeof(int));
+            checkCUDAErrorWithLine("cudaMalloc dev_revivedFlag failed!");
+        }
+        cudaMemset(dev_revivedFlag, 0, sizeof(int));
+        const int numDeadAttrPts = gridNumBuiltPoints - gridNumIndexedPoints;
+        kernFindRevivedPoints << <(numDeadAttrPts + blockSize - 1) / blockSize, blockSize >> > (gridNumIndexedPoints, gridNumBuiltPoints, dev_attrPtIndices, dev_aliveMask, dev_revivedFlag);
+        checkCUDAErrorWithLine("After kernFindRevivedPoints");
+        int revived = 0;
+        cudaStatus = cudaMemcpy(&revived, dev_revivedFlag, sizeof(int), cudaMemcpyDeviceToHost);
+        checkCUDAErrorWithLine("cudaMemcpy revivedFlag failed!");
+        reconstructUniformGrid = revived != 0;
     }
 
-    if (reconstructUniformGrid | resetAttrPtState) {
-        kernComputeIndices << <fullBlocksPerGrid_AttrPts, blockSize >> > (numAttractorPoints, gridSideCount, gridMin, gridInverseCellWidth, dev_attrPts, dev_attrPtIndices, dev_gridCellIndices);
+    if (reconstructUniformGrid) {
+        PROFILE_SCOPE("Rebuild Uniform Grid");
+        // Padded, so that the bounds can grow a little with appended points before the frame has to change
+        const float framePadding = UNIFORM_GRID_FRAME_PADDING * gridCellWidth * gridSideCount;
+        gridBuiltMin = gridMin - glm::vec3(framePadding);
+        gridBuiltCellWidth = gridCellWidth + 2.0f * framePadding / gridSideCount;
+        gridBuiltSideCount = gridSideCount;
+
+        cudaMemset(dev_gridCellStartIndices, -1, (numTotalGridCells + 1) * sizeof(int));
+        checkCUDAErrorWithLine("Cuda memset failed");
+        cudaMemset(dev_gridCellEndIndices, -1, (numTotalGridCells + 1) * sizeof(int));
+        checkCUDAErrorWithLine("Cuda memset failed");
+
+        kernComputeIndices << <fullBlocksPerGrid_AttrPts, blockSize >> > (numAttractorPoints, gridBuiltSideCount, gridBuiltMin, 1.0f / gridBuiltCellWidth, dev_attrPts, dev_aliveMask,
+                                                                          dev_attrPtIndices, dev_gridCellIndices);
 
         checkCUDAErrorWithLine("After kernComputeIndices");
 
@@ -356,20 +520,58 @@ cudaError_t RunSpaceColonizationKernel(Bud* buds, const int numBuds, AttractorPo
         kernMakeDataMemoryCoherent << <fullBlocksPerGrid_AttrPts, blockSize >> > (numAttractorPoints, dev_attrPtIndices, dev_attrPts, dev_attrPts_memCoherent);
 
         checkCUDAErrorWithLine("After make data coherent");
+
+        gridPointsRevision = pointsRevision;
+        gridNumBuiltPoints = numAttractorPoints;
+        gridNumIndexedPoints = numAliveAttractorPoints;
+    }
+    PROFILE_COUNTER("Uniform Grid Points", gridNumIndexedPoints);
+    PROFILE_COUNTER("Uniform Grid Pending Points", gridNumSourcePoints - gridNumBuiltPoints);
+
+    const float gridInverseCellWidth = 1.0f / gridBuiltCellWidth;
+    const int firstPendingAttrPt = gridNumBuiltPoints;
+    const int endPendingAttrPt = gridNumSourcePoints;
+
+    // Every point between the indexed ones and the pending bucket was dead at the last build, so the per point passes skip them
+    const int liveAttrPtRanges[2][2] = { { 0, gridNumIndexedPoints }, { firstPendingAttrPt, endPendingAttrPt } };
+    for (int r = 0; r < 2; ++r) {
+        if (liveAttrPtRanges[r][1] <= liveAttrPtRanges[r][0]) { continue; }
+        dim3 fullBlocksPerGrid_LiveAttrPts((liveAttrPtRanges[r][1] - liveAttrPtRanges[r][0] + blockSize - 1) / blockSize);
+        kernResetAttractorPointSpaceColState << < fullBlocksPerGrid_LiveAttrPts, blockSize >> > (dev_attrPts_memCoherent, liveAttrPtRanges[r][0], liveAttrPtRanges[r][1]);
+        kernApplyAliveMask << <fullBlocksPerGrid_LiveAttrPts, blockSize >> > (liveAttrPtRanges[r][0], liveAttrPtRanges[r][1], dev_attrPtIndices, dev_aliveMask, dev_attrPts_memCoherent);
     }
 
+    checkCUDAErrorWithLine("After apply alive mask");
+
     // this got merged into the first space col kernel farter down in this function
     // no it didn't
-    kernMarkAttractorPointsAsRemoved << < fullBlocksPerGrid_Buds, blockSize >> > (dev_buds, gridMin, gridSideCount, gridInverseCellWidth, numBuds, dev_attrPts_memCoherent,
-                                                                                  numAttractorPoints, dev_mutex, dev_gridCellStartIndices, dev_gridCellEndIndices);
+    #ifdef ENABLE_PROFILING
+    if (!dev_profileCounters) {
+        cudaStatus = cudaMalloc((void**)&dev_profileCounters, NUM_PROFILE_COUNTERS * sizeof(unsigned long long));
+        checkCUDAErrorWithLine("cudaMalloc dev_profileCounters failed!");
+    }
+    cudaMemset(dev_profileCounters, 0, NUM_PROFILE_COUNTERS * sizeof(unsigned long long));
+    #endif
+
+    kernMarkAttractorPointsAsRemoved << < fullBlocksPerGrid_Buds, blockSize >> > (dev_buds, gridBuiltMin, gridBuiltSideCount, gridInverseCellWidth, numBuds, dev_attrPts_memCoherent,
+                                                                                  numAttractorPoints, dev_mutex, dev_gridCellStartIndices, dev_gridCellEndIndices,
+                                                                                  firstPendingAttrPt, endPendingAttrPt, dev_profileCounters);
+
+    for (int r = 0; r < 2; ++r) {
+        if (liveAttrPtRanges[r][1] <= liveAttrPtRanges[r][0]) { continue; }
+        dim3 fullBlocksPerGrid_LiveAttrPts((liveAttrPtRanges[r][1] - liveAttrPtRanges[r][0] + blockSize - 1) / blockSize);
+        kernClearRemovedInAliveMask << <fullBlocksPerGrid_LiveAttrPts, blockSize >> > (liveAttrPtRanges[r][0], liveAttrPtRanges[r][1], dev_attrPtIndices, dev_attrPts_memCoherent, dev_aliveMask);
+    }
 
-    kernSetNearestBudForAttractorPoints << < fullBlocksPerGrid_Buds, blockSize >> > (dev_buds, gridMin, gridSideCount, gridInverseCellWidth, numBuds, dev_attrPts_memCoherent,
-                                                                                     numAttractorPoints, dev_mutex, dev_gridCellStartIndices, dev_gridCellEndIndices);
+    kernSetNearestBudForAttractorPoints << < fullBlocksPerGrid_Buds, blockSize >> > (dev_buds, gridBuiltMin, gridBuiltSideCount, gridInverseCellWidth, numBuds, dev_attrPts_memCoherent,
+                                                                                     numAttractorPoints, dev_mutex, dev_gridCellStartIndices, dev_gridCellEndIndices,
+                                                                                     firstPendingAttrPt, endPendingAttrPt, perceptionCosTheta, dev_profileCounters);
 
     checkCUDAErrorWithLine("After space col pass 1");
 
-    kernSpaceCol << < fullBlocksPerGrid_Buds, blockSize >> > (dev_buds, gridMin, gridSideCount, gridInverseCellWidth, numBuds, dev_attrPts_memCoherent,
-                                                              numAttractorPoints, dev_mutex, dev_gridCellStartIndices, dev_gridCellEndIndices);
+    kernSpaceCol << < fullBlocksPerGrid_Buds, blockSize >> > (dev_buds, gridBuiltMin, gridBuiltSideCount, gridInverseCellWidth, numBuds, dev_attrPts_memCoherent,
+                                                              numAttractorPoints, dev_mutex, dev_gridCellStartIndices, dev_gridCellEndIndices,
+                                                              firstPendingAttrPt, endPendingAttrPt, perceptionCosTheta);
 
     checkCUDAErrorWithLine("After space col pass 2");
 
@@ -377,10 +579,19 @@ cudaError_t RunSpaceColonizationKernel(Bud* buds, const int numBuds, AttractorPo
     cudaStatus = cudaMemcpy(buds, dev_buds, numBuds * sizeof(Bud), cudaMemcpyDeviceToHost);
     checkCUDAErrorWithLine("cudaMemcpy to buds failed!");
 
+    cudaStatus = cudaMemcpy(aliveMask, dev_aliveMask, numAliveMaskWords * sizeof(unsigned int), cudaMemcpyDeviceToHost);
+    checkCUDAErrorWithLine("cudaMemcpy to aliveMask failed!");
+
+    #ifdef ENABLE_PROFILING
+    unsigned long long profileCounters[NUM_PROFILE_COUNTERS];
+    cudaMemcpy(profileCounters, dev_profileCounters, NUM_PROFILE_COUNTERS * sizeof(unsigned long long), cudaMemcpyDeviceToHost);
+    PROFILE_COUNTER("Grid Cells Visited", profileCounters[GRID_CELLS_VISITED]);
+    PROFILE_COUNTER("Distance Tests", profileCounters[DISTANCE_TESTS]);
+    PROFILE_COUNTER("Points Killed", profileCounters[POINTS_KILLED]);
+    #endif
+
     cudaFree(dev_buds);
-    //printf("reconstruct grid: %d, resetAttrPtState: %d", reconstructUniformGrid, resetAttrPtState);
     reconstructUniformGrid = false;
-    resetAttrPtState = false;
     return cudaStatus;
 }
 
@@ -391,11 +602,32 @@ void TreeApp::FreeUniformGrid() {
     cudaFree(dev_gridCellIndices);
     cudaFree(dev_gridCellStartIndices);
     cudaFree(dev_gridCellEndIndices);
+    cudaFree(dev_mutex);
+    cudaFree(dev_aliveMask);
+    cudaFree(dev_profileCounters);
+    cudaFree(dev_revivedFlag);
+    dev_attrPts = 0;
+    dev_attrPts_memCoherent = 0;
+    dev_attrPtIndices = 0;
+    dev_gridCellIndices = 0;
+    dev_gridCellStartIndices = 0;
+    dev_gridCellEndIndices = 0;
+    dev_mutex = 0;
+    dev_aliveMask = 0;
+    dev_profileCounters = 0;
+    dev_revivedFlag = 0;
+    gridPointsRevision = 0;
+    gridNumAllocatedPoints = 0;
+    gridNumAllocatedCells = 0;
+    gridNumSourcePoints = 0;
+    gridNumBuiltPoints = 0;
+    gridNumIndexedPoints = 0;
 }
 
-void TreeApp::PerformSpaceColonizationParallel(Bud* buds, const int numBuds, AttractorPoint* attractorPoints, const int numAttractorPoints,
-                                               const int gridSideCount, const int numTotalGridCells, const glm::vec3& gridMin, const float gridCellWidth, bool& reconstructUniformGrid,
-                                               bool& resetAttrPtState) {
-    cudaError_t cudaStatus = RunSpaceColonizationKernel(buds, numBuds, attractorPoints, numAttractorPoints, gridSideCount, numTotalGridCells, gridMin, gridCellWidth, reconstructUniformGrid, resetAttrPtState);
+void TreeApp::PerformSpaceColonizationParallel(Bud* buds, const int numBuds, const AttractorPoint* attractorPoints, const int numAttractorPoints, unsigned int* aliveMask, const int numAliveAttractorPoints,
+                                               const int gridSideCount, const int numTotalGridCells, const glm::vec3& gridMin, const float gridCellWidth, const float perceptionCosTheta,
+                                               const unsigned int pointsRevision, bool& reconstructUniformGrid) {
+    cudaError_t cudaStatus = RunSpaceColonizationKernel(buds, numBuds, attractorPoints, numAttractorPoints, aliveMask, numAliveAttractorPoints, gridSideCount, numTotalGridCells, gridMin, gridCellWidth,
+                                                        perceptionCosTheta, pointsRevision, reconstructUniformGrid);
     checkCUDAErrorWithLine("Space colonization failed!\n");
 }
@@ -13,7 +13,16 @@ struct Bud;
 struct AttractorPoint;
 
 namespace TreeApp {
-    void PerformSpaceColonizationParallel(Bud* buds, const int numBuds, AttractorPoint* attractorPoints, const int numAttractorPoints,
-                                          const int gridSideCount, const int numTotalGridCells, const glm::vec3& gridMin, const float gridCellWidth, bool& reconstructUniformGrid, bool& resetAttrPtState);
+    // aliveMask holds one bit per attractor point (see AttractorPointMask). Only alive points take part, and the bits of the points that get
+    // removed are cleared before returning. A bud perceives the points within its perception radius whose direction has a cosine above
+    // perceptionCosTheta with the bud's growth direction.
+    // The uniform grid over the points stays on the device from one call to the next, keyed on pointsRevision (see
+    // TreeParameters::attractorPointsRevision); dead points stay in it as tombstones. Points appended under the same revision wait in a pending
+    // bucket until the next rebuild. It is rebuilt when reconstructUniformGrid is set (which this then clears), for another revision, when the
+    // points outgrow its buffers or its padded frame, when points it left out are alive again, once more than UNIFORM_GRID_MAX_DEAD_FRACTION of
+    // its points are dead, and once more than UNIFORM_GRID_MAX_PENDING_POINTS are pending. A rebuild leaves the dead points out.
+    void PerformSpaceColonizationParallel(Bud* buds, const int numBuds, const AttractorPoint* attractorPoints, const int numAttractorPoints, unsigned int* aliveMask, const int numAliveAttractorPoints,
+                                          const int gridSideCount, const int numTotalGridCells, const glm::vec3& gridMin, const float gridCellWidth, const float perceptionCosTheta,
+                                          const unsigned int pointsRevision, bool& reconstructUniformGrid);
     void FreeUniformGrid();
 }
@@ -4,6 +4,9 @@ void Drawable::destroy() {
     glDeleteBuffers(1, &bufIdx);
     glDeleteBuffers(1, &bufPos);
     glDeleteBuffers(1, &bufNor);
+    idxBound = false;
+    posBound = false;
+    norBound = false;
 }
 
 bool Drawable::bindBufIdx() {
@@ -27,17 +30,25 @@ bool Drawable::bindBufNor() {
     return norBound;
 }
 
+// Buffers are only generated once, so calling create() again re-uploads into the same buffers instead of leaking the old ones
+
 void Drawable::genBufIdx() {
+    if (!idxBound) {
+        glGenBuffers(1, &bufIdx);
+    }
     idxBound = true;
-    glGenBuffers(1, &bufIdx);
 }
 
 void Drawable::genBufPos() {
+    if (!posBound) {
+        glGenBuffers(1, &bufPos);
+    }
     posBound = true;
-    glGenBuffers(1, &bufPos);
 }
 
 void Drawable::genBufNor() {
+    if (!norBound) {
+        glGenBuffers(1, &bufNor);
+    }
     norBound = true;
-    glGenBuffers(1, &bufNor);
 }
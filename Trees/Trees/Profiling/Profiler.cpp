@@ -0,0 +1,122 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+// Every buffer ever handed out. Buffers are never freed, only recycled once their thread exits, so readers can always walk this list.
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<Profiler::ThreadBuffer>> threadBuffers;
+static std::vector<Profiler::ThreadBuffer*> freeThreadBuffers;
+
+// Returns the buffer to the free list when its thread exits
+struct ThreadBufferHandle {
+    Profiler::ThreadBuffer* buffer;
+    ThreadBufferHandle() : buffer(nullptr) {}
+    ~ThreadBufferHandle() {
+        if (buffer) {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            freeThreadBuffers.emplace_back(buffer);
+        }
+    }
+};
+
+Profiler::ThreadBuffer& Profiler::GetThreadBuffer() {
+    thread_local ThreadBufferHandle handle;
+    if (!handle.buffer) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        if (freeThreadBuffers.size() > 0) {
+            handle.buffer = freeThreadBuffers.back();
+            freeThreadBuffers.pop_back();
+            handle.buffer->currentDepth = 0;
+        } else {
+            threadBuffers.emplace_back(new ThreadBuffer((unsigned int)threadBuffers.size()));
+            handle.buffer = threadBuffers.back().get();
+        }
+    }
+    return *handle.buffer;
+}
+
+void Profiler::RecordCounter(const char* name, double value) {
+    ThreadBuffer& buffer = GetThreadBuffer();
+    const unsigned long long slot = buffer.numCountersWritten.load(std::memory_order_relaxed);
+    CounterEvent& e = buffer.counters[slot % PROFILER_COUNTER_BUFFER_SIZE];
+    e.name = name;
+    e.timeNs = Now();
+    e.value = value;
+    e.threadId = buffer.threadId;
+    buffer.numCountersWritten.store(slot + 1, std::memory_order_release);
+}
+
+// Copy the valid tail of one ring. Entries the writer may have lapped while we were copying are dropped afterwards, and so is the one it may
+// be writing right now: slot numWritten is filled before the count is published, and it is the same slot as entry numWritten - capacity.
+template <typename T>
+static void CopyRing(const T* ring, const unsigned long long capacity, const std::atomic<unsigned long long>& numWritten, std::vector<T>& out) {
+    const unsigned long long countBefore = numWritten.load(std::memory_order_acquire);
+    const unsigned long long first = (countBefore > capacity) ? countBefore - capacity : 0;
+    const size_t outStart = out.size();
+    for (unsigned long long i = first; i < countBefore; ++i) {
+        out.emplace_back(ring[i % capacity]);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire); // the copies above are done before the count is read again
+    const unsigned long long countAfter = numWritten.load(std::memory_order_relaxed);
+    const unsigned long long firstSafe = (countAfter + 1 > capacity) ? countAfter + 1 - capacity : 0;
+    if (firstSafe > first) {
+        const size_t numOverwritten = (size_t)std::min(firstSafe - first, countBefore - first);
+        out.erase(out.begin() + outStart, out.begin() + outStart + numOverwritten);
+    }
+}
+
+void Profiler::CollectEvents(std::vector<ZoneEvent>& zones, std::vector<CounterEvent>& counters) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (unsigned int t = 0; t < (unsigned int)threadBuffers.size(); ++t) {
+        const ThreadBuffer& buffer = *threadBuffers[t];
+        CopyRing(buffer.zones, PROFILER_ZONE_BUFFER_SIZE, buffer.numZonesWritten, zones);
+        CopyRing(buffer.counters, PROFILER_COUNTER_BUFFER_SIZE, buffer.numCountersWritten, counters);
+    }
+}
+
+void Profiler::Clear() {
+    // Only resets the counts; a thread writing concurrently may leave one stale event behind, which is harmless
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (unsigned int t = 0; t < (unsigned int)threadBuffers.size(); ++t) {
+        threadBuffers[t]->numZonesWritten.store(0, std::memory_order_release);
+        threadBuffers[t]->numCountersWritten.store(0, std::memory_order_release);
+    }
+}
+
+bool Profiler::ExportChromeTrace(const char* filepath) {
+    std::vector<ZoneEvent> zones = std::vector<ZoneEvent>();
+    std::vector<CounterEvent> counters = std::vector<CounterEvent>();
+    CollectEvents(zones, counters);
+
+    std::ofstream outputFile;
+    outputFile.open(filepath);
+    if (!outputFile.is_open()) {
+        return false;
+    }
+
+    // Chrome trace timestamps are in microseconds
+    outputFile.setf(std::ios::fixed);
+    outputFile.precision(3);
+    outputFile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (unsigned int i = 0; i < (unsigned int)zones.size(); ++i) {
+        const ZoneEvent& e = zones[i];
+        outputFile << (first ? "" : ",\n");
+        outputFile << "{\"name\":\"" << e.name << "\",\"cat\":\"trees\",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.threadId;
+        outputFile << ",\"ts\":" << (double)e.startNs * 0.001 << ",\"dur\":" << (double)(e.endNs - e.startNs) * 0.001 << "}";
+        first = false;
+    }
+    for (unsigned int i = 0; i < (unsigned int)counters.size(); ++i) {
+        const CounterEvent& e = counters[i];
+        outputFile << (first ? "" : ",\n");
+        outputFile << "{\"name\":\"" << e.name << "\",\"cat\":\"trees\",\"ph\":\"C\",\"pid\":0,\"tid\":" << e.threadId;
+        outputFile << ",\"ts\":" << (double)e.timeNs * 0.001 << ",\"args\":{\"value\":" << e.value << "}}";
+        first = false;
+    }
+    outputFile << "\n]}\n";
+    outputFile.close();
+    return true;
+}
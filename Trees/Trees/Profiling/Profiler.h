@@ -0,0 +1,103 @@
+#pragma once
+
+#include "../Scene/Globals.h"
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+// Lightweight hierarchical profiler. Zones are recorded with steady_clock into a fixed-size ring buffer owned by the recording thread,
+// so recording never locks or allocates. Readers (the UI panel and the trace exporter) copy events out of every thread's buffer.
+// Everything below the macros compiles out to nothing when ENABLE_PROFILING is not defined in Globals.h.
+
+#define PROFILER_ZONE_BUFFER_SIZE 16384
+#define PROFILER_COUNTER_BUFFER_SIZE 16384
+
+namespace Profiler {
+    // A completed timed zone. Times are nanoseconds since the profiler's epoch.
+    struct ZoneEvent {
+        const char* name;
+        long long startNs;
+        long long endNs;
+        unsigned int depth; // nesting level within the recording thread
+        unsigned int threadId;
+    };
+
+    // A sampled value of an algorithmic counter (points alive, buds tested, ...)
+    struct CounterEvent {
+        const char* name;
+        long long timeNs;
+        double value;
+        unsigned int threadId;
+    };
+
+    // Per-thread storage. Only the owning thread writes; the write counts are published with release semantics so readers can tell
+    // which entries are complete and which might have been overwritten while they were copying.
+    struct ThreadBuffer {
+        ZoneEvent zones[PROFILER_ZONE_BUFFER_SIZE];
+        CounterEvent counters[PROFILER_COUNTER_BUFFER_SIZE];
+        std::atomic<unsigned long long> numZonesWritten;
+        std::atomic<unsigned long long> numCountersWritten;
+        unsigned int currentDepth;
+        unsigned int threadId;
+        ThreadBuffer(unsigned int id) : numZonesWritten(0), numCountersWritten(0), currentDepth(0), threadId(id) {}
+    };
+
+    inline long long Now() {
+        static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    ThreadBuffer& GetThreadBuffer(); // Hands the calling thread a buffer on first use. Buffers of exited threads are recycled.
+
+    void RecordCounter(const char* name, double value);
+
+    // Copies out every event still present in the ring buffers, oldest first per thread
+    void CollectEvents(std::vector<ZoneEvent>& zones, std::vector<CounterEvent>& counters);
+    // Drops all recorded events
+    void Clear();
+    // Writes all recorded events as a Chrome / Perfetto JSON trace (load in chrome://tracing or ui.perfetto.dev)
+    bool ExportChromeTrace(const char* filepath);
+
+    class ScopedZone {
+    private:
+        const char* name;
+        long long startNs;
+        ThreadBuffer& buffer;
+    public:
+        ScopedZone(const char* n) : name(n), buffer(GetThreadBuffer()) {
+            ++buffer.currentDepth;
+            startNs = Now();
+        }
+        ~ScopedZone() {
+            const long long endNs = Now();
+            --buffer.currentDepth;
+            const unsigned long long slot = buffer.numZonesWritten.load(std::memory_order_relaxed);
+            ZoneEvent& e = buffer.zones[slot % PROFILER_ZONE_BUFFER_SIZE];
+            e.name = name;
+            e.startNs = startNs;
+            e.endNs = endNs;
+            e.depth = buffer.currentDepth;
+            e.threadId = buffer.threadId;
+            buffer.numZonesWritten.store(slot + 1, std::memory_order_release);
+        }
+    };
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef ENABLE_PROFILING
+// Times the enclosing scope
+#define PROFILE_SCOPE(name) Profiler::ScopedZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+// Records one sample of a counter
+#define PROFILE_COUNTER(name, value) Profiler::RecordCounter(name, (double)(value))
+// Local tallies for counters gathered inside hot loops, so the loop itself never calls into the profiler
+#define PROFILE_LOCAL_COUNTER(var) unsigned long long var = 0
+#define PROFILE_INCREMENT(var, amount) var += (amount)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNTER(name, value)
+#define PROFILE_LOCAL_COUNTER(var)
+#define PROFILE_INCREMENT(var, amount)
+#endif
@@ -0,0 +1,318 @@
+#include "CapsuleBVH.h"
+#include "../Threading/Parallel.h"
+#include "../Profiling/Profiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <thread>
+
+void RayPacket::SetRay(unsigned int i, const glm::vec3& origin, const glm::vec3& direction, float tMax) {
+    originX[i] = origin.x;
+    originY[i] = origin.y;
+    originZ[i] = origin.z;
+    directionX[i] = direction.x;
+    directionY[i] = direction.y;
+    directionZ[i] = direction.z;
+    // An axis-parallel ray gets a huge inverse instead of an infinite one, which would turn the slab test's 0 * inf into NaN
+    inverseDirectionX[i] = 1.0f / ((direction.x != 0.0f) ? direction.x : 1e-20f);
+    inverseDirectionY[i] = 1.0f / ((direction.y != 0.0f) ? direction.y : 1e-20f);
+    inverseDirectionZ[i] = 1.0f / ((direction.z != 0.0f) ? direction.z : 1e-20f);
+    tHit[i] = tMax;
+    hitCapsule[i] = -1;
+}
+
+/// Building
+
+static float SurfaceArea(const glm::vec3& minPt, const glm::vec3& maxPt) {
+    const glm::vec3 d = glm::max(maxPt - minPt, glm::vec3(0.0f));
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+// Bins the items by their centers along the axis and partitions them at the bin boundary with the least surface area heuristic cost: the
+// chance a ray hitting the parent hits a child, its area over the parent's, times the capsules it would then test. Returns the index of
+// the first item on the far side.
+int CapsuleBVH::SplitBySurfaceArea(std::vector<BuildItem>& items, int firstItem, int lastItem, int axis, float minCenter, float extent) {
+    glm::vec3 binMin[CAPSULE_BVH_NUM_BINS];
+    glm::vec3 binMax[CAPSULE_BVH_NUM_BINS];
+    int binCount[CAPSULE_BVH_NUM_BINS];
+    for (int b = 0; b < CAPSULE_BVH_NUM_BINS; ++b) {
+        binMin[b] = glm::vec3(999999.0f);
+        binMax[b] = glm::vec3(-999999.0f);
+        binCount[b] = 0;
+    }
+    const float binsPerUnit = CAPSULE_BVH_NUM_BINS / extent;
+    auto binOf = [&](const BuildItem& item) { return std::min(CAPSULE_BVH_NUM_BINS - 1, (int)((item.center[axis] - minCenter) * binsPerUnit)); };
+    for (int i = firstItem; i < lastItem; ++i) {
+        const int b = binOf(items[i]);
+        binMin[b] = glm::min(binMin[b], items[i].minPt);
+        binMax[b] = glm::max(binMax[b], items[i].maxPt);
+        ++binCount[b];
+    }
+    // The cost of every split from the right, then the best one sweeping from the left
+    float rightCost[CAPSULE_BVH_NUM_BINS];
+    glm::vec3 sweepMin = glm::vec3(999999.0f);
+    glm::vec3 sweepMax = glm::vec3(-999999.0f);
+    int sweepCount = 0;
+    for (int b = CAPSULE_BVH_NUM_BINS - 1; b > 0; --b) {
+        sweepMin = glm::min(sweepMin, binMin[b]);
+        sweepMax = glm::max(sweepMax, binMax[b]);
+        sweepCount += binCount[b];
+        rightCost[b] = (sweepCount > 0) ? SurfaceArea(sweepMin, sweepMax) * sweepCount : 0.0f;
+    }
+    sweepMin = glm::vec3(999999.0f);
+    sweepMax = glm::vec3(-999999.0f);
+    sweepCount = 0;
+    int bestSplit = -1;
+    float bestCost = 0.0f;
+    for (int b = 1; b < CAPSULE_BVH_NUM_BINS; ++b) {
+        sweepMin = glm::min(sweepMin, binMin[b - 1]);
+        sweepMax = glm::max(sweepMax, binMax[b - 1]);
+        sweepCount += binCount[b - 1];
+        if (sweepCount == 0 || sweepCount == lastItem - firstItem) { continue; }
+        const float cost = SurfaceArea(sweepMin, sweepMax) * sweepCount + rightCost[b];
+        if (bestSplit < 0 || cost < bestCost) {
+            bestSplit = b;
+            bestCost = cost;
+        }
+    }
+    if (bestSplit < 0) { return firstItem; }
+    return (int)(std::partition(items.begin() + firstItem, items.begin() + lastItem, [&](const BuildItem& item) { return binOf(item) < bestSplit; }) - items.begin());
+}
+
+// Levels a subtree over n items needs at most when every node splits its items in half
+static int GetMedianSplitDepth(int n) {
+    int depth = 0;
+    while ((CAPSULE_BVH_MAX_LEAF_SIZE << depth) < n) {
+        ++depth;
+    }
+    return depth;
+}
+
+// The surface area heuristic can peel a few capsules off at a time (e.g. along a long, thin branch), so it could build a tree deeper than a
+// traversal's stack. A node that would leave too few levels for its items to fit even when halved at every level is split at the median
+// instead, and so are all nodes below it: then no leaf gets deeper than CAPSULE_BVH_MAX_STACK_DEPTH - 1.
+int CapsuleBVH::BuildRecursive(std::vector<BuildItem>& items, int firstItem, int lastItem, int depth, std::vector<Node>& out, std::vector<DeferredSubtree>* deferred, int maxDeferredSize) {
+    const int nodeIdx = (int)out.size();
+    out.emplace_back(Node());
+    Node node;
+    node.minPt = glm::vec3(999999.0f);
+    node.maxPt = glm::vec3(-999999.0f);
+    glm::vec3 minCenter = glm::vec3(999999.0f);
+    glm::vec3 maxCenter = glm::vec3(-999999.0f);
+    for (int i = firstItem; i < lastItem; ++i) {
+        node.minPt = glm::min(node.minPt, items[i].minPt);
+        node.maxPt = glm::max(node.maxPt, items[i].maxPt);
+        minCenter = glm::min(minCenter, items[i].center);
+        maxCenter = glm::max(maxCenter, items[i].center);
+    }
+    node.firstCapsule = firstItem;
+    node.numCapsules = lastItem - firstItem;
+    node.secondChild = -1;
+    node.axis = 0;
+    if (deferred != nullptr && node.numCapsules <= maxDeferredSize) {
+        node.numCapsules = -1 - (int)deferred->size(); // a placeholder for the subtree, see Build()
+        DeferredSubtree subtree;
+        subtree.firstItem = firstItem;
+        subtree.lastItem = lastItem;
+        subtree.depth = depth;
+        deferred->emplace_back(subtree);
+    } else if (node.numCapsules > CAPSULE_BVH_MAX_LEAF_SIZE) {
+        const glm::vec3 extent = maxCenter - minCenter;
+        node.axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : ((extent.y >= extent.z) ? 1 : 2);
+        const int axis = node.axis;
+        const bool splitAtMedian = depth + GetMedianSplitDepth(node.numCapsules) >= CAPSULE_BVH_MAX_STACK_DEPTH - 1;
+        int middle = (extent[axis] > 0.0f && !splitAtMedian) ? SplitBySurfaceArea(items, firstItem, lastItem, axis, minCenter[axis], extent[axis]) : firstItem;
+        if (middle <= firstItem || middle >= lastItem) { // all centers in one bin, or too deep: split in half instead
+            middle = firstItem + node.numCapsules / 2;
+            std::nth_element(items.begin() + firstItem, items.begin() + middle, items.begin() + lastItem,
+                             [axis](const BuildItem& a, const BuildItem& b) { return a.center[axis] < b.center[axis]; });
+        }
+        node.numCapsules = 0;
+        BuildRecursive(items, firstItem, middle, depth + 1, out, deferred, maxDeferredSize); // right after this node
+        node.secondChild = BuildRecursive(items, middle, lastItem, depth + 1, out, deferred, maxDeferredSize);
+    }
+    out[nodeIdx] = node;
+    return nodeIdx;
+}
+
+// Copies the top levels into nodes depth first, each placeholder replaced by its subtree
+int CapsuleBVH::SpliceSubtrees(const std::vector<Node>& topNodes, int topIdx, const std::vector<std::vector<Node>>& subtrees) {
+    const int nodeIdx = (int)nodes.size();
+    const Node& node = topNodes[topIdx];
+    if (node.numCapsules < 0) {
+        const std::vector<Node>& subtree = subtrees[-1 - node.numCapsules];
+        for (unsigned int s = 0; s < (unsigned int)subtree.size(); ++s) {
+            nodes.emplace_back(subtree[s]);
+            if (subtree[s].numCapsules == 0) { nodes.back().secondChild += nodeIdx; }
+        }
+        return nodeIdx;
+    }
+    nodes.emplace_back(node);
+    if (node.numCapsules == 0) {
+        SpliceSubtrees(topNodes, topIdx + 1, subtrees);
+        const int secondChild = SpliceSubtrees(topNodes, node.secondChild, subtrees);
+        nodes[nodeIdx].secondChild = secondChild;
+    }
+    return nodeIdx;
+}
+
+// The top levels are built on the calling thread, down to ranges small enough that there are several per core, and the subtrees below
+// them in parallel, each into its own nodes
+void CapsuleBVH::Build(std::vector<Capsule>&& c) {
+    PROFILE_SCOPE("Build Capsule BVH");
+    nodes.clear();
+    capsules.clear();
+    if (c.size() == 0) { return; }
+    const unsigned int numCapsules = (unsigned int)c.size();
+    std::vector<BuildItem> items = std::vector<BuildItem>(numCapsules);
+    ParallelForBlocks(numCapsules, CAPSULE_BVH_MIN_SUBTREE_SIZE, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; ++i) {
+            items[i].minPt = glm::min(c[i].start, c[i].end) - glm::vec3(c[i].radius);
+            items[i].maxPt = glm::max(c[i].start, c[i].end) + glm::vec3(c[i].radius);
+            items[i].center = 0.5f * (c[i].start + c[i].end);
+            items[i].capsule = i;
+        }
+    });
+
+    const unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+    const int maxSubtreeSize = (int)std::max((unsigned int)CAPSULE_BVH_MIN_SUBTREE_SIZE, numCapsules / (4 * numThreads));
+    std::vector<Node> topNodes = std::vector<Node>();
+    std::vector<DeferredSubtree> deferred = std::vector<DeferredSubtree>();
+    BuildRecursive(items, 0, (int)numCapsules, 0, topNodes, &deferred, maxSubtreeSize);
+    std::vector<std::vector<Node>> subtrees = std::vector<std::vector<Node>>(deferred.size());
+    ParallelFor((unsigned int)deferred.size(), [&](unsigned int s) {
+        subtrees[s].reserve(2 * (deferred[s].lastItem - deferred[s].firstItem) / CAPSULE_BVH_MAX_LEAF_SIZE + 1);
+        BuildRecursive(items, deferred[s].firstItem, deferred[s].lastItem, deferred[s].depth, subtrees[s], nullptr, 0);
+    });
+    nodes.reserve(2 * numCapsules / CAPSULE_BVH_MAX_LEAF_SIZE + 1);
+    SpliceSubtrees(topNodes, 0, subtrees);
+
+    capsules.reserve(numCapsules);
+    for (unsigned int i = 0; i < numCapsules; ++i) {
+        capsules.emplace_back(c[items[i].capsule]);
+    }
+    c.clear();
+}
+
+void CapsuleBVH::GetBounds(glm::vec3& minPt, glm::vec3& maxPt) const {
+    if (IsEmpty()) {
+        minPt = glm::vec3(0.0f);
+        maxPt = glm::vec3(0.0f);
+        return;
+    }
+    minPt = nodes[0].minPt;
+    maxPt = nodes[0].maxPt;
+}
+
+/// Tracing
+
+// Which rays of the packet enter the box before their nearest hit so far, and whether any does. A ray that isn't used has tHit 0 and never
+// enters.
+static bool PacketHitsBox(const RayPacket& packet, const glm::vec3& minPt, const glm::vec3& maxPt, bool* rayHits) {
+    bool anyHit = false;
+    for (unsigned int i = 0; i < RAY_PACKET_SIZE; ++i) {
+        const float tx0 = (minPt.x - packet.originX[i]) * packet.inverseDirectionX[i];
+        const float tx1 = (maxPt.x - packet.originX[i]) * packet.inverseDirectionX[i];
+        const float ty0 = (minPt.y - packet.originY[i]) * packet.inverseDirectionY[i];
+        const float ty1 = (maxPt.y - packet.originY[i]) * packet.inverseDirectionY[i];
+        const float tz0 = (minPt.z - packet.originZ[i]) * packet.inverseDirectionZ[i];
+        const float tz1 = (maxPt.z - packet.originZ[i]) * packet.inverseDirectionZ[i];
+        const float tNear = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.0f));
+        const float tFar = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), packet.tHit[i]));
+        rayHits[i] = tNear < tFar;
+        anyHit |= rayHits[i];
+    }
+    return anyHit;
+}
+
+static float IntersectSphere(const glm::vec3& centerToOrigin, const glm::vec3& direction, float radius2) {
+    const float b = glm::dot(direction, centerToOrigin);
+    const float h = b * b - (glm::dot(centerToOrigin, centerToOrigin) - radius2);
+    return (h < 0.0f) ? -1.0f : -b - std::sqrt(h);
+}
+
+// Where the ray first hits the capsule, -1 if it misses. Intersects the infinite cylinder first and falls back to the sphere at the end the
+// hit lies beyond, see https://iquilezles.org/articles/intersectors/. Hits behind the origin come back negative too.
+static float IntersectCapsule(const glm::vec3& origin, const glm::vec3& direction, const Capsule& capsule, const glm::vec3& axis, float axisLength2) {
+    const glm::vec3 toOrigin = origin - capsule.start;
+    const float axisDotDirection = glm::dot(axis, direction);
+    const float axisDotOrigin = glm::dot(axis, toOrigin);
+    const float radius2 = capsule.radius * capsule.radius;
+    const float a = axisLength2 - axisDotDirection * axisDotDirection;
+    if (a <= 1e-12f * axisLength2 || axisLength2 == 0.0f) { // a sphere, or a ray along the axis: whichever end it hits first
+        const float tStart = IntersectSphere(toOrigin, direction, radius2);
+        const float tEnd = IntersectSphere(origin - capsule.end, direction, radius2);
+        return (tStart > 0.0f && (tEnd <= 0.0f || tStart < tEnd)) ? tStart : tEnd;
+    }
+    const float b = axisLength2 * glm::dot(direction, toOrigin) - axisDotOrigin * axisDotDirection;
+    const float c = axisLength2 * glm::dot(toOrigin, toOrigin) - axisDotOrigin * axisDotOrigin - radius2 * axisLength2;
+    const float h = b * b - a * c;
+    if (h < 0.0f) { return -1.0f; }
+    const float t = (-b - std::sqrt(h)) / a;
+    const float y = axisDotOrigin + t * axisDotDirection;
+    if (y > 0.0f && y < axisLength2) { return t; }
+    return IntersectSphere((y <= 0.0f) ? toOrigin : origin - capsule.end, direction, radius2);
+}
+
+// With anyHit, a ray retires at its first hit instead of looking for a nearer one: its tHit becomes 0, so it enters no more boxes, and
+// once every ray retired the traversal ends
+template <bool anyHit>
+void CapsuleBVH::Traverse(RayPacket& packet) const {
+    if (IsEmpty()) { return; }
+    unsigned int numActive = 0;
+    for (unsigned int i = 0; i < RAY_PACKET_SIZE; ++i) {
+        numActive += (packet.tHit[i] > 0.0f) ? 1 : 0;
+    }
+    const float* directions[3] = { packet.directionX, packet.directionY, packet.directionZ };
+    int stack[CAPSULE_BVH_MAX_STACK_DEPTH];
+    int stackSize = 0;
+    int nodeIdx = 0;
+    bool rayHits[RAY_PACKET_SIZE];
+    while (true) {
+        const Node& node = nodes[nodeIdx];
+        if (PacketHitsBox(packet, node.minPt, node.maxPt, rayHits)) {
+            if (node.numCapsules == 0) {
+                // Nearer child first, judged by the packet's first ray: the rays of a packet point about the same way
+                const bool secondIsNearer = directions[node.axis][0] < 0.0f;
+                assert(stackSize < CAPSULE_BVH_MAX_STACK_DEPTH); // see BuildRecursive()
+                stack[stackSize++] = secondIsNearer ? nodeIdx + 1 : node.secondChild;
+                nodeIdx = secondIsNearer ? node.secondChild : nodeIdx + 1;
+                continue;
+            }
+            for (int c = node.firstCapsule; c < node.firstCapsule + node.numCapsules; ++c) {
+                const Capsule& capsule = capsules[c];
+                const glm::vec3 axis = capsule.end - capsule.start;
+                const float axisLength2 = glm::dot(axis, axis);
+                for (unsigned int i = 0; i < RAY_PACKET_SIZE; ++i) {
+                    if (!rayHits[i] || packet.tHit[i] <= 0.0f) { continue; } // only the rays that entered the leaf's box and are still looking
+                    const glm::vec3 origin = glm::vec3(packet.originX[i], packet.originY[i], packet.originZ[i]);
+                    const glm::vec3 direction = glm::vec3(packet.directionX[i], packet.directionY[i], packet.directionZ[i]);
+                    const float t = IntersectCapsule(origin, direction, capsule, axis, axisLength2);
+                    if (t > 0.0f && t < packet.tHit[i]) {
+                        packet.tHit[i] = anyHit ? 0.0f : t;
+                        packet.hitCapsule[i] = c;
+                        if (anyHit && --numActive == 0) { return; }
+                    }
+                }
+            }
+        }
+        if (stackSize == 0) { break; }
+        nodeIdx = stack[--stackSize];
+    }
+}
+
+void CapsuleBVH::Intersect(RayPacket& packet) const {
+    Traverse<false>(packet);
+}
+
+void CapsuleBVH::IntersectAny(RayPacket& packet) const {
+    Traverse<true>(packet);
+}
+
+glm::vec3 CapsuleBVH::GetNormal(const Capsule& capsule, const glm::vec3& pointOnSurface) {
+    const glm::vec3 axis = capsule.end - capsule.start;
+    const float axisLength2 = glm::dot(axis, axis);
+    const float along = (axisLength2 > 0.0f) ? glm::clamp(glm::dot(pointOnSurface - capsule.start, axis) / axisLength2, 0.0f, 1.0f) : 0.0f;
+    return glm::normalize(pointOnSurface - (capsule.start + along * axis));
+}
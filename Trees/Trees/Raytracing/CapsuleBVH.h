@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+
+#define CAPSULE_BVH_MAX_LEAF_SIZE 4 // capsules per leaf when built
+#define CAPSULE_BVH_MAX_STACK_DEPTH 64 // nodes a traversal can have waiting, so also the deepest a leaf may be built, see BuildRecursive()
+#define CAPSULE_BVH_NUM_BINS 16 // candidate splits per node, see SplitBySurfaceArea() in CapsuleBVH.cpp
+#define CAPSULE_BVH_MIN_SUBTREE_SIZE 4096 // capsules under a subtree built on its own thread, at least
+#define RAY_PACKET_WIDTH 4 // a packet covers RAY_PACKET_WIDTH x RAY_PACKET_WIDTH pixels
+#define RAY_PACKET_SIZE (RAY_PACKET_WIDTH * RAY_PACKET_WIDTH)
+
+// A segment swept by a sphere: an internode is one from bud to bud with the branch's radius, a sphere one whose ends coincide
+struct Capsule {
+    glm::vec3 start;
+    float radius;
+    glm::vec3 end;
+    int material; // up to the owner, e.g. branch or leaf
+    Capsule(const glm::vec3& s, const glm::vec3& e, float r, int m) : start(s), radius(r), end(e), material(m) {}
+};
+
+// Rays traced through a CapsuleBVH together, e.g. the primary rays of a block of neighboring pixels, which mostly visit the same nodes.
+// Each component is its own array, so the loops over the rays of the packet compile to SIMD instructions without intrinsics.
+struct RayPacket {
+    float originX[RAY_PACKET_SIZE];
+    float originY[RAY_PACKET_SIZE];
+    float originZ[RAY_PACKET_SIZE];
+    float directionX[RAY_PACKET_SIZE]; // normalized
+    float directionY[RAY_PACKET_SIZE];
+    float directionZ[RAY_PACKET_SIZE];
+    float inverseDirectionX[RAY_PACKET_SIZE];
+    float inverseDirectionY[RAY_PACKET_SIZE];
+    float inverseDirectionZ[RAY_PACKET_SIZE];
+    float tHit[RAY_PACKET_SIZE]; // before tracing the farthest t to look at, 0 for a ray that isn't used; after it the nearest hit's
+    int hitCapsule[RAY_PACKET_SIZE]; // -1 if the ray hit nothing
+
+    void SetRay(unsigned int i, const glm::vec3& origin, const glm::vec3& direction, float tMax);
+    glm::vec3 GetHitPoint(unsigned int i) const {
+        return glm::vec3(originX[i], originY[i], originZ[i]) + tHit[i] * glm::vec3(directionX[i], directionY[i], directionZ[i]);
+    }
+};
+
+// Bounding volume hierarchy over capsules, for tracing packets of rays into a grown tree (see TreePreviewRenderer). Built top down: every
+// node splits its capsules along the longest axis of their centers where the surface area heuristic says rays will test the fewest
+// capsules, down to CAPSULE_BVH_MAX_LEAF_SIZE capsules; below the first few levels the subtrees are built on all cores. The nodes are
+// stored depth first, so a node's first child comes right after it. A packet visits a node if any of its rays hits the node's box, nearer
+// child first, and skips every node farther away than the hits its rays found so far.
+class CapsuleBVH {
+private:
+    struct Node {
+        glm::vec3 minPt;
+        int firstCapsule; // leaves only
+        glm::vec3 maxPt;
+        int numCapsules; // 0 for an inner node
+        int secondChild; // inner nodes only, the first child is the next node
+        int axis; // the one the children were split along
+    };
+    std::vector<Node> nodes;
+    std::vector<Capsule> capsules; // in leaf order
+    struct BuildItem { // a capsule's bounds while building
+        glm::vec3 minPt;
+        unsigned int capsule;
+        glm::vec3 maxPt;
+        glm::vec3 center;
+    };
+    struct DeferredSubtree { // a range of items the top levels left to be built on its own
+        int firstItem;
+        int lastItem;
+        int depth; // of its root in the whole tree
+    };
+
+    template <bool anyHit>
+    void Traverse(RayPacket& packet) const;
+    // Builds the subtree over items[firstItem, lastItem), which it reorders, into out, depth first, and returns the index of its root in out.
+    // depth is the root's in the whole tree. With deferred, a range of at most maxDeferredSize items becomes a placeholder node instead, and
+    // is listed in deferred to be built later.
+    static int SplitBySurfaceArea(std::vector<BuildItem>& items, int firstItem, int lastItem, int axis, float minCenter, float extent);
+    static int BuildRecursive(std::vector<BuildItem>& items, int firstItem, int lastItem, int depth, std::vector<Node>& out, std::vector<DeferredSubtree>* deferred, int maxDeferredSize);
+    int SpliceSubtrees(const std::vector<Node>& topNodes, int topIdx, const std::vector<std::vector<Node>>& subtrees);
+
+public:
+    CapsuleBVH() {
+        nodes = std::vector<Node>();
+        capsules = std::vector<Capsule>();
+    }
+
+    // Takes the capsules over and reorders them
+    void Build(std::vector<Capsule>&& c);
+    void Clear() {
+        nodes.clear();
+        capsules.clear();
+    }
+    bool IsEmpty() const { return nodes.size() == 0; }
+    const std::vector<Capsule>& GetCapsules() const { return capsules; } // hitCapsule indexes these
+    void GetBounds(glm::vec3& minPt, glm::vec3& maxPt) const;
+
+    // Finds the nearest hit of every ray in the packet, within the t the packet came in with
+    void Intersect(RayPacket& packet) const;
+    // Finds whether each ray hits anything within its t, e.g. for shadow rays: hitCapsule is one it hits, not necessarily the nearest, and
+    // tHit is left 0 for the rays that hit
+    void IntersectAny(RayPacket& packet) const;
+    static glm::vec3 GetNormal(const Capsule& capsule, const glm::vec3& pointOnSurface);
+};
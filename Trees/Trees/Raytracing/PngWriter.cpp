@@ -0,0 +1,193 @@
+#include "PngWriter.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+/// Checksums
+
+struct Crc32Table {
+    unsigned int entries[256];
+    Crc32Table() {
+        for (unsigned int n = 0; n < 256; ++n) {
+            unsigned int c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            }
+            entries[n] = c;
+        }
+    }
+};
+
+static unsigned int Crc32(const unsigned char* data, size_t size) {
+    static const Crc32Table table = Crc32Table(); // built on first use, once even if several threads write at the same time
+    unsigned int crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static unsigned int Adler32(const std::vector<unsigned char>& data) {
+    unsigned int a = 1;
+    unsigned int b = 0;
+    for (size_t i = 0; i < data.size(); ++i) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+/// Deflate
+
+// Deflate's bit order: values go in starting at the least significant bit, Huffman codes starting at their most significant one
+class DeflateBitWriter {
+private:
+    std::vector<unsigned char>& bytes;
+    unsigned int bitBuffer;
+    int numBits;
+
+public:
+    DeflateBitWriter(std::vector<unsigned char>& b) : bytes(b), bitBuffer(0), numBits(0) {}
+    void WriteBits(unsigned int value, int count) {
+        bitBuffer |= value << numBits;
+        numBits += count;
+        while (numBits >= 8) {
+            bytes.emplace_back((unsigned char)(bitBuffer & 0xFF));
+            bitBuffer >>= 8;
+            numBits -= 8;
+        }
+    }
+    void WriteCode(unsigned int code, int length) {
+        unsigned int reversed = 0;
+        for (int i = 0; i < length; ++i) {
+            reversed |= ((code >> i) & 1) << (length - 1 - i);
+        }
+        WriteBits(reversed, length);
+    }
+    void Flush() {
+        if (numBits > 0) { WriteBits(0, 8 - numBits); }
+    }
+};
+
+// The fixed literal/length code of deflate's block type 1
+static void WriteLiteralOrLength(DeflateBitWriter& writer, unsigned int symbol) {
+    if (symbol < 144) {
+        writer.WriteCode(0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        writer.WriteCode(0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+        writer.WriteCode(symbol - 256, 7);
+    } else {
+        writer.WriteCode(0xC0 + symbol - 280, 8);
+    }
+}
+
+static void WriteMatch(DeflateBitWriter& writer, unsigned int length, unsigned int distance) {
+    static const unsigned short lengthBases[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const unsigned char lengthExtraBits[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const unsigned short distanceBases[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                                      8193, 12289, 16385, 24577 };
+    static const unsigned char distanceExtraBits[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    int l = 28;
+    while (lengthBases[l] > length) { --l; }
+    WriteLiteralOrLength(writer, 257 + l);
+    writer.WriteBits(length - lengthBases[l], lengthExtraBits[l]);
+    int d = 29;
+    while (distanceBases[d] > distance) { --d; }
+    writer.WriteCode(d, 5);
+    writer.WriteBits(distance - distanceBases[d], distanceExtraBits[d]);
+}
+
+// Greedy: at each position, takes the match with the latest earlier occurrence of the next three bytes if there is one
+void PngWriter::Deflate(const std::vector<unsigned char>& data, std::vector<unsigned char>& compressed) {
+    DeflateBitWriter writer = DeflateBitWriter(compressed);
+    writer.WriteBits(1, 1); // the last block
+    writer.WriteBits(1, 2); // compressed with the fixed codes
+    std::vector<int> latest = std::vector<int>(1u << PNG_WRITER_HASH_BITS, -1);
+    const size_t size = data.size();
+    size_t i = 0;
+    while (i < size) {
+        unsigned int matchLength = 0;
+        unsigned int matchDistance = 0;
+        if (i + 3 <= size) {
+            const unsigned int hash = ((data[i] << 16 | data[i + 1] << 8 | data[i + 2]) * 2654435761u) >> (32 - PNG_WRITER_HASH_BITS);
+            const int candidate = latest[hash];
+            latest[hash] = (int)i;
+            if (candidate >= 0 && i - candidate <= PNG_WRITER_WINDOW_SIZE) {
+                const size_t maxLength = std::min<size_t>(258, size - i);
+                while (matchLength < maxLength && data[candidate + matchLength] == data[i + matchLength]) { ++matchLength; }
+                matchDistance = (unsigned int)(i - candidate);
+            }
+        }
+        if (matchLength >= 3) {
+            WriteMatch(writer, matchLength, matchDistance);
+            i += matchLength;
+        } else {
+            WriteLiteralOrLength(writer, data[i]);
+            ++i;
+        }
+    }
+    WriteLiteralOrLength(writer, 256); // end of block
+    writer.Flush();
+}
+
+/// Writing
+
+static void AppendBigEndian(std::vector<unsigned char>& bytes, unsigned int value) {
+    bytes.emplace_back((unsigned char)(value >> 24));
+    bytes.emplace_back((unsigned char)(value >> 16));
+    bytes.emplace_back((unsigned char)(value >> 8));
+    bytes.emplace_back((unsigned char)value);
+}
+
+static void WriteChunk(std::ofstream& file, const char* type, const std::vector<unsigned char>& data) {
+    std::vector<unsigned char> chunk = std::vector<unsigned char>();
+    AppendBigEndian(chunk, (unsigned int)data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    AppendBigEndian(chunk, Crc32(chunk.data() + 4, chunk.size() - 4)); // over the type and the data
+    file.write((const char*)chunk.data(), chunk.size());
+}
+
+bool PngWriter::Write(const std::string& path, unsigned int width, unsigned int height, const std::vector<unsigned char>& rgb) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not open " << path << " for writing" << std::endl;
+        return false;
+    }
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    file.write((const char*)signature, sizeof(signature));
+
+    std::vector<unsigned char> header = std::vector<unsigned char>();
+    AppendBigEndian(header, width);
+    AppendBigEndian(header, height);
+    header.emplace_back(8); // bits per channel
+    header.emplace_back(2); // RGB
+    header.emplace_back(0); // deflate
+    header.emplace_back(0); // the only filter method
+    header.emplace_back(0); // not interlaced
+    WriteChunk(file, "IHDR", header);
+
+    // Every row starts with its filter type. Sub (1) stores each byte as the difference to the byte one pixel to the left, which turns
+    // smooth shading into runs the matcher can find.
+    const unsigned int rowBytes = 3 * width;
+    std::vector<unsigned char> filtered = std::vector<unsigned char>();
+    filtered.reserve((size_t)height * (rowBytes + 1));
+    for (unsigned int y = 0; y < height; ++y) {
+        const unsigned char* row = rgb.data() + (size_t)y * rowBytes;
+        filtered.emplace_back(1);
+        for (unsigned int x = 0; x < rowBytes; ++x) {
+            filtered.emplace_back((unsigned char)(row[x] - ((x >= 3) ? row[x - 3] : 0)));
+        }
+    }
+    std::vector<unsigned char> imageData = std::vector<unsigned char>();
+    imageData.emplace_back(0x78); // zlib header: deflate with a 32K window, no preset dictionary
+    imageData.emplace_back(0x01);
+    Deflate(filtered, imageData);
+    AppendBigEndian(imageData, Adler32(filtered));
+    WriteChunk(file, "IDAT", imageData);
+    WriteChunk(file, "IEND", std::vector<unsigned char>());
+    file.close();
+    return !file.fail();
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#define PNG_WRITER_WINDOW_SIZE 32768 // how far back a match may reach, the most deflate allows
+#define PNG_WRITER_HASH_BITS 15 // of the table of the latest position of each 3-byte sequence
+
+// Writes 8-bit RGB images as PNG without any library: the image is deflated with fixed Huffman codes and one candidate match per position,
+// a fraction of what zlib would take to find the best ones. Good enough for thumbnails (see TreePreviewRenderer), whose flat background
+// makes up most of the image and shrinks to almost nothing.
+class PngWriter {
+private:
+    static void Deflate(const std::vector<unsigned char>& data, std::vector<unsigned char>& compressed); // raw deflate, no zlib header
+
+public:
+    // rgb holds width * height pixels, three bytes each, row by row from the top. Returns false if the file could not be written.
+    static bool Write(const std::string& path, unsigned int width, unsigned int height, const std::vector<unsigned char>& rgb);
+};
@@ -0,0 +1,343 @@
+#include "AttractorBrickStore.h"
+#include "MortonOrder.h"
+#include "../Profiling/Profiler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+
+// A point's position, keyed by its Morton code within its brick
+struct MortonKeyedPosition {
+    unsigned int code;
+    glm::vec3 position;
+};
+
+static AttractorBrickStoreHeader MakeHeader(const glm::vec3& minPt, const glm::vec3& maxPt, float brickSize) {
+    AttractorBrickStoreHeader header = AttractorBrickStoreHeader();
+    header.magic = ATTRACTOR_BRICK_STORE_MAGIC;
+    header.version = ATTRACTOR_BRICK_STORE_VERSION;
+    header.minPoint = minPt;
+    header.maxPoint = maxPt;
+    const glm::vec3 extent = glm::max(maxPt - minPt, glm::vec3(1e-6f));
+    const float maxExtent = std::max(std::max(extent.x, extent.y), extent.z);
+    header.brickSize = std::max(brickSize, maxExtent / (float)ATTRACTOR_BRICK_STORE_MAX_BRICKS_PER_AXIS);
+    header.numBricksPerAxis = glm::clamp(glm::ivec3(glm::ceil(extent / header.brickSize)), glm::ivec3(1), glm::ivec3(ATTRACTOR_BRICK_STORE_MAX_BRICKS_PER_AXIS));
+    header.numPoints = 0;
+    return header;
+}
+
+static glm::ivec3 BrickCoordsOfIndex(const AttractorBrickStoreHeader& header, unsigned int b) {
+    return glm::ivec3(b % header.numBricksPerAxis.x, (b / header.numBricksPerAxis.x) % header.numBricksPerAxis.y,
+                      b / (header.numBricksPerAxis.x * header.numBricksPerAxis.y));
+}
+
+// Writes a whole store: the header, the brick records, then the points of brick after brick, which fillBrick(b, positions) provides one brick
+// at a time, and finally the alive bits with every point alive.
+template <typename FillBrick>
+static bool WriteStore(const std::string& path, AttractorBrickStoreHeader header, const std::vector<unsigned int>& brickCounts, FillBrick fillBrick) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Could not write attractor brick store " << path << std::endl;
+        return false;
+    }
+    const unsigned int numBricks = (unsigned int)brickCounts.size();
+    header.numPoints = 0;
+    for (unsigned int b = 0; b < numBricks; ++b) {
+        header.numPoints += brickCounts[b];
+    }
+    file.write((const char*)&header, sizeof(header));
+    unsigned long long firstPoint = 0;
+    for (unsigned int b = 0; b < numBricks; ++b) {
+        AttractorBrickRecord record = AttractorBrickRecord();
+        record.firstPoint = firstPoint;
+        record.numPoints = brickCounts[b];
+        record.numAlive = brickCounts[b];
+        file.write((const char*)&record, sizeof(record));
+        firstPoint += brickCounts[b];
+    }
+
+    std::vector<glm::vec3> positions = std::vector<glm::vec3>();
+    std::vector<MortonKeyedPosition> keyedPositions = std::vector<MortonKeyedPosition>();
+    std::vector<MortonKeyedPosition> scratch = std::vector<MortonKeyedPosition>();
+    for (unsigned int b = 0; b < numBricks; ++b) {
+        if (brickCounts[b] == 0) { continue; }
+        positions.clear();
+        fillBrick(b, positions);
+        const glm::vec3 brickMin = header.minPoint + glm::vec3(BrickCoordsOfIndex(header, b)) * header.brickSize;
+        const MortonFrame frame = MortonFrame(brickMin, brickMin + glm::vec3(header.brickSize));
+        keyedPositions.resize(positions.size());
+        for (unsigned int i = 0; i < (unsigned int)positions.size(); ++i) {
+            keyedPositions[i].code = frame.Encode(positions[i]);
+            keyedPositions[i].position = positions[i];
+        }
+        RadixSortByKey(keyedPositions, scratch, [](const MortonKeyedPosition& k) { return k.code; });
+        for (unsigned int i = 0; i < (unsigned int)keyedPositions.size(); ++i) {
+            positions[i] = keyedPositions[i].position;
+        }
+        file.write((const char*)positions.data(), positions.size() * sizeof(glm::vec3));
+    }
+
+    std::vector<unsigned int> words = std::vector<unsigned int>();
+    for (unsigned int b = 0; b < numBricks; ++b) {
+        words.assign((brickCounts[b] + 31) / 32, 0xFFFFFFFFu);
+        if (brickCounts[b] % 32 != 0) { words.back() = (1u << (brickCounts[b] % 32)) - 1u; }
+        file.write((const char*)words.data(), words.size() * sizeof(unsigned int));
+    }
+    if (!file) {
+        std::cerr << "Could not write attractor brick store " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Stratified: each brick gets its share of the points by volume, placed uniformly at random with a generator seeded by the brick index, so
+// the bricks can be generated one at a time and the result only depends on the seed.
+bool AttractorBrickStore::WriteUniformBox(const std::string& path, unsigned long long numPoints, const glm::vec3& minPt, const glm::vec3& maxPt, float brickSize, unsigned long long seed) {
+    PROFILE_SCOPE("Write Attractor Brick Store");
+    const AttractorBrickStoreHeader header = MakeHeader(minPt, maxPt, brickSize);
+    const unsigned int numBricks = (unsigned int)(header.numBricksPerAxis.x * header.numBricksPerAxis.y * header.numBricksPerAxis.z);
+    const glm::vec3 extent = glm::max(maxPt - minPt, glm::vec3(1e-6f));
+    const double totalVolume = (double)extent.x * (double)extent.y * (double)extent.z;
+
+    std::vector<unsigned int> brickCounts = std::vector<unsigned int>(numBricks);
+    double cumulativePoints = 0.0;
+    unsigned long long numAssigned = 0;
+    for (unsigned int b = 0; b < numBricks; ++b) {
+        const glm::vec3 brickMin = minPt + glm::vec3(BrickCoordsOfIndex(header, b)) * header.brickSize;
+        const glm::vec3 brickExtent = glm::max(glm::min(brickMin + glm::vec3(header.brickSize), minPt + extent) - brickMin, glm::vec3(0.0f));
+        cumulativePoints += (double)numPoints * (double)brickExtent.x * (double)brickExtent.y * (double)brickExtent.z / totalVolume;
+        const unsigned long long numAssignedAfter = (b == numBricks - 1) ? numPoints : std::min(numPoints, (unsigned long long)(cumulativePoints + 0.5));
+        brickCounts[b] = (unsigned int)(numAssignedAfter - numAssigned);
+        numAssigned = numAssignedAfter;
+    }
+
+    return WriteStore(path, header, brickCounts, [&](unsigned int b, std::vector<glm::vec3>& positions) {
+        const glm::vec3 brickMin = minPt + glm::vec3(BrickCoordsOfIndex(header, b)) * header.brickSize;
+        const glm::vec3 brickExtent = glm::max(glm::min(brickMin + glm::vec3(header.brickSize), minPt + extent) - brickMin, glm::vec3(0.0f));
+        pcg32 rng = pcg32(seed, b);
+        std::uniform_real_distribution<float> dis = std::uniform_real_distribution<float>(0.0f, 1.0f);
+        positions.reserve(brickCounts[b]);
+        for (unsigned int i = 0; i < brickCounts[b]; ++i) {
+            const float x = dis(rng);
+            const float y = dis(rng);
+            const float z = dis(rng);
+            positions.emplace_back(brickMin + glm::vec3(x, y, z) * brickExtent);
+        }
+    });
+}
+
+bool AttractorBrickStore::WritePoints(const std::string& path, const std::vector<AttractorPoint>& points, float brickSize) {
+    PROFILE_SCOPE("Write Attractor Brick Store");
+    glm::vec3 minPt = points.size() > 0 ? points[0].point : glm::vec3(0.0f);
+    glm::vec3 maxPt = minPt;
+    for (unsigned int i = 1; i < (unsigned int)points.size(); ++i) {
+        minPt = glm::min(minPt, points[i].point);
+        maxPt = glm::max(maxPt, points[i].point);
+    }
+    const AttractorBrickStoreHeader header = MakeHeader(minPt, maxPt, brickSize);
+    const unsigned int numBricks = (unsigned int)(header.numBricksPerAxis.x * header.numBricksPerAxis.y * header.numBricksPerAxis.z);
+
+    // Counting sort of the point indices by brick, as in AttractorPointGrid::Build()
+    std::vector<unsigned int> pointBricks = std::vector<unsigned int>(points.size());
+    std::vector<unsigned int> brickCounts = std::vector<unsigned int>(numBricks, 0);
+    for (unsigned int i = 0; i < (unsigned int)points.size(); ++i) {
+        const glm::ivec3 c = glm::clamp(glm::ivec3(glm::floor((points[i].point - minPt) / header.brickSize)), glm::ivec3(0), header.numBricksPerAxis - glm::ivec3(1));
+        pointBricks[i] = (unsigned int)(c.x + header.numBricksPerAxis.x * (c.y + header.numBricksPerAxis.y * c.z));
+        ++brickCounts[pointBricks[i]];
+    }
+    std::vector<unsigned int> brickStarts = std::vector<unsigned int>(numBricks + 1, 0);
+    for (unsigned int b = 0; b < numBricks; ++b) {
+        brickStarts[b + 1] = brickStarts[b] + brickCounts[b];
+    }
+    std::vector<unsigned int> brickFill = std::vector<unsigned int>(brickStarts.begin(), brickStarts.end() - 1);
+    std::vector<unsigned int> pointIndices = std::vector<unsigned int>(points.size());
+    for (unsigned int i = 0; i < (unsigned int)points.size(); ++i) {
+        pointIndices[brickFill[pointBricks[i]]++] = i;
+    }
+
+    return WriteStore(path, header, brickCounts, [&](unsigned int b, std::vector<glm::vec3>& positions) {
+        for (unsigned int i = brickStarts[b]; i < brickStarts[b + 1]; ++i) {
+            positions.emplace_back(points[pointIndices[i]].point);
+        }
+    });
+}
+
+bool AttractorBrickStore::Open(const std::string& filePath) {
+    Close();
+    file.open(filePath, std::ios::in | std::ios::out | std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not open attractor brick store " << filePath << std::endl;
+        return false;
+    }
+    file.read((char*)&header, sizeof(header));
+    if (!file || header.magic != ATTRACTOR_BRICK_STORE_MAGIC || header.version != ATTRACTOR_BRICK_STORE_VERSION) {
+        std::cerr << "Not an attractor brick store: " << filePath << std::endl;
+        file.close();
+        return false;
+    }
+    path = filePath;
+    const unsigned int numBricks = (unsigned int)(header.numBricksPerAxis.x * header.numBricksPerAxis.y * header.numBricksPerAxis.z);
+    std::vector<AttractorBrickRecord> records = std::vector<AttractorBrickRecord>(numBricks);
+    file.read((char*)records.data(), numBricks * sizeof(AttractorBrickRecord));
+    bricks.resize(numBricks);
+    unsigned long long firstMaskWord = 0;
+    for (unsigned int b = 0; b < numBricks; ++b) {
+        bricks[b].firstPoint = records[b].firstPoint;
+        bricks[b].firstMaskWord = firstMaskWord;
+        bricks[b].numPoints = records[b].numPoints;
+        bricks[b].numAlive = records[b].numAlive;
+        bricks[b].numAliveOnDisk = records[b].numAlive;
+        bricks[b].firstResidentPoint = -1;
+        firstMaskWord += (records[b].numPoints + 31) / 32;
+    }
+    numBytesRead += sizeof(header) + numBricks * sizeof(AttractorBrickRecord);
+    pagedMin = glm::vec3(1.0f);
+    pagedMax = glm::vec3(-1.0f);
+    return true;
+}
+
+void AttractorBrickStore::Close() {
+    if (!file.is_open()) { return; }
+    EvictAll();
+    file.close();
+    bricks.clear();
+}
+
+unsigned int AttractorBrickStore::CountResidentAlive(const Brick& brick) const {
+    unsigned int numAlive = 0;
+    for (unsigned int i = 0; i < brick.numPoints; ++i) {
+        numAlive += residentMask.IsAlive(brick.firstResidentPoint + i) ? 1 : 0;
+    }
+    return numAlive;
+}
+
+void AttractorBrickStore::WriteBackBrick(unsigned int b) {
+    Brick& brick = bricks[b];
+    if (brick.numAlive == brick.numAliveOnDisk) { return; } // points only ever die, so the same count means the same bits
+    std::vector<unsigned int> words = std::vector<unsigned int>((brick.numPoints + 31) / 32, 0u);
+    for (unsigned int i = 0; i < brick.numPoints; ++i) {
+        if (residentMask.IsAlive(brick.firstResidentPoint + i)) { words[i >> 5] |= 1u << (i & 31); }
+    }
+    file.seekp(MasksOffset() + (std::streamoff)(brick.firstMaskWord * sizeof(unsigned int)));
+    file.write((const char*)words.data(), words.size() * sizeof(unsigned int));
+    file.seekp(TableOffset() + (std::streamoff)(b * sizeof(AttractorBrickRecord) + offsetof(AttractorBrickRecord, numAlive)));
+    file.write((const char*)&brick.numAlive, sizeof(brick.numAlive));
+    if (!file) { std::cerr << "Could not write back attractor brick " << b << " to " << path << std::endl; }
+    numBytesWritten += words.size() * sizeof(unsigned int) + sizeof(brick.numAlive);
+    brick.numAliveOnDisk = brick.numAlive;
+}
+
+void AttractorBrickStore::PageIn(const glm::vec3& minPt, const glm::vec3& maxPt) {
+    if (!file.is_open()) { return; }
+    PROFILE_SCOPE("Page In Attractor Bricks");
+    // Which bricks stay depends on whether they still have alive points
+    for (unsigned int r = 0; r < (unsigned int)residentBricks.size(); ++r) {
+        Brick& brick = bricks[residentBricks[r]];
+        brick.numAlive = CountResidentAlive(brick);
+    }
+
+    std::vector<unsigned int> newResidentBricks = std::vector<unsigned int>();
+    const glm::vec3 boxMin = glm::max(minPt, header.minPoint);
+    const glm::vec3 boxMax = glm::min(maxPt, header.maxPoint);
+    if (boxMin.x <= boxMax.x && boxMin.y <= boxMax.y && boxMin.z <= boxMax.z) {
+        const glm::ivec3 minBrick = BrickCoords(boxMin);
+        const glm::ivec3 maxBrick = BrickCoords(boxMax);
+        for (int z = minBrick.z; z <= maxBrick.z; ++z) {
+            for (int y = minBrick.y; y <= maxBrick.y; ++y) {
+                for (int x = minBrick.x; x <= maxBrick.x; ++x) {
+                    const unsigned int b = (unsigned int)(x + header.numBricksPerAxis.x * (y + header.numBricksPerAxis.y * z));
+                    if (bricks[b].numAlive > 0) { newResidentBricks.push_back(b); } // ascending, x is fastest in both
+                }
+            }
+        }
+    }
+
+    // Evict first, while the old resident points are still there to write back
+    for (unsigned int r = 0; r < (unsigned int)residentBricks.size(); ++r) {
+        if (!std::binary_search(newResidentBricks.begin(), newResidentBricks.end(), residentBricks[r])) {
+            WriteBackBrick(residentBricks[r]);
+        }
+    }
+
+    unsigned int numNewResidentPoints = 0;
+    for (unsigned int r = 0; r < (unsigned int)newResidentBricks.size(); ++r) {
+        numNewResidentPoints += bricks[newResidentBricks[r]].numPoints;
+    }
+    std::vector<AttractorPoint> newResidentPoints = std::vector<AttractorPoint>();
+    newResidentPoints.reserve(numNewResidentPoints);
+    AttractorPointMask newResidentMask = AttractorPointMask();
+    newResidentMask.Reset(numNewResidentPoints);
+    std::vector<int> newFirstResidentPoints = std::vector<int>(newResidentBricks.size());
+    std::vector<glm::vec3> positions = std::vector<glm::vec3>();
+    std::vector<unsigned int> words = std::vector<unsigned int>();
+    for (unsigned int r = 0; r < (unsigned int)newResidentBricks.size(); ++r) {
+        const Brick& brick = bricks[newResidentBricks[r]];
+        const unsigned int first = (unsigned int)newResidentPoints.size();
+        newFirstResidentPoints[r] = (int)first;
+        if (brick.firstResidentPoint >= 0) { // stays resident
+            newResidentPoints.insert(newResidentPoints.end(), residentPoints.begin() + brick.firstResidentPoint, residentPoints.begin() + brick.firstResidentPoint + brick.numPoints);
+            for (unsigned int i = 0; i < brick.numPoints; ++i) {
+                if (!residentMask.IsAlive(brick.firstResidentPoint + i)) { newResidentMask.Kill(first + i); }
+            }
+            continue;
+        }
+        positions.resize(brick.numPoints);
+        file.seekg(PointsOffset() + (std::streamoff)(brick.firstPoint * sizeof(glm::vec3)));
+        file.read((char*)positions.data(), positions.size() * sizeof(glm::vec3));
+        words.resize((brick.numPoints + 31) / 32);
+        file.seekg(MasksOffset() + (std::streamoff)(brick.firstMaskWord * sizeof(unsigned int)));
+        file.read((char*)words.data(), words.size() * sizeof(unsigned int));
+        if (!file) {
+            std::cerr << "Could not read attractor brick " << newResidentBricks[r] << " from " << path << std::endl;
+            file.clear();
+        }
+        numBytesRead += positions.size() * sizeof(glm::vec3) + words.size() * sizeof(unsigned int);
+        for (unsigned int i = 0; i < brick.numPoints; ++i) {
+            newResidentPoints.emplace_back(AttractorPoint(positions[i]));
+            if (((words[i >> 5] >> (i & 31)) & 1u) == 0) { newResidentMask.Kill(first + i); }
+        }
+    }
+
+    for (unsigned int r = 0; r < (unsigned int)residentBricks.size(); ++r) {
+        bricks[residentBricks[r]].firstResidentPoint = -1;
+    }
+    for (unsigned int r = 0; r < (unsigned int)newResidentBricks.size(); ++r) {
+        bricks[newResidentBricks[r]].firstResidentPoint = newFirstResidentPoints[r];
+    }
+    if (newResidentBricks != residentBricks) {
+        residentRevision = AttractorPointCloud::NewLayoutRevision();
+    }
+    residentBricks.swap(newResidentBricks);
+    residentPoints.swap(newResidentPoints);
+    residentMask = std::move(newResidentMask);
+    pagedMin = minPt;
+    pagedMax = maxPt;
+    PROFILE_COUNTER("Resident Attractor Bricks", residentBricks.size());
+    PROFILE_COUNTER("Resident Attractor Points", residentPoints.size());
+}
+
+void AttractorBrickStore::Flush() {
+    if (!file.is_open()) { return; }
+    for (unsigned int r = 0; r < (unsigned int)residentBricks.size(); ++r) {
+        Brick& brick = bricks[residentBricks[r]];
+        brick.numAlive = CountResidentAlive(brick);
+        WriteBackBrick(residentBricks[r]);
+    }
+    file.flush();
+}
+
+bool AttractorBrickStore::IsPagedIn(const glm::vec3& minPt, const glm::vec3& maxPt) const {
+    const glm::vec3 boxMin = glm::max(minPt, header.minPoint);
+    const glm::vec3 boxMax = glm::min(maxPt, header.maxPoint);
+    if (boxMin.x > boxMax.x || boxMin.y > boxMax.y || boxMin.z > boxMax.z) { return true; } // no part of the box holds any points
+    return boxMin.x >= pagedMin.x && boxMin.y >= pagedMin.y && boxMin.z >= pagedMin.z &&
+           boxMax.x <= pagedMax.x && boxMax.y <= pagedMax.y && boxMax.z <= pagedMax.z;
+}
+
+unsigned long long AttractorBrickStore::GetNumAlive() const {
+    unsigned long long numAlive = 0;
+    for (unsigned int b = 0; b < (unsigned int)bricks.size(); ++b) {
+        numAlive += (bricks[b].firstResidentPoint >= 0) ? CountResidentAlive(bricks[b]) : bricks[b].numAlive;
+    }
+    return numAlive;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+
+#include "AttractorPointCloud.h"
+#include "AttractorPointMask.h"
+
+#define ATTRACTOR_BRICK_STORE_MAGIC 0x53425441u // "ATBS"
+#define ATTRACTOR_BRICK_STORE_VERSION 1
+#define ATTRACTOR_BRICK_STORE_DEFAULT_BRICK_SIZE 0.5f // world units, a few perception radii at the default internode scale
+#define ATTRACTOR_BRICK_STORE_MAX_BRICKS_PER_AXIS 128 // bricks grow beyond the requested size if needed, to keep the brick table small
+
+// Layout of a brick store file, in this order:
+//   AttractorBrickStoreHeader
+//   one AttractorBrickRecord per brick, x fastest
+//   the positions (glm::vec3) of all points, brick after brick, in Morton order within each brick
+//   the alive bits of all points, one run of 32 bit words per brick (see AttractorPointMask)
+struct AttractorBrickStoreHeader {
+    unsigned int magic;
+    unsigned int version;
+    glm::vec3 minPoint; // bounds of the points. The bricks start at minPoint, the last ones per axis may reach past maxPoint.
+    glm::vec3 maxPoint;
+    float brickSize;
+    glm::ivec3 numBricksPerAxis;
+    unsigned long long numPoints;
+};
+
+struct AttractorBrickRecord {
+    unsigned long long firstPoint; // index of the brick's first point in the file's point section
+    unsigned int numPoints;
+    unsigned int numAlive; // kept up to date on disk, so a consumed brick is never read again
+};
+
+// Attractor points on disk, for clouds that don't fit in memory. The cloud is cut into cubic bricks; only the bricks around the growing part
+// of a tree are resident (see Tree::IterateGrowthOutOfCore). Paging in a box reads the bricks that intersect it and evicts every other one,
+// writing its alive bits back first, so memory use follows the size of the box and not the size of the cloud. Bricks with no alive points
+// left are never paged in again.
+// The resident points are handed out as one point array with its alive mask, the way an AttractorPointCloud hands out its points, so growth
+// runs on them unchanged. Their indices change whenever a page in changes which bricks are resident.
+class AttractorBrickStore {
+private:
+    struct Brick {
+        unsigned long long firstPoint;
+        unsigned long long firstMaskWord;
+        unsigned int numPoints;
+        unsigned int numAlive; // as of the last page in or flush while resident
+        unsigned int numAliveOnDisk;
+        int firstResidentPoint; // -1 if not resident
+    };
+
+    std::fstream file;
+    std::string path;
+    AttractorBrickStoreHeader header;
+    std::vector<Brick> bricks;
+    std::vector<unsigned int> residentBricks; // ascending brick indices, in the order their points appear in residentPoints
+    std::vector<AttractorPoint> residentPoints;
+    AttractorPointMask residentMask;
+    glm::vec3 pagedMin; // the box the resident bricks were paged in for
+    glm::vec3 pagedMax;
+    unsigned int residentRevision; // changes whenever the resident bricks do, see AttractorPointCloud::GetLayoutRevision()
+    unsigned long long numBytesRead;
+    unsigned long long numBytesWritten;
+
+    std::streamoff TableOffset() const { return (std::streamoff)sizeof(AttractorBrickStoreHeader); }
+    std::streamoff PointsOffset() const { return TableOffset() + (std::streamoff)(bricks.size() * sizeof(AttractorBrickRecord)); }
+    std::streamoff MasksOffset() const { return PointsOffset() + (std::streamoff)(header.numPoints * sizeof(glm::vec3)); }
+    glm::ivec3 BrickCoords(const glm::vec3& p) const {
+        return glm::clamp(glm::ivec3(glm::floor((p - header.minPoint) / header.brickSize)), glm::ivec3(0), header.numBricksPerAxis - glm::ivec3(1));
+    }
+    unsigned int CountResidentAlive(const Brick& brick) const;
+    void WriteBackBrick(unsigned int b); // alive bits and count of a resident brick
+
+public:
+    AttractorBrickStore() : pagedMin(glm::vec3(1.0f)), pagedMax(glm::vec3(-1.0f)), residentRevision(0), numBytesRead(0), numBytesWritten(0) {
+        header = AttractorBrickStoreHeader();
+        bricks = std::vector<Brick>();
+        residentBricks = std::vector<unsigned int>();
+        residentPoints = std::vector<AttractorPoint>();
+        residentMask = AttractorPointMask();
+    }
+    ~AttractorBrickStore() { Close(); }
+
+    // Write a new store file, overwriting whatever is at path. Neither keeps more than one brick of points in memory at a time (besides the
+    // given points), so WriteUniformBox can make stores of any size. Both return false if the file can't be written.
+    static bool WriteUniformBox(const std::string& path, unsigned long long numPoints, const glm::vec3& minPt, const glm::vec3& maxPt, float brickSize, unsigned long long seed);
+    static bool WritePoints(const std::string& path, const std::vector<AttractorPoint>& points, float brickSize);
+
+    bool Open(const std::string& filePath);
+    void Close(); // writes back the resident bricks
+    bool IsOpen() const { return file.is_open(); }
+
+    // Makes exactly the bricks intersecting the box resident, except for the ones without alive points
+    void PageIn(const glm::vec3& minPt, const glm::vec3& maxPt);
+    void EvictAll() { PageIn(glm::vec3(1.0f), glm::vec3(-1.0f)); }
+    // Writes the alive bits of the resident bricks back without evicting them
+    void Flush();
+    // Whether the part of the box inside the store was paged in, i.e. every point in the box is resident or consumed
+    bool IsPagedIn(const glm::vec3& minPt, const glm::vec3& maxPt) const;
+
+    const std::vector<AttractorPoint>& GetResidentPoints() const { return residentPoints; }
+    AttractorPointMask& GetResidentMask() { return residentMask; }
+    unsigned int GetResidentRevision() const { return residentRevision; } // 0 before the first page in
+    unsigned int GetNumResidentBricks() const { return (unsigned int)residentBricks.size(); }
+
+    const glm::vec3& GetMinPoint() const { return header.minPoint; }
+    const glm::vec3& GetMaxPoint() const { return header.maxPoint; }
+    float GetBrickSize() const { return header.brickSize; }
+    unsigned int GetNumBricks() const { return (unsigned int)bricks.size(); }
+    unsigned long long GetNumPoints() const { return header.numPoints; }
+    unsigned long long GetNumAlive() const; // of the whole store, resident bricks included
+    unsigned long long GetNumBytesRead() const { return numBytesRead; }
+    unsigned long long GetNumBytesWritten() const { return numBytesWritten; }
+};
@@ -1,10 +1,18 @@
 #include "Globals.h"
 #include "AttractorPointCloud.h"
+#include "MortonOrder.h"
+#include "../Profiling/Profiler.h"
+
+#include <atomic>
+
+unsigned int AttractorPointCloud::NewLayoutRevision() {
+    static std::atomic<unsigned int> lastRevision(0); // shared by every cloud and every other owner of point vectors, on any thread
+    return ++lastRevision;
+}
 
 void AttractorPointCloud::GeneratePointsInUnitCube(unsigned int numPoints) {
-    #ifdef ENABLE_DEBUG_OUTPUT
-    auto start = std::chrono::system_clock::now();
-    #endif
+    PROFILE_SCOPE("Attractor Point Cloud Generation");
+    std::vector<AttractorPoint>& points = GetMutablePoints();
     for (unsigned int i = 0; i < numPoints; ++i) {
         const glm::vec3 p = glm::vec3(dis(rng), dis(rng), dis(rng));
         minPoint.x = std::min(minPoint.x, p.x);
@@ -15,21 +23,14 @@ void AttractorPointCloud::GeneratePointsInUnitCube(unsigned int numPoints) {
         maxPoint.z = std::max(maxPoint.z, p.z);
         points.emplace_back(AttractorPoint(p));
     }
-    #ifdef ENABLE_DEBUG_OUTPUT
-    auto end = std::chrono::system_clock::now();
-    std::chrono::duration<double> elapsed_seconds = end - start;
-    std::time_t end_time = std::chrono::system_clock::to_time_t(end);
-    std::cout << "Elapsed time for Attractor Point Cloud Generation: " << elapsed_seconds.count() << "s\n";
-    std::cout << "Number of Attractor Points Generated: " << points.size() << "\n\n";
-    #endif
-    create();
+    PROFILE_COUNTER("Attractor Points Generated", points.size());
+    SortPointsInMortonOrder(0);
 }
 
 void AttractorPointCloud::GeneratePoints(unsigned int numPoints) {
-    #ifdef ENABLE_DEBUG_OUTPUT
-    auto start = std::chrono::system_clock::now();
-    #endif
-    boundingMesh.LoadFromFile("OBJs/helixRot.obj");
+    PROFILE_SCOPE("Attractor Point Cloud Generation");
+    std::vector<AttractorPoint>& points = GetMutablePoints();
+    boundingMesh.LoadFromFile("OBJs/helixRot.obj", true);
     for (unsigned int i = 0; i < numPoints; ++i) {
         const glm::vec3 p = glm::vec3(dis(rng) * 1.0f - 1.0f, dis(rng) * 3.0f, dis(rng) * 2.0f + 2.0f); // these scales are hard coded for the helixRot mesh
 
@@ -44,21 +45,51 @@ void AttractorPointCloud::GeneratePoints(unsigned int numPoints) {
             points.emplace_back(AttractorPoint(p));
         }
     }
-    #ifdef ENABLE_DEBUG_OUTPUT
-    auto end = std::chrono::system_clock::now();
-    std::chrono::duration<double> elapsed_seconds = end - start;
-    std::time_t end_time = std::chrono::system_clock::to_time_t(end);
-    std::cout << "Elapsed time for Attractor Point Cloud Generation: " << elapsed_seconds.count() << "s\n";
-    std::cout << "Number of Attractor Points Generated: " << points.size() << "\n\n";
-    #endif
-    create();
+    PROFILE_COUNTER("Attractor Points Generated", points.size());
+    SortPointsInMortonOrder(0);
+}
+
+// Rejection-sample the bounding box of an arbitrary closed mesh until numPoints points lie inside it.
+// Gives up after a fixed number of tries per requested point so a degenerate (flat / open) mesh can't spin forever.
+void AttractorPointCloud::GeneratePointsInMesh(unsigned int numPoints, const char* filepath) {
+    PROFILE_SCOPE("Attractor Point Cloud Generation");
+    std::vector<AttractorPoint>& points = GetMutablePoints();
+    boundingMesh.LoadFromFile(filepath, true);
+    const std::vector<glm::vec3>& meshPositions = boundingMesh.GetPositions();
+    if (meshPositions.size() == 0) { return; }
+    glm::vec3 meshMin = meshPositions[0];
+    glm::vec3 meshMax = meshPositions[0];
+    for (unsigned int i = 1; i < (unsigned int)meshPositions.size(); ++i) {
+        meshMin = glm::min(meshMin, meshPositions[i]);
+        meshMax = glm::max(meshMax, meshPositions[i]);
+    }
+    const glm::vec3 center = 0.5f * (meshMin + meshMax);
+    const glm::vec3 halfExtent = 0.5f * (meshMax - meshMin);
+
+    const unsigned long long maxAttempts = (unsigned long long)numPoints * MESH_SAMPLING_MAX_ATTEMPTS_PER_POINT;
+    unsigned int numGenerated = 0;
+    for (unsigned long long attempt = 0; attempt < maxAttempts && numGenerated < numPoints; ++attempt) {
+        const glm::vec3 p = center + halfExtent * glm::vec3(dis(rng), dis(rng), dis(rng));
+        if (boundingMesh.Contains(p)) {
+            minPoint.x = std::min(minPoint.x, p.x);
+            minPoint.y = std::min(minPoint.y, p.y);
+            minPoint.z = std::min(minPoint.z, p.z);
+            maxPoint.x = std::max(maxPoint.x, p.x);
+            maxPoint.y = std::max(maxPoint.y, p.y);
+            maxPoint.z = std::max(maxPoint.z, p.z);
+            points.emplace_back(AttractorPoint(p));
+            ++numGenerated;
+        }
+    }
+    PROFILE_COUNTER("Attractor Points Generated", points.size());
+    SortPointsInMortonOrder(0);
 }
 
 // Generate points 
 void AttractorPointCloud::GeneratePointsGivenSketchPoints(unsigned int numPoints, const std::vector<glm::vec3>& sketchPoints, const float brushRadius) {
-    #ifdef ENABLE_DEBUG_OUTPUT
-    auto start = std::chrono::system_clock::now();
-    #endif
+    PROFILE_SCOPE("Attractor Point Cloud Generation");
+    std::vector<AttractorPoint>& points = GetMutablePoints();
+    const unsigned int numOldPoints = (unsigned int)points.size();
 
     for (unsigned int i = 0; i < numPoints; ++i) {
         const glm::vec3 p = glm::vec3(dis(rng) * 5.0, dis(rng) * 5.0f, dis(rng) * 5.0f);
@@ -83,17 +114,48 @@ void AttractorPointCloud::GeneratePointsGivenSketchPoints(unsigned int numPoints
             points.emplace_back(AttractorPoint(p));
         }
     }
-    #ifdef ENABLE_DEBUG_OUTPUT
-    auto end = std::chrono::system_clock::now();
-    std::chrono::duration<double> elapsed_seconds = end - start;
-    std::time_t end_time = std::chrono::system_clock::to_time_t(end);
-    std::cout << "Elapsed time for Attractor Point Cloud Generation: " << elapsed_seconds.count() << "s\n";
-    std::cout << "Number of Attractor Points Generated: " << points.size() << "\n\n";
-    #endif
-    create();
+    PROFILE_COUNTER("Attractor Points Generated", points.size());
+    SortPointsInMortonOrder(numOldPoints); // appended, so growth sessions in this cloud keep what they consumed
+}
+
+// A point's index into the cloud, keyed by the Morton code of its position
+struct MortonKeyedIndex {
+    unsigned int code;
+    unsigned int index;
+};
+
+void AttractorPointCloud::SortPointsInMortonOrder(unsigned int firstPoint) {
+    std::vector<AttractorPoint>& points = GetMutablePoints();
+    if (firstPoint == 0) { layoutRevision = NewLayoutRevision(); }
+    const unsigned int numPoints = (unsigned int)points.size();
+    if (numPoints < firstPoint + 2) { return; }
+    PROFILE_SCOPE("Sort Attractor Points");
+    glm::vec3 boundsMin = points[firstPoint].point; // of the points being sorted only
+    glm::vec3 boundsMax = points[firstPoint].point;
+    for (unsigned int i = firstPoint + 1; i < numPoints; ++i) {
+        boundsMin = glm::min(boundsMin, points[i].point);
+        boundsMax = glm::max(boundsMax, points[i].point);
+    }
+    const MortonFrame frame = MortonFrame(boundsMin, boundsMax);
+    std::vector<MortonKeyedIndex> keyedIndices = std::vector<MortonKeyedIndex>(numPoints - firstPoint);
+    for (unsigned int i = firstPoint; i < numPoints; ++i) {
+        keyedIndices[i - firstPoint].code = frame.Encode(points[i].point);
+        keyedIndices[i - firstPoint].index = i;
+    }
+    std::vector<MortonKeyedIndex> scratch = std::vector<MortonKeyedIndex>();
+    RadixSortByKey(keyedIndices, scratch, [](const MortonKeyedIndex& k) { return k.code; });
+    std::vector<AttractorPoint> sortedPoints = std::vector<AttractorPoint>();
+    sortedPoints.reserve(numPoints);
+    sortedPoints.insert(sortedPoints.end(), points.begin(), points.begin() + firstPoint);
+    for (unsigned int i = 0; i < (unsigned int)keyedIndices.size(); ++i) {
+        sortedPoints.emplace_back(points[keyedIndices[i].index]);
+    }
+    points.swap(sortedPoints);
 }
 
 void AttractorPointCloud::create() {
+    const std::vector<AttractorPoint>& points = *sharedPoints;
+
     // Indices
     genBufIdx();
 
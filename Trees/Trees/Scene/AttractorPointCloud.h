@@ -7,56 +7,76 @@
 #include <chrono>
 #include <ctime>
 #include <random>
+#include <memory>
 
 #include "../OpenGL/Drawable.h"
 #include "Mesh.h"
 
+#define MESH_SAMPLING_MAX_ATTEMPTS_PER_POINT 1000
+
 struct AttractorPoint {
     glm::vec3 point; // Point in world space
+    float weight; // how many points of the original cloud this one stands for: 1, except in the coarse levels of an AttractorPointLOD
+    // Scratch space of the GPU space colonization kernels, which work on their own copy of the points. The CPU keeps this state per growth
+    // (see NearestBud and AttractorPointMask), so a cloud's points are never written to once generated.
     float nearestBudDist2; // how close the nearest bud is that has this point in its perception volume, squared
     int nearestBudBranchIdx; // index in the array of the branch of that bud ^^
     int nearestBudIdx; // index in the array of the bud of that branch ^^
     bool removed;
 
     AttractorPoint() : AttractorPoint(glm::vec3(0.0f)) {}
-    AttractorPoint(const glm::vec3& p) : point(p), nearestBudDist2(9999999.0f), nearestBudBranchIdx(-1), nearestBudIdx(-1), removed(false) {}
+    AttractorPoint(const glm::vec3& p, float w = 1.0f) : point(p), weight(w), nearestBudDist2(9999999.0f), nearestBudBranchIdx(-1), nearestBudIdx(-1), removed(false) {}
 };
 
 class AttractorPointCloud : public Drawable {
 protected:
     
 private:
-    std::vector<AttractorPoint> points;
+    // Shared with every growth session over this cloud, which only ever reads it. Changing the points never touches a vector that is still
+    // shared: the cloud makes its own copy first, and sessions notice that it is a different vector (see GrowthSession).
+    std::shared_ptr<std::vector<AttractorPoint>> sharedPoints;
     glm::vec3 minPoint;
     glm::vec3 maxPoint;
     pcg32 rng;
     std::uniform_real_distribution<float> dis;
     Mesh boundingMesh;
     bool shouldDisplay;
+    unsigned int layoutRevision; // changes whenever existing points move or go away. Appending points keeps it, see GetLayoutRevision().
+
+    std::vector<AttractorPoint>& GetMutablePoints() { // copy-on-write, see sharedPoints
+        if (sharedPoints.use_count() > 1) {
+            sharedPoints = std::make_shared<std::vector<AttractorPoint>>(*sharedPoints);
+        }
+        return *sharedPoints;
+    }
+    // Lays the points [firstPoint, end) out along a Z-order curve (see MortonFrame). Every function that adds points ends with this, so point
+    // indices follow space: a neighbourhood query reads the points, their alive bits and their nearest bud scratch from a few nearby cache lines.
+    // Sketching appends its points sorted among themselves, so that the indices of the points already there stay valid.
+    void SortPointsInMortonOrder(unsigned int firstPoint);
 public:
-    AttractorPointCloud() : shouldDisplay(true), minPoint(glm::vec3(999999.0f)), maxPoint(glm::vec3(-999999.0f)) {
-        points = std::vector<AttractorPoint>();
+    AttractorPointCloud() : minPoint(glm::vec3(999999.0f)), maxPoint(glm::vec3(-999999.0f)), shouldDisplay(true), layoutRevision(0) {
+        sharedPoints = std::make_shared<std::vector<AttractorPoint>>();
         rng(101); // Any seed
         dis = std::uniform_real_distribution<float>(-1.0f, 1.0f);
         boundingMesh = Mesh();
     }
-    bool ShouldDisplay() const { return shouldDisplay && points.size() > 0; }
+    bool ShouldDisplay() const { return shouldDisplay && sharedPoints->size() > 0; }
     void ToggleDisplay() { shouldDisplay = !shouldDisplay; }
-    const std::vector<AttractorPoint>& GetPointsConst() const { return points; }
-    std::vector<AttractorPoint>& GetPoints() { return points; }
-    std::vector<AttractorPoint> GetPointsCopy() const { return points; }
+    const std::vector<AttractorPoint>& GetPointsConst() const { return *sharedPoints; }
+    std::shared_ptr<const std::vector<AttractorPoint>> GetSharedPoints() const { return sharedPoints; }
+    // While this stays the same, points were only ever appended: point i of an older point vector is still point i (see GrowthSession).
+    // Revisions come from NewLayoutRevision(), so no two clouds ever share one.
+    unsigned int GetLayoutRevision() const { return layoutRevision; }
+    static unsigned int NewLayoutRevision(); // never 0, e.g. for other point vectors that the GPU grid should tell apart (see TreeParameters)
     glm::vec3& GetMinPoint() { return minPoint; }
     glm::vec3& GetMaxPoint() { return maxPoint; }
+    void Seed(unsigned long long seed) { rng.seed(seed); } // Make generation reproducible, e.g. for benchmark fixtures
+
+    // Point generation only fills the CPU-side point list. Call create() afterwards to upload the points for display.
     void GeneratePointsInUnitCube(unsigned int numPoints);
     void GeneratePoints(unsigned int numPoints);
+    void GeneratePointsInMesh(unsigned int numPoints, const char* filepath); // numPoints is the number of points kept, not sampled
     void GeneratePointsGivenSketchPoints(unsigned int numPoints, const std::vector<glm::vec3>& sketchPoints, const float brushRadius);
-    void AddPoints(const std::vector<AttractorPoint>& p) { points.insert(points.begin(), p.begin(), p.end()); }
-    static AttractorPointCloud UnionAttractorPointClouds(const AttractorPointCloud& ap1, const AttractorPointCloud& ap2) {
-        AttractorPointCloud unionCloud;
-        unionCloud.AddPoints(ap1.points);
-        unionCloud.AddPoints(ap2.points);
-        return unionCloud;
-    }
 
     // Inherited functions from Drawable
     void create() override;
@@ -0,0 +1,51 @@
+#include "Globals.h"
+#include "AttractorPointComposite.h"
+#include "../Profiling/Profiler.h"
+
+int AttractorPointComposite::AddCloud(const std::shared_ptr<const std::vector<AttractorPoint>>& points, AttractorPointMask&& aliveMask, AttractorPointGrid&& grid, float gridCellWidth) {
+    members.emplace_back();
+    AttractorPointCompositeMember& member = members.back();
+    member.points = points;
+    member.aliveMask = std::move(aliveMask);
+    member.grid = std::move(grid);
+    member.gridCellWidth = member.grid.IsEmpty() ? 0.0f : gridCellWidth;
+    member.firstIndex = numPoints;
+    for (unsigned int i = 0; i < (unsigned int)points->size(); ++i) {
+        member.minPoint = glm::min(member.minPoint, (*points)[i].point);
+        member.maxPoint = glm::max(member.maxPoint, (*points)[i].point);
+    }
+    numPoints += (unsigned int)points->size();
+    return (int)members.size() - 1;
+}
+
+void AttractorPointComposite::TakeMember(unsigned int m, AttractorPointMask& aliveMask, AttractorPointGrid& grid, float& gridCellWidth) {
+    AttractorPointCompositeMember& member = members[m];
+    aliveMask = std::move(member.aliveMask);
+    grid = std::move(member.grid);
+    gridCellWidth = member.gridCellWidth;
+    member.aliveMask = AttractorPointMask();
+    member.grid = AttractorPointGrid();
+    member.gridCellWidth = 0.0f;
+}
+
+void AttractorPointComposite::BuildGrids(float cellWidth) {
+    for (unsigned int m = 0; m < (unsigned int)members.size(); ++m) {
+        AttractorPointCompositeMember& member = members[m];
+        if (member.gridCellWidth == cellWidth) { continue; }
+        PROFILE_SCOPE("Build Attractor Point Grid");
+        member.grid.Build(*member.points, cellWidth);
+        member.gridCellWidth = cellWidth;
+    }
+}
+
+bool AttractorPointComposite::GetBounds(glm::vec3& minPt, glm::vec3& maxPt) const {
+    minPt = glm::vec3(999999.0f); // an empty box if there are no points
+    maxPt = glm::vec3(-999999.0f);
+    if (numPoints == 0) { return false; }
+    for (unsigned int m = 0; m < (unsigned int)members.size(); ++m) {
+        if (members[m].points->size() == 0) { continue; }
+        minPt = glm::min(minPt, members[m].minPoint);
+        maxPt = glm::max(maxPt, members[m].maxPoint);
+    }
+    return true;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "glm/glm.hpp"
+
+#include "AttractorPointCloud.h"
+#include "AttractorPointGrid.h"
+#include "AttractorPointMask.h"
+
+// One cloud of an AttractorPointComposite: its points, shared with the cloud and never copied, and its own alive mask and grid
+struct AttractorPointCompositeMember {
+    std::shared_ptr<const std::vector<AttractorPoint>> points;
+    AttractorPointMask aliveMask;
+    AttractorPointGrid grid;
+    float gridCellWidth; // the cell width the grid was built for, 0 if it wasn't built yet
+    glm::vec3 minPoint; // bounds of the points
+    glm::vec3 maxPoint;
+    unsigned int firstIndex; // of the member's points in the composite's index space
+    AttractorPointCompositeMember() : gridCellWidth(0.0f), minPoint(glm::vec3(999999.0f)), maxPoint(glm::vec3(-999999.0f)), firstIndex(0) {
+        aliveMask = AttractorPointMask();
+        grid = AttractorPointGrid();
+    }
+};
+
+// Several attractor point clouds that a tree grows into as if they were one, e.g. one cloud per sketched stroke, without ever copying them
+// into one. Point i of member m is point members[m].firstIndex + i of the composite, so per-point state such as the nearest bud scratch can
+// still be one array. Each member keeps its own alive mask and grid: adding a cloud builds just its own grid, and a query only visits the
+// members whose bounds it overlaps. Incremental space colonization (see Tree::IterateGrowth) goes through the same point interface as for a
+// single cloud: operator[], IsAlive(), Kill(), ForEachPointNear() and ForEachAlivePoint().
+class AttractorPointComposite {
+private:
+    std::vector<AttractorPointCompositeMember> members;
+    unsigned int numPoints;
+
+    // The member that holds point i of the composite. A linear search: there is one member per cloud, a handful at most.
+    unsigned int GetMemberIndex(unsigned int i) const {
+        unsigned int m = 0;
+        while (m + 1 < (unsigned int)members.size() && members[m + 1].firstIndex <= i) { ++m; }
+        return m;
+    }
+
+public:
+    AttractorPointComposite() : numPoints(0) {
+        members = std::vector<AttractorPointCompositeMember>();
+    }
+
+    // Adds a cloud's points with the given alive mask, e.g. a growth session's, and optionally the grid that was built over them before (see
+    // TakeMember()). Leaves the other members alone. Returns the member's index.
+    int AddCloud(const std::shared_ptr<const std::vector<AttractorPoint>>& points, AttractorPointMask&& aliveMask, AttractorPointGrid&& grid = AttractorPointGrid(), float gridCellWidth = 0.0f);
+    // Hands a member's mask and grid back, e.g. to the growth session it came from once growth is done. The member keeps its points.
+    void TakeMember(unsigned int m, AttractorPointMask& aliveMask, AttractorPointGrid& grid, float& gridCellWidth);
+    // Builds the grid of every member that has none for this cell width yet
+    void BuildGrids(float cellWidth);
+    void CompactGridsIfFragmented() {
+        for (unsigned int m = 0; m < (unsigned int)members.size(); ++m) {
+            members[m].grid.CompactIfFragmented(members[m].aliveMask);
+        }
+    }
+
+    unsigned int GetNumMembers() const { return (unsigned int)members.size(); }
+    unsigned int GetNumPoints() const { return numPoints; }
+    unsigned int GetNumAlive() const {
+        unsigned int numAlive = 0;
+        for (unsigned int m = 0; m < (unsigned int)members.size(); ++m) {
+            numAlive += members[m].aliveMask.GetNumAlive();
+        }
+        return numAlive;
+    }
+    // Bounds of every member's points. Returns false if there are none.
+    bool GetBounds(glm::vec3& minPt, glm::vec3& maxPt) const;
+
+    const AttractorPoint& operator[](unsigned int i) const {
+        const AttractorPointCompositeMember& member = members[GetMemberIndex(i)];
+        return (*member.points)[i - member.firstIndex];
+    }
+    bool IsAlive(unsigned int i) const {
+        const AttractorPointCompositeMember& member = members[GetMemberIndex(i)];
+        return member.aliveMask.IsAlive(i - member.firstIndex);
+    }
+    bool Kill(unsigned int i) { // Returns whether the point was still alive
+        AttractorPointCompositeMember& member = members[GetMemberIndex(i)];
+        return member.aliveMask.Kill(i - member.firstIndex);
+    }
+
+    // Calls f(pointIndex, point) for every point in a grid cell overlapping the sphere's bounding box, in every member whose bounds that box
+    // overlaps. Needs BuildGrids(). Callers do their own exact distance test and skip the dead points.
+    template <typename F>
+    void ForEachPointNear(const glm::vec3& center, const float radius, F&& f) const {
+        const glm::vec3 queryMin = center - glm::vec3(radius);
+        const glm::vec3 queryMax = center + glm::vec3(radius);
+        for (unsigned int m = 0; m < (unsigned int)members.size(); ++m) {
+            const AttractorPointCompositeMember& member = members[m];
+            if (queryMax.x < member.minPoint.x || queryMax.y < member.minPoint.y || queryMax.z < member.minPoint.z ||
+                queryMin.x > member.maxPoint.x || queryMin.y > member.maxPoint.y || queryMin.z > member.maxPoint.z) {
+                continue;
+            }
+            const std::vector<AttractorPoint>& memberPoints = *member.points;
+            member.grid.ForEachPointNear(center, radius, [&](unsigned int ap) { f(member.firstIndex + ap, memberPoints[ap]); });
+        }
+    }
+    // Calls f(pointIndex, point) for every alive point of every member, in ascending order. f may kill the point it is given.
+    template <typename F>
+    void ForEachAlivePoint(F&& f) const {
+        for (unsigned int m = 0; m < (unsigned int)members.size(); ++m) {
+            const AttractorPointCompositeMember& member = members[m];
+            const std::vector<AttractorPoint>& memberPoints = *member.points;
+            member.aliveMask.ForEachAlive([&](unsigned int ap) { f(member.firstIndex + ap, memberPoints[ap]); });
+        }
+    }
+};
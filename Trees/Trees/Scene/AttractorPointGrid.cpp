@@ -0,0 +1,87 @@
+#include "Globals.h"
+#include "AttractorPointGrid.h"
+#include "../Profiling/Profiler.h"
+
+#include <algorithm>
+
+void AttractorPointGrid::Build(const std::vector<AttractorPoint>& points, float desiredCellWidth) {
+    Clear();
+    if (points.size() == 0) { return; }
+
+    gridMin = points[0].point;
+    glm::vec3 gridMax = points[0].point;
+    for (unsigned int i = 1; i < (unsigned int)points.size(); ++i) {
+        gridMin = glm::min(gridMin, points[i].point);
+        gridMax = glm::max(gridMax, points[i].point);
+    }
+    const glm::vec3 extent = gridMax - gridMin;
+    const float maxExtent = std::max(std::max(extent.x, extent.y), extent.z);
+    cellWidth = std::max(desiredCellWidth, maxExtent / (float)ATTRACTOR_POINT_GRID_MAX_CELLS_PER_AXIS);
+    cellWidth = std::max(cellWidth, EPSILON); // all points in one spot
+    inverseCellWidth = 1.0f / cellWidth;
+    resolution = glm::ivec3(glm::floor(extent * inverseCellWidth)) + glm::ivec3(1);
+    resolution = glm::min(resolution, glm::ivec3(ATTRACTOR_POINT_GRID_MAX_CELLS_PER_AXIS));
+
+    // Counting sort of the point indices by cell. Points are visited in index order, so indices stay ascending within each cell.
+    const unsigned int numCells = (unsigned int)(resolution.x * resolution.y * resolution.z);
+    std::vector<unsigned int> pointCells = std::vector<unsigned int>(points.size());
+    cellStartIndices = std::vector<unsigned int>(numCells + 1, 0);
+    for (unsigned int i = 0; i < (unsigned int)points.size(); ++i) {
+        const glm::ivec3 cellCoords = CellCoords(points[i].point);
+        pointCells[i] = (unsigned int)CellIndex(cellCoords.x, cellCoords.y, cellCoords.z);
+        ++cellStartIndices[pointCells[i] + 1];
+    }
+    for (unsigned int c = 0; c < numCells; ++c) {
+        cellStartIndices[c + 1] += cellStartIndices[c];
+    }
+    std::vector<unsigned int> cellFill = std::vector<unsigned int>(cellStartIndices.begin(), cellStartIndices.end() - 1);
+    pointIndices = std::vector<unsigned int>(points.size());
+    for (unsigned int i = 0; i < (unsigned int)points.size(); ++i) {
+        pointIndices[cellFill[pointCells[i]]++] = i;
+    }
+}
+
+void AttractorPointGrid::Compact(const AttractorPointMask& aliveMask) {
+    if (cellStartIndices.size() == 0) { return; }
+    PROFILE_SCOPE("Compact Attractor Point Grid");
+    const unsigned int numCells = (unsigned int)cellStartIndices.size() - 1;
+    unsigned int numKept = 0;
+    for (unsigned int c = 0; c < numCells; ++c) {
+        const unsigned int cellEnd = cellStartIndices[c + 1];
+        const unsigned int cellStart = cellStartIndices[c];
+        cellStartIndices[c] = numKept;
+        for (unsigned int i = cellStart; i < cellEnd; ++i) {
+            if (aliveMask.IsAlive(pointIndices[i])) {
+                pointIndices[numKept++] = pointIndices[i];
+            }
+        }
+    }
+    cellStartIndices[numCells] = numKept;
+    pointIndices.resize(numKept);
+}
+
+void AttractorPointGrid::CompactFrom(const AttractorPointGrid& source, const AttractorPointMask& aliveMask) {
+    if (&source == this) {
+        Compact(aliveMask);
+        return;
+    }
+    Clear();
+    if (source.cellStartIndices.size() == 0) { return; }
+    PROFILE_SCOPE("Compact Attractor Point Grid");
+    gridMin = source.gridMin;
+    cellWidth = source.cellWidth;
+    inverseCellWidth = source.inverseCellWidth;
+    resolution = source.resolution;
+    const unsigned int numCells = (unsigned int)source.cellStartIndices.size() - 1;
+    cellStartIndices = std::vector<unsigned int>(numCells + 1);
+    pointIndices.reserve(aliveMask.GetNumAlive());
+    for (unsigned int c = 0; c < numCells; ++c) {
+        cellStartIndices[c] = (unsigned int)pointIndices.size();
+        for (unsigned int i = source.cellStartIndices[c]; i < source.cellStartIndices[c + 1]; ++i) {
+            if (aliveMask.IsAlive(source.pointIndices[i])) {
+                pointIndices.emplace_back(source.pointIndices[i]);
+            }
+        }
+    }
+    cellStartIndices[numCells] = (unsigned int)pointIndices.size();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+
+#include "AttractorPointCloud.h"
+#include "AttractorPointMask.h"
+
+#define ATTRACTOR_POINT_GRID_MAX_CELLS_PER_AXIS 256
+#define ATTRACTOR_POINT_GRID_MAX_DEAD_FRACTION 0.5f // of the indexed points, before CompactIfFragmented() drops the dead ones
+#define ATTRACTOR_POINT_GRID_LOOKUP_COST 27.0f // of walking the cells of one ForEachPointNear() of a perception radius, in bud-to-point distance tests
+
+// CPU uniform grid over a fixed array of attractor points, for neighbourhood queries during space colonization.
+// Point indices are bucketed by cell in one flat array (cell c owns pointIndices[cellStartIndices[c], cellStartIndices[c + 1])), ascending within a cell.
+// The grid stores indices only, so removing a point is just a matter of clearing its bit in an AttractorPointMask; queries hand back dead points too.
+// Dead points are tombstones that every query still has to skip, so once enough of them piled up, the grid is compacted: the dead indices are
+// dropped from the cells in one linear pass, without re-bucketing anything.
+class AttractorPointGrid {
+private:
+    glm::vec3 gridMin;
+    float cellWidth;
+    float inverseCellWidth;
+    glm::ivec3 resolution;
+    std::vector<unsigned int> cellStartIndices;
+    std::vector<unsigned int> pointIndices;
+
+    int CellIndex(int x, int y, int z) const { return x + resolution.x * (y + resolution.y * z); }
+    glm::ivec3 CellCoords(const glm::vec3& p) const {
+        return glm::clamp(glm::ivec3(glm::floor((p - gridMin) * inverseCellWidth)), glm::ivec3(0), resolution - glm::ivec3(1));
+    }
+
+public:
+    AttractorPointGrid() : gridMin(glm::vec3(0.0f)), cellWidth(1.0f), inverseCellWidth(1.0f), resolution(glm::ivec3(0)) {
+        cellStartIndices = std::vector<unsigned int>();
+        pointIndices = std::vector<unsigned int>();
+    }
+
+    // Bucket all points. The cell width is a hint; it grows if the points' bounds would need more than ATTRACTOR_POINT_GRID_MAX_CELLS_PER_AXIS cells.
+    void Build(const std::vector<AttractorPoint>& points, float desiredCellWidth);
+    void Clear() {
+        cellStartIndices.clear();
+        pointIndices.clear();
+        resolution = glm::ivec3(0);
+    }
+    bool IsEmpty() const { return pointIndices.size() == 0; }
+    unsigned int GetNumIndexedPoints() const { return (unsigned int)pointIndices.size(); }
+
+    // Drops the points that aren't alive anymore from the cells. Queries hand back the same alive points as before, in the same order.
+    void Compact(const AttractorPointMask& aliveMask);
+    // Compact() into a copy of source, e.g. of a grid shared with other growers that this one may not change. Only the alive points are copied.
+    void CompactFrom(const AttractorPointGrid& source, const AttractorPointMask& aliveMask);
+    // Compacts once more than ATTRACTOR_POINT_GRID_MAX_DEAD_FRACTION of the indexed points are dead. Returns whether it did.
+    bool CompactIfFragmented(const AttractorPointMask& aliveMask) {
+        if ((float)aliveMask.GetNumAlive() >= (1.0f - ATTRACTOR_POINT_GRID_MAX_DEAD_FRACTION) * (float)pointIndices.size()) { return false; }
+        Compact(aliveMask);
+        return true;
+    }
+
+    // Calls f(pointIndex) for every point in a cell overlapping the sphere's bounding box. Callers do their own exact distance test.
+    template <typename F>
+    void ForEachPointNear(const glm::vec3& center, const float radius, F&& f) const {
+        if (IsEmpty()) { return; }
+        const glm::ivec3 minCell = CellCoords(center - glm::vec3(radius));
+        const glm::ivec3 maxCell = CellCoords(center + glm::vec3(radius));
+        for (int z = minCell.z; z <= maxCell.z; ++z) {
+            for (int y = minCell.y; y <= maxCell.y; ++y) {
+                for (int x = minCell.x; x <= maxCell.x; ++x) {
+                    const int cell = CellIndex(x, y, z);
+                    for (unsigned int i = cellStartIndices[cell]; i < cellStartIndices[cell + 1]; ++i) {
+                        f(pointIndices[i]);
+                    }
+                }
+            }
+        }
+    }
+};
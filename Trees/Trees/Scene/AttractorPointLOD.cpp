@@ -0,0 +1,52 @@
+#include "Globals.h"
+#include "AttractorPointLOD.h"
+#include "MortonOrder.h"
+#include "../Profiling/Profiler.h"
+
+#include <algorithm>
+
+void AttractorPointLOD::Build(const std::vector<AttractorPoint>& points, const AttractorPointMask& aliveMask, const glm::vec3& minPt, const glm::vec3& maxPt, float cellWidth, int numLevels) {
+    PROFILE_SCOPE("Build Attractor Point LOD");
+    Clear();
+    float levelCellWidth = cellWidth;
+    for (int l = 1; l < numLevels; ++l) {
+        levels.emplace_back();
+        float actualCellWidth = levelCellWidth;
+        if (l == 1) {
+            Decimate(points, &aliveMask, minPt, maxPt, levelCellWidth, levels.back(), actualCellWidth);
+        } else {
+            Decimate(levels[l - 2], nullptr, minPt, maxPt, levelCellWidth, levels.back(), actualCellWidth);
+        }
+        cellWidths.emplace_back(actualCellWidth);
+        levelCellWidth = 2.0f * actualCellWidth;
+    }
+}
+
+void AttractorPointLOD::Decimate(const std::vector<AttractorPoint>& source, const AttractorPointMask* aliveMask, const glm::vec3& minPt, const glm::vec3& maxPt, float cellWidth,
+                                 std::vector<AttractorPoint>& dest, float& actualCellWidth) {
+    const glm::vec3 extent = glm::max(maxPt - minPt, glm::vec3(0.0f));
+    const float maxExtent = std::max(std::max(extent.x, extent.y), extent.z);
+    actualCellWidth = std::max(cellWidth, maxExtent / (float)ATTRACTOR_POINT_LOD_MAX_CELLS_PER_AXIS);
+    actualCellWidth = std::max(actualCellWidth, EPSILON); // all points in one spot
+    const float inverseCellWidth = 1.0f / actualCellWidth;
+    const glm::ivec3 resolution = glm::min(glm::ivec3(glm::floor(extent * inverseCellWidth)) + glm::ivec3(1), glm::ivec3(ATTRACTOR_POINT_LOD_MAX_CELLS_PER_AXIS));
+
+    // Sum up the weighted positions (xyz) and the weights (w) of the points in each cube
+    std::vector<glm::vec4> cellSums = std::vector<glm::vec4>((size_t)resolution.x * resolution.y * resolution.z, glm::vec4(0.0f));
+    for (unsigned int i = 0; i < (unsigned int)source.size(); ++i) {
+        if (aliveMask && !aliveMask->IsAlive(i)) { continue; }
+        const AttractorPoint& currentAttrPt = source[i];
+        const glm::ivec3 c = glm::clamp(glm::ivec3(glm::floor((currentAttrPt.point - minPt) * inverseCellWidth)), glm::ivec3(0), resolution - glm::ivec3(1));
+        cellSums[c.x + resolution.x * (c.y + resolution.y * c.z)] += glm::vec4(currentAttrPt.weight * currentAttrPt.point, currentAttrPt.weight);
+    }
+
+    dest.clear();
+    for (unsigned int c = 0; c < (unsigned int)cellSums.size(); ++c) {
+        if (cellSums[c].w > 0.0f) {
+            dest.emplace_back(AttractorPoint(glm::vec3(cellSums[c]) / cellSums[c].w, cellSums[c].w));
+        }
+    }
+    const MortonFrame mortonFrame = MortonFrame(minPt, maxPt);
+    std::vector<AttractorPoint> scratch = std::vector<AttractorPoint>();
+    RadixSortByKey(dest, scratch, [&](const AttractorPoint& p) { return mortonFrame.Encode(p.point); });
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+
+#include "AttractorPointCloud.h"
+#include "AttractorPointMask.h"
+
+#define ATTRACTOR_POINT_LOD_MAX_CELLS_PER_AXIS 128
+
+// Coarser stand-ins for an attractor point cloud, for growing a tree coarse to fine (see Tree::GrowCoarseLevels). Level 0 is the cloud itself
+// and isn't stored. Level l >= 1 cuts the cloud's box into cubes twice as wide as those of level l - 1 (the cubes of level 1 are cellWidth
+// wide) and keeps one point per cube that holds any point of level l - 1: their centroid, weighted by how many points of the cloud each stands
+// for. The weights add up to the number of alive points on every level, so a coarse point pulls a bud as hard as the points it replaces.
+// Each level is in Morton order, like a cloud's own points.
+class AttractorPointLOD {
+private:
+    std::vector<std::vector<AttractorPoint>> levels; // levels[l - 1] is level l
+    std::vector<float> cellWidths;
+
+    // Decimates source into dest, with cubes of the given width from minPt on
+    static void Decimate(const std::vector<AttractorPoint>& source, const AttractorPointMask* aliveMask, const glm::vec3& minPt, const glm::vec3& maxPt, float cellWidth,
+                         std::vector<AttractorPoint>& dest, float& actualCellWidth);
+
+public:
+    AttractorPointLOD() {
+        levels = std::vector<std::vector<AttractorPoint>>();
+        cellWidths = std::vector<float>();
+    }
+
+    // Builds levels 1 to numLevels - 1 from the alive points of the cloud. The cube width is a hint; it grows if the box would need more than
+    // ATTRACTOR_POINT_LOD_MAX_CELLS_PER_AXIS cubes per axis.
+    void Build(const std::vector<AttractorPoint>& points, const AttractorPointMask& aliveMask, const glm::vec3& minPt, const glm::vec3& maxPt, float cellWidth, int numLevels);
+    void Clear() {
+        levels.clear();
+        cellWidths.clear();
+    }
+    int GetNumLevels() const { return (int)levels.size() + 1; } // including the cloud itself
+    const std::vector<AttractorPoint>& GetLevel(int l) const { return levels[l - 1]; } // l >= 1
+    float GetCellWidth(int l) const { return cellWidths[l - 1]; }
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+
+// One bit per point of an attractor point cloud, set while the point is alive, i.e. no bud has consumed it yet.
+// Growth never writes to the cloud itself: everything it removes is recorded here, so several trees (or several growth sessions of one tree)
+// can share a cloud, and starting over only means setting every bit again. At 1 bit per point instead of a copy of the cloud.
+class AttractorPointMask {
+private:
+    std::vector<unsigned int> words; // point i is bit (i % 32) of words[i / 32]. Bits past numPoints are always 0.
+    unsigned int numPoints;
+    unsigned int numAlive;
+
+public:
+    AttractorPointMask() : numPoints(0), numAlive(0) {
+        words = std::vector<unsigned int>();
+    }
+
+    // Marks all n points as alive
+    void Reset(unsigned int n) {
+        numPoints = n;
+        numAlive = n;
+        words.assign((n + 31) / 32, 0xFFFFFFFFu);
+        if (n % 32 != 0) { words.back() = (1u << (n % 32)) - 1u; }
+    }
+    // Adds points [GetNumPoints(), n) as alive, e.g. points appended to the cloud. The existing points keep their bits.
+    void Grow(unsigned int n) {
+        if (n <= numPoints) { return; }
+        words.resize((n + 31) / 32, 0u);
+        for (unsigned int i = numPoints; i < n; ++i) {
+            words[i >> 5] |= 1u << (i & 31);
+        }
+        numAlive += n - numPoints;
+        numPoints = n;
+    }
+    bool IsAlive(unsigned int i) const { return ((words[i >> 5] >> (i & 31)) & 1u) != 0; }
+    // Returns whether the point was still alive
+    bool Kill(unsigned int i) {
+        const unsigned int bit = 1u << (i & 31);
+        if ((words[i >> 5] & bit) == 0) { return false; }
+        words[i >> 5] &= ~bit;
+        --numAlive;
+        return true;
+    }
+    // Replaces the contents of indices with the indices of the alive points, in ascending order
+    void GetAliveIndices(std::vector<unsigned int>& indices) const {
+        indices.clear();
+        indices.reserve(numAlive);
+        for (unsigned int w = 0; w < (unsigned int)words.size(); ++w) {
+            for (unsigned int bits = words[w], b = 0; bits != 0; bits >>= 1, ++b) {
+                if (bits & 1u) { indices.push_back(w * 32 + b); }
+            }
+        }
+    }
+    // Calls f(i) for every alive point, in ascending order. f may kill point i, but no other.
+    template <typename F>
+    void ForEachAlive(F&& f) const {
+        for (unsigned int w = 0; w < (unsigned int)words.size(); ++w) {
+            for (unsigned int bits = words[w], b = 0; bits != 0; bits >>= 1, ++b) { // a copy of the word, so killing point i can't skip another
+                if (bits & 1u) { f(w * 32 + b); }
+            }
+        }
+    }
+    unsigned int GetNumPoints() const { return numPoints; }
+    unsigned int GetNumAlive() const { return numAlive; }
+
+    // Raw access, e.g. to copy the mask to and from the GPU. Call RecountAlive() after writing to the words directly.
+    unsigned int* GetWords() { return words.data(); }
+    unsigned int GetNumWords() const { return (unsigned int)words.size(); }
+    void RecountAlive() {
+        numAlive = 0;
+        for (unsigned int w = 0; w < (unsigned int)words.size(); ++w) {
+            unsigned int bits = words[w];
+            while (bits != 0) {
+                bits &= bits - 1u;
+                ++numAlive;
+            }
+        }
+    }
+};
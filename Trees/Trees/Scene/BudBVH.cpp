@@ -0,0 +1,131 @@
+#include "Globals.h"
+#include "BudBVH.h"
+
+#include <algorithm>
+
+// Surface area heuristic of a box, for choosing where to insert
+static float HalfSurfaceArea(const glm::vec3& minPt, const glm::vec3& maxPt) {
+    const glm::vec3 extent = maxPt - minPt;
+    return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+int BudBVH::AddItem(const glm::vec3& p, float radius, int branchIdx, int budIdx) {
+    Item item;
+    item.point = p;
+    item.radius = radius;
+    item.branchIdx = branchIdx;
+    item.budIdx = budIdx;
+    item.leaf = -1;
+    item.nextItem = -1;
+    item.lastSeen = updateStamp;
+    items.emplace_back(item);
+    return (int)items.size() - 1;
+}
+
+void BudBVH::Build() {
+    nodes.clear();
+    numBuiltItems = (unsigned int)items.size();
+    numChangedItems = 0;
+    if (items.empty()) { return; }
+    nodes.reserve(2 * (items.size() / BUD_BVH_MAX_LEAF_SIZE + 1));
+    BuildRecursive(-1, 0, (int)items.size());
+}
+
+// Nodes are laid out in preorder, so every child comes after its parent
+int BudBVH::BuildRecursive(int parent, int firstItem, int lastItem) {
+    const int nodeIdx = (int)nodes.size();
+    nodes.emplace_back();
+    nodes[nodeIdx].parent = parent;
+    nodes[nodeIdx].left = -1;
+    nodes[nodeIdx].right = -1;
+    nodes[nodeIdx].firstItem = -1;
+    nodes[nodeIdx].needsRefit = false;
+    if (lastItem - firstItem <= BUD_BVH_MAX_LEAF_SIZE) {
+        for (int i = lastItem - 1; i >= firstItem; --i) {
+            items[i].leaf = nodeIdx;
+            items[i].nextItem = nodes[nodeIdx].firstItem;
+            nodes[nodeIdx].firstItem = i;
+        }
+    } else {
+        const int middleItem = firstItem + (lastItem - firstItem) / 2;
+        const int left = BuildRecursive(nodeIdx, firstItem, middleItem);
+        const int right = BuildRecursive(nodeIdx, middleItem, lastItem);
+        nodes[nodeIdx].left = left;
+        nodes[nodeIdx].right = right;
+    }
+    RefitNode(nodes[nodeIdx]);
+    return nodeIdx;
+}
+
+// An empty node gets an inverted box, which holds no point
+void BudBVH::RefitNode(Node& node) {
+    node.minPt = glm::vec3(999999.0f);
+    node.maxPt = glm::vec3(-999999.0f);
+    if (node.left >= 0) {
+        node.minPt = glm::min(nodes[node.left].minPt, nodes[node.right].minPt);
+        node.maxPt = glm::max(nodes[node.left].maxPt, nodes[node.right].maxPt);
+        return;
+    }
+    for (int i = node.firstItem; i >= 0; i = items[i].nextItem) {
+        const Item& item = items[i];
+        if (item.radius < 0.0f) { continue; }
+        node.minPt = glm::min(node.minPt, item.point - glm::vec3(item.radius));
+        node.maxPt = glm::max(node.maxPt, item.point + glm::vec3(item.radius));
+    }
+}
+
+void BudBVH::UpdateItem(int item, const glm::vec3& p, float radius) {
+    Item& currentItem = items[item];
+    currentItem.lastSeen = updateStamp;
+    if (currentItem.point == p && currentItem.radius == radius) { return; }
+    currentItem.point = p;
+    currentItem.radius = radius;
+    nodes[currentItem.leaf].needsRefit = true;
+}
+
+int BudBVH::InsertItem(const glm::vec3& p, float radius, int branchIdx, int budIdx) {
+    const int item = AddItem(p, radius, branchIdx, budIdx);
+    const int leaf = ChooseLeaf(p - glm::vec3(radius), p + glm::vec3(radius));
+    items[item].leaf = leaf;
+    items[item].nextItem = nodes[leaf].firstItem;
+    nodes[leaf].firstItem = item;
+    nodes[leaf].needsRefit = true; // the boxes on the way down were grown already, but the refit shrinks them around removed items too
+    ++numChangedItems;
+    return item;
+}
+
+int BudBVH::ChooseLeaf(const glm::vec3& minPt, const glm::vec3& maxPt) {
+    int nodeIdx = 0;
+    while (true) {
+        Node& node = nodes[nodeIdx];
+        node.minPt = glm::min(node.minPt, minPt);
+        node.maxPt = glm::max(node.maxPt, maxPt);
+        if (node.left < 0) { return nodeIdx; }
+        float growth[2];
+        const int children[2] = { node.left, node.right };
+        for (int c = 0; c < 2; ++c) {
+            const Node& child = nodes[children[c]];
+            const float area = (child.minPt.x > child.maxPt.x) ? 0.0f : HalfSurfaceArea(child.minPt, child.maxPt); // empty
+            growth[c] = HalfSurfaceArea(glm::min(child.minPt, minPt), glm::max(child.maxPt, maxPt)) - area;
+        }
+        nodeIdx = (growth[1] < growth[0]) ? children[1] : children[0];
+    }
+}
+
+void BudBVH::EndUpdate() {
+    for (unsigned int i = 0; i < (unsigned int)items.size(); ++i) {
+        Item& item = items[i];
+        if (item.radius >= 0.0f && item.lastSeen != updateStamp) {
+            item.radius = -1.0f;
+            nodes[item.leaf].needsRefit = true;
+            ++numChangedItems;
+        }
+    }
+    for (int n = (int)nodes.size() - 1; n >= 0; --n) {
+        Node& node = nodes[n];
+        if (!node.needsRefit) { continue; }
+        RefitNode(node);
+        node.needsRefit = false;
+        if (node.parent >= 0) { nodes[node.parent].needsRefit = true; }
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+#include "glm/gtx/norm.hpp"
+
+#define BUD_BVH_MAX_LEAF_SIZE 4 // items per leaf when built
+#define BUD_BVH_MAX_STACK_DEPTH 64
+// Cost of keeping one bud up to date, of building over one bud, of one point's lookup beyond the node visits and of one node visit, in
+// bud-to-point distance tests, see UsePointCentricQueries() in Tree.cpp
+#define BUD_BVH_UPDATE_COST 8.0f
+#define BUD_BVH_BUILD_COST 4.0f
+#define BUD_BVH_LOOKUP_COST 2.0f
+#define BUD_BVH_NODE_COST 3.0f
+#define BUD_BVH_TYPICAL_OVERLAP 4.0f // nodes a point's lookup visits, in multiples of log2(number of items), among the buds of a tree, whose spheres overlap a lot
+#define BUD_BVH_MAX_CHANGED_FRACTION 1.0f // items inserted or removed since the last build, relative to the number it was built with, before NeedsRebuild()
+
+// Bounding volume hierarchy over a tree's active buds, for point-centric queries: which buds can reach a given point. Each item is a bud's
+// position and a radius, and a node's box bounds the spheres of the items below it. Built top down over items in the order they were added,
+// which should be Morton order: every range is split in half, down to BUD_BVH_MAX_LEAF_SIZE items. From one growth iteration to the next the
+// hierarchy is updated rather than rebuilt: items that moved or went away only mark their leaf, and new items are inserted into the child
+// whose box grows least, down to a leaf. A leaf keeps its items in a linked list, so inserting never moves anything. EndUpdate() then refits
+// the marked leaves and their ancestors. Boxes only get looser that way, so once enough items changed, the owner rebuilds.
+class BudBVH {
+private:
+    struct Node {
+        glm::vec3 minPt;
+        glm::vec3 maxPt;
+        int parent;
+        int left; // children, -1 for a leaf
+        int right;
+        int firstItem; // leaves only: head of the list of items, -1 if empty
+        bool needsRefit;
+    };
+    struct Item {
+        glm::vec3 point;
+        float radius; // -1 once removed
+        int branchIdx;
+        int budIdx;
+        int leaf;
+        int nextItem; // in the leaf's list, -1 at the end
+        unsigned int lastSeen; // update in which the owner last touched the item
+    };
+    std::vector<Node> nodes;
+    std::vector<Item> items;
+    unsigned int numBuiltItems;
+    unsigned int numChangedItems;
+    unsigned int updateStamp;
+
+    int BuildRecursive(int parent, int firstItem, int lastItem); // over items [firstItem, lastItem), returns the node index
+    void RefitNode(Node& node);
+    int ChooseLeaf(const glm::vec3& minPt, const glm::vec3& maxPt); // grows the boxes on the way down
+
+public:
+    BudBVH() : numBuiltItems(0), numChangedItems(0), updateStamp(0) {
+        nodes = std::vector<Node>();
+        items = std::vector<Item>();
+    }
+
+    void Clear() {
+        nodes.clear();
+        items.clear();
+        numBuiltItems = 0;
+        numChangedItems = 0;
+    }
+    bool IsEmpty() const { return nodes.size() == 0; }
+    unsigned int GetNumItems() const { return (unsigned int)items.size(); } // removed ones included: an upper bound for item indices
+    bool NeedsRebuild() const { return IsEmpty() || (float)numChangedItems > BUD_BVH_MAX_CHANGED_FRACTION * (float)numBuiltItems; }
+
+    // Building: Clear(), AddItem() for every bud, then Build(). AddItem() returns the item's index, which the owner keeps to update it later.
+    int AddItem(const glm::vec3& p, float radius, int branchIdx, int budIdx);
+    void Build();
+
+    // Updating: BeginUpdate(), then UpdateItem() for every bud that already has an item and InsertItem() for every other one, then EndUpdate().
+    // Items that weren't touched in between are removed.
+    void BeginUpdate() { ++updateStamp; }
+    void UpdateItem(int item, const glm::vec3& p, float radius);
+    int InsertItem(const glm::vec3& p, float radius, int branchIdx, int budIdx);
+    void EndUpdate();
+
+    // Calls f(item, branchIdx, budIdx) for every item whose sphere holds p, in no particular order. Callers do their own exact tests.
+    // Returns the number of nodes visited, e.g. for cost estimates.
+    template <typename F>
+    unsigned int ForEachBudNear(const glm::vec3& p, F&& f) const {
+        if (IsEmpty()) { return 0; }
+        unsigned int numNodesVisited = 0;
+        int stack[BUD_BVH_MAX_STACK_DEPTH];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0) {
+            const Node& node = nodes[stack[--stackSize]];
+            ++numNodesVisited;
+            if (p.x < node.minPt.x || p.y < node.minPt.y || p.z < node.minPt.z || p.x > node.maxPt.x || p.y > node.maxPt.y || p.z > node.maxPt.z) { continue; }
+            if (node.left >= 0) {
+                stack[stackSize++] = node.left;
+                stack[stackSize++] = node.right;
+                continue;
+            }
+            for (int i = node.firstItem; i >= 0; i = items[i].nextItem) {
+                const Item& item = items[i];
+                if (item.radius >= 0.0f && glm::length2(p - item.point) <= item.radius * item.radius) {
+                    f(i, item.branchIdx, item.budIdx);
+                }
+            }
+        }
+        return numNodesVisited;
+    }
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Array whose elements live in fixed-size chunks that copies of the array share (copy-on-write). Copying the array only copies one pointer
+// per chunk; a chunk is copied the first time it is written to through an array that shares it. So a copy costs next to nothing, and two
+// copies only ever pay for the chunks in which they differ.
+// Writes go through the non-const accessors, which is what triggers the copy: read through a const reference wherever nothing is written,
+// or every chunk gets copied anyway. Elements never move once added, except when their chunk gets copied, which can only happen on the first
+// write after the array itself was copied.
+// Different copies may be used from different threads, as long as each copy is used from one thread at a time. Within one copy, several threads
+// may write different elements at once only after MakeUnique() over those elements.
+template <typename T, unsigned int CHUNK_SIZE_LOG2 = 6>
+class CowChunkedArray {
+private:
+    typedef std::vector<T> Chunk;
+    static const unsigned int CHUNK_SIZE = 1u << CHUNK_SIZE_LOG2;
+    static const unsigned int CHUNK_MASK = CHUNK_SIZE - 1u;
+
+    std::vector<std::shared_ptr<Chunk>> chunks; // every chunk but the last is full. Chunks always have CHUNK_SIZE capacity, so they never reallocate.
+    unsigned int numElements;
+
+    Chunk& GetMutableChunk(unsigned int c) {
+        std::shared_ptr<Chunk>& chunk = chunks[c];
+        if (chunk.use_count() > 1) {
+            std::shared_ptr<Chunk> copy = std::make_shared<Chunk>();
+            copy->reserve(CHUNK_SIZE);
+            copy->insert(copy->end(), chunk->begin(), chunk->end());
+            chunk = copy;
+        }
+        return *chunk;
+    }
+
+public:
+    CowChunkedArray() : numElements(0) {
+        chunks = std::vector<std::shared_ptr<Chunk>>();
+    }
+
+    unsigned int size() const { return numElements; }
+    bool empty() const { return numElements == 0; }
+    void clear() {
+        chunks.clear();
+        numElements = 0;
+    }
+    void swap(CowChunkedArray& other) {
+        chunks.swap(other.chunks);
+        std::swap(numElements, other.numElements);
+    }
+
+    const T& operator[](unsigned int i) const { return (*chunks[i >> CHUNK_SIZE_LOG2])[i & CHUNK_MASK]; }
+    T& operator[](unsigned int i) { return GetMutableChunk(i >> CHUNK_SIZE_LOG2)[i & CHUNK_MASK]; }
+    const T& back() const { return (*this)[numElements - 1]; }
+    T& back() { return (*this)[numElements - 1]; }
+
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+        if ((numElements & CHUNK_MASK) == 0) {
+            chunks.emplace_back(std::make_shared<Chunk>());
+            chunks.back()->reserve(CHUNK_SIZE);
+        }
+        Chunk& chunk = GetMutableChunk(numElements >> CHUNK_SIZE_LOG2);
+        chunk.emplace_back(std::forward<Args>(args)...);
+        ++numElements;
+        return chunk.back();
+    }
+
+    // Copies every shared chunk holding one of the elements [begin, end). Afterwards, those elements can be written through the non-const
+    // accessors from several threads at once (each element from one thread), since no chunk has to be copied anymore.
+    void MakeUnique(unsigned int begin, unsigned int end) {
+        if (begin >= end) { return; }
+        for (unsigned int c = begin >> CHUNK_SIZE_LOG2; c <= ((end - 1) >> CHUNK_SIZE_LOG2); ++c) {
+            GetMutableChunk(c);
+        }
+    }
+
+    // Chunks that no other copy of this array refers to, i.e. the ones this copy alone pays for
+    unsigned int GetNumUnsharedChunks() const {
+        unsigned int numUnshared = 0;
+        for (unsigned int c = 0; c < (unsigned int)chunks.size(); ++c) {
+            numUnshared += (chunks[c].use_count() == 1) ? 1 : 0;
+        }
+        return numUnshared;
+    }
+    unsigned int GetNumChunks() const { return (unsigned int)chunks.size(); }
+};
@@ -0,0 +1,92 @@
+#include "Forest.h"
+#include "../Profiling/Profiler.h"
+#include "../Threading/Parallel.h"
+
+void Forest::IterateGrowth(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, const TreeParameters& treeParams) {
+    PROFILE_SCOPE("Iterate Forest Growth");
+    const unsigned int numTrees = (unsigned int)trees.size();
+    if (numTrees == 0) { return; }
+
+    BeginGrowth(attractorPoints, minAttrPt, maxAttrPt, treeParams);
+    for (int n = 0; n < forestParams.numSpaceColonizationIterations; ++n) {
+        if (!PerformGrowthIteration(attractorPoints, aliveMask, n)) { break; }
+    }
+    EndGrowth();
+
+    PROFILE_SCOPE("Compute Branch Radii");
+    ParallelFor(numTrees, [&](unsigned int t) { trees[t].ComputeBranchRadii(forestParams); });
+}
+
+void Forest::BeginGrowth(const std::vector<AttractorPoint>& attractorPoints, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, const TreeParameters& treeParams) {
+    forestParams = treeParams;
+    forestParams.incrementalSpaceColonization = true;
+
+    for (unsigned int t = 0; t < (unsigned int)trees.size(); ++t) {
+        trees[t].PrepareGrowth(minAttrPt, maxAttrPt, forestParams, false);
+    }
+    nearestBuds.assign(attractorPoints.size(), NearestBud());
+    PROFILE_SCOPE("Build Attractor Point Grid");
+    attractorPointGrid.Build(attractorPoints, PERCEPTION_RADIUS * forestParams.internodeScale); // one perception radius
+}
+
+bool Forest::PerformGrowthIteration(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, int n) {
+    PROFILE_SCOPE("Forest Growth Iteration");
+    const unsigned int numTrees = (unsigned int)trees.size();
+
+    PerformSpaceColonization(attractorPoints, aliveMask);
+
+    {
+        PROFILE_SCOPE("Grow Trees");
+        ParallelFor(numTrees, [&](unsigned int t) {
+            Tree& tree = trees[t];
+            tree.ComputeBHModelBasipetalPass();
+            tree.ComputeBHModelAcropetalPass(forestParams);
+            tree.AppendNewShoots(n, forestParams);
+            tree.ResetState(forestParams, false);
+        });
+    }
+
+    bool didUpdate = false;
+    for (unsigned int t = 0; t < numTrees; ++t) {
+        didUpdate = didUpdate || trees[t].DidUpdate();
+    }
+    return didUpdate && aliveMask.GetNumAlive() > 0; // No tree grew or no more attractor points to consider
+}
+
+// Same as Tree::EndGrowth
+void Forest::EndGrowth() {
+    attractorPointGrid.Clear();
+    nearestBuds = std::vector<NearestBud>();
+    for (unsigned int t = 0; t < (unsigned int)trees.size(); ++t) {
+        trees[t].InvalidatePerceivedAttractorPoints();
+    }
+}
+
+// Tree::PerformSpaceColonizationIncremental, with every tree competing for the same points. Killing points and picking each point's nearest
+// bud write to the shared mask and scratch, so those steps visit one tree at a time; they only touch buds that moved and points that some bud
+// perceives. Ties between trees go to the lower tree index, so the result doesn't depend on scheduling.
+void Forest::PerformSpaceColonization(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask) {
+    PROFILE_SCOPE("Space Colonization");
+    if (aliveMask.GetNumAlive() == 0) { return; }
+    const unsigned int numTrees = (unsigned int)trees.size();
+    attractorPointGrid.CompactIfFragmented(aliveMask);
+
+    for (unsigned int t = 0; t < numTrees; ++t) {
+        trees[t].KillAttractorPointsNearMovedBuds(attractorPoints, aliveMask, attractorPointGrid);
+    }
+    ParallelFor(numTrees, [&](unsigned int t) { trees[t].UpdatePerceivedAttractorPoints(attractorPoints, aliveMask, attractorPointGrid, forestParams); });
+
+    for (unsigned int t = 0; t < numTrees; ++t) {
+        trees[t].ResetPerceivedAttractorPoints(nearestBuds);
+    }
+    for (unsigned int t = 0; t < numTrees; ++t) {
+        trees[t].AssignPerceivedAttractorPoints(nearestBuds, (int)t);
+    }
+
+    ParallelFor(numTrees, [&](unsigned int t) {
+        trees[t].AccumulateOptimalGrowthDirs(attractorPoints, nearestBuds, (int)t);
+        trees[t].RetireInactiveBuds();
+    });
+
+    PROFILE_COUNTER("Attractor Points Alive", aliveMask.GetNumAlive());
+}
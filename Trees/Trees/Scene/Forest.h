@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Tree.h"
+
+#include <vector>
+
+// Grows several trees at once in one attractor point cloud, so that they compete for it: every attractor point goes to the nearest bud of
+// any tree, recorded as (tree, branch, bud), and a point killed by one tree is gone for all of them.
+// Uses incremental space colonization on the CPU regardless of the given parameters. The cloud is bucketed into a single grid that every
+// tree queries, the nearest-bud competition runs once over the points perceived by any tree, and everything that only touches one tree
+// (perception sets, BH model, new shoots) runs for all trees in parallel.
+class Forest {
+private:
+    std::vector<Tree>& trees;
+    AttractorPointGrid attractorPointGrid;
+    std::vector<NearestBud> nearestBuds; // shared by all trees, unlike Tree::nearestBuds
+    TreeParameters forestParams; // the ones given to BeginGrowth, with incremental space colonization
+
+public:
+    Forest(std::vector<Tree>& t) : trees(t) {
+        attractorPointGrid = AttractorPointGrid();
+        nearestBuds = std::vector<NearestBud>();
+        forestParams = TreeParameters();
+    }
+
+    // Same as Tree::IterateGrowth, for every tree at once. Clears the points consumed by any tree from aliveMask.
+    void IterateGrowth(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, const TreeParameters& treeParams);
+    // IterateGrowth one iteration at a time, like Tree::BeginGrowth and friends, e.g. to show the forest between iterations (see GrowthWorker).
+    // PerformGrowthIteration returns false once no tree grew or no point is left. EndGrowth leaves the branch radii to the caller.
+    void BeginGrowth(const std::vector<AttractorPoint>& attractorPoints, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, const TreeParameters& treeParams);
+    bool PerformGrowthIteration(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, int n);
+    void EndGrowth();
+    void PerformSpaceColonization(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask);
+};
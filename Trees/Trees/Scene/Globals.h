@@ -12,4 +12,4 @@
 
 #define UNIFORM_GRID_CELL_COUNT 15
 
-#define ENABLE_DEBUG_OUTPUT
\ No newline at end of file
+#define ENABLE_PROFILING // Comment out to compile all PROFILE_* zones and counters out of the build
\ No newline at end of file
@@ -0,0 +1,42 @@
+#include "GrowthEnsemble.h"
+#include "../Profiling/Profiler.h"
+
+void GrowthEnsemble::SetAttractorPoints(const std::shared_ptr<const std::vector<AttractorPoint>>& attractorPoints, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, float minInternodeScale) {
+    PROFILE_SCOPE("Build Attractor Point Grid");
+    index.Build(attractorPoints, minAttrPt, maxAttrPt, PERCEPTION_RADIUS * minInternodeScale); // one perception radius
+}
+
+void GrowthEnsemble::IterateGrowth(const std::vector<TreeParameters>& params, std::vector<AttractorPointMask>& aliveMasks, unsigned int numThreads) {
+    PROFILE_SCOPE("Iterate Ensemble Growth");
+    const unsigned int numVariants = (unsigned int)trees.size();
+    variantParams = params;
+    numIterationsDone.assign(numVariants, 0);
+    WorkStealingPool pool(numThreads);
+    for (unsigned int v = 0; v < numVariants; ++v) {
+        variantParams[v].incrementalSpaceColonization = true;
+        pool.Push([this, &pool, &aliveMasks, v](unsigned int worker) { GrowVariant(pool, aliveMasks, v, worker); });
+    }
+    pool.Run();
+    numSteals = pool.GetNumSteals();
+}
+
+void GrowthEnsemble::GrowVariant(WorkStealingPool& pool, std::vector<AttractorPointMask>& aliveMasks, unsigned int v, unsigned int worker) {
+    Tree& tree = trees[v];
+    const TreeParameters& treeParams = variantParams[v];
+    int& n = numIterationsDone[v];
+    SharedAttractorPoints sharedPoints = SharedAttractorPoints(index, aliveMasks[v]);
+    if (n == 0) {
+        tree.BeginGrowth(sharedPoints, treeParams);
+    }
+    bool keepGrowing = true;
+    for (int i = 0; i < GROWTH_ENSEMBLE_ITERATIONS_PER_TASK && n < treeParams.numSpaceColonizationIterations && keepGrowing; ++i, ++n) {
+        keepGrowing = tree.PerformGrowthIteration(sharedPoints, treeParams, n);
+    }
+    if (keepGrowing && n < treeParams.numSpaceColonizationIterations) {
+        pool.Push(worker, [this, &pool, &aliveMasks, v](unsigned int w) { GrowVariant(pool, aliveMasks, v, w); });
+        return;
+    }
+    tree.EndGrowth(treeParams, false);
+    PROFILE_SCOPE("Compute Branch Radii");
+    tree.ComputeBranchRadii(treeParams);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Tree.h"
+#include "SharedAttractorPointIndex.h"
+#include "../Threading/WorkStealingPool.h"
+
+#include <memory>
+#include <vector>
+
+#define GROWTH_ENSEMBLE_ITERATIONS_PER_TASK 4 // growth iterations of one variant per task, after which its next task goes back onto the worker's deque
+
+// Grows one tree per variant of the tree parameters into the same cloud, e.g. a look-dev parameter sweep. Unlike a Forest, the trees don't
+// compete: each variant consumes points from its own alive mask only. The cloud's grid is built once and shared by every variant (see
+// SharedAttractorPointIndex), so a variant costs its own mask, buds and nearest bud scratch, the latter only where its buds perceive points
+// (see NearestBudPages), and the growth work itself. Only once a variant consumed most of the points does it keep a grid of the rest.
+// The variants are spread over the cores with work stealing (see WorkStealingPool): each task grows one variant a few iterations and then
+// pushes its continuation, so a variant stays on one core unless another core runs out of work and takes it over.
+// Uses incremental space colonization on the CPU regardless of the given parameters, and no coarse levels.
+class GrowthEnsemble {
+private:
+    std::vector<Tree>& trees; // one per variant
+    SharedAttractorPointIndex index;
+    std::vector<TreeParameters> variantParams;
+    std::vector<int> numIterationsDone;
+    unsigned long long numSteals;
+
+    void GrowVariant(WorkStealingPool& pool, std::vector<AttractorPointMask>& aliveMasks, unsigned int v, unsigned int worker); // one task's worth
+
+public:
+    GrowthEnsemble(std::vector<Tree>& t) : trees(t), numSteals(0) {
+        index = SharedAttractorPointIndex();
+        variantParams = std::vector<TreeParameters>();
+        numIterationsDone = std::vector<int>();
+    }
+
+    // Builds the shared grid, once for every later IterateGrowth into these points. Picks the cell width for the smallest internode scale
+    // that will be used: a bud with longer internodes just visits more cells.
+    void SetAttractorPoints(const std::shared_ptr<const std::vector<AttractorPoint>>& attractorPoints, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, float minInternodeScale);
+    // Grows trees[v] with params[v] into the points aliveMasks[v] says are alive, for every v, and clears the points each tree consumes from its
+    // own mask. Same per tree as Tree::IterateGrowth. numThreads 0 uses every core.
+    void IterateGrowth(const std::vector<TreeParameters>& params, std::vector<AttractorPointMask>& aliveMasks, unsigned int numThreads = 0);
+    unsigned long long GetNumSteals() const { return numSteals; } // by the last IterateGrowth, how often a variant moved to another core
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "AttractorPointCloud.h"
+#include "AttractorPointGrid.h"
+#include "AttractorPointMask.h"
+
+#include <memory>
+#include <vector>
+
+// What a tree (or every tree in the scene, grown together as a Forest) has consumed of one attractor point cloud so far.
+// The application keeps one session per (tree, cloud) pair, so that Iterate continues from the points that are left and Regrow starts over
+// by just setting every bit of the mask again. The cloud's points are shared with the session, never copied.
+class GrowthSession {
+private:
+    int treeIndex; // -1 for the whole scene grown as a Forest
+    int cloudIndex;
+    std::shared_ptr<const std::vector<AttractorPoint>> points; // the points the mask was made for
+    unsigned int layoutRevision; // of the cloud, when points was taken from it
+    AttractorPointMask aliveMask;
+    // Kept from one growth into several clouds at once to the next (see AttractorPointComposite), so a cloud is only bucketed again when it
+    // changed. It is compacted along with the mask, so it goes whenever the mask starts over.
+    AttractorPointGrid grid;
+    float gridCellWidth; // 0 while there is no grid
+
+    void ClearGrid() {
+        grid.Clear();
+        gridCellWidth = 0.0f;
+    }
+
+public:
+    GrowthSession(int t, int c) : treeIndex(t), cloudIndex(c), layoutRevision(0), gridCellWidth(0.0f) {
+        aliveMask = AttractorPointMask();
+        grid = AttractorPointGrid();
+    }
+
+    bool Matches(int t, int c) const { return treeIndex == t && cloudIndex == c; }
+    int GetTreeIndex() const { return treeIndex; }
+
+    // The same progress through the same cloud, for a fork of the tree. The mask is copied (1 bit per point), the points stay shared.
+    GrowthSession Fork(int newTreeIndex) const {
+        GrowthSession fork = *this;
+        fork.treeIndex = newTreeIndex;
+        fork.ClearGrid(); // a cache, rebuilt when needed
+        return fork;
+    }
+
+    // Points the session at the cloud's current points. Points appended since the last call (e.g. sketched ones) join as alive points; if the
+    // cloud changed in any other way, the mask no longer lines up and starts over.
+    void Prepare(const AttractorPointCloud& cloud) {
+        std::shared_ptr<const std::vector<AttractorPoint>> cloudPoints = cloud.GetSharedPoints();
+        if (cloudPoints == points) { return; }
+        const bool onlyAppended = points && cloud.GetLayoutRevision() == layoutRevision && cloudPoints->size() >= points->size();
+        points = cloudPoints;
+        layoutRevision = cloud.GetLayoutRevision();
+        ClearGrid(); // doesn't hold the new points
+        if (onlyAppended) {
+            aliveMask.Grow((unsigned int)points->size());
+        } else {
+            Restart();
+        }
+    }
+    void Restart() {
+        aliveMask.Reset(points ? (unsigned int)points->size() : 0);
+        ClearGrid(); // compaction dropped the points that are alive again
+    }
+
+    const std::shared_ptr<const std::vector<AttractorPoint>>& GetPoints() const { return points; }
+    AttractorPointMask& GetAliveMask() { return aliveMask; }
+    AttractorPointGrid& GetGrid() { return grid; }
+    float& GetGridCellWidth() { return gridCellWidth; }
+};
@@ -5,9 +5,29 @@
 
 #include <iostream>
 #include <fstream>
+#include <cstdio>
+#include <unordered_map>
+
+// Key used to weld vertices: a position index from the OBJ plus the actual normal value.
+// Exporters often write one "vn" per face corner, so the normal index alone would never match.
+struct WeldKey {
+    int positionIndex;
+    glm::vec3 normal;
+    bool operator==(const WeldKey& other) const { return positionIndex == other.positionIndex && normal == other.normal; }
+};
+
+struct WeldKeyHash {
+    size_t operator()(const WeldKey& k) const {
+        size_t h = std::hash<int>()(k.positionIndex);
+        h ^= std::hash<float>()(k.normal.x) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        h ^= std::hash<float>()(k.normal.y) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        h ^= std::hash<float>()(k.normal.z) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        return h;
+    }
+};
 
 // Implementation based on example usage here: https://github.com/syoyo/tinyobjloader
-void Mesh::LoadFromFile(const char* filepath) {
+void Mesh::LoadFromFile(const char* filepath, bool computeIsectData) {
     filename = std::string(filepath, 0, 100); // max 100 characters for internal file name
     filename = filename.substr(5, filename.size()); // trim the "OBJs/"
     std::cout << filename << std::endl;
@@ -27,6 +47,10 @@ void Mesh::LoadFromFile(const char* filepath) {
         exit(EXIT_FAILURE);
     }
 
+    // Weld vertices: every unique (position, normal) pair in the OBJ becomes one entry in the vertex buffer
+    std::unordered_map<WeldKey, unsigned int, WeldKeyHash> weldedIndices = std::unordered_map<WeldKey, unsigned int, WeldKeyHash>();
+    weldedIndices.reserve(attrib.vertices.size() / 3);
+
     // Loop over shapes
     for (size_t s = 0; s < shapes.size(); ++s) {
         // Loop over faces (polygon)
@@ -34,97 +58,117 @@ void Mesh::LoadFromFile(const char* filepath) {
         for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); ++f) {
             int fv = shapes[s].mesh.num_face_vertices[f];
 
-            Triangle t = Triangle();
-
             // Loop over vertices in the face
             for (size_t v = 0; v < fv; ++v) {
-                const unsigned int index = (unsigned int)(index_offset + v);
-                tinyobj::index_t idx = shapes[s].mesh.indices[index];
-                Vertex newVert;
-                newVert.pos = { attrib.vertices[3 * idx.vertex_index], attrib.vertices[3 * idx.vertex_index + 1], attrib.vertices[3 * idx.vertex_index + 2] };
-                newVert.nor = { attrib.normals[3 * idx.normal_index], attrib.normals[3 * idx.normal_index + 1], attrib.normals[3 * idx.normal_index + 2] };
-                
-                // Store data
-                vertices.emplace_back(newVert);
-                indices.emplace_back(index);
-                t.AppendVertex(newVert.pos);
-                positions.emplace_back(newVert.pos);
-                normals.emplace_back(newVert.nor);
+                tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
+                const glm::vec3 normal = (idx.normal_index >= 0) ? glm::vec3(attrib.normals[3 * idx.normal_index], attrib.normals[3 * idx.normal_index + 1], attrib.normals[3 * idx.normal_index + 2]) : glm::vec3(0.0f);
+                const WeldKey key = { idx.vertex_index, normal };
+                auto weldedIter = weldedIndices.find(key);
+                if (weldedIter != weldedIndices.end()) {
+                    indices.emplace_back(weldedIter->second);
+                    continue;
+                }
+
+                // First time seeing this vertex, add it to the vertex buffer
+                const unsigned int newIndex = (unsigned int)positions.size();
+                weldedIndices.emplace(key, newIndex);
+                positions.emplace_back(attrib.vertices[3 * idx.vertex_index], attrib.vertices[3 * idx.vertex_index + 1], attrib.vertices[3 * idx.vertex_index + 2]);
+                normals.emplace_back(normal);
+                indices.emplace_back(newIndex);
             }
             index_offset += fv;
-            t.ComputePlaneNormal();
-            triangles.emplace_back(t);
         }
     }
+
+    if (computeIsectData) {
+        ComputeIntersectionData();
+    }
     return;
 }
 
 void Mesh::ExportToFile() const {
+    ExportToFile("output_" + filename + ".obj");
+}
+
+// Formats the lines into a buffer written out in large chunks: streaming every number through the ofstream on its own made exporting
+// take longer than growing the tree. %g prints exactly what the stream's default float formatting did.
+bool Mesh::ExportToFile(const std::string& outputFileName) const {
     std::ofstream outputFile;
-    std::string outputFileName = "output_" + filename + ".obj";
     outputFile.open(outputFileName);
+    if (!outputFile.is_open()) {
+        std::cerr << "Could not open " << outputFileName << " for writing" << std::endl;
+        return false;
+    }
+    std::vector<char> buffer = std::vector<char>(MESH_EXPORT_BUFFER_SIZE);
+    unsigned int used = 0;
+    auto append = [&](const char* format, auto... values) {
+        if (used + MESH_EXPORT_MAX_LINE_LENGTH > (unsigned int)buffer.size()) {
+            outputFile.write(buffer.data(), used);
+            used = 0;
+        }
+        used += std::snprintf(buffer.data() + used, MESH_EXPORT_MAX_LINE_LENGTH, format, values...);
+    };
     for (unsigned int i = 0; i < (unsigned int)positions.size(); ++i) {
-        outputFile << "v ";
-        outputFile << positions[i].x << " ";
-        outputFile << positions[i].y << " ";
-        outputFile << positions[i].z << "\n";
+        append("v %g %g %g\n", positions[i].x, positions[i].y, positions[i].z);
     }
     for (unsigned int i = 0; i < (unsigned int)positions.size(); ++i) {
-        outputFile << "vt ";
-        outputFile << 0.00000 << " ";
-        outputFile << 0.00000 << "\n";
+        append("vt 0 0\n");
     }
     for (unsigned int i = 0; i < (unsigned int)normals.size(); ++i) {
-        outputFile << "vn ";
-        outputFile << normals[i].x << " ";
-        outputFile << normals[i].y << " ";
-        outputFile << normals[i].z << "\n";
+        append("vn %g %g %g\n", normals[i].x, normals[i].y, normals[i].z);
     }
     for (unsigned int i = 0; i < (unsigned int)indices.size(); i += 3) {
-        outputFile << "f ";
-        outputFile << (indices[i] + 1) << "/";
-        outputFile << (indices[i] + 1) << "/";
-        outputFile << (indices[i] + 1) << "/ ";
-
-        outputFile << (indices[i] + 2) << "/";
-        outputFile << (indices[i] + 2) << "/";
-        outputFile << (indices[i] + 2) << "/ ";
-
-        outputFile << (indices[i] + 3) << "/";
-        outputFile << (indices[i] + 3) << "/";
-        outputFile << (indices[i] + 3) << "/\n";
+        // Positions, uvs and normals all share the welded vertex index
+        const unsigned int a = indices[i] + 1;
+        const unsigned int b = indices[i + 1] + 1;
+        const unsigned int c = indices[i + 2] + 1;
+        append("f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c, c);
     }
+    outputFile.write(buffer.data(), used);
     outputFile.close();
+    return !outputFile.fail();
 }
 
-// TODO: implement better tri intersection?
-Intersection Triangle::Intersect(const Ray& r) const {
+// Moller-Trumbore, using the edges precomputed in the constructor
+Intersection TriangleIsectData::Intersect(const Ray& r) const {
+    const glm::vec3 pVec = glm::cross(r.GetDirection(), edge2);
+    const float det = glm::dot(edge1, pVec);
+    if (std::abs(det) < 1e-12f) { // ray is parallel to the triangle's plane
+        return Intersection();
+    }
+    const float invDet = 1.0f / det;
 
-    // 1. Ray-plane intersection
-    const float t = glm::dot(planeNormal, (points[0] - r.GetOrigin())) / glm::dot(planeNormal, r.GetDirection());
-    if (t < 0) {
+    const glm::vec3 tVec = r.GetOrigin() - p0;
+    const float u = glm::dot(tVec, pVec) * invDet;
+    if (u <= 0.0f || u >= 1.0f) {
         return Intersection();
     }
 
-    const glm::vec3 P = r.GetOrigin() + t * r.GetDirection();
+    const glm::vec3 qVec = glm::cross(tVec, edge1);
+    const float v = glm::dot(r.GetDirection(), qVec) * invDet;
+    if (v <= 0.0f || u + v >= 1.0f) {
+        return Intersection();
+    }
 
-    // 2. Barycentric test
-    const double S = 1.0 / (0.5 * glm::length(glm::cross(points[0] - points[1], points[0] - points[2])));
-    const double S1 = 0.5 * glm::length(glm::cross(P - points[1], P - points[2]));
-    const double S2 = 0.5 * glm::length(glm::cross(P - points[2], P - points[0]));
-    const double S3 = 0.5 * glm::length(glm::cross(P - points[0], P - points[1]));
-    const double sum = (S1 + S2 + S3) * S;
+    const float t = glm::dot(edge2, qVec) * invDet;
+    if (t < 0.0f) {
+        return Intersection();
+    }
+    return Intersection(r.GetOrigin() + t * r.GetDirection(), planeNormal, t);
+}
 
-    if ((S1 > 0.0 && S1 < 1.0) && (S2 > 0.0 && S2 < 1.0) && (S3 > 0.0 && S3 < 1.0) && std::abs(sum - 1.0) < 0.000001) {
-        return Intersection(P, planeNormal, t);
+void Mesh::ComputeIntersectionData() {
+    triangleIsectData.clear();
+    triangleIsectData.reserve(indices.size() / 3);
+    for (unsigned int i = 0; i + 2 < (unsigned int)indices.size(); i += 3) {
+        triangleIsectData.emplace_back(positions[indices[i]], positions[indices[i + 1]], positions[indices[i + 2]]);
     }
-    return Intersection();
 }
 
 Intersection Mesh::Intersect(const Ray& r) const {
-    Intersection finalIsect = triangles[0].Intersect(r);
-    for (unsigned int i = 1; i < (unsigned int)triangles.size(); ++i) {
-        const Intersection isect = triangles[i].Intersect(r);
+    Intersection finalIsect = Intersection();
+    for (unsigned int i = 0; i < (unsigned int)triangleIsectData.size(); ++i) {
+        const Intersection isect = triangleIsectData[i].Intersect(r);
         if (isect.IsValid() && (!finalIsect.IsValid() || isect.GetT() < finalIsect.GetT())) {
             finalIsect = isect;
         }
@@ -1,67 +1,64 @@
 #pragma once
 #include <vector>
+#include <string>
 #include "glm/glm.hpp"
 #include "../Raytracing/Raytracing.h"
 #include "../OpenGL/Drawable.h"
 
-// Note: UVs and colors aren't necessary to draw (for this project)
-struct Vertex {
-    glm::vec3 pos;
-    glm::vec3 nor;
-    Vertex() : pos(glm::vec3(0.f)), nor(glm::vec3(0.f)) {}
-};
+#define MESH_EXPORT_BUFFER_SIZE (1 << 20) // bytes formatted before each write to the OBJ file
+#define MESH_EXPORT_MAX_LINE_LENGTH 128 // longer than any line ExportToFile writes
 
-class Triangle {
-private:
+// Precomputed data for ray-triangle intersection (Moller-Trumbore): the first corner, the two edges leaving it and the plane normal.
+// Only built for meshes that get raytraced (e.g. attractor point cloud bounding meshes).
+struct TriangleIsectData {
+    glm::vec3 p0;
+    glm::vec3 edge1;
+    glm::vec3 edge2;
     glm::vec3 planeNormal;
-    std::vector<glm::vec3> points;
-public:
-    Triangle() {
-        points = std::vector<glm::vec3>();
-        points.reserve(3);
-    }
-    void AppendVertex(const glm::vec3& p) {
-        points.emplace_back(p);
-    }
+    TriangleIsectData(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) :
+        p0(a), edge1(b - a), edge2(c - a), planeNormal(glm::normalize(glm::cross(b - a, c - a))) {}
     Intersection Intersect(const Ray& r) const;
-    inline void ComputePlaneNormal() { planeNormal = glm::normalize(glm::cross(points[1] - points[0], points[2] - points[1])); }
 };
 
-// TODO: refactor, remove the excess storage of vertices/indices
+// Indexed mesh. Vertices are welded on load, so positions[i] and normals[i] describe one unique (position, normal) pair.
 // TODO: currently assumes a triangulated mesh. No triangulation occurs here right now.
 class Mesh : public Drawable {
 protected:
     std::string filename;
 private:
-    // Lists of vertices and indices
-    std::vector<Triangle> triangles;
-    std::vector<Vertex> vertices;
+    // Welded vertex buffer and flat triangle list (three indices per triangle). Read by both the GPU upload (create()) and the raytracing functions.
     std::vector<glm::vec3> positions;
     std::vector<glm::vec3> normals;
     std::vector<unsigned int> indices;
+    std::vector<TriangleIsectData> triangleIsectData; // optional, see ComputeIntersectionData()
 public:
     Mesh() : filename("") {
-        triangles = std::vector<Triangle>();
-        vertices = std::vector<Vertex>();
         positions = std::vector<glm::vec3>();
         normals = std::vector<glm::vec3>();
         indices = std::vector<unsigned int>();
+        triangleIsectData = std::vector<TriangleIsectData>();
     }
-    void LoadFromFile(const char* filepath);
-    void ExportToFile() const;
+    void LoadFromFile(const char* filepath, bool computeIsectData = false);
+    void ExportToFile() const; // to output_<name>.obj
+    bool ExportToFile(const std::string& outputFileName) const; // Returns false if the file could not be written
     void SetName(const char* name) { filename = std::string(name, 0, 100); }
+    const std::string& GetName() const { return filename; }
 
     void clearData() {
-        triangles.clear();
-        vertices.clear();
         positions.clear();
         normals.clear();
         indices.clear();
+        triangleIsectData.clear();
+    }
+    // Exchanges the CPU-side data (not the GL buffers) with another mesh, e.g. to hand over a mesh baked on another thread without copying it
+    void SwapData(Mesh& other) {
+        positions.swap(other.positions);
+        normals.swap(other.normals);
+        indices.swap(other.indices);
+        triangleIsectData.swap(other.triangleIsectData);
     }
 
     // Getters
-    const std::vector<Triangle>&     GetTriangles() const { return triangles; }
-    const std::vector<Vertex>&       GetVertices()  const { return vertices; }
     const std::vector<glm::vec3>&    GetPositions() const { return positions; }
     const std::vector<glm::vec3>&    GetNormals()   const { return normals; }
     const std::vector<unsigned int>& GetIndices()   const { return indices; }
@@ -72,6 +69,7 @@ public:
     void SetIndices(std::vector<unsigned int>& i) { indices = i; }
 
     // Raytracing functions
+    void ComputeIntersectionData(); // Precompute edges/normals of every triangle. Required before calling Intersect() or Contains().
     Intersection Intersect(const Ray& r) const; // Intersect a single ray with this mesh
     bool Contains(const glm::vec3& p) const; // Check if a point intersects this mesh an odd number of times
 
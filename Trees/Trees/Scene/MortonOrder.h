@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "glm/glm.hpp"
+
+#define MORTON_BITS_PER_AXIS 10 // 30-bit codes
+#define MORTON_RADIX_BITS 10 // so a sort takes three passes
+
+// Maps positions inside a box to Morton codes: the box is split into 2^10 cells per axis, and the bits of a position's three cell coordinates
+// are interleaved (x lowest). Sorting by code lays positions out along a Z-order curve, so positions that are close in space mostly end up
+// close in memory. Positions outside the box are clamped to it, which only costs locality, never correctness.
+class MortonFrame {
+private:
+    glm::vec3 minPoint;
+    glm::vec3 scale; // world units -> cells
+
+    // Spreads the lowest 10 bits of v out to every third bit
+    static unsigned int SpreadBits(unsigned int v) {
+        v = (v | (v << 16)) & 0x030000FFu;
+        v = (v | (v << 8)) & 0x0300F00Fu;
+        v = (v | (v << 4)) & 0x030C30C3u;
+        v = (v | (v << 2)) & 0x09249249u;
+        return v;
+    }
+
+public:
+    MortonFrame() : minPoint(glm::vec3(0.0f)), scale(glm::vec3(0.0f)) {}
+    MortonFrame(const glm::vec3& minPt, const glm::vec3& maxPt) : minPoint(minPt) {
+        const glm::vec3 extent = glm::max(maxPt - minPt, glm::vec3(1e-6f));
+        scale = glm::vec3((float)(1u << MORTON_BITS_PER_AXIS)) / extent;
+    }
+
+    unsigned int Encode(const glm::vec3& p) const {
+        const glm::vec3 cell = glm::clamp((p - minPoint) * scale, glm::vec3(0.0f), glm::vec3((float)((1u << MORTON_BITS_PER_AXIS) - 1u)));
+        return SpreadBits((unsigned int)cell.x) | (SpreadBits((unsigned int)cell.y) << 1) | (SpreadBits((unsigned int)cell.z) << 2);
+    }
+};
+
+// Stable LSD radix sort of items by a 30-bit key, e.g. a Morton code: three counting passes over 10-bit digits. keyOf(item) returns the key.
+// scratch is resized as needed, so a caller sorting again and again can keep it around to avoid reallocating.
+template <typename T, typename KeyOf>
+void RadixSortByKey(std::vector<T>& items, std::vector<T>& scratch, KeyOf keyOf) {
+    const unsigned int numItems = (unsigned int)items.size();
+    if (numItems < 2) { return; }
+    scratch.resize(numItems, items[0]);
+    const unsigned int numBuckets = 1u << MORTON_RADIX_BITS;
+    std::vector<unsigned int> bucketStarts = std::vector<unsigned int>(numBuckets);
+    for (unsigned int shift = 0; shift < 3 * MORTON_BITS_PER_AXIS; shift += MORTON_RADIX_BITS) {
+        std::fill(bucketStarts.begin(), bucketStarts.end(), 0u);
+        for (unsigned int i = 0; i < numItems; ++i) {
+            ++bucketStarts[(keyOf(items[i]) >> shift) & (numBuckets - 1u)];
+        }
+        unsigned int sum = 0;
+        for (unsigned int b = 0; b < numBuckets; ++b) {
+            const unsigned int count = bucketStarts[b];
+            bucketStarts[b] = sum;
+            sum += count;
+        }
+        for (unsigned int i = 0; i < numItems; ++i) {
+            scratch[bucketStarts[(keyOf(items[i]) >> shift) & (numBuckets - 1u)]++] = items[i];
+        }
+        items.swap(scratch);
+    }
+}
@@ -0,0 +1,75 @@
+#include "Globals.h"
+#include "QuantizedAttractorPoints.h"
+#include "../Profiling/Profiler.h"
+
+#include <algorithm>
+
+void QuantizedAttractorPoints::Build(const std::vector<AttractorPoint>& sourcePoints, float desiredCellWidth) {
+    PROFILE_SCOPE("Quantize Attractor Points");
+    Clear();
+    if (sourcePoints.size() == 0) { return; }
+
+    for (unsigned int i = 0; i < (unsigned int)sourcePoints.size(); ++i) {
+        minPoint = glm::min(minPoint, sourcePoints[i].point);
+        maxPoint = glm::max(maxPoint, sourcePoints[i].point);
+    }
+    gridMin = minPoint;
+    const glm::vec3 extent = maxPoint - minPoint;
+    const float maxExtent = std::max(std::max(extent.x, extent.y), extent.z);
+    cellWidth = std::max(desiredCellWidth, maxExtent / (float)QUANTIZED_ATTRACTOR_POINTS_MAX_CELLS_PER_AXIS);
+    cellWidth = std::max(cellWidth, EPSILON); // all points in one spot
+    inverseCellWidth = 1.0f / cellWidth;
+    stepWidth = cellWidth / QUANTIZED_ATTRACTOR_POINTS_STEPS_PER_CELL;
+    resolution = glm::ivec3(glm::floor(extent * inverseCellWidth)) + glm::ivec3(1);
+    resolution = glm::min(resolution, glm::ivec3(QUANTIZED_ATTRACTOR_POINTS_MAX_CELLS_PER_AXIS));
+
+    // Counting sort by cell, as in AttractorPointGrid::Build. Points keep their order within a cell, e.g. the cloud's Morton order.
+    const unsigned int numCells = (unsigned int)(resolution.x * resolution.y * resolution.z);
+    std::vector<unsigned int> pointCells = std::vector<unsigned int>(sourcePoints.size());
+    cellStartIndices = std::vector<unsigned int>(numCells + 1, 0);
+    for (unsigned int i = 0; i < (unsigned int)sourcePoints.size(); ++i) {
+        const glm::ivec3 cellCoords = CellCoords(sourcePoints[i].point);
+        pointCells[i] = (unsigned int)CellIndex(cellCoords.x, cellCoords.y, cellCoords.z);
+        ++cellStartIndices[pointCells[i] + 1];
+    }
+    for (unsigned int c = 0; c < numCells; ++c) {
+        if (cellStartIndices[c + 1] > 0) { occupiedCells.emplace_back(c); }
+        cellStartIndices[c + 1] += cellStartIndices[c];
+    }
+    std::vector<unsigned int> cellFill = std::vector<unsigned int>(cellStartIndices.begin(), cellStartIndices.end() - 1);
+    points = std::vector<QuantizedAttractorPoint>(sourcePoints.size());
+    for (unsigned int i = 0; i < (unsigned int)sourcePoints.size(); ++i) {
+        const unsigned int c = pointCells[i];
+        const glm::ivec3 cellCoords = glm::ivec3((int)c % resolution.x, ((int)c / resolution.x) % resolution.y, (int)c / (resolution.x * resolution.y));
+        const glm::vec3 steps = glm::floor((sourcePoints[i].point - CellOrigin(cellCoords.x, cellCoords.y, cellCoords.z)) / stepWidth);
+        const glm::ivec3 q = glm::clamp(glm::ivec3(steps), glm::ivec3(0), glm::ivec3((int)QUANTIZED_ATTRACTOR_POINTS_STEPS_PER_CELL - 1)); // the last cells may be clamped
+        QuantizedAttractorPoint& quantizedPoint = points[cellFill[c]++];
+        quantizedPoint.x = (unsigned short)q.x;
+        quantizedPoint.y = (unsigned short)q.y;
+        quantizedPoint.z = (unsigned short)q.z;
+    }
+    aliveMask.Reset((unsigned int)points.size());
+}
+
+void QuantizedAttractorPoints::Clear() {
+    minPoint = glm::vec3(999999.0f);
+    maxPoint = glm::vec3(-999999.0f);
+    resolution = glm::ivec3(0);
+    cellStartIndices.clear();
+    occupiedCells.clear();
+    points.clear();
+    aliveMask.Reset(0);
+}
+
+unsigned long long QuantizedAttractorPoints::GetNumBytes() const {
+    return (unsigned long long)points.size() * sizeof(QuantizedAttractorPoint) + (unsigned long long)cellStartIndices.size() * sizeof(unsigned int) +
+           (unsigned long long)occupiedCells.size() * sizeof(unsigned int) + (unsigned long long)aliveMask.GetNumWords() * sizeof(unsigned int);
+}
+
+AttractorPoint QuantizedAttractorPoints::operator[](unsigned int i) const {
+    // The last occupied cell that starts at or before i
+    const std::vector<unsigned int>::const_iterator it = std::upper_bound(occupiedCells.begin(), occupiedCells.end(), i,
+                                                                          [&](unsigned int pointIdx, unsigned int cell) { return pointIdx < cellStartIndices[cell]; });
+    const int c = (int)*(it - 1);
+    return AttractorPoint(Decode(CellOrigin(c % resolution.x, (c / resolution.x) % resolution.y, c / (resolution.x * resolution.y)), points[i]));
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+
+#include "AttractorPointCloud.h"
+#include "AttractorPointMask.h"
+
+#define QUANTIZED_ATTRACTOR_POINTS_MAX_CELLS_PER_AXIS 256
+#define QUANTIZED_ATTRACTOR_POINTS_STEPS_PER_CELL 65536.0f // positions within a cell, per axis: one per value of a 16 bit offset
+
+// A point of a QuantizedAttractorPoints: its offset from the origin of its cell, in 1 / QUANTIZED_ATTRACTOR_POINTS_STEPS_PER_CELL of the cell
+// width per axis
+struct QuantizedAttractorPoint {
+    unsigned short x;
+    unsigned short y;
+    unsigned short z;
+};
+
+// Compact storage of an attractor point cloud, for clouds too large to keep as AttractorPoints: 6 bytes per point instead of 32, plus the
+// alive bit. The points are bucketed into a uniform grid, cell after cell, and each one only keeps its 16 bit fixed point offset from its
+// cell's origin, which is a lot finer than growth needs at any cell width. Point i of the store is the i-th point in cell order, so the store
+// is its own grid: a neighbourhood query walks the cells and decodes each point on the fly, and the point indices of neighbouring points are
+// close together. Only positions are kept, every point stands for itself (weight 1).
+// Incremental space colonization (see Tree::IterateGrowth) goes through the same point interface as for an AttractorPointComposite:
+// operator[], IsAlive(), Kill(), ForEachPointNear() and ForEachAlivePoint(). Points are never compacted away, since that would change the indices of the others;
+// queries skip the dead ones by their alive bit instead.
+class QuantizedAttractorPoints {
+private:
+    glm::vec3 gridMin;
+    glm::vec3 minPoint; // bounds of the points
+    glm::vec3 maxPoint;
+    float cellWidth;
+    float inverseCellWidth;
+    float stepWidth; // cellWidth / QUANTIZED_ATTRACTOR_POINTS_STEPS_PER_CELL
+    glm::ivec3 resolution;
+    std::vector<unsigned int> cellStartIndices; // cell c holds points [cellStartIndices[c], cellStartIndices[c + 1])
+    std::vector<unsigned int> occupiedCells; // the cells that hold any point, ascending, to find the cell of a point by its index
+    std::vector<QuantizedAttractorPoint> points;
+    AttractorPointMask aliveMask;
+
+    int CellIndex(int x, int y, int z) const { return x + resolution.x * (y + resolution.y * z); }
+    glm::ivec3 CellCoords(const glm::vec3& p) const {
+        return glm::clamp(glm::ivec3(glm::floor((p - gridMin) * inverseCellWidth)), glm::ivec3(0), resolution - glm::ivec3(1));
+    }
+    glm::vec3 CellOrigin(int x, int y, int z) const { return gridMin + glm::vec3((float)x, (float)y, (float)z) * cellWidth; }
+    // The center of the point's step, so the error is at most half a step per axis
+    glm::vec3 Decode(const glm::vec3& cellOrigin, const QuantizedAttractorPoint& q) const {
+        return cellOrigin + (glm::vec3((float)q.x, (float)q.y, (float)q.z) + glm::vec3(0.5f)) * stepWidth;
+    }
+
+public:
+    QuantizedAttractorPoints() : gridMin(glm::vec3(0.0f)), minPoint(glm::vec3(999999.0f)), maxPoint(glm::vec3(-999999.0f)), cellWidth(1.0f), inverseCellWidth(1.0f),
+        stepWidth(1.0f / QUANTIZED_ATTRACTOR_POINTS_STEPS_PER_CELL), resolution(glm::ivec3(0)) {
+        cellStartIndices = std::vector<unsigned int>();
+        occupiedCells = std::vector<unsigned int>();
+        points = std::vector<QuantizedAttractorPoint>();
+        aliveMask = AttractorPointMask();
+    }
+
+    // Encodes the given points, all alive. The cell width is a hint, as for an AttractorPointGrid: about one perception radius makes a query
+    // visit few cells. It grows if the points' bounds would need more than QUANTIZED_ATTRACTOR_POINTS_MAX_CELLS_PER_AXIS cells.
+    void Build(const std::vector<AttractorPoint>& sourcePoints, float desiredCellWidth);
+    void Clear();
+
+    unsigned int GetNumPoints() const { return (unsigned int)points.size(); }
+    unsigned int GetNumAlive() const { return aliveMask.GetNumAlive(); }
+    AttractorPointMask& GetAliveMask() { return aliveMask; }
+    const AttractorPointMask& GetAliveMaskConst() const { return aliveMask; }
+    // Bounds of the points. Returns false if there are none.
+    bool GetBounds(glm::vec3& minPt, glm::vec3& maxPt) const {
+        minPt = minPoint;
+        maxPt = maxPoint;
+        return points.size() > 0;
+    }
+    unsigned long long GetNumBytes() const; // of the points, cells and alive bits, e.g. to compare with a cloud's footprint
+
+    AttractorPoint operator[](unsigned int i) const; // decoded. Finds the point's cell by a binary search, so queries use ForEachPointNear().
+    bool IsAlive(unsigned int i) const { return aliveMask.IsAlive(i); }
+    bool Kill(unsigned int i) { return aliveMask.Kill(i); } // Returns whether the point was still alive
+
+    // Calls f(pointIndex, point) for every alive point in a cell overlapping the sphere's bounding box, decoded. Callers do their own exact
+    // distance test.
+    template <typename F>
+    void ForEachPointNear(const glm::vec3& center, const float radius, F&& f) const {
+        if (points.size() == 0) { return; }
+        const glm::ivec3 minCell = CellCoords(center - glm::vec3(radius));
+        const glm::ivec3 maxCell = CellCoords(center + glm::vec3(radius));
+        for (int z = minCell.z; z <= maxCell.z; ++z) {
+            for (int y = minCell.y; y <= maxCell.y; ++y) {
+                for (int x = minCell.x; x <= maxCell.x; ++x) {
+                    const int cell = CellIndex(x, y, z);
+                    const glm::vec3 cellOrigin = CellOrigin(x, y, z);
+                    for (unsigned int i = cellStartIndices[cell]; i < cellStartIndices[cell + 1]; ++i) {
+                        if (!aliveMask.IsAlive(i)) { continue; }
+                        f(i, AttractorPoint(Decode(cellOrigin, points[i])));
+                    }
+                }
+            }
+        }
+    }
+    // Calls f(pointIndex, point) for every alive point, decoded, in ascending order. f may kill the point it is given.
+    template <typename F>
+    void ForEachAlivePoint(F&& f) const {
+        for (unsigned int o = 0; o < (unsigned int)occupiedCells.size(); ++o) {
+            const int c = (int)occupiedCells[o];
+            const glm::vec3 cellOrigin = CellOrigin(c % resolution.x, (c / resolution.x) % resolution.y, c / (resolution.x * resolution.y));
+            for (unsigned int i = cellStartIndices[c]; i < cellStartIndices[c + 1]; ++i) {
+                if (!aliveMask.IsAlive(i)) { continue; }
+                f(i, AttractorPoint(Decode(cellOrigin, points[i])));
+            }
+        }
+    }
+};
@@ -0,0 +1,37 @@
+#include "Globals.h"
+#include "ShadowGrid.h"
+
+#include <algorithm>
+
+void ShadowGrid::Build(const glm::vec3& minPt, const glm::vec3& maxPt, float desiredVoxelWidth) {
+    Clear();
+    const glm::vec3 extent = glm::max(maxPt - minPt, glm::vec3(0.0f));
+    const float maxExtent = std::max(std::max(extent.x, extent.y), extent.z);
+    voxelWidth = std::max(desiredVoxelWidth, maxExtent / (float)SHADOW_GRID_MAX_VOXELS_PER_AXIS);
+    voxelWidth = std::max(voxelWidth, EPSILON); // an empty box
+    inverseVoxelWidth = 1.0f / voxelWidth;
+    gridMin = minPt;
+    resolution = glm::ivec3(glm::floor(extent * inverseVoxelWidth)) + glm::ivec3(1);
+    resolution = glm::min(resolution, glm::ivec3(SHADOW_GRID_MAX_VOXELS_PER_AXIS));
+    shadows.assign((size_t)resolution.x * resolution.y * resolution.z, 0.0f);
+}
+
+void ShadowGrid::CastShadow(const glm::vec3& p, const float strength, const float falloff, const int depth) {
+    if (IsEmpty()) { return; }
+    const glm::ivec3 v = VoxelCoords(p);
+    float layerShadow = strength;
+    for (int q = 1; q <= depth; ++q, layerShadow /= falloff) {
+        const int y = v.y - q;
+        if (y < 0) { break; }
+        if (y >= resolution.y) { continue; } // a bud above the grid still shades the layers that reach into it
+        const int minX = std::max(v.x - q, 0);
+        const int maxX = std::min(v.x + q, resolution.x - 1);
+        const int minZ = std::max(v.z - q, 0);
+        const int maxZ = std::min(v.z + q, resolution.z - 1);
+        for (int z = minZ; z <= maxZ; ++z) {
+            for (int x = minX; x <= maxX; ++x) {
+                shadows[VoxelIndex(glm::ivec3(x, y, z))] += layerShadow;
+            }
+        }
+    }
+}
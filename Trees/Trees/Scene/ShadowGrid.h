@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+
+#define SHADOW_GRID_MAX_VOXELS_PER_AXIS 128
+
+// Voxel grid of shadow values for the shadow propagation environment model (Palubicki et al. 2009), the cheaper alternative to attractor
+// points: memory and cost follow the number of voxels, not the density of a cloud. Every bud darkens a pyramid of voxels below it: q = 1, 2, ...
+// layers down, the (2q + 1)^2 voxels centered under the bud each get strength * falloff^(1 - q) more shadow. Unlike in the paper, a bud leaves
+// its own voxel alone, so buds that share a voxel (e.g. the first metamers of a shoot) don't shade each other. Shadow is only ever added, so
+// a voxel only ever gets darker while a tree grows, and adding buds only touches the voxels under them.
+class ShadowGrid {
+private:
+    glm::vec3 gridMin;
+    float voxelWidth;
+    float inverseVoxelWidth;
+    glm::ivec3 resolution;
+    std::vector<float> shadows;
+
+    int VoxelIndex(const glm::ivec3& v) const { return v.x + resolution.x * (v.y + resolution.y * v.z); }
+
+public:
+    ShadowGrid() : gridMin(glm::vec3(0.0f)), voxelWidth(1.0f), inverseVoxelWidth(1.0f), resolution(glm::ivec3(0)) {
+        shadows = std::vector<float>();
+    }
+
+    // Covers the box with unshadowed voxels. The voxel width is a hint; it grows if the box would need more than SHADOW_GRID_MAX_VOXELS_PER_AXIS voxels.
+    void Build(const glm::vec3& minPt, const glm::vec3& maxPt, float desiredVoxelWidth);
+    void Clear() {
+        shadows.clear();
+        resolution = glm::ivec3(0);
+    }
+    bool IsEmpty() const { return shadows.size() == 0; }
+
+    glm::ivec3 VoxelCoords(const glm::vec3& p) const { return glm::ivec3(glm::floor((p - gridMin) * inverseVoxelWidth)); }
+    bool IsInside(const glm::ivec3& v) const {
+        return v.x >= 0 && v.y >= 0 && v.z >= 0 && v.x < resolution.x && v.y < resolution.y && v.z < resolution.z;
+    }
+    glm::ivec3 ClampToGrid(const glm::ivec3& v) const { return glm::clamp(v, glm::ivec3(0), resolution - glm::ivec3(1)); }
+    glm::vec3 GetVoxelCenter(const glm::ivec3& v) const { return gridMin + (glm::vec3(v) + glm::vec3(0.5f)) * voxelWidth; }
+    float GetVoxelWidth() const { return voxelWidth; }
+    float GetShadow(const glm::ivec3& v) const { return shadows[VoxelIndex(v)]; } // v must be inside
+
+    // Adds the shadow pyramid of a bud at p, depth layers deep. The parts outside the grid are dropped.
+    void CastShadow(const glm::vec3& p, const float strength, const float falloff, const int depth);
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "glm/glm.hpp"
+
+#include "AttractorPointCloud.h"
+#include "AttractorPointGrid.h"
+#include "AttractorPointMask.h"
+
+// A cloud's points and their grid, built once and from then on only read, so that any number of trees can grow into the cloud at the same
+// time, each with nothing but its own alive mask (see GrowthEnsemble). The points are shared with the cloud, never copied. Since no grower
+// may change the grid, it is never compacted: a grower skips the points its mask says are dead, and once most of them are, it moves on to
+// a compacted copy of its own (see Tree::PerformSpaceColonizationIncremental).
+class SharedAttractorPointIndex {
+private:
+    std::shared_ptr<const std::vector<AttractorPoint>> points;
+    AttractorPointGrid grid;
+    glm::vec3 minPoint; // bounds of the points
+    glm::vec3 maxPoint;
+
+public:
+    SharedAttractorPointIndex() : minPoint(glm::vec3(999999.0f)), maxPoint(glm::vec3(-999999.0f)) {
+        points = std::make_shared<const std::vector<AttractorPoint>>();
+        grid = AttractorPointGrid();
+    }
+
+    // The cell width is a hint, see AttractorPointGrid::Build
+    void Build(const std::shared_ptr<const std::vector<AttractorPoint>>& p, const glm::vec3& minPt, const glm::vec3& maxPt, float cellWidth) {
+        points = p;
+        minPoint = minPt;
+        maxPoint = maxPt;
+        grid.Build(*points, cellWidth);
+    }
+
+    const std::vector<AttractorPoint>& GetPoints() const { return *points; }
+    unsigned int GetNumPoints() const { return (unsigned int)points->size(); }
+    const AttractorPointGrid& GetGrid() const { return grid; }
+    const glm::vec3& GetMinPoint() const { return minPoint; }
+    const glm::vec3& GetMaxPoint() const { return maxPoint; }
+};
+
+// One grower's view of a SharedAttractorPointIndex: the shared points and grid with its own alive mask, as a point source for Tree::IterateGrowth
+struct SharedAttractorPoints {
+    const SharedAttractorPointIndex& index;
+    AttractorPointMask& aliveMask;
+    SharedAttractorPoints(const SharedAttractorPointIndex& i, AttractorPointMask& m) : index(i), aliveMask(m) {}
+
+    unsigned int GetNumPoints() const { return index.GetNumPoints(); }
+    unsigned int GetNumAlive() const { return aliveMask.GetNumAlive(); }
+    bool GetBounds(glm::vec3& minPt, glm::vec3& maxPt) const {
+        minPt = index.GetMinPoint();
+        maxPt = index.GetMaxPoint();
+        return true;
+    }
+};
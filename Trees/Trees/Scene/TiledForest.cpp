@@ -0,0 +1,507 @@
+#include "TiledForest.h"
+#include "../Profiling/Profiler.h"
+#include "../Threading/Parallel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/// TileWorker Class Functions
+
+Tree* TileWorker::FindTree(int treeIdx) const {
+    const std::vector<int>::const_iterator it = std::lower_bound(treeIndices.begin(), treeIndices.end(), treeIdx);
+    return (it != treeIndices.end() && *it == treeIdx) ? trees[it - treeIndices.begin()] : nullptr;
+}
+
+bool TileWorker::IterateGrowth(const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, const TreeParameters& treeParams) {
+    PROFILE_SCOPE("Iterate Tile Growth");
+    const unsigned int numTrees = (unsigned int)trees.size();
+
+    TreeParameters forestParams = treeParams;
+    forestParams.incrementalSpaceColonization = true;
+
+    for (unsigned int t = 0; t < numTrees; ++t) {
+        trees[t]->PrepareGrowth(minAttrPt, maxAttrPt, forestParams, false);
+    }
+    nearestBuds.assign(attractorPoints.size(), NearestBud());
+    {
+        PROFILE_SCOPE("Build Attractor Point Grid");
+        attractorPointGrid.Build(attractorPoints, PERCEPTION_RADIUS * forestParams.internodeScale); // one perception radius
+    }
+
+    bool allRanksAnswered = true;
+    for (int n = 0; n < forestParams.numSpaceColonizationIterations; ++n) {
+        PROFILE_SCOPE("Tile Growth Iteration");
+
+        if (!ExchangeHaloBuds()) {
+            allRanksAnswered = false;
+            break;
+        }
+        PerformSpaceColonization(forestParams);
+        if (!ExchangePointClaims()) {
+            allRanksAnswered = false;
+            break;
+        }
+
+        {
+            PROFILE_SCOPE("Grow Trees");
+            ParallelFor(numTrees, [&](unsigned int t) {
+                Tree& tree = *trees[t];
+                tree.RetireInactiveBuds();
+                tree.ComputeBHModelBasipetalPass();
+                tree.ComputeBHModelAcropetalPass(forestParams);
+                tree.AppendNewShoots(n, forestParams);
+                tree.ResetState(forestParams, false);
+            });
+        }
+
+        bool keepGrowing = false;
+        if (!ExchangeGrowthStatus(keepGrowing)) {
+            allRanksAnswered = false;
+            break;
+        }
+        if (!keepGrowing) { break; } // No tree grew or no more attractor points to consider, in any tile
+    }
+
+    // Same as Tree::EndGrowth
+    attractorPointGrid.Clear();
+    nearestBuds = std::vector<NearestBud>();
+    for (unsigned int t = 0; t < numTrees; ++t) {
+        trees[t]->InvalidatePerceivedAttractorPoints();
+    }
+
+    PROFILE_SCOPE("Compute Branch Radii");
+    ParallelFor(numTrees, [&](unsigned int t) { trees[t]->ComputeBranchRadii(forestParams); });
+    return allRanksAnswered;
+}
+
+// 1. Every active bud goes to each tile its perception volume reaches into. The kill volume is smaller, so that covers killing too.
+bool TileWorker::ExchangeHaloBuds() {
+    PROFILE_SCOPE("Exchange Halo Buds");
+    const int numRanks = transport.GetNumRanks();
+    std::vector<std::vector<HaloBud>> outgoing = std::vector<std::vector<HaloBud>>(numRanks);
+    for (unsigned int t = 0; t < (unsigned int)trees.size(); ++t) {
+        const Tree& tree = *trees[t];
+        for (unsigned int a = 0; a < (unsigned int)tree.activeBuds.size(); ++a) {
+            const ActiveBudRef& ref = tree.activeBuds[a];
+            const int br = ref.branchIdx;
+            const int bu = (ref.budIdx == -1) ? (int)tree.GetBranchConst(br).GetNumBuds() - 1 : ref.budIdx;
+            const Bud& currentBud = tree.GetBudConst(br, bu);
+            HaloBud haloBud = HaloBud();
+            haloBud.point = currentBud.point;
+            haloBud.naturalGrowthDir = currentBud.naturalGrowthDir;
+            haloBud.internodeLength = currentBud.internodeLength;
+            haloBud.treeIdx = treeIndices[t];
+            haloBud.branchIdx = br;
+            haloBud.budIdx = bu;
+            haloBud.perceives = (currentBud.internodeLength > 0.0f && currentBud.fate == DORMANT) ? 1 : 0;
+            const float perceptionRadius = std::sqrt(PERCEPTION_RADIUS_SQUARED * currentBud.internodeLength * currentBud.internodeLength); // as in Tree::UpdatePerceivedAttractorPoints
+            layout.ForEachTileOverlapping(currentBud.point - glm::vec3(perceptionRadius), currentBud.point + glm::vec3(perceptionRadius),
+                                          [&](int tile) { outgoing[tile].push_back(haloBud); });
+        }
+    }
+
+    for (int r = 0; r < numRanks; ++r) {
+        message.clear();
+        WriteRecords(message, outgoing[r]);
+        transport.Send(r, message);
+    }
+    haloBuds.clear();
+    haloBudRanks.clear();
+    for (int r = 0; r < numRanks; ++r) {
+        size_t offset = 0;
+        if (!transport.Receive(r, message) || !ReadRecords(message, offset, haloBuds)) { return false; }
+        haloBudRanks.resize(haloBuds.size(), r);
+    }
+    PROFILE_COUNTER("Halo Buds", haloBuds.size());
+    return true;
+}
+
+// 2. The steps of Tree::PerformSpaceColonizationIncremental over this tile's points, for the buds of every tree at once
+void TileWorker::PerformSpaceColonization(const TreeParameters& forestParams) {
+    PROFILE_SCOPE("Space Colonization");
+    const unsigned int numHaloBuds = (unsigned int)haloBuds.size();
+    perceivedPoints.clear();
+    perceivedStarts.assign(numHaloBuds + 1, 0);
+    if (aliveMask.GetNumAlive() == 0) { return; }
+    attractorPointGrid.CompactIfFragmented(aliveMask);
+
+    // Kill the points too close to any bud. The tile keeps no record of which buds moved since the last iteration, so every bud kills again,
+    // which only finds something to kill around the ones that did.
+    PROFILE_LOCAL_COUNTER(numPointsKilled);
+    for (unsigned int b = 0; b < numHaloBuds; ++b) {
+        const HaloBud& haloBud = haloBuds[b];
+        const float killDist2 = KILL_RADIUS_SQUARED * haloBud.internodeLength * haloBud.internodeLength; // the same test as Tree's kill passes
+        attractorPointGrid.ForEachPointNear(haloBud.point, std::sqrt(killDist2), [&](unsigned int ap) {
+            if (glm::length2(attractorPoints[ap].point - haloBud.point) < killDist2 && aliveMask.Kill(ap)) {
+                PROFILE_INCREMENT(numPointsKilled, 1);
+            }
+        });
+    }
+    PROFILE_COUNTER("Points Killed", numPointsKilled);
+
+    // Perception sets, as in Tree::UpdatePerceivedAttractorPoints
+    const float perceptionCosTheta = std::abs(forestParams.perceptionCosThetaSmall);
+    for (unsigned int b = 0; b < numHaloBuds; ++b) {
+        const HaloBud& haloBud = haloBuds[b];
+        if (haloBud.perceives) {
+            const float perceptionDist2 = PERCEPTION_RADIUS_SQUARED * haloBud.internodeLength * haloBud.internodeLength; // ~4x internode length - use distance squared
+            attractorPointGrid.ForEachPointNear(haloBud.point, std::sqrt(perceptionDist2), [&](unsigned int ap) {
+                if (!aliveMask.IsAlive(ap)) { return; }
+                glm::vec3 budToPtDir = attractorPoints[ap].point - haloBud.point;
+                const float budToPtDist2 = glm::length2(budToPtDir);
+                budToPtDir = glm::normalize(budToPtDir);
+                const float dotProd = glm::dot(budToPtDir, haloBud.naturalGrowthDir);
+                if (budToPtDist2 < perceptionDist2 && dotProd > perceptionCosTheta) {
+                    perceivedPoints.emplace_back(ap, budToPtDist2);
+                }
+            });
+        }
+        perceivedStarts[b + 1] = (unsigned int)perceivedPoints.size();
+    }
+
+    // Every perceived point goes to its nearest bud
+    for (unsigned int i = 0; i < (unsigned int)perceivedPoints.size(); ++i) {
+        nearestBuds[perceivedPoints[i].pointIdx] = NearestBud();
+    }
+    for (unsigned int b = 0; b < numHaloBuds; ++b) {
+        const HaloBud& haloBud = haloBuds[b];
+        for (unsigned int i = perceivedStarts[b]; i < perceivedStarts[b + 1]; ++i) {
+            NearestBud& nearestBud = nearestBuds[perceivedPoints[i].pointIdx];
+            if (IsNearerBud(nearestBud, perceivedPoints[i].dist2, haloBud.treeIdx, haloBud.branchIdx, haloBud.budIdx)) {
+                SetNearestBud(nearestBud, perceivedPoints[i].dist2, haloBud.treeIdx, haloBud.branchIdx, haloBud.budIdx);
+            }
+        }
+    }
+}
+
+// 3. Perception counts and claimed points go back to the buds' workers, which turn them into growth directions
+bool TileWorker::ExchangePointClaims() {
+    PROFILE_SCOPE("Exchange Point Claims");
+    const int numRanks = transport.GetNumRanks();
+    std::vector<std::vector<HaloBudPerception>> outgoingPerceptions = std::vector<std::vector<HaloBudPerception>>(numRanks);
+    std::vector<std::vector<PointClaim>> outgoingClaims = std::vector<std::vector<PointClaim>>(numRanks);
+    for (unsigned int b = 0; b < (unsigned int)haloBuds.size(); ++b) {
+        if (perceivedStarts[b] == perceivedStarts[b + 1]) { continue; }
+        const HaloBud& haloBud = haloBuds[b];
+        const int rank = haloBudRanks[b];
+        HaloBudPerception perception = HaloBudPerception();
+        perception.treeIdx = haloBud.treeIdx;
+        perception.branchIdx = haloBud.branchIdx;
+        perception.budIdx = haloBud.budIdx;
+        perception.numPerceived = (int)(perceivedStarts[b + 1] - perceivedStarts[b]);
+        outgoingPerceptions[rank].push_back(perception);
+        for (unsigned int i = perceivedStarts[b]; i < perceivedStarts[b + 1]; ++i) {
+            const unsigned int ap = perceivedPoints[i].pointIdx;
+            const NearestBud& nearestBud = nearestBuds[ap];
+            if (nearestBud.treeIdx == haloBud.treeIdx && nearestBud.branchIdx == haloBud.branchIdx && nearestBud.budIdx == haloBud.budIdx) {
+                PointClaim claim = PointClaim();
+                claim.point = attractorPoints[ap].point;
+                claim.pointIdx = pointIndices[ap];
+                claim.treeIdx = haloBud.treeIdx;
+                claim.branchIdx = haloBud.branchIdx;
+                claim.budIdx = haloBud.budIdx;
+                outgoingClaims[rank].push_back(claim);
+            }
+        }
+    }
+
+    for (int r = 0; r < numRanks; ++r) {
+        message.clear();
+        WriteRecords(message, outgoingPerceptions[r]);
+        WriteRecords(message, outgoingClaims[r]);
+        transport.Send(r, message);
+    }
+    perceptions.clear();
+    pointClaims.clear();
+    for (int r = 0; r < numRanks; ++r) {
+        size_t offset = 0;
+        if (!transport.Receive(r, message) || !ReadRecords(message, offset, perceptions) || !ReadRecords(message, offset, pointClaims)) { return false; }
+    }
+
+    // A bud's points may come from several tiles, so they are summed in ascending order of their index in the whole cloud, the order a
+    // Forest sums them in
+    for (unsigned int p = 0; p < (unsigned int)perceptions.size(); ++p) {
+        const HaloBudPerception& perception = perceptions[p];
+        FindTree(perception.treeIdx)->GetBud(perception.branchIdx, perception.budIdx).numPerceivedAttrPts += perception.numPerceived;
+    }
+    std::sort(pointClaims.begin(), pointClaims.end(), [](const PointClaim& a, const PointClaim& b) {
+        if (a.treeIdx != b.treeIdx) { return a.treeIdx < b.treeIdx; }
+        if (a.branchIdx != b.branchIdx) { return a.branchIdx < b.branchIdx; }
+        if (a.budIdx != b.budIdx) { return a.budIdx < b.budIdx; }
+        return a.pointIdx < b.pointIdx;
+    });
+    for (unsigned int i = 0; i < (unsigned int)pointClaims.size();) {
+        const PointClaim& first = pointClaims[i];
+        Bud& currentBud = FindTree(first.treeIdx)->GetBud(first.branchIdx, first.budIdx);
+        for (; i < (unsigned int)pointClaims.size() && pointClaims[i].treeIdx == first.treeIdx && pointClaims[i].branchIdx == first.branchIdx &&
+               pointClaims[i].budIdx == first.budIdx; ++i) {
+            ++currentBud.numNearbyAttrPts;
+            currentBud.optimalGrowthDir += glm::normalize(pointClaims[i].point - currentBud.point);
+            currentBud.environmentQuality = 1.0f;
+        }
+        currentBud.optimalGrowthDir = glm::normalize(currentBud.optimalGrowthDir);
+    }
+    PROFILE_COUNTER("Point Claims", pointClaims.size());
+    return true;
+}
+
+bool TileWorker::ExchangeGrowthStatus(bool& keepGrowing) {
+    const int numRanks = transport.GetNumRanks();
+    TileGrowthStatus status = TileGrowthStatus();
+    for (unsigned int t = 0; t < (unsigned int)trees.size(); ++t) {
+        status.didUpdate = status.didUpdate || trees[t]->DidUpdate();
+    }
+    status.numAlive = aliveMask.GetNumAlive();
+    const std::vector<TileGrowthStatus> outgoing = std::vector<TileGrowthStatus>(1, status);
+    for (int r = 0; r < numRanks; ++r) {
+        message.clear();
+        WriteRecords(message, outgoing);
+        transport.Send(r, message);
+    }
+
+    bool didUpdate = false;
+    unsigned long long numAlive = 0;
+    std::vector<TileGrowthStatus> incoming = std::vector<TileGrowthStatus>();
+    for (int r = 0; r < numRanks; ++r) {
+        size_t offset = 0;
+        incoming.clear();
+        if (!transport.Receive(r, message) || !ReadRecords(message, offset, incoming) || incoming.size() != 1) { return false; }
+        didUpdate = didUpdate || incoming[0].didUpdate;
+        numAlive += incoming[0].numAlive;
+    }
+    keepGrowing = didUpdate && numAlive > 0;
+    return true;
+}
+
+/// TiledForest Class Functions
+
+void TiledForest::PartitionTiles(const TileLayout& layout, const std::vector<AttractorPoint>& attractorPoints, const AttractorPointMask& aliveMask, std::vector<TileShare>& shares) {
+    PROFILE_SCOPE("Partition Tiles");
+    const int numRanks = layout.GetNumTiles();
+    shares = std::vector<TileShare>(numRanks);
+    std::vector<unsigned int> aliveIndices = std::vector<unsigned int>();
+    aliveMask.GetAliveIndices(aliveIndices);
+    for (unsigned int i = 0; i < (unsigned int)aliveIndices.size(); ++i) {
+        TileShare& share = shares[layout.GetTileIndex(attractorPoints[aliveIndices[i]].point)];
+        share.points.push_back(attractorPoints[aliveIndices[i]]);
+        share.pointIndices.push_back(aliveIndices[i]);
+    }
+    for (unsigned int t = 0; t < (unsigned int)trees.size(); ++t) {
+        TileShare& share = shares[layout.GetTileIndex(trees[t].GetBudConst(0, 0).point)];
+        share.trees.push_back(&trees[t]);
+        share.treeIndices.push_back((int)t);
+    }
+    for (int r = 0; r < numRanks; ++r) {
+        shares[r].mask.Reset((unsigned int)shares[r].points.size());
+    }
+}
+
+void TiledForest::KillConsumedPoints(const std::vector<TileShare>& shares, AttractorPointMask& aliveMask) {
+    for (unsigned int r = 0; r < (unsigned int)shares.size(); ++r) {
+        const TileShare& share = shares[r];
+        for (unsigned int i = 0; i < (unsigned int)share.points.size(); ++i) {
+            if (!share.mask.IsAlive(i)) { aliveMask.Kill(share.pointIndices[i]); }
+        }
+    }
+}
+
+void TiledForest::IterateGrowth(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, const TreeParameters& treeParams) {
+    PROFILE_SCOPE("Iterate Tiled Forest Growth");
+    const TileLayout layout = TileLayout(minAttrPt, maxAttrPt, numTiles);
+    const int numRanks = layout.GetNumTiles();
+    std::vector<TileShare> shares = std::vector<TileShare>();
+    PartitionTiles(layout, attractorPoints, aliveMask, shares);
+
+    // Each worker stands in for a process with a machine of its own, so its trees run their parallel passes serially on the worker's thread
+    LoopbackTransportHub hub(numRanks);
+    std::vector<std::thread> threads = std::vector<std::thread>();
+    for (int r = 0; r < numRanks; ++r) {
+        threads.emplace_back([&, r]() {
+            IsInsideParallelFor() = true;
+            LoopbackTransport transport = LoopbackTransport(hub, r);
+            TileShare& share = shares[r];
+            TileWorker worker = TileWorker(transport, layout, share.trees, share.treeIndices, share.points, share.pointIndices, share.mask);
+            worker.IterateGrowth(minAttrPt, maxAttrPt, treeParams); // a loopback rank never stops answering
+        });
+    }
+    for (unsigned int t = 0; t < (unsigned int)threads.size(); ++t) {
+        threads[t].join();
+    }
+
+    KillConsumedPoints(shares, aliveMask);
+}
+
+#ifndef _WIN32
+static void CloseAll(std::vector<int>& fds) {
+    for (unsigned int i = 0; i < (unsigned int)fds.size(); ++i) {
+        if (fds[i] != -1) { close(fds[i]); }
+        fds[i] = -1;
+    }
+}
+
+static bool WriteAll(int fd, const std::vector<unsigned char>& data) {
+    size_t numWritten = 0;
+    while (numWritten < data.size()) {
+        const ssize_t n = write(fd, data.data() + numWritten, data.size() - numWritten);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { return false; }
+        numWritten += (size_t)n;
+    }
+    return true;
+}
+
+// Reads until the other end is closed
+static bool ReadAll(int fd, std::vector<unsigned char>& data) {
+    unsigned char buffer[65536];
+    for (;;) {
+        const ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n < 0) { return false; }
+        if (n == 0) { return true; }
+        data.insert(data.end(), buffer, buffer + n);
+    }
+}
+#endif
+
+bool TiledForest::IterateGrowthInProcesses(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt,
+                                           const TreeParameters& treeParams) {
+#ifdef _WIN32
+    std::cerr << "Tile processes need fork(), which Windows doesn't have. Use TiledForest::IterateGrowth instead." << std::endl;
+    return false;
+#else
+    PROFILE_SCOPE("Iterate Tiled Forest Growth In Processes");
+    const TileLayout layout = TileLayout(minAttrPt, maxAttrPt, numTiles);
+    const int numRanks = layout.GetNumTiles();
+    std::vector<TileShare> shares = std::vector<TileShare>();
+    PartitionTiles(layout, attractorPoints, aliveMask, shares);
+
+    // rankSockets[r * numRanks + q] is rank r's end of the socket pair between ranks r and q. Rank r writes its result to resultPipes[2 * r + 1].
+    std::vector<int> rankSockets = std::vector<int>(numRanks * numRanks, -1);
+    std::vector<int> resultPipes = std::vector<int>(2 * numRanks, -1);
+    bool opened = true;
+    for (int r = 0; r < numRanks && opened; ++r) {
+        for (int q = r + 1; q < numRanks && opened; ++q) {
+            int ends[2] = { -1, -1 };
+            opened = socketpair(AF_UNIX, SOCK_STREAM, 0, ends) == 0;
+            rankSockets[r * numRanks + q] = ends[0];
+            rankSockets[q * numRanks + r] = ends[1];
+        }
+        opened = opened && pipe(&resultPipes[2 * r]) == 0;
+    }
+    if (!opened) {
+        std::cerr << "Could not connect " << numRanks << " tile processes: " << std::strerror(errno) << std::endl;
+        CloseAll(rankSockets);
+        CloseAll(resultPipes);
+        return false;
+    }
+
+    std::cout.flush(); // or the children would inherit whatever is buffered
+    std::vector<pid_t> children = std::vector<pid_t>();
+    for (int r = 0; r < numRanks; ++r) {
+        const pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "Could not start tile process " << r << ": " << std::strerror(errno) << std::endl;
+            break; // the children started so far see the missing rank hang up and fail
+        }
+        if (pid > 0) {
+            children.push_back(pid);
+            continue;
+        }
+
+        // The child keeps its own ends only, so that it sees every other rank hang up when that one exits. The other threads of the parent,
+        // those of the shared pool included, weren't forked along: the worker runs its trees' parallel passes on this thread. It leaves
+        // through _exit(), which doesn't run the static destructors of the parent's state, e.g. the pool's.
+        std::vector<int> sockets = std::vector<int>(numRanks, -1);
+        for (int q = 0; q < numRanks; ++q) {
+            std::swap(sockets[q], rankSockets[r * numRanks + q]);
+        }
+        const int resultPipe = resultPipes[2 * r + 1];
+        resultPipes[2 * r + 1] = -1;
+        CloseAll(rankSockets);
+        CloseAll(resultPipes);
+
+        IsInsideParallelFor() = true;
+        SocketTransport transport(r, sockets);
+        TileShare& share = shares[r];
+        TileWorker worker = TileWorker(transport, layout, share.trees, share.treeIndices, share.points, share.pointIndices, share.mask);
+        bool succeeded = worker.IterateGrowth(minAttrPt, maxAttrPt, treeParams) && transport.Flush();
+        if (succeeded) {
+            std::vector<unsigned char> result = std::vector<unsigned char>();
+            for (unsigned int t = 0; t < (unsigned int)share.trees.size(); ++t) {
+                share.trees[t]->WriteGrowthState(result);
+            }
+            std::vector<unsigned int> consumedPoints = std::vector<unsigned int>(); // indices into share.points
+            for (unsigned int i = 0; i < (unsigned int)share.points.size(); ++i) {
+                if (!share.mask.IsAlive(i)) { consumedPoints.push_back(i); }
+            }
+            WriteRecords(result, consumedPoints);
+            succeeded = WriteAll(resultPipe, result);
+        }
+        close(resultPipe);
+        _exit(succeeded ? 0 : 1);
+    }
+
+    // Only the children use the sockets. Each result is read to the end before the next, which is fine: a child only writes its result
+    // once it is done with the other ranks.
+    CloseAll(rankSockets);
+    for (int r = 0; r < numRanks; ++r) {
+        close(resultPipes[2 * r + 1]);
+        resultPipes[2 * r + 1] = -1;
+    }
+    std::vector<std::vector<unsigned char>> results = std::vector<std::vector<unsigned char>>(numRanks);
+    bool succeeded = (int)children.size() == numRanks;
+    for (int r = 0; r < (int)children.size(); ++r) {
+        succeeded = ReadAll(resultPipes[2 * r], results[r]) && succeeded;
+    }
+    CloseAll(resultPipes);
+    for (int r = 0; r < (int)children.size(); ++r) {
+        int status = 0;
+        while (waitpid(children[r], &status, 0) < 0 && errno == EINTR) {}
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            std::cerr << "Tile process " << r << " failed" << std::endl;
+            succeeded = false;
+        }
+    }
+    if (!succeeded) { return false; }
+
+    // A result that doesn't parse puts back the trees taken over so far, so that a bad one leaves everything as it was
+    std::vector<TreeGrowthSnapshot> snapshots = std::vector<TreeGrowthSnapshot>();
+    for (unsigned int t = 0; t < (unsigned int)trees.size(); ++t) {
+        snapshots.emplace_back(trees[t].TakeSnapshot());
+    }
+    std::vector<std::vector<unsigned int>> consumedPoints = std::vector<std::vector<unsigned int>>(numRanks); // indices into shares[r].points
+    for (int r = 0; r < numRanks && succeeded; ++r) {
+        size_t offset = 0;
+        for (unsigned int t = 0; t < (unsigned int)shares[r].trees.size() && succeeded; ++t) {
+            succeeded = shares[r].trees[t]->ReadGrowthState(results[r], offset);
+        }
+        succeeded = succeeded && ReadRecords(results[r], offset, consumedPoints[r]) && offset == results[r].size();
+        for (unsigned int i = 0; i < (unsigned int)consumedPoints[r].size() && succeeded; ++i) {
+            succeeded = consumedPoints[r][i] < (unsigned int)shares[r].points.size();
+        }
+    }
+    if (!succeeded) {
+        std::cerr << "A tile process sent back a result that doesn't parse" << std::endl;
+        for (unsigned int t = 0; t < (unsigned int)trees.size(); ++t) {
+            trees[t].RestoreSnapshot(snapshots[t]);
+        }
+        return false;
+    }
+    for (int r = 0; r < numRanks; ++r) {
+        for (unsigned int i = 0; i < (unsigned int)consumedPoints[r].size(); ++i) {
+            shares[r].mask.Kill(consumedPoints[r][i]);
+        }
+    }
+    KillConsumedPoints(shares, aliveMask);
+    return true;
+#endif
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "Tree.h"
+#include "../Threading/TileTransport.h"
+
+#include <vector>
+
+// The scene box cut into numTiles.x * numTiles.y * numTiles.z equal tiles, numbered x fastest. Positions outside the box belong to the
+// nearest tile, so every position has exactly one.
+struct TileLayout {
+    glm::vec3 minPoint;
+    glm::vec3 maxPoint;
+    glm::ivec3 numTiles;
+    TileLayout() : minPoint(glm::vec3(0.0f)), maxPoint(glm::vec3(0.0f)), numTiles(glm::ivec3(1)) {}
+    TileLayout(const glm::vec3& minPt, const glm::vec3& maxPt, const glm::ivec3& n) : minPoint(minPt), maxPoint(maxPt), numTiles(glm::max(n, glm::ivec3(1))) {}
+
+    int GetNumTiles() const { return numTiles.x * numTiles.y * numTiles.z; }
+    glm::ivec3 TileCoords(const glm::vec3& p) const {
+        const glm::vec3 tileSize = glm::max(maxPoint - minPoint, glm::vec3(1e-6f)) / glm::vec3(numTiles);
+        return glm::clamp(glm::ivec3(glm::floor((p - minPoint) / tileSize)), glm::ivec3(0), numTiles - glm::ivec3(1));
+    }
+    int GetTileIndex(const glm::vec3& p) const {
+        const glm::ivec3 c = TileCoords(p);
+        return c.x + numTiles.x * (c.y + numTiles.y * c.z);
+    }
+    // Calls f(tile) for every tile the box reaches into
+    template <typename F>
+    void ForEachTileOverlapping(const glm::vec3& minPt, const glm::vec3& maxPt, F&& f) const {
+        const glm::ivec3 minTile = TileCoords(minPt);
+        const glm::ivec3 maxTile = TileCoords(maxPt);
+        for (int z = minTile.z; z <= maxTile.z; ++z) {
+            for (int y = minTile.y; y <= maxTile.y; ++y) {
+                for (int x = minTile.x; x <= maxTile.x; ++x) {
+                    f(x + numTiles.x * (y + numTiles.y * z));
+                }
+            }
+        }
+    }
+};
+
+// What the workers of a tiled growth send each other, as raw bytes, so all of them have to run on the same kind of machine.
+// Buds are named by (tree, branch, bud), with the tree's index in the whole forest and the bud's actual index, never -1.
+
+// An active bud whose perception volume reaches into another worker's tile, sent to that worker
+struct HaloBud {
+    glm::vec3 point;
+    glm::vec3 naturalGrowthDir;
+    float internodeLength;
+    int treeIdx;
+    int branchIdx;
+    int budIdx;
+    int perceives; // whether the bud takes part in the nearest-bud competition, see Tree::UpdatePerceivedAttractorPoints. Every active bud kills.
+};
+
+// How many points of the sender's tile a halo bud perceives, sent back to the bud's worker
+struct HaloBudPerception {
+    int treeIdx;
+    int branchIdx;
+    int budIdx;
+    int numPerceived;
+};
+
+// A point of the sender's tile whose nearest bud is the given halo bud, sent back to the bud's worker
+struct PointClaim {
+    glm::vec3 point;
+    unsigned int pointIdx; // in the whole cloud
+    int treeIdx;
+    int branchIdx;
+    int budIdx;
+};
+
+// Sent to every worker at the end of each iteration
+struct TileGrowthStatus {
+    int didUpdate; // whether any of the sender's trees grew
+    unsigned int numAlive; // points left in the sender's tile
+};
+
+// One rank of a tiled growth, e.g. one process of a distributed one. A worker owns the points inside its tile and the trees rooted in it,
+// wherever they grow. Every iteration runs the phases of Forest::IterateGrowth in three rounds of messages:
+//   1. Every worker sends each active bud of its trees to every worker whose tile the bud's perception volume reaches into, itself included.
+//   2. Every worker kills and hands out its own points among the buds it received, with the same nearest-bud rule (and tie break) as the
+//      other growth paths, and sends each bud's perception count and claimed points back to the bud's worker. Since a point only ever
+//      competes in its own tile, but every bud that can reach it is there, nearest-bud semantics hold across tile borders.
+//   3. Every worker sums the claims into growth directions, in ascending point order like Tree::AccumulateOptimalGrowthDirs, grows its
+//      trees, and tells everyone else whether they grew and how many of its points are left, so that all workers stop after the same iteration.
+// The trees come out exactly as a Forest of all of them would grow them in the whole cloud.
+class TileWorker {
+private:
+    TileTransport& transport;
+    TileLayout layout; // one tile per rank
+    std::vector<Tree*> trees;
+    std::vector<int> treeIndices; // in the whole forest, ascending
+    const std::vector<AttractorPoint>& attractorPoints; // the points inside this worker's tile
+    const std::vector<unsigned int>& pointIndices; // their indices in the whole cloud, ascending
+    AttractorPointMask& aliveMask; // of attractorPoints
+    AttractorPointGrid attractorPointGrid;
+    std::vector<NearestBud> nearestBuds;
+    // Per-iteration scratch: the buds received in round 1 and the rank each came from, their perceived points (bud b's are
+    // [perceivedStarts[b], perceivedStarts[b + 1]) of perceivedPoints), and the messages being read or written
+    std::vector<HaloBud> haloBuds;
+    std::vector<int> haloBudRanks;
+    std::vector<PerceivedAttractorPoint> perceivedPoints;
+    std::vector<unsigned int> perceivedStarts;
+    std::vector<PointClaim> pointClaims;
+    std::vector<HaloBudPerception> perceptions;
+    std::vector<unsigned char> message;
+
+    Tree* FindTree(int treeIdx) const; // null if the tree isn't this worker's
+    // The rounds of messages of one iteration. Each returns false if some rank stopped answering, or sent something that doesn't parse.
+    bool ExchangeHaloBuds();
+    void PerformSpaceColonization(const TreeParameters& forestParams); // over the points of this tile, for the received buds
+    bool ExchangePointClaims();
+    bool ExchangeGrowthStatus(bool& keepGrowing); // keepGrowing: whether any tree grew and any point is left, in any tile
+
+public:
+    // The trees and points stay with the caller. aliveMask is updated in place.
+    TileWorker(TileTransport& t, const TileLayout& l, const std::vector<Tree*>& tr, const std::vector<int>& trIndices, const std::vector<AttractorPoint>& points,
+               const std::vector<unsigned int>& ptIndices, AttractorPointMask& mask) :
+        transport(t), layout(l), trees(tr), treeIndices(trIndices), attractorPoints(points), pointIndices(ptIndices), aliveMask(mask) {
+        attractorPointGrid = AttractorPointGrid();
+        nearestBuds = std::vector<NearestBud>();
+        haloBuds = std::vector<HaloBud>();
+        haloBudRanks = std::vector<int>();
+        perceivedPoints = std::vector<PerceivedAttractorPoint>();
+        perceivedStarts = std::vector<unsigned int>();
+        pointClaims = std::vector<PointClaim>();
+        perceptions = std::vector<HaloBudPerception>();
+        message = std::vector<unsigned char>();
+    }
+
+    // Same as Forest::IterateGrowth for this worker's share of the forest. Every rank has to call it with the same bounds (those of the whole
+    // cloud) and parameters, since the ranks wait on each other every iteration. Returns false if some rank stopped answering, e.g. because
+    // its process died: then the trees are grown as far as this rank got.
+    bool IterateGrowth(const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, const TreeParameters& treeParams);
+};
+
+// Forest::IterateGrowth, split into numTiles tiles that grow on TileWorkers of their own: one thread per tile over a loopback transport, or
+// one process per tile over sockets. Both grow the same trees as a Forest, which the benchmark checks.
+class TiledForest {
+private:
+    std::vector<Tree>& trees;
+    glm::ivec3 numTiles;
+
+    // What the worker of one tile gets: every alive point inside the tile and every tree rooted in it, both in ascending order
+    struct TileShare {
+        std::vector<AttractorPoint> points;
+        std::vector<unsigned int> pointIndices; // in the whole cloud
+        AttractorPointMask mask; // of points
+        std::vector<Tree*> trees;
+        std::vector<int> treeIndices;
+    };
+    void PartitionTiles(const TileLayout& layout, const std::vector<AttractorPoint>& attractorPoints, const AttractorPointMask& aliveMask, std::vector<TileShare>& shares);
+    static void KillConsumedPoints(const std::vector<TileShare>& shares, AttractorPointMask& aliveMask); // the points that died in any tile
+
+public:
+    TiledForest(std::vector<Tree>& t, const glm::ivec3& n) : trees(t), numTiles(n) {}
+
+    void IterateGrowth(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, const TreeParameters& treeParams);
+    // The same with every tile forked off into a child process, connected to the others by a socket pair each. The children send their grown
+    // trees and consumed points back through a pipe and exit. Returns false, with the trees' growth and aliveMask left as they were, if a
+    // child could not be started or failed; always on Windows, which has no fork().
+    bool IterateGrowthInProcesses(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt,
+                                  const TreeParameters& treeParams);
+};
@@ -1,282 +1,1163 @@
 #include "Tree.h"
+#include "AttractorBrickStore.h"
+#include "../Profiling/Profiler.h"
+#include "../Threading/Parallel.h"
+#include "../Threading/TileTransport.h"
 #include "glm/gtc/matrix_transform.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
 
-/// TreeBranch Class Functions
+/// TreeParameters Functions
 
-void TreeBranch::AddAxillaryBuds(const Bud& sourceBud, const int numBuds, const float internodeLength) {
-    // Create a temporary list of Buds that will be inserted in this branch's list of buds
-    std::vector<Bud> newBuds = std::vector<Bud>();
+// The stage each parameter feeds into. Parameters that only steer the app, e.g. the brush radius, feed into no stage.
+struct TreeParameterField {
+    size_t offset;
+    size_t size;
+    TREE_STAGE stage;
+};
+#define TREE_PARAMETER_FIELD(field, stage) { offsetof(TreeParameters, field), sizeof(TreeParameters::field), stage }
+static const TreeParameterField treeParameterFields[] = {
+    TREE_PARAMETER_FIELD(internodeScale, STAGE_TOPOLOGY),
+    TREE_PARAMETER_FIELD(perceptionCosTheta, STAGE_TOPOLOGY),
+    TREE_PARAMETER_FIELD(perceptionCosThetaSmall, STAGE_TOPOLOGY),
+    TREE_PARAMETER_FIELD(BHAlpha, STAGE_TOPOLOGY),
+    TREE_PARAMETER_FIELD(BHLambda, STAGE_TOPOLOGY),
+    TREE_PARAMETER_FIELD(optimalGrowthDirWeight, STAGE_TOPOLOGY),
+    TREE_PARAMETER_FIELD(tropismDirWeight, STAGE_TOPOLOGY),
+    TREE_PARAMETER_FIELD(tropismVector, STAGE_TOPOLOGY),
+    TREE_PARAMETER_FIELD(numSpaceColonizationIterations, STAGE_TOPOLOGY),
+    TREE_PARAMETER_FIELD(minimumBranchRadius, STAGE_RADII),
+    TREE_PARAMETER_FIELD(pipeModelExponent, STAGE_RADII),
+    TREE_PARAMETER_FIELD(maximumBranchRadius, STAGE_RADII),
+    TREE_PARAMETER_FIELD(brushRadius, STAGE_NONE),
+    TREE_PARAMETER_FIELD(numAttractorPointsToGenerate, STAGE_NONE),
+    TREE_PARAMETER_FIELD(reconstructUniformGridOnGPU, STAGE_NONE),
+    TREE_PARAMETER_FIELD(attractorPointsRevision, STAGE_NONE),
+    TREE_PARAMETER_FIELD(incrementalSpaceColonization, STAGE_NONE), // both modes grow the same tree
+    TREE_PARAMETER_FIELD(environmentModel, STAGE_TOPOLOGY),
+    TREE_PARAMETER_FIELD(shadowStrength, STAGE_TOPOLOGY),
+    TREE_PARAMETER_FIELD(shadowFalloff, STAGE_TOPOLOGY),
+    TREE_PARAMETER_FIELD(shadowPyramidDepth, STAGE_TOPOLOGY),
+    TREE_PARAMETER_FIELD(numResolutionLevels, STAGE_TOPOLOGY),
+    TREE_PARAMETER_FIELD(iterationsPerResolutionLevel, STAGE_TOPOLOGY),
+};
+#undef TREE_PARAMETER_FIELD
+static const int NUM_TREE_PARAMETER_FIELDS = (int)(sizeof(treeParameterFields) / sizeof(treeParameterFields[0]));
 
-    // Direction in which growth occurs
-    const glm::vec3 newShootGrowthDir = glm::normalize(sourceBud.naturalGrowthDir + OPTIMAL_GROWTH_DIR_WEIGHT * sourceBud.optimalGrowthDir + TROPISM_DIR_WEIGHT * TROPISM_VECTOR);
+unsigned int TreeParameters::GetChangedStages(const TreeParameters& other) const {
+    unsigned int changedStages = 0;
+    for (int f = 0; f < NUM_TREE_PARAMETER_FIELDS; ++f) {
+        const TreeParameterField& field = treeParameterFields[f];
+        if (field.stage != STAGE_NONE && std::memcmp((const char*)this + field.offset, (const char*)&other + field.offset, field.size) != 0) {
+            changedStages |= 1u << field.stage;
+        }
+    }
+    return changedStages;
+}
+
+void TreeParameters::CopyStageFields(TREE_STAGE stage, const TreeParameters& other) {
+    for (int f = 0; f < NUM_TREE_PARAMETER_FIELDS; ++f) {
+        const TreeParameterField& field = treeParameterFields[f];
+        if (field.stage == stage) {
+            std::memcpy((char*)this + field.offset, (const char*)&other + field.offset, field.size);
+        }
+    }
+}
+
+/// BudArena Class Functions
+
+void BudArena::Clear() {
+    slots.clear();
+    for (int c = 0; c < NUM_BUD_SPAN_CLASSES; ++c) {
+        freeSpans[c].clear();
+    }
+}
+
+unsigned int BudArena::AllocateSpan(unsigned int minSize, unsigned int& size) {
+    int sizeClass = MIN_BUD_SPAN_CLASS;
+    while ((1u << sizeClass) < minSize) { ++sizeClass; }
+    size = 1u << sizeClass;
+    if (!freeSpans[sizeClass].empty()) {
+        const unsigned int first = freeSpans[sizeClass].back();
+        freeSpans[sizeClass].pop_back();
+        return first;
+    }
+    const unsigned int first = slots.size();
+    for (unsigned int i = 0; i < size; ++i) {
+        slots.emplace_back();
+    }
+    return first;
+}
+
+void BudArena::FreeSpan(unsigned int first, unsigned int size) {
+    int sizeClass = 0;
+    while ((1u << sizeClass) < size) { ++sizeClass; }
+    freeSpans[sizeClass].push_back(first);
+}
+
+void BudArena::Write(std::vector<unsigned char>& message) const {
+    std::vector<Bud> slotsCopy = std::vector<Bud>();
+    slotsCopy.reserve(slots.size());
+    for (unsigned int i = 0; i < slots.size(); ++i) {
+        slotsCopy.push_back(slots[i]);
+    }
+    WriteRecords(message, slotsCopy);
+    for (int c = 0; c < NUM_BUD_SPAN_CLASSES; ++c) {
+        WriteRecords(message, freeSpans[c]);
+    }
+}
+
+bool BudArena::Read(const std::vector<unsigned char>& message, size_t& offset) {
+    std::vector<Bud> slotsCopy = std::vector<Bud>();
+    BudArena arena = BudArena();
+    if (!ReadRecords(message, offset, slotsCopy)) { return false; }
+    for (int c = 0; c < NUM_BUD_SPAN_CLASSES; ++c) {
+        if (!ReadRecords(message, offset, arena.freeSpans[c])) { return false; }
+    }
+    for (unsigned int i = 0; i < (unsigned int)slotsCopy.size(); ++i) {
+        arena.slots.emplace_back(slotsCopy[i]);
+    }
+    std::swap(*this, arena);
+    return true;
+}
+
+/// Tree Class Functions
+
+void Tree::IterateGrowth(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, TreeParameters& treeParams, bool useGPU) {
+    PROFILE_SCOPE("Iterate Growth");
+
+    int n = GrowCoarseLevels(attractorPoints, aliveMask, minAttrPt, maxAttrPt, treeParams, useGPU);
+    BeginGrowth(attractorPoints, minAttrPt, maxAttrPt, treeParams, useGPU);
+
+    for (; n < treeParams.numSpaceColonizationIterations; ++n) {
+        if (!PerformGrowthIteration(attractorPoints, aliveMask, minAttrPt, maxAttrPt, treeParams, n, useGPU)) { break; }
+    }
+    EndGrowth(treeParams, useGPU);
+
+    PROFILE_SCOPE("Compute Branch Radii");
+    ComputeBranchRadii(treeParams);
+}
+
+template <typename PointSource>
+void Tree::IterateGrowth(PointSource& pointSource, const TreeParameters& treeParams) {
+    PROFILE_SCOPE("Iterate Growth");
+    TreeParameters sourceParams = treeParams;
+    sourceParams.incrementalSpaceColonization = true;
+
+    BeginGrowth(pointSource, sourceParams);
+    for (int n = 0; n < sourceParams.numSpaceColonizationIterations; ++n) {
+        if (!PerformGrowthIteration(pointSource, sourceParams, n)) { break; }
+    }
+    EndGrowth(sourceParams, false);
+
+    PROFILE_SCOPE("Compute Branch Radii");
+    ComputeBranchRadii(sourceParams);
+}
+
+// The store's bounds stand in for the cloud's everywhere (bud reactivation, the Morton frame of the active buds, the GPU grid), so that growing
+// out of core makes the same choices as growing with the whole cloud in memory. Each page in reaches one brick past the perception volumes,
+// so it usually lasts a few iterations.
+void Tree::IterateGrowthOutOfCore(AttractorBrickStore& store, TreeParameters& treeParams, bool useGPU) {
+    PROFILE_SCOPE("Iterate Growth Out Of Core");
+    const glm::vec3& minAttrPt = store.GetMinPoint();
+    const glm::vec3& maxAttrPt = store.GetMaxPoint();
+    const glm::vec3 pageMargin = glm::vec3(store.GetBrickSize());
+    ReactivateBuds(minAttrPt, maxAttrPt); // once, as IterateGrowth would. Paging in again doesn't bring any points back.
 
-    // Axillary bud orientation: Golden angle of 137.5 about the growth axis
-    glm::vec3 crossVec = (std::abs(glm::dot(newShootGrowthDir, WORLD_UP_VECTOR)) > 0.99f) ? glm::vec3(1.0f, 0.0f, 0.0f) : WORLD_UP_VECTOR; // avoid glm::cross returning a nan or 0-vector
-    const glm::quat branchQuat = glm::angleAxis(glm::radians(22.5f), glm::normalize(glm::cross(newShootGrowthDir, crossVec)));
+    int n = 0;
+    bool keepGrowing = true;
+    glm::vec3 perceptionMin;
+    glm::vec3 perceptionMax;
+    while (keepGrowing && n < treeParams.numSpaceColonizationIterations && GetActiveBudPerceptionBounds(perceptionMin, perceptionMax)) {
+        store.PageIn(perceptionMin - pageMargin, perceptionMax + pageMargin);
+        const std::vector<AttractorPoint>& attractorPoints = store.GetResidentPoints();
+        AttractorPointMask& aliveMask = store.GetResidentMask();
+        TreeParameters pageParams = treeParams;
+        pageParams.attractorPointsRevision = store.GetResidentRevision(); // whatever the address of the resident points
+        BeginGrowth(attractorPoints, minAttrPt, maxAttrPt, pageParams, useGPU, false);
+        while (n < treeParams.numSpaceColonizationIterations) {
+            keepGrowing = PerformGrowthIteration(attractorPoints, aliveMask, minAttrPt, maxAttrPt, pageParams, n, useGPU);
+            keepGrowing = keepGrowing || (DidUpdate() && aliveMask.GetNumAlive() == 0 && store.GetNumAlive() > 0); // points left outside the resident bricks
+            ++n;
+            if (!keepGrowing || !GetActiveBudPerceptionBounds(perceptionMin, perceptionMax) || !store.IsPagedIn(perceptionMin, perceptionMax)) { break; }
+        }
+        EndGrowth(pageParams, useGPU);
+    }
+
+    PROFILE_SCOPE("Compute Branch Radii");
+    ComputeBranchRadii(treeParams);
+}
+
+int Tree::GrowCoarseLevels(const std::vector<AttractorPoint>& attractorPoints, const AttractorPointMask& aliveMask, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, TreeParameters& treeParams, bool useGPU) {
+    if (treeParams.numResolutionLevels <= 1 || treeParams.environmentModel != ENVIRONMENT_SPACE_COLONIZATION || !IsBareRoot()) { return 0; }
+    PROFILE_SCOPE("Grow Coarse Levels");
+    AttractorPointLOD lod = AttractorPointLOD();
+    lod.Build(attractorPoints, aliveMask, minAttrPt, maxAttrPt, 2.0f * treeParams.internodeScale, treeParams.numResolutionLevels);
+
+    TreeParameters levelParams = treeParams;
+    int n = 0;
+    for (int l = lod.GetNumLevels() - 1; l >= 1 && n < treeParams.numSpaceColonizationIterations; --l) {
+        const std::vector<AttractorPoint>& levelPoints = lod.GetLevel(l);
+        AttractorPointMask levelMask = AttractorPointMask();
+        levelMask.Reset((unsigned int)levelPoints.size());
+        levelParams.internodeScale = lod.GetCellWidth(l);
+        levelParams.attractorPointsRevision = 0; // other points, so BeginGrowth() gives them a grid of their own
+        if (IsBareRoot()) {
+            GetBud(0, -1).internodeLength = levelParams.internodeScale; // so that it perceives as far as the level's buds will
+        }
+        BeginGrowth(levelPoints, minAttrPt, maxAttrPt, levelParams, useGPU);
+        for (int i = 0; i < treeParams.iterationsPerResolutionLevel && n < treeParams.numSpaceColonizationIterations; ++i) {
+            if (!PerformGrowthIteration(levelPoints, levelMask, minAttrPt, maxAttrPt, levelParams, n++, useGPU)) { break; } // on to the next finer level
+        }
+        EndGrowth(levelParams, useGPU);
+        SubdivideInternodes((l > 1) ? lod.GetCellWidth(l - 1) : treeParams.internodeScale); // refine the scaffold for the next level
+    }
+    if (IsBareRoot()) {
+        GetBud(0, -1).internodeLength = INITIAL_BUD_INTERNODE_RADIUS; // nothing grew, so leave the tree as it was
+    }
+    return n;
+}
+
+bool Tree::GetActiveBudPerceptionBounds(glm::vec3& minPt, glm::vec3& maxPt) const {
+    if (activeBuds.empty()) { return false; }
+    minPt = glm::vec3(999999.0f);
+    maxPt = glm::vec3(-999999.0f);
+    for (unsigned int a = 0; a < (unsigned int)activeBuds.size(); ++a) {
+        const Bud& currentBud = GetActiveBudConst(activeBuds[a]);
+        const float perceptionRadius = PERCEPTION_RADIUS * currentBud.internodeLength; // see PerformSpaceColonizationCPU
+        minPt = glm::min(minPt, currentBud.point - glm::vec3(perceptionRadius));
+        maxPt = glm::max(maxPt, currentBud.point + glm::vec3(perceptionRadius));
+    }
+    return true;
+}
+
+bool Tree::PerformGrowthIteration(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, TreeParameters& treeParams, int n, bool useGPU) {
+    PROFILE_SCOPE("Growth Iteration");
+    PerformSpaceColonization(attractorPoints, aliveMask, minAttrPt, maxAttrPt, treeParams, useGPU); // 1. Compute Q (presence of space/light) and optimal growth direction using space colonization
+                                                                                                    //    or shadow propagation
+    GrowShoots(n, treeParams, useGPU);
+
+    // No more attractor points to consider, so stop the algorithm. The shadow model runs out of light instead, which retires every bud: then nothing grows.
+    return didUpdate && (treeParams.environmentModel == ENVIRONMENT_SHADOW_PROPAGATION || aliveMask.GetNumAlive() > 0);
+}
+
+template <typename PointSource>
+bool Tree::PerformGrowthIteration(PointSource& pointSource, const TreeParameters& treeParams, int n) {
+    PROFILE_SCOPE("Growth Iteration");
+    if (treeParams.environmentModel == ENVIRONMENT_SHADOW_PROPAGATION) {
+        PerformShadowPropagation(treeParams);
+    } else if (pointSource.GetNumAlive() > 0) {
+        PROFILE_SCOPE("Space Colonization");
+        PerformSpaceColonizationIncremental(pointSource, treeParams);
+    }
+    GrowShoots(n, treeParams, false);
+    return didUpdate && (treeParams.environmentModel == ENVIRONMENT_SHADOW_PROPAGATION || pointSource.GetNumAlive() > 0);
+}
+
+void Tree::GrowShoots(int n, const TreeParameters& treeParams, bool useGPU) {
+    {
+        PROFILE_SCOPE("BH Model");
+        ComputeBHModelBasipetalPass();             // 2. Using BH Model, flow resource basipetally and then acropetally
+        ComputeBHModelAcropetalPass(treeParams);
+    }
+
+    {
+        PROFILE_SCOPE("Append New Shoots");
+        AppendNewShoots(n, treeParams);                         // 3. Add new shoots using the resource computed in previous step
+    }
+
+    {
+        PROFILE_SCOPE("Reset State");
+        ResetState(treeParams, useGPU);          // 4. Prepare all data to be iterated over again, e.g. set accumQ / resourceBH for all buds back to 0
+    }
+}
+
+int Tree::AddBranch(const glm::vec3& p, const glm::vec3& growthDir, unsigned int axisOrder, int prevBranchIndex, unsigned int numBudsToReserve) {
+    unsigned int budCapacity = 0;
+    const unsigned int firstBudSlot = buds.AllocateSpan(numBudsToReserve, budCapacity);
+    buds.GetMutable(firstBudSlot) = Bud(p, growthDir, glm::vec3(0.0f), 0.0f, 0.0f, 0.0f, -1, INITIAL_BUD_INTERNODE_RADIUS, 0.0f, 0, TERMINAL, DORMANT); // add the terminal bud for this branch. Applies a prelim internode length (tweak, TODO)
+    branches.emplace_back(TreeBranch(firstBudSlot, budCapacity, axisOrder, prevBranchIndex));
+    return (int)branches.size() - 1;
+}
+
+void Tree::ReserveBuds(int br, unsigned int numBuds) {
+    const TreeBranch& branch = GetBranchConst(br);
+    if (numBuds <= branch.budCapacity) { return; }
+    const unsigned int oldFirstBudSlot = branch.firstBudSlot;
+    const unsigned int oldBudCapacity = branch.budCapacity;
+    const unsigned int numBudsToMove = branch.numBuds;
+    unsigned int budCapacity = 0;
+    const unsigned int firstBudSlot = buds.AllocateSpan(std::max(numBuds, 2 * oldBudCapacity), budCapacity);
+    for (unsigned int i = 0; i < numBudsToMove; ++i) {
+        const Bud bud = buds.Get(oldFirstBudSlot + i); // by value: writing the new slot may copy the chunk the old one is in
+        buds.GetMutable(firstBudSlot + i) = bud;
+    }
+    buds.FreeSpan(oldFirstBudSlot, oldBudCapacity);
+    TreeBranch& movedBranch = branches[br];
+    movedBranch.firstBudSlot = firstBudSlot;
+    movedBranch.budCapacity = budCapacity;
+}
+
+// Axillary buds point 22.5 degrees away from the axis of their shoot, turned about it by the golden angle of 137.5 degrees from one bud to the
+// next. The first returns the unturned direction, the second turns it for bud budIdx of the branch.
+static glm::vec3 GetAxillaryBudBaseDir(const glm::vec3& shootDir) {
+    glm::vec3 crossVec = (std::abs(glm::dot(shootDir, WORLD_UP_VECTOR)) > 0.99f) ? glm::vec3(1.0f, 0.0f, 0.0f) : WORLD_UP_VECTOR; // avoid glm::cross returning a nan or 0-vector
+    const glm::quat branchQuat = glm::angleAxis(glm::radians(22.5f), glm::normalize(glm::cross(shootDir, crossVec)));
     const glm::mat4 budRotMat = glm::toMat4(branchQuat);
+    return glm::normalize(glm::vec3(budRotMat * glm::vec4(shootDir, 0.0f)));
+}
+
+static glm::vec3 GetAxillaryBudDir(const glm::vec3& shootDir, const glm::vec3& baseDir, unsigned int budIdx) {
+    const float rotAmt = 137.5f * (float)(budIdx /** (axisOrder + 1)*/);
+    const glm::quat branchQuatGoldenAngle = glm::angleAxis(glm::radians(rotAmt), shootDir);
+    const glm::mat4 budRotMatGoldenAngle = glm::toMat4(branchQuatGoldenAngle);
+    return glm::normalize(glm::vec3(budRotMatGoldenAngle * glm::vec4(baseDir, 0.0f)));
+}
+
+void Tree::SubdivideInternodes(float minInternodeLength) {
+    std::vector<unsigned int> numSegments = std::vector<unsigned int>();
+    for (unsigned int br = 0; br < (unsigned int)branches.size(); ++br) {
+        const unsigned int numBuds = GetBranchConst(br).GetNumBuds();
+        numSegments.assign(numBuds, 1);
+        unsigned int newNumBuds = numBuds;
+        for (unsigned int bu = 1; bu < numBuds; ++bu) { // bud 0 has no internode of its own
+            numSegments[bu] = std::max((unsigned int)(GetBudConst(br, bu).internodeLength / minInternodeLength), 1u);
+            newNumBuds += numSegments[bu] - 1;
+        }
+        if (newNumBuds == numBuds) { continue; }
+        ReserveBuds(br, newNumBuds);
+        const unsigned int firstBudSlot = GetBranchConst(br).firstBudSlot;
+        buds.MakeUnique(firstBudSlot, newNumBuds);
 
-    // Direction in which the bud itself is oriented
-    glm::vec3 budGrowthDir = glm::normalize(glm::vec3(budRotMat * glm::vec4(newShootGrowthDir, 0.0f)));
+        // Back to front: buds only ever move up the span, so each one is read before anything gets written to its slot. The terminal bud stays put.
+        unsigned int newBu = newNumBuds;
+        for (int bu = (int)numBuds - 1; bu >= 0; --bu) {
+            const unsigned int oldSlot = (bu == (int)numBuds - 1) ? firstBudSlot : firstBudSlot + 1 + (unsigned int)bu;
+            const Bud bud = buds.Get(oldSlot);
+            --newBu;
+            Bud& movedBud = buds.GetMutable((newBu == newNumBuds - 1) ? firstBudSlot : firstBudSlot + 1 + newBu);
+            movedBud = bud;
+            const unsigned int k = numSegments[bu];
+            if (k == 1) { continue; }
+            const glm::vec3 prevPoint = buds.Get(firstBudSlot + bu).point; // bud bu - 1, an axillary bud
+            const glm::vec3 internode = bud.point - prevPoint;
+            const float segmentLength = bud.internodeLength / (float)k;
+            movedBud.internodeLength = segmentLength;
+            const glm::vec3 shootDir = glm::normalize(internode);
+            const glm::vec3 budGrowthDir = GetAxillaryBudBaseDir(shootDir);
+            for (unsigned int s = k - 1; s >= 1; --s) {
+                --newBu;
+                buds.GetMutable(firstBudSlot + 1 + newBu) = Bud(prevPoint + internode * ((float)s / (float)k), GetAxillaryBudDir(shootDir, budGrowthDir, newBu), glm::vec3(0.0f),
+                                                                0.0f, 0.0f, 0.0f, -1, segmentLength, 0.0f, 0, AXILLARY, ABORT);
+            }
+        }
+        branches[br].numBuds = newNumBuds;
+    }
+
+    activeBuds.clear();
+    for (unsigned int br = 0; br < (unsigned int)branches.size(); ++br) {
+        if (GetBranchConst(br).terminalBudActive) { branches[br].terminalBudActive = false; }
+    }
+    InvalidateStage(STAGE_RADII);
+}
+
+template <bool WITH_TROPISM>
+void Tree::WriteAxillaryBuds(int br, const Bud& sourceBud, const int numBuds, const float internodeLength, const TreeParameters& treeParams) {
+    // Direction in which growth occurs
+    glm::vec3 weightedGrowthDir = sourceBud.naturalGrowthDir + treeParams.optimalGrowthDirWeight * sourceBud.optimalGrowthDir;
+    if (WITH_TROPISM) {
+        weightedGrowthDir += treeParams.tropismDirWeight * treeParams.tropismVector;
+    }
+    const glm::vec3 newShootGrowthDir = glm::normalize(weightedGrowthDir);
+
+    // Direction in which the bud itself is oriented, before the golden angle
+    const glm::vec3 budGrowthDir = GetAxillaryBudBaseDir(newShootGrowthDir);
+
+    // New buds go into the free slots at the end of the branch's span, right behind its current axillary buds: the terminal bud stays put
+    const unsigned int numOldBuds = GetBranchConst(br).numBuds;
+    const unsigned int firstBudSlot = GetBranchConst(br).firstBudSlot;
+    const glm::vec3 terminalBudPoint = buds.Get(firstBudSlot).point;
+    const float terminalBudInternodeLength = buds.Get(firstBudSlot).internodeLength;
 
     // Buds will be inserted @ current terminal bud pos + (float)b * branchGrowthDir * internodeLength
-    Bud& terminalBud = buds[buds.size() - 1]; // last bud is always the terminal bud
     for (int b = 0; b < numBuds; ++b) {
         // Account for golden angle here
-        const float rotAmt = 137.5f * (float)((buds.size() + b) /** (axisOrder + 1)*/);
-        const glm::quat branchQuatGoldenAngle = glm::angleAxis(glm::radians(rotAmt), newShootGrowthDir);
-        const glm::mat4 budRotMatGoldenAngle = glm::toMat4(branchQuatGoldenAngle);
-        const glm::vec3 budGrowthGoldenAngle = glm::normalize(glm::vec3(budRotMatGoldenAngle * glm::vec4(budGrowthDir, 0.0f)));
+        const glm::vec3 budGrowthGoldenAngle = GetAxillaryBudDir(newShootGrowthDir, budGrowthDir, numOldBuds + b);
         
         // Special measure taken:
         // If this is the first bud among the buds to be added, give it the internode length of the the terminal bud.
         // But, if this is the first time the terminal bud is growing, make the internode length 0 instead. The bud shouldn't grow at all.
-        const float internodeLengthChecked = (buds.size() == 1) ? ((b == 0) ? 0.0f : internodeLength) : ((b == 0) ? terminalBud.internodeLength : internodeLength);
-        newBuds.emplace_back(terminalBud.point + (float)b * newShootGrowthDir * internodeLength, budGrowthGoldenAngle, glm::vec3(0.0f),
-                             0.0f, 0.0f, 0.0f, -1, internodeLengthChecked, 0.0f, 0, AXILLARY, DORMANT);
+        const float internodeLengthChecked = (numOldBuds == 1) ? ((b == 0) ? 0.0f : internodeLength) : ((b == 0) ? terminalBudInternodeLength : internodeLength);
+        buds.GetMutable(firstBudSlot + numOldBuds + b) = Bud(terminalBudPoint + (float)b * newShootGrowthDir * internodeLength, budGrowthGoldenAngle, glm::vec3(0.0f),
+                                                              0.0f, 0.0f, 0.0f, -1, internodeLengthChecked, 0.0f, 0, AXILLARY, DORMANT);
     }
     // Update terminal bud position
-    terminalBud.point = terminalBud.point + (float)(numBuds) * newShootGrowthDir * internodeLength;
+    Bud& terminalBud = buds.GetMutable(firstBudSlot);
+    terminalBud.point = terminalBudPoint + (float)(numBuds) * newShootGrowthDir * internodeLength;
     terminalBud.internodeLength = internodeLength;
-    buds.insert(buds.begin() + buds.size() - 1, newBuds.begin(), newBuds.end());
 }
 
+void Tree::TakeGrowthState(Tree& other) {
+    branches.swap(other.branches);
+    std::swap(buds, other.buds);
+    activeBuds.swap(other.activeBuds);
+    didUpdate = other.didUpdate;
+    dirtyStage = other.dirtyStage;
+    stageParameters = other.stageParameters;
+}
 
-/// Tree Class Functions
+void Tree::WriteGrowthState(std::vector<unsigned char>& message) const {
+    std::vector<TreeBranch> branchesCopy = std::vector<TreeBranch>();
+    branchesCopy.reserve(branches.size());
+    for (unsigned int br = 0; br < branches.size(); ++br) {
+        branchesCopy.push_back(branches[br]);
+    }
+    WriteRecords(message, branchesCopy);
+    buds.Write(message);
+    WriteRecords(message, activeBuds);
+    WriteRecords(message, std::vector<int>{ didUpdate ? 1 : 0, (int)dirtyStage });
+    WriteRecords(message, std::vector<TreeParameters>(1, stageParameters));
+}
 
-void Tree::IterateGrowth(std::vector<AttractorPoint>& attractorPoints, glm::vec3& minAttrPt, glm::vec3& maxAttrPt, TreeParameters& treeParams, bool useGPU) {
-    
-    ResetState(attractorPoints, useGPU);               // Prepare all data to be iterated over again, e.g. set accumQ / resourceBH for all buds back to 0
-    
-    for (int n = 0; n < treeParams.numSpaceColonizationIterations; ++n) {
-        didUpdate = false;
-        #ifdef ENABLE_DEBUG_OUTPUT
-        std::cout << "Iteration #: " << n << std::endl;
-        #endif
-
-        #ifdef ENABLE_DEBUG_OUTPUT
-        auto start = std::chrono::system_clock::now();
-        #endif
-        PerformSpaceColonization(attractorPoints, minAttrPt, maxAttrPt, treeParams.reconstructUniformGridOnGPU, treeParams.resetAttractorPointState, useGPU); // 1. Compute Q (presence of space/light) and optimal growth direction using space colonization
-        #ifdef ENABLE_DEBUG_OUTPUT
-        auto end = std::chrono::system_clock::now();
-        std::chrono::duration<double> elapsed_seconds = end - start;
-        std::time_t end_time = std::chrono::system_clock::to_time_t(end);
-        std::cout << "Elapsed time for Space Colonization: " << elapsed_seconds.count() << "s\n";
-        #endif
-
-        #ifdef ENABLE_DEBUG_OUTPUT
-        start = std::chrono::system_clock::now();
-        #endif
-        ComputeBHModelBasipetalPass();             // 2. Using BH Model, flow resource basipetally and then acropetally
-        ComputeBHModelAcropetalPass();
-        #ifdef ENABLE_DEBUG_OUTPUT
-        end = std::chrono::system_clock::now();
-        elapsed_seconds = end - start;
-        end_time = std::chrono::system_clock::to_time_t(end);
-        std::cout << "Elapsed time for Computing BH Model (both passes): " << elapsed_seconds.count() << "s\n";
-        #endif
-
-        #ifdef ENABLE_DEBUG_OUTPUT
-        start = std::chrono::system_clock::now();
-        #endif
-        AppendNewShoots(n, treeParams);                         // 3. Add new shoots using the resource computed in previous step
-        #ifdef ENABLE_DEBUG_OUTPUT
-        end = std::chrono::system_clock::now();
-        elapsed_seconds = end - start;
-        end_time = std::chrono::system_clock::to_time_t(end);
-        std::cout << "Elapsed time for Appending New Shoots: " << elapsed_seconds.count() << "s\n";
-        #endif
-        
-        #ifdef ENABLE_DEBUG_OUTPUT
-        start = std::chrono::system_clock::now();
-        #endif
-        ResetState(attractorPoints, useGPU);                      // 4. Prepare all data to be iterated over again, e.g. set accumQ / resourceBH for all buds back to 0
-        #ifdef ENABLE_DEBUG_OUTPUT
-        end = std::chrono::system_clock::now();
-        elapsed_seconds = end - start;
-        end_time = std::chrono::system_clock::to_time_t(end);
-        std::cout << "Elapsed time for State Resetting: " << elapsed_seconds.count() << "s\n\n";
-        #endif
-
-        if (!didUpdate || attractorPoints.size() == 0) { break; } // No more attractor points to consider, so stop the algorithm
-    }
-
-    #ifdef ENABLE_DEBUG_OUTPUT
-    auto start = std::chrono::system_clock::now();
-    #endif
-    ComputeBranchRadii(treeParams);
-    #ifdef ENABLE_DEBUG_OUTPUT
-    auto end = std::chrono::system_clock::now();
-    std::chrono::duration<double> elapsed_seconds = end - start;
-    std::time_t end_time = std::chrono::system_clock::to_time_t(end);
-    std::cout << "Elapsed time for Computing Branch Radii: " << elapsed_seconds.count() << "s\n";
-    #endif
-}
-
-void Tree::PerformSpaceColonization(std::vector<AttractorPoint>& attractorPoints, glm::vec3& minAttrPt, glm::vec3& maxAttrPt, bool& reconstructUniformGrid, bool& resetAttrPtState, bool useGPU) {
-    /*#ifdef ENABLE_DEBUG_OUTPUT
-    auto start = std::chrono::system_clock::now();
-    #endif*/
-    //RemoveAttractorPoints(attractorPoints);
-    /*#ifdef ENABLE_DEBUG_OUTPUT
-    auto end = std::chrono::system_clock::now();
-    std::chrono::duration<double> elapsed_seconds = end - start;
-    std::time_t end_time = std::chrono::system_clock::to_time_t(end);
-    std::cout << "Total Elapsed time for Attractor Point Removal: " << elapsed_seconds.count() << "s\n";
-    #endif*/
-    
-    if (attractorPoints.size() == 0) { return; }
-
-    #ifdef ENABLE_DEBUG_OUTPUT
-    auto start = std::chrono::system_clock::now();
-    #endif
+bool Tree::ReadGrowthState(const std::vector<unsigned char>& message, size_t& offset) {
+    std::vector<TreeBranch> branchesCopy = std::vector<TreeBranch>();
+    BudArena budsCopy = BudArena();
+    std::vector<ActiveBudRef> activeBudsCopy = std::vector<ActiveBudRef>();
+    std::vector<int> flags = std::vector<int>();
+    std::vector<TreeParameters> parameters = std::vector<TreeParameters>();
+    size_t end = offset;
+    if (!ReadRecords(message, end, branchesCopy) || !budsCopy.Read(message, end) || !ReadRecords(message, end, activeBudsCopy) ||
+        !ReadRecords(message, end, flags) || !ReadRecords(message, end, parameters) || flags.size() != 2 || parameters.size() != 1) {
+        return false;
+    }
+    offset = end;
+    branches.clear();
+    for (unsigned int br = 0; br < (unsigned int)branchesCopy.size(); ++br) {
+        branches.emplace_back(branchesCopy[br]);
+    }
+    std::swap(buds, budsCopy);
+    activeBuds.swap(activeBudsCopy);
+    didUpdate = flags[0] != 0;
+    dirtyStage = (TREE_STAGE)flags[1];
+    stageParameters = parameters[0];
+    return true;
+}
+
+TreeGrowthSnapshot Tree::TakeSnapshot() const {
+    TreeGrowthSnapshot snapshot = TreeGrowthSnapshot();
+    snapshot.branches = branches;
+    snapshot.buds = buds;
+    snapshot.activeBuds = activeBuds;
+    snapshot.stageParameters = stageParameters;
+    snapshot.didUpdate = didUpdate;
+    return snapshot;
+}
+
+void Tree::RestoreSnapshot(const TreeGrowthSnapshot& snapshot) {
+    branches = snapshot.branches;
+    buds = snapshot.buds;
+    activeBuds = snapshot.activeBuds;
+    stageParameters = snapshot.stageParameters;
+    didUpdate = snapshot.didUpdate;
+    InvalidatePerceivedAttractorPoints(); // the perception sets belong to whatever growth state the tree had before
+    dirtyStage = STAGE_MESH; // the radii are stored in the buds, the meshes still show whatever the tree looked like before
+}
+
+Tree::Tree(const Tree& source, const TreeGrowthSnapshot& snapshot) : gpuPointsRevision(0), lookUpInMovedBudBVH(false), gridLookupFraction(0.0f), movedBudBVHOverlap(BUD_BVH_TYPICAL_OVERLAP), didUpdate(false), hasBeenCreated(false), dirtyStage(STAGE_MESH), branchColor(source.branchColor), leafColor(source.leafColor) {
+    activeBudsScratch = std::vector<ActiveBudRef>();
+    activeBudMortonFrame = source.activeBudMortonFrame;
+    attractorPointGrid = AttractorPointGrid();
+    perceivedPoints = std::vector<PerceivedAttractorPoint>();
+    perceivedPointsNext = std::vector<PerceivedAttractorPoint>();
+    movedBudIndices = std::vector<unsigned int>();
+    lookedUpPoints = std::vector<LookedUpAttractorPoint>();
+    nearestBuds = std::vector<NearestBud>();
+    nearestBudPages = NearestBudPages();
+    newShootBlocks = std::vector<std::vector<NewShoot>>();
+    newShoots = std::vector<NewShoot>();
+    RestoreSnapshot(snapshot);
+    branchMesh = source.branchMesh;
+    leafMesh = source.leafMesh;
+    treeMesh.SetName("tree_mesh");
+    leavesMesh.SetName("leaves_mesh");
+}
+
+Tree Tree::Fork() const {
+    PROFILE_SCOPE("Fork Tree");
+    return Tree(*this, TakeSnapshot());
+}
+
+void Tree::BeginGrowth(const std::vector<AttractorPoint>& attractorPoints, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, const TreeParameters& treeParams, bool useGPU,
+                       bool reactivateBuds) {
+    const bool shadowPropagation = treeParams.environmentModel == ENVIRONMENT_SHADOW_PROPAGATION;
+    if (!useGPU && !shadowPropagation) {
+        nearestBuds.assign(attractorPoints.size(), NearestBud());
+    }
+    PrepareGrowth(minAttrPt, maxAttrPt, treeParams, useGPU, reactivateBuds);
     if (useGPU) {
-        PerformSpaceColonizationGPU(attractorPoints, minAttrPt, maxAttrPt, reconstructUniformGrid, resetAttrPtState);
+        gpuPointsRevision = (treeParams.attractorPointsRevision != 0) ? treeParams.attractorPointsRevision : AttractorPointCloud::NewLayoutRevision();
+    }
+    if (shadowPropagation) {
+        BuildShadowGrid(minAttrPt, maxAttrPt, treeParams);
+    } else if (!useGPU && treeParams.incrementalSpaceColonization) {
+        PROFILE_SCOPE("Build Attractor Point Grid");
+        attractorPointGrid.Build(attractorPoints, PERCEPTION_RADIUS * treeParams.internodeScale); // one perception radius
+    }
+}
+
+template <typename PointSource>
+void Tree::BeginGrowth(PointSource& pointSource, const TreeParameters& treeParams) {
+    const bool shadowPropagation = treeParams.environmentModel == ENVIRONMENT_SHADOW_PROPAGATION;
+    glm::vec3 minAttrPt;
+    glm::vec3 maxAttrPt;
+    pointSource.GetBounds(minAttrPt, maxAttrPt);
+    PrepareGrowth(minAttrPt, maxAttrPt, treeParams, false);
+    if (shadowPropagation) {
+        BuildShadowGrid(minAttrPt, maxAttrPt, treeParams);
     } else {
-        RemoveAttractorPoints(attractorPoints);
-        PerformSpaceColonizationCPU(attractorPoints);
+        PrepareSpaceColonization(pointSource, treeParams);
     }
-    #ifdef ENABLE_DEBUG_OUTPUT
-    auto end = std::chrono::system_clock::now();
-    std::chrono::duration<double> elapsed_seconds = end - start;
-    std::time_t end_time = std::chrono::system_clock::to_time_t(end);
-    std::cout << "Total Elapsed time for Actual Space Col: " << elapsed_seconds.count() << "s\n";
-    #endif
 }
 
-void Tree::PerformSpaceColonizationCPU(std::vector<AttractorPoint>& attractorPoints) {
-    // 2. Pass One - For each bud, set the nearest bud of each perceived attractor point
-    for (unsigned int br = 0; br < (unsigned int)branches.size(); ++br) {
-        std::vector<Bud>& buds = branches[br].buds;
-        const unsigned int numBuds = (unsigned int)buds.size();
-        for (unsigned int bu = 0; bu < numBuds; ++bu) {
-            Bud& currentBud = buds[bu];
-            if (currentBud.internodeLength > 0.0f && currentBud.fate == DORMANT) {
-                for (int ap = 0; ap < attractorPoints.size(); ++ap) {
-                    AttractorPoint& currentAttrPt = attractorPoints[ap];
-                    glm::vec3 budToPtDir = currentAttrPt.point - currentBud.point;
-                    const float budToPtDist2 = glm::length2(budToPtDir);
-                    budToPtDir = glm::normalize(budToPtDir);
-                    const float dotProd = glm::dot(budToPtDir, currentBud.naturalGrowthDir);
-                    if (budToPtDist2 < (14.0f * currentBud.internodeLength * currentBud.internodeLength) && dotProd > std::abs(COS_THETA_SMALL)) { // ~4x internode length - use distance squared
-                                                                                                                                                   // Any given attractor point can only be perceived by one bud - the nearest one.
-                                                                                                                                                   // If we end up find a bud closer to this attractor point than the previously recorded one,
-                                                                                                                                                   // update the point accordingly and remove this attractor point's contribution from that bud's
-                                                                                                                                                   // growth direction vector.
-                        if (budToPtDist2 < currentAttrPt.nearestBudDist2) {
-                            currentAttrPt.nearestBudDist2 = budToPtDist2;
-                            currentAttrPt.nearestBudBranchIdx = br;
-                            currentAttrPt.nearestBudIdx = bu;
-                        }
+void Tree::PrepareSpaceColonization(AttractorPointComposite& composite, const TreeParameters& treeParams) {
+    nearestBuds.assign(composite.GetNumPoints(), NearestBud());
+    composite.BuildGrids(PERCEPTION_RADIUS * treeParams.internodeScale); // only the members that have no grid of this width yet
+}
+
+void Tree::PrepareSpaceColonization(const QuantizedAttractorPoints& quantizedPoints, const TreeParameters& treeParams) {
+    nearestBudPages.Reset(quantizedPoints.GetNumPoints());
+}
+
+void Tree::PrepareSpaceColonization(const SharedAttractorPoints& sharedPoints, const TreeParameters& treeParams) {
+    nearestBudPages.Reset(sharedPoints.GetNumPoints()); // the cloud's points are in Morton order, so the pages follow space
+}
+
+void Tree::BuildShadowGrid(const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, const TreeParameters& treeParams) {
+    PROFILE_SCOPE("Build Shadow Grid");
+    const glm::vec3& rootPoint = GetBudConst(0, 0).point; // the root usually sits below the points, but has to get light to grow at all
+    shadowGrid.Build(glm::min(minAttrPt, rootPoint), glm::max(maxAttrPt, rootPoint), treeParams.internodeScale); // one internode per voxel
+    CastShadows(treeParams);
+}
+
+void Tree::PrepareGrowth(const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, const TreeParameters& treeParams, bool useGPU, bool reactivateBuds) {
+    if (reactivateBuds) {
+        ReactivateBuds(minAttrPt, maxAttrPt); // The given points may not be the ones the tree last grew into, so any bud that can see them has to be considered again
+    }
+    activeBudMortonFrame = MortonFrame(minAttrPt, maxAttrPt);
+    OrderActiveBuds(0);
+    InvalidatePerceivedAttractorPoints(); // Cached perception sets index into the point array of the previous call
+    budBVH.Clear();
+    for (unsigned int a = 0; a < (unsigned int)activeBuds.size(); ++a) {
+        activeBuds[a].budBVHItem = -1;
+    }
+    lookUpInMovedBudBVH = false;
+    gridLookupFraction = 0.0f; // the first incremental pass uses the grid and measures it
+    movedBudBVHOverlap = BUD_BVH_TYPICAL_OVERLAP; // until measured
+    ResetState(treeParams, useGPU); // Prepare all data to be iterated over, e.g. set accumQ / resourceBH for all buds to 0
+    stageParameters.CopyStageFields(STAGE_TOPOLOGY, treeParams);
+}
+
+void Tree::EndGrowth(const TreeParameters& treeParams, bool useGPU) {
+    if (!useGPU && treeParams.incrementalSpaceColonization) {
+        attractorPointGrid.Clear();
+        InvalidatePerceivedAttractorPoints();
+    }
+    nearestBuds = std::vector<NearestBud>();
+    nearestBudPages.Clear();
+    budBVH.Clear();
+    movedBudBVH.Clear();
+    shadowGrid.Clear();
+}
+
+void Tree::InvalidatePerceivedAttractorPoints() {
+    perceivedPoints.clear();
+    perceivedPointsNext.clear();
+    for (unsigned int a = 0; a < (unsigned int)activeBuds.size(); ++a) {
+        activeBuds[a].perceivedStart = -1;
+        activeBuds[a].numPerceived = 0;
+    }
+}
+
+void Tree::PerformSpaceColonization(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, TreeParameters& treeParams, bool useGPU) {
+    if (treeParams.environmentModel == ENVIRONMENT_SHADOW_PROPAGATION) {
+        PerformShadowPropagation(treeParams);
+        return;
+    }
+    PROFILE_SCOPE("Space Colonization");
+    if (aliveMask.GetNumAlive() == 0) { return; }
+
+    if (useGPU) {
+        PerformSpaceColonizationGPU(attractorPoints, aliveMask, minAttrPt, maxAttrPt, treeParams);
+    } else if (treeParams.incrementalSpaceColonization) {
+        PerformSpaceColonizationIncremental(attractorPoints, aliveMask, treeParams);
+    } else {
+        RemoveAttractorPoints(attractorPoints, aliveMask);
+        PerformSpaceColonizationCPU(attractorPoints, aliveMask, treeParams);
+    }
+}
+
+// Rough cost of numPasses point-centric passes relative to the bud-centric ones, which the caller estimates: testing every active bud against
+// every point, or looking up the new and moved buds in the attractor point grid. Keeping a BudBVH of numBuds buds up to date costs
+// budBVHCost per bud, and each point's lookup visits about log2(numBuds) nodes, times overlap where the buds' spheres overlap.
+static bool UsePointCentricQueries(unsigned int numBuds, float budBVHCost, float overlap, unsigned int numPoints, unsigned int numPasses, float budCentricCost) {
+    const float lookupCost = BUD_BVH_LOOKUP_COST + BUD_BVH_NODE_COST * overlap * std::log2((float)numBuds + 1.0f);
+    const float pointCentricCost = budBVHCost * (float)numBuds + (float)numPasses * (float)numPoints * lookupCost;
+    return pointCentricCost < budCentricCost;
+}
+
+// Perception radius of a bud in the BudBVH: a bit over PERCEPTION_RADIUS internodes, so rounding can't leave out a point the exact tests take
+static float GetBudBVHRadius(const Bud& bud) {
+    return (PERCEPTION_RADIUS + 0.01f) * bud.internodeLength;
+}
+
+void Tree::UpdateBudBVH() {
+    PROFILE_SCOPE("Update Bud BVH");
+    if (budBVH.NeedsRebuild()) {
+        budBVH.Clear();
+        for (unsigned int a = 0; a < (unsigned int)activeBuds.size(); ++a) { // in Morton order, see OrderActiveBuds()
+            ActiveBudRef& ref = activeBuds[a];
+            const Bud& currentBud = GetActiveBudConst(ref);
+            ref.budBVHItem = budBVH.AddItem(currentBud.point, GetBudBVHRadius(currentBud), ref.branchIdx, ref.budIdx);
+        }
+        budBVH.Build();
+        return;
+    }
+    budBVH.BeginUpdate();
+    for (unsigned int a = 0; a < (unsigned int)activeBuds.size(); ++a) {
+        ActiveBudRef& ref = activeBuds[a];
+        const Bud& currentBud = GetActiveBudConst(ref);
+        if (ref.budBVHItem < 0) {
+            ref.budBVHItem = budBVH.InsertItem(currentBud.point, GetBudBVHRadius(currentBud), ref.branchIdx, ref.budIdx);
+        } else {
+            budBVH.UpdateItem(ref.budBVHItem, currentBud.point, GetBudBVHRadius(currentBud)); // only terminal buds that grew have moved
+        }
+    }
+    budBVH.EndUpdate(); // drops the retired buds
+}
+
+void Tree::PerformSpaceColonizationCPU(const std::vector<AttractorPoint>& attractorPoints, const AttractorPointMask& aliveMask, const TreeParameters& treeParams) {
+    const float perceptionCosTheta = std::abs(treeParams.perceptionCosThetaSmall); // a local, so the loops below keep it in a register
+    PROFILE_LOCAL_COUNTER(numActiveBuds);
+    PROFILE_LOCAL_COUNTER(numDistanceTests);
+    std::vector<unsigned int> aliveIndices = std::vector<unsigned int>();
+    aliveMask.GetAliveIndices(aliveIndices);
+
+    if (UsePointCentricQueries((unsigned int)activeBuds.size(), BUD_BVH_UPDATE_COST, 1.0f, (unsigned int)aliveIndices.size(), 1, (float)activeBuds.size() * (float)aliveIndices.size())) {
+        UpdateBudBVH();
+
+        // 2. Pass One, point-centric - For each alive attractor point, let every active bud that perceives it compete to be its nearest bud
+        for (unsigned int i = 0; i < (unsigned int)aliveIndices.size(); ++i) {
+            const unsigned int ap = aliveIndices[i];
+            const AttractorPoint& currentAttrPt = attractorPoints[ap];
+            budBVH.ForEachBudNear(currentAttrPt.point, [&](int, int br, int budIdx) {
+                const int bu = (budIdx == -1) ? (int)GetBranchConst(br).GetNumBuds() - 1 : budIdx;
+                const Bud& currentBud = GetBudConst(br, bu);
+                if (currentBud.internodeLength <= 0.0f || currentBud.fate != DORMANT) { return; }
+                PROFILE_INCREMENT(numDistanceTests, 1);
+                glm::vec3 budToPtDir = currentAttrPt.point - currentBud.point;
+                const float budToPtDist2 = glm::length2(budToPtDir);
+                budToPtDir = glm::normalize(budToPtDir);
+                const float dotProd = glm::dot(budToPtDir, currentBud.naturalGrowthDir);
+                if (budToPtDist2 < (PERCEPTION_RADIUS_SQUARED * currentBud.internodeLength * currentBud.internodeLength) && dotProd > perceptionCosTheta) { // same test as below
+                    ++GetBud(br, bu).numPerceivedAttrPts;
+                    if (IsNearerBud(nearestBuds[ap], budToPtDist2, 0, br, bu)) {
+                        SetNearestBud(nearestBuds[ap], budToPtDist2, 0, br, bu);
                     }
                 }
+            });
+        }
+
+        // 2. Pass Two, point-centric - Each attractor point adds its normalized dir to its nearest bud's optimal dir, in ascending point order like below
+        for (unsigned int i = 0; i < (unsigned int)aliveIndices.size(); ++i) {
+            const unsigned int ap = aliveIndices[i];
+            const NearestBud& nearestBud = nearestBuds[ap];
+            if (nearestBud.branchIdx < 0) { continue; }
+            const AttractorPoint& currentAttrPt = attractorPoints[ap];
+            Bud& currentBud = GetBud(nearestBud.branchIdx, nearestBud.budIdx);
+            ++currentBud.numNearbyAttrPts;
+            currentBud.optimalGrowthDir += currentAttrPt.weight * glm::normalize(currentAttrPt.point - currentBud.point);
+            currentBud.environmentQuality = 1.0f;
+        }
+        for (unsigned int a = 0; a < (unsigned int)activeBuds.size(); ++a) {
+            Bud& currentBud = GetActiveBud(activeBuds[a]);
+            if (currentBud.internodeLength > 0.0f && currentBud.fate == DORMANT && currentBud.numPerceivedAttrPts > 0) {
+                PROFILE_INCREMENT(numActiveBuds, 1);
+                currentBud.optimalGrowthDir = currentBud.numNearbyAttrPts > 0 ? glm::normalize(currentBud.optimalGrowthDir) : glm::vec3(0.0f);
             }
         }
+
+        PROFILE_COUNTER("Active Buds", numActiveBuds);
+        PROFILE_COUNTER("Distance Tests", numDistanceTests);
+        PROFILE_COUNTER("Attractor Points Alive", aliveMask.GetNumAlive());
+
+        RetireInactiveBuds();
+        return;
     }
 
-    // 2. Pass Two - For each bud, if the current attr pt has the current bud as its nearest, add it's normalized dir to the total optimal dir. normalize it at the end.
-    for (unsigned int br = 0; br < (unsigned int)branches.size(); ++br) {
-        std::vector<Bud>& buds = branches[br].buds;
-        const unsigned int numBuds = (unsigned int)buds.size();
-        for (unsigned int bu = 0; bu < numBuds; ++bu) {
-            Bud& currentBud = buds[bu];
-            if (currentBud.internodeLength > 0.0f && currentBud.fate == DORMANT) {
-                for (int ap = 0; ap < attractorPoints.size(); ++ap) {
-                    const AttractorPoint& currentAttrPt = attractorPoints[ap];
-                    glm::vec3 budToPtDir = currentAttrPt.point - currentBud.point;
-                    const float budToPtDist2 = glm::length2(budToPtDir);
-                    budToPtDir = glm::normalize(budToPtDir);
-                    const float dotProd = glm::dot(budToPtDir, currentBud.naturalGrowthDir);
-                    if (budToPtDist2 < (14.0f * currentBud.internodeLength * currentBud.internodeLength) && dotProd > std::abs(COS_THETA_SMALL)) { // ~4x internode length - use distance squared
-                                                                                                                                                   // Any given attractor point can only be perceived by one bud - the nearest one.
-                                                                                                                                                   // If we end up find a bud closer to this attractor point than the previously recorded one,
-                                                                                                                                                   // update the point accordingly and remove this attractor point's contribution from that bud's
-                                                                                                                                                   // growth direction vector.
-                        if (currentAttrPt.nearestBudBranchIdx == br && currentAttrPt.nearestBudIdx == bu) {
-                            ++currentBud.numNearbyAttrPts;
-                            currentBud.optimalGrowthDir += budToPtDir;
-                            currentBud.environmentQuality = 1.0f;
-                        }
+    // 2. Pass One - For each active bud, set the nearest bud of each perceived attractor point
+    for (unsigned int a = 0; a < (unsigned int)activeBuds.size(); ++a) {
+        const int br = activeBuds[a].branchIdx;
+        const int bu = (activeBuds[a].budIdx == -1) ? (int)GetBranchConst(br).GetNumBuds() - 1 : activeBuds[a].budIdx;
+        Bud& currentBud = GetBud(br, bu);
+        if (currentBud.internodeLength > 0.0f && currentBud.fate == DORMANT) {
+            PROFILE_INCREMENT(numActiveBuds, 1);
+            PROFILE_INCREMENT(numDistanceTests, aliveIndices.size());
+            for (unsigned int i = 0; i < (unsigned int)aliveIndices.size(); ++i) {
+                const unsigned int ap = aliveIndices[i];
+                const AttractorPoint& currentAttrPt = attractorPoints[ap];
+                glm::vec3 budToPtDir = currentAttrPt.point - currentBud.point;
+                const float budToPtDist2 = glm::length2(budToPtDir);
+                budToPtDir = glm::normalize(budToPtDir);
+                const float dotProd = glm::dot(budToPtDir, currentBud.naturalGrowthDir);
+                if (budToPtDist2 < (PERCEPTION_RADIUS_SQUARED * currentBud.internodeLength * currentBud.internodeLength) && dotProd > perceptionCosTheta) { // ~4x internode length - use distance squared
+                                                                                                                                               // Any given attractor point can only be perceived by one bud - the nearest one.
+                                                                                                                                               // If we end up find a bud closer to this attractor point than the previously recorded one,
+                                                                                                                                               // update the point accordingly and remove this attractor point's contribution from that bud's
+                                                                                                                                               // growth direction vector.
+                    ++currentBud.numPerceivedAttrPts;
+                    if (IsNearerBud(nearestBuds[ap], budToPtDist2, 0, br, bu)) {
+                        SetNearestBud(nearestBuds[ap], budToPtDist2, 0, br, bu);
                     }
                 }
-                currentBud.optimalGrowthDir = currentBud.numNearbyAttrPts > 0 ? glm::normalize(currentBud.optimalGrowthDir) : glm::vec3(0.0f);
             }
         }
     }
-}
 
-void Tree::PerformSpaceColonizationGPU(std::vector<AttractorPoint>& attractorPoints, glm::vec3& minAttrPt, glm::vec3& maxAttrPt, bool& reconstructUniformGrid, bool& resetAttrPtState) {
-    // Assemble array of buds
-    std::vector<Bud> buds = std::vector<Bud>(); // TODO replace this vector
-    for (unsigned int br = 0; br < (unsigned int)branches.size(); ++br) {
-        const std::vector<Bud> branchBuds = branches[br].GetBuds();
-        for (unsigned int bu = 0; bu < branchBuds.size(); ++bu) {
-            buds.emplace_back(branchBuds[bu]);
+    // 2. Pass Two - For each active bud, if the current attr pt has the current bud as its nearest, add it's normalized dir to the total optimal dir. normalize it at the end.
+    for (unsigned int a = 0; a < (unsigned int)activeBuds.size(); ++a) {
+        const int br = activeBuds[a].branchIdx;
+        const int bu = (activeBuds[a].budIdx == -1) ? (int)GetBranchConst(br).GetNumBuds() - 1 : activeBuds[a].budIdx;
+        Bud& currentBud = GetBud(br, bu);
+        if (currentBud.internodeLength > 0.0f && currentBud.fate == DORMANT && currentBud.numPerceivedAttrPts > 0) {
+            for (unsigned int i = 0; i < (unsigned int)aliveIndices.size(); ++i) {
+                const unsigned int ap = aliveIndices[i];
+                const AttractorPoint& currentAttrPt = attractorPoints[ap];
+                if (nearestBuds[ap].branchIdx == br && nearestBuds[ap].budIdx == bu) {
+                    ++currentBud.numNearbyAttrPts;
+                    currentBud.optimalGrowthDir += currentAttrPt.weight * glm::normalize(currentAttrPt.point - currentBud.point);
+                    currentBud.environmentQuality = 1.0f;
+                }
+            }
+            currentBud.optimalGrowthDir = currentBud.numNearbyAttrPts > 0 ? glm::normalize(currentBud.optimalGrowthDir) : glm::vec3(0.0f);
         }
     }
 
-    Bud* budArray = new Bud[buds.size()];
-    for (int i = 0; i < buds.size(); ++i) {
-        budArray[i] = buds[i];
+    PROFILE_COUNTER("Active Buds", numActiveBuds);
+    PROFILE_COUNTER("Distance Tests", numDistanceTests);
+    PROFILE_COUNTER("Attractor Points Alive", aliveMask.GetNumAlive());
+
+    RetireInactiveBuds();
+}
+
+// Same result as PerformSpaceColonizationCPU, but each active bud keeps the set of points in its perception volume from one iteration to the next.
+// Points never move and only ever get removed, so a bud that hasn't moved only needs its set filtered for dead points. Only new buds and
+// terminal buds that grew are looked up in the attractor point grid. The nearest-bud competition is then replayed over the cached sets alone.
+void Tree::PerformSpaceColonizationIncremental(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const TreeParameters& treeParams) {
+    attractorPointGrid.CompactIfFragmented(aliveMask);
+    KillAttractorPointsNearMovedBuds(attractorPoints, aliveMask, attractorPointGrid);
+    UpdatePerceivedAttractorPoints(attractorPoints, aliveMask, attractorPointGrid, treeParams);
+    ResetPerceivedAttractorPoints(nearestBuds);
+    AssignPerceivedAttractorPoints(nearestBuds, 0);
+    AccumulateOptimalGrowthDirs(attractorPoints, nearestBuds, 0);
+
+    PROFILE_COUNTER("Attractor Points Alive", aliveMask.GetNumAlive());
+
+    RetireInactiveBuds();
+}
+
+// The same steps over every member of a composite. Point indices are the composite's, so the perception sets and the nearest bud scratch work
+// as they do for one cloud.
+void Tree::PerformSpaceColonizationIncremental(AttractorPointComposite& composite, const TreeParameters& treeParams) {
+    composite.CompactGridsIfFragmented();
+    KillAttractorPointsNearMovedBuds(composite);
+    UpdatePerceivedAttractorPoints(composite, treeParams);
+    ResetPerceivedAttractorPoints(nearestBuds);
+    AssignPerceivedAttractorPoints(nearestBuds, 0);
+    AccumulateOptimalGrowthDirs(composite, nearestBuds, 0);
+
+    PROFILE_COUNTER("Attractor Points Alive", composite.GetNumAlive());
+
+    RetireInactiveBuds();
+}
+
+// The same steps over quantized points, which decode each point as it is looked at. The nearest bud scratch only gets pages for perceived points.
+void Tree::PerformSpaceColonizationIncremental(QuantizedAttractorPoints& quantizedPoints, const TreeParameters& treeParams) {
+    KillAttractorPointsNearMovedBuds(quantizedPoints);
+    UpdatePerceivedAttractorPoints(quantizedPoints, treeParams);
+    ResetPerceivedAttractorPoints(nearestBudPages);
+    AssignPerceivedAttractorPoints(nearestBudPages, 0);
+    AccumulateOptimalGrowthDirs(quantizedPoints, nearestBudPages, 0);
+
+    PROFILE_COUNTER("Attractor Points Alive", quantizedPoints.GetNumAlive());
+    PROFILE_COUNTER("Nearest Bud Scratch Points", nearestBudPages.GetNumAllocatedPoints());
+
+    RetireInactiveBuds();
+}
+
+// A single cloud's points, alive mask and grid behind the interface of an AttractorPointComposite, for the steps below. Mask is const for the
+// steps that only read it.
+template <typename Mask>
+struct SingleCloudPoints {
+    const std::vector<AttractorPoint>& points;
+    Mask& aliveMask;
+    const AttractorPointGrid& grid;
+    SingleCloudPoints(const std::vector<AttractorPoint>& p, Mask& m, const AttractorPointGrid& g) : points(p), aliveMask(m), grid(g) {}
+
+    unsigned int GetNumAlive() const { return aliveMask.GetNumAlive(); }
+    const AttractorPoint& operator[](unsigned int i) const { return points[i]; }
+    bool IsAlive(unsigned int i) const { return aliveMask.IsAlive(i); }
+    bool Kill(unsigned int i) { return aliveMask.Kill(i); }
+    template <typename F>
+    void ForEachPointNear(const glm::vec3& center, const float radius, F&& f) const {
+        grid.ForEachPointNear(center, radius, [&](unsigned int ap) { f(ap, points[ap]); });
+    }
+    template <typename F>
+    void ForEachAlivePoint(F&& f) const {
+        aliveMask.ForEachAlive([&](unsigned int ap) { f(ap, points[ap]); });
     }
+};
 
-    // Need to make sure that the grid bounds contain all currently existing buds
-    glm::vec3& minGridPoint = minAttrPt;
-    glm::vec3& maxGridPoint = maxAttrPt;
-    for (unsigned int br = 0; br < (unsigned int)branches.size(); ++br) {
-        const std::vector<Bud>& branchBuds = branches[br].GetBuds();
-        for (unsigned int bu = 0; bu < branchBuds.size(); ++bu) {
-            const Bud& currentBud = branchBuds[bu];
-            if (currentBud.point.x < minGridPoint.x) {
-                minGridPoint.x = currentBud.point.x;
-                reconstructUniformGrid = true;
-            }
-            if (currentBud.point.y < minGridPoint.y) {
-                minGridPoint.y = currentBud.point.y;
-                reconstructUniformGrid = true;
-            }
-            if (currentBud.point.z < minGridPoint.z) {
-                minGridPoint.z = currentBud.point.z;
-                reconstructUniformGrid = true;
+void Tree::KillAttractorPointsNearMovedBuds(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const AttractorPointGrid& grid) {
+    SingleCloudPoints<AttractorPointMask> pointSource = SingleCloudPoints<AttractorPointMask>(attractorPoints, aliveMask, grid);
+    KillAttractorPointsNearMovedBuds(pointSource);
+}
+
+void Tree::UpdatePerceivedAttractorPoints(const std::vector<AttractorPoint>& attractorPoints, const AttractorPointMask& aliveMask, const AttractorPointGrid& grid, const TreeParameters& treeParams) {
+    const SingleCloudPoints<const AttractorPointMask> pointSource = SingleCloudPoints<const AttractorPointMask>(attractorPoints, aliveMask, grid);
+    UpdatePerceivedAttractorPoints(pointSource, treeParams);
+}
+
+// The same steps over a grid that other trees read at the same time, with nearest bud scratch only where needed. The shared grid can't be
+// compacted, so once it is fragmented as far as this tree is concerned, the tree moves on to a compacted copy of its own, which only holds
+// the points still alive for it.
+void Tree::PerformSpaceColonizationIncremental(SharedAttractorPoints& sharedPoints, const TreeParameters& treeParams) {
+    const SharedAttractorPointIndex& index = sharedPoints.index;
+    AttractorPointMask& aliveMask = sharedPoints.aliveMask;
+    const AttractorPointGrid& sharedGrid = index.GetGrid();
+    if (!attractorPointGrid.IsEmpty()) {
+        attractorPointGrid.CompactIfFragmented(aliveMask);
+    } else if ((float)aliveMask.GetNumAlive() < (1.0f - ATTRACTOR_POINT_GRID_MAX_DEAD_FRACTION) * (float)sharedGrid.GetNumIndexedPoints()) {
+        attractorPointGrid.CompactFrom(sharedGrid, aliveMask);
+    }
+    const AttractorPointGrid& grid = attractorPointGrid.IsEmpty() ? sharedGrid : attractorPointGrid;
+    SingleCloudPoints<AttractorPointMask> pointSource = SingleCloudPoints<AttractorPointMask>(index.GetPoints(), aliveMask, grid);
+    KillAttractorPointsNearMovedBuds(pointSource);
+    UpdatePerceivedAttractorPoints(pointSource, treeParams);
+    ResetPerceivedAttractorPoints(nearestBudPages);
+    AssignPerceivedAttractorPoints(nearestBudPages, 0);
+    AccumulateOptimalGrowthDirs(index.GetPoints(), nearestBudPages, 0);
+
+    PROFILE_COUNTER("Attractor Points Alive", aliveMask.GetNumAlive());
+
+    RetireInactiveBuds();
+}
+
+// 1. Buds that are new or have moved remove the points too close to them. Every other active bud already did so at its current position.
+// Each of them looks up the points around it in the grid, unless so few points are left that going over them and looking up the buds that
+// reach each one in a BudBVH of just these buds costs less. That choice holds for UpdatePerceivedAttractorPoints() in the same iteration too.
+template <typename PointSource>
+void Tree::KillAttractorPointsNearMovedBuds(PointSource& pointSource) {
+    PROFILE_LOCAL_COUNTER(numPointsKilled);
+    movedBudIndices.clear();
+    for (unsigned int a = 0; a < (unsigned int)activeBuds.size(); ++a) {
+        if (NeedsPerceptionLookup(activeBuds[a])) { movedBudIndices.push_back(a); }
+    }
+    const unsigned int numLookups = (unsigned int)movedBudIndices.size();
+    const float gridCost = 2.0f * (float)numLookups * (ATTRACTOR_POINT_GRID_LOOKUP_COST + gridLookupFraction * (float)pointSource.GetNumAlive());
+    lookUpInMovedBudBVH = numLookups > 0 && UsePointCentricQueries(numLookups, BUD_BVH_BUILD_COST, movedBudBVHOverlap, pointSource.GetNumAlive(), 2, gridCost);
+    if (lookUpInMovedBudBVH) {
+        movedBudBVH.Clear();
+        for (unsigned int m = 0; m < numLookups; ++m) { // in Morton order, like the active buds
+            const ActiveBudRef& ref = activeBuds[movedBudIndices[m]];
+            const Bud& currentBud = GetActiveBudConst(ref);
+            movedBudBVH.AddItem(currentBud.point, GetBudBVHRadius(currentBud), ref.branchIdx, ref.budIdx);
+        }
+        movedBudBVH.Build();
+        const unsigned int numPoints = pointSource.GetNumAlive();
+        unsigned int numNodesVisited = 0;
+        pointSource.ForEachAlivePoint([&](unsigned int ap, const AttractorPoint& currentAttrPt) {
+            numNodesVisited += movedBudBVH.ForEachBudNear(currentAttrPt.point, [&](int item, int, int) {
+                const Bud& currentBud = GetActiveBudConst(activeBuds[movedBudIndices[item]]);
+                const float killDist2 = KILL_RADIUS_SQUARED * currentBud.internodeLength * currentBud.internodeLength;
+                if (glm::length2(currentAttrPt.point - currentBud.point) < killDist2 && pointSource.Kill(ap)) {
+                    PROFILE_INCREMENT(numPointsKilled, 1);
+                }
+            });
+        });
+        if (numPoints > 0) {
+            movedBudBVHOverlap = (float)numNodesVisited / ((float)numPoints * std::log2((float)numLookups + 1.0f));
+        }
+        PROFILE_COUNTER("Points Killed", numPointsKilled);
+        return;
+    }
+    for (unsigned int m = 0; m < numLookups; ++m) {
+        const Bud& currentBud = GetActiveBudConst(activeBuds[movedBudIndices[m]]);
+        const float killDist2 = KILL_RADIUS_SQUARED * currentBud.internodeLength * currentBud.internodeLength;
+        pointSource.ForEachPointNear(currentBud.point, std::sqrt(killDist2), [&](unsigned int ap, const AttractorPoint& currentAttrPt) {
+            if (glm::length2(currentAttrPt.point - currentBud.point) < killDist2 && pointSource.Kill(ap)) {
+                PROFILE_INCREMENT(numPointsKilled, 1);
             }
-            if (currentBud.point.x > maxGridPoint.x) {
-                maxGridPoint.x = currentBud.point.x;
-                reconstructUniformGrid = true;
+        });
+    }
+    PROFILE_COUNTER("Points Killed", numPointsKilled);
+}
+
+// 2. Rebuild every active bud's perception set into the other pool: filter cached sets, look up new ones, in the grid or the BudBVH
+template <typename PointSource>
+void Tree::UpdatePerceivedAttractorPoints(const PointSource& pointSource, const TreeParameters& treeParams) {
+    const float perceptionCosTheta = std::abs(treeParams.perceptionCosThetaSmall);
+    PROFILE_LOCAL_COUNTER(numActiveBuds);
+    PROFILE_LOCAL_COUNTER(numDistanceTests);
+    PROFILE_LOCAL_COUNTER(numPerceptionSetsRebuilt);
+    lookedUpPoints.clear();
+    if (lookUpInMovedBudBVH) { // the same tests as the grid lookups below, from the other side
+        pointSource.ForEachAlivePoint([&](unsigned int ap, const AttractorPoint& currentAttrPt) {
+            movedBudBVH.ForEachBudNear(currentAttrPt.point, [&](int item, int, int) {
+                const unsigned int a = movedBudIndices[item];
+                const Bud& currentBud = GetActiveBudConst(activeBuds[a]);
+                if (currentBud.internodeLength <= 0.0f || currentBud.fate != DORMANT) { return; }
+                PROFILE_INCREMENT(numDistanceTests, 1);
+                const float perceptionDist2 = PERCEPTION_RADIUS_SQUARED * currentBud.internodeLength * currentBud.internodeLength;
+                glm::vec3 budToPtDir = currentAttrPt.point - currentBud.point;
+                const float budToPtDist2 = glm::length2(budToPtDir);
+                budToPtDir = glm::normalize(budToPtDir);
+                const float dotProd = glm::dot(budToPtDir, currentBud.naturalGrowthDir);
+                if (budToPtDist2 < perceptionDist2 && dotProd > perceptionCosTheta) {
+                    lookedUpPoints.emplace_back(a, ap, budToPtDist2);
+                }
+            });
+        });
+        std::sort(lookedUpPoints.begin(), lookedUpPoints.end()); // each bud's points in a row, in point order
+    }
+    unsigned int nextLookedUp = 0;
+    unsigned int numGridLookups = 0;
+    unsigned int numGridPointsVisited = 0;
+    perceivedPointsNext.clear();
+    for (unsigned int a = 0; a < (unsigned int)activeBuds.size(); ++a) {
+        ActiveBudRef& ref = activeBuds[a];
+        Bud& currentBud = GetActiveBud(ref);
+        const int newStart = (int)perceivedPointsNext.size();
+        if (currentBud.internodeLength > 0.0f && currentBud.fate == DORMANT) {
+            PROFILE_INCREMENT(numActiveBuds, 1);
+            if (NeedsPerceptionLookup(ref)) {
+                PROFILE_INCREMENT(numPerceptionSetsRebuilt, 1);
+                if (lookUpInMovedBudBVH) { // only the buds that get here have looked up points, so they come up in turn
+                    for (; nextLookedUp < (unsigned int)lookedUpPoints.size() && lookedUpPoints[nextLookedUp].activeBudIdx == a; ++nextLookedUp) {
+                        perceivedPointsNext.emplace_back(lookedUpPoints[nextLookedUp].perceived);
+                    }
+                } else {
+                    ++numGridLookups;
+                    const float perceptionDist2 = PERCEPTION_RADIUS_SQUARED * currentBud.internodeLength * currentBud.internodeLength; // ~4x internode length - use distance squared
+                    pointSource.ForEachPointNear(currentBud.point, std::sqrt(perceptionDist2), [&](unsigned int ap, const AttractorPoint& currentAttrPt) {
+                        ++numGridPointsVisited;
+                        if (!pointSource.IsAlive(ap)) { return; }
+                        PROFILE_INCREMENT(numDistanceTests, 1);
+                        glm::vec3 budToPtDir = currentAttrPt.point - currentBud.point;
+                        const float budToPtDist2 = glm::length2(budToPtDir);
+                        budToPtDir = glm::normalize(budToPtDir);
+                        const float dotProd = glm::dot(budToPtDir, currentBud.naturalGrowthDir);
+                        if (budToPtDist2 < perceptionDist2 && dotProd > perceptionCosTheta) {
+                            perceivedPointsNext.emplace_back(ap, budToPtDist2);
+                        }
+                    });
+                    std::sort(perceivedPointsNext.begin() + newStart, perceivedPointsNext.end()); // grid order -> point order, the order the full pass sums in
+                }
+                if (ref.budIdx == -1) { branches[ref.branchIdx].terminalBudMoved = false; }
+            } else {
+                for (int i = ref.perceivedStart; i < ref.perceivedStart + ref.numPerceived; ++i) {
+                    if (pointSource.IsAlive(perceivedPoints[i].pointIdx)) {
+                        perceivedPointsNext.emplace_back(perceivedPoints[i]);
+                    }
+                }
             }
-            if (currentBud.point.y > maxGridPoint.y) {
-                maxGridPoint.y = currentBud.point.y;
-                reconstructUniformGrid = true;
+        }
+        ref.perceivedStart = newStart;
+        ref.numPerceived = (int)perceivedPointsNext.size() - newStart;
+        currentBud.numPerceivedAttrPts = ref.numPerceived;
+    }
+    std::swap(perceivedPoints, perceivedPointsNext);
+    if (numGridLookups > 0 && pointSource.GetNumAlive() > 0) {
+        gridLookupFraction = (float)numGridPointsVisited / ((float)numGridLookups * (float)pointSource.GetNumAlive());
+    }
+
+    PROFILE_COUNTER("Active Buds", numActiveBuds);
+    PROFILE_COUNTER("Distance Tests", numDistanceTests);
+    PROFILE_COUNTER("Perception Sets Rebuilt", numPerceptionSetsRebuilt);
+}
+
+// 3a. Points that no bud perceives are never looked at, so only the perceived ones need their nearest bud cleared
+template <typename NearestBuds>
+void Tree::ResetPerceivedAttractorPoints(NearestBuds& nearest) const {
+    for (unsigned int i = 0; i < (unsigned int)perceivedPoints.size(); ++i) {
+        nearest[perceivedPoints[i].pointIdx] = NearestBud();
+    }
+}
+
+// 3b. Pass One - Every perceived point goes to its nearest bud
+template <typename NearestBuds>
+void Tree::AssignPerceivedAttractorPoints(NearestBuds& nearest, int treeIdx) const {
+    for (unsigned int a = 0; a < (unsigned int)activeBuds.size(); ++a) {
+        const ActiveBudRef& ref = activeBuds[a];
+        const int br = ref.branchIdx;
+        const int bu = (ref.budIdx == -1) ? (int)GetBranchConst(br).GetNumBuds() - 1 : ref.budIdx;
+        for (int i = ref.perceivedStart; i < ref.perceivedStart + ref.numPerceived; ++i) {
+            NearestBud& nearestBud = nearest[perceivedPoints[i].pointIdx];
+            if (IsNearerBud(nearestBud, perceivedPoints[i].dist2, treeIdx, br, bu)) {
+                SetNearestBud(nearestBud, perceivedPoints[i].dist2, treeIdx, br, bu);
             }
-            if (currentBud.point.z > maxGridPoint.z) {
-                maxGridPoint.z = currentBud.point.z;
-                reconstructUniformGrid = true;
+        }
+    }
+}
+
+// 4. Pass Two - Same as the full CPU pass, over each bud's perceived points in ascending point order
+template <typename PointSource, typename NearestBuds>
+void Tree::AccumulateOptimalGrowthDirs(const PointSource& attractorPoints, const NearestBuds& nearest, int treeIdx) {
+    for (unsigned int a = 0; a < (unsigned int)activeBuds.size(); ++a) {
+        const ActiveBudRef& ref = activeBuds[a];
+        if (ref.numPerceived == 0) { continue; }
+        const int br = ref.branchIdx;
+        const int bu = (ref.budIdx == -1) ? (int)GetBranchConst(br).GetNumBuds() - 1 : ref.budIdx;
+        Bud& currentBud = GetBud(br, bu);
+        for (int i = ref.perceivedStart; i < ref.perceivedStart + ref.numPerceived; ++i) {
+            const NearestBud& nearestBud = nearest[perceivedPoints[i].pointIdx];
+            if (nearestBud.treeIdx == treeIdx && nearestBud.branchIdx == br && nearestBud.budIdx == bu) {
+                const AttractorPoint& currentAttrPt = attractorPoints[perceivedPoints[i].pointIdx]; // only looked up if it counts, since decoding may cost
+                ++currentBud.numNearbyAttrPts;
+                currentBud.optimalGrowthDir += currentAttrPt.weight * glm::normalize(currentAttrPt.point - currentBud.point);
+                currentBud.environmentQuality = 1.0f;
             }
         }
+        currentBud.optimalGrowthDir = currentBud.numNearbyAttrPts > 0 ? glm::normalize(currentBud.optimalGrowthDir) : glm::vec3(0.0f);
+    }
+}
+
+// Forest's
+template void Tree::ResetPerceivedAttractorPoints(std::vector<NearestBud>& nearest) const;
+template void Tree::AssignPerceivedAttractorPoints(std::vector<NearestBud>& nearest, int treeIdx) const;
+template void Tree::AccumulateOptimalGrowthDirs(const std::vector<AttractorPoint>& attractorPoints, const std::vector<NearestBud>& nearest, int treeIdx);
+
+void Tree::PerformSpaceColonizationGPU(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, TreeParameters& treeParams) {
+    bool& reconstructUniformGrid = treeParams.reconstructUniformGridOnGPU;
+    // Assemble array of active buds. Retired buds can't perceive or kill anything, so they never leave the CPU.
+    const int numBuds = (int)activeBuds.size();
+    PROFILE_LOCAL_COUNTER(numActiveBuds);
+    Bud* budArray = new Bud[numBuds];
+    for (int i = 0; i < numBuds; ++i) {
+        budArray[i] = GetActiveBud(activeBuds[i]);
+        PROFILE_INCREMENT(numActiveBuds, (budArray[i].internodeLength > 0.0f && budArray[i].fate == DORMANT) ? 1 : 0);
     }
-    reconstructUniformGrid = true; // why does this FIX ITTTT
-    //std::cout << "reconstruct grid after changing points: " << reconstructUniformGrid << std::endl;
+    PROFILE_COUNTER("Active Buds", numActiveBuds);
+
+    // The grid only has to contain the points: buds outside of it just find nothing in the cells past its border. So it keeps its frame while
+    // the tree grows, and the device can keep reusing it (see RunSpaceColonizationKernel).
+    const glm::vec3 minGridPoint = minAttrPt;
+    const glm::vec3 maxGridPoint = maxAttrPt;
     const int maxGridSideLength = (int)std::ceil(std::abs(std::max(std::max(maxGridPoint.x - minGridPoint.x, maxGridPoint.y - minGridPoint.y), maxGridPoint.z - minGridPoint.z)));
     const float gridCellWidth = maxGridSideLength / (float)UNIFORM_GRID_CELL_COUNT;
     const int numTotalGridCells = UNIFORM_GRID_CELL_COUNT * UNIFORM_GRID_CELL_COUNT * UNIFORM_GRID_CELL_COUNT;
 
-    TreeApp::PerformSpaceColonizationParallel(budArray, (int)buds.size(), attractorPoints.data(), (int)attractorPoints.size(),
-                                              UNIFORM_GRID_CELL_COUNT, numTotalGridCells, minGridPoint, gridCellWidth, reconstructUniformGrid, resetAttrPtState);
+    TreeApp::PerformSpaceColonizationParallel(budArray, numBuds, attractorPoints.data(), (int)attractorPoints.size(), aliveMask.GetWords(), (int)aliveMask.GetNumAlive(),
+                                              UNIFORM_GRID_CELL_COUNT, numTotalGridCells, minGridPoint, gridCellWidth, std::abs(treeParams.perceptionCosThetaSmall), gpuPointsRevision,
+                                              reconstructUniformGrid);
+    aliveMask.RecountAlive(); // the kernels cleared the bits of the points they removed
     // Copy bud info back to the tree
-    int budCounter = 0;
+    for (int i = 0; i < numBuds; ++i) {
+        GetActiveBud(activeBuds[i]) = budArray[i];
+    }
+    delete[] budArray;
+
+    RetireInactiveBuds();
+}
+
+/// Shadow propagation
+
+void Tree::CastShadows(const TreeParameters& treeParams) {
     for (unsigned int br = 0; br < (unsigned int)branches.size(); ++br) {
-        std::vector<Bud>& branchBuds = branches[br].buds;
-        for (unsigned int bu = 0; bu < branchBuds.size(); ++bu) {
-            branchBuds[bu] = budArray[bu + budCounter];
+        const unsigned int numBuds = (unsigned int)GetBranchConst(br).GetNumBuds();
+        for (unsigned int bu = (br == 0) ? 0 : 1; bu < numBuds; ++bu) { // the first bud of any branch but the trunk sits on the bud that formed the branch
+            shadowGrid.CastShadow(GetBudConst(br, bu).point, treeParams.shadowStrength, treeParams.shadowFalloff, treeParams.shadowPyramidDepth);
         }
-        budCounter += (unsigned int)branchBuds.size();
     }
 }
 
-float Tree::ComputeQAccumRecursive(TreeBranch& branch) {
+void Tree::CastNewShootShadows(const TreeParameters& treeParams) {
+    for (unsigned int s = 0; s < (unsigned int)newShoots.size(); ++s) {
+        const NewShoot& shoot = newShoots[s];
+        const int grownBranchIdx = (shoot.formedBranchIndex == -1) ? shoot.branchIdx : shoot.formedBranchIndex;
+        const int numBuds = (int)GetBranchConst(grownBranchIdx).GetNumBuds();
+        for (int bu = numBuds - shoot.numMetamers; bu < numBuds; ++bu) { // new buds but the first, then the terminal bud
+            shadowGrid.CastShadow(GetBudConst(grownBranchIdx, bu).point, treeParams.shadowStrength, treeParams.shadowFalloff, treeParams.shadowPyramidDepth);
+        }
+    }
+}
+
+// Every active bud reads the light at its own voxel: Q = max(C - s, 0), full light minus the shadow there. A lit bud grows
+// toward the least shadowed voxel in its perception volume (the same cone and radius as in space colonization), an unlit one retires for
+// good, since shadows only ever get darker.
+void Tree::PerformShadowPropagation(const TreeParameters& treeParams) {
+    PROFILE_SCOPE("Shadow Propagation");
+    const float perceptionCosTheta = std::abs(treeParams.perceptionCosThetaSmall);
+    const float perceptionSinTheta = std::sqrt(std::max(1.0f - perceptionCosTheta * perceptionCosTheta, 0.0f));
+    PROFILE_LOCAL_COUNTER(numActiveBuds);
+    PROFILE_LOCAL_COUNTER(numVoxelsVisited);
+    for (unsigned int a = 0; a < (unsigned int)activeBuds.size(); ++a) {
+        Bud& currentBud = GetActiveBud(activeBuds[a]);
+        if (currentBud.internodeLength <= 0.0f || currentBud.fate != DORMANT) { continue; }
+        const glm::ivec3 budVoxel = shadowGrid.VoxelCoords(currentBud.point);
+        if (!shadowGrid.IsInside(budVoxel)) { continue; } // no light outside the grid, like no points outside the cloud
+        const float light = std::max(SHADOW_FULL_LIGHT - shadowGrid.GetShadow(budVoxel), 0.0f);
+        if (light <= 0.0f) { continue; }
+        PROFILE_INCREMENT(numActiveBuds, 1);
+        currentBud.environmentQuality = light;
+        currentBud.numPerceivedAttrPts = 1;
+
+        // Only the voxels in the bounding box of the perception volume: the cone from the bud out to the disc where it meets the sphere,
+        // then the spherical cap, which stays inside the cylinder over that disc
+        const float perceptionDist2 = PERCEPTION_RADIUS_SQUARED * currentBud.internodeLength * currentBud.internodeLength; // ~4x internode length - use distance squared
+        const float perceptionRadius = std::sqrt(perceptionDist2);
+        const glm::vec3& growthDir = currentBud.naturalGrowthDir;
+        const glm::vec3 discExtent = perceptionRadius * perceptionSinTheta * glm::sqrt(glm::max(glm::vec3(1.0f) - growthDir * growthDir, glm::vec3(0.0f)));
+        const glm::vec3 nearDiscCenter = currentBud.point + perceptionRadius * perceptionCosTheta * growthDir;
+        const glm::vec3 farDiscCenter = currentBud.point + perceptionRadius * growthDir;
+        const glm::ivec3 minVoxel = shadowGrid.ClampToGrid(shadowGrid.VoxelCoords(glm::min(currentBud.point, glm::min(nearDiscCenter, farDiscCenter) - discExtent)));
+        const glm::ivec3 maxVoxel = shadowGrid.ClampToGrid(shadowGrid.VoxelCoords(glm::max(currentBud.point, glm::max(nearDiscCenter, farDiscCenter) + discExtent)));
+        float leastShadow = 0.0f;
+        glm::vec3 leastShadowDir = glm::vec3(0.0f);
+        for (int z = minVoxel.z; z <= maxVoxel.z; ++z) {
+            for (int y = minVoxel.y; y <= maxVoxel.y; ++y) {
+                for (int x = minVoxel.x; x <= maxVoxel.x; ++x) {
+                    const glm::ivec3 voxel = glm::ivec3(x, y, z);
+                    PROFILE_INCREMENT(numVoxelsVisited, 1);
+                    glm::vec3 budToVoxelDir = shadowGrid.GetVoxelCenter(voxel) - currentBud.point;
+                    const float budToVoxelDist2 = glm::length2(budToVoxelDir);
+                    if (budToVoxelDist2 >= perceptionDist2 || budToVoxelDist2 == 0.0f) { continue; }
+                    budToVoxelDir = glm::normalize(budToVoxelDir);
+                    const float shadow = shadowGrid.GetShadow(voxel);
+                    if (glm::dot(budToVoxelDir, growthDir) > perceptionCosTheta && (leastShadowDir == glm::vec3(0.0f) || shadow < leastShadow)) {
+                        leastShadow = shadow;
+                        leastShadowDir = budToVoxelDir;
+                    }
+                }
+            }
+        }
+        currentBud.optimalGrowthDir = leastShadowDir;
+    }
+    PROFILE_COUNTER("Active Buds", numActiveBuds);
+    PROFILE_COUNTER("Voxels Visited", numVoxelsVisited);
+
+    RetireInactiveBuds();
+}
+
+// The BH and pipe model passes visit every bud, but only write the values that changed: most of a grown tree comes out the same every time,
+// and leaving it untouched keeps its branches shared with any snapshot or fork. Buds are looked up again after each recursive call, since a
+// write in there may have copied the chunk they live in.
+float Tree::ComputeQAccumRecursive(int br) {
     float accumQ = 0.0f;
-    for (int bu = (int)branch.buds.size() - 1; bu >= 0; --bu) {
-        Bud& currentBud = branch.buds[bu];
+    for (int bu = (int)GetBranchConst(br).GetNumBuds() - 1; bu >= 0; --bu) {
+        const Bud& currentBud = GetBudConst(br, bu);
         switch (currentBud.type) {
         case TERMINAL:
             accumQ += currentBud.environmentQuality;
@@ -288,10 +1169,10 @@ float Tree::ComputeQAccumRecursive(TreeBranch& branch) {
                 accumQ += currentBud.environmentQuality;
                 break;
             case FORMED_BRANCH:
-                accumQ += ComputeQAccumRecursive(branches[currentBud.formedBranchIndex]);
+                accumQ += ComputeQAccumRecursive(currentBud.formedBranchIndex);
                 break;
             case FORMED_FLOWER: // double check if we include the resource in this case TODO
-                accumQ += ComputeQAccumRecursive(branches[currentBud.formedBranchIndex]);
+                accumQ += ComputeQAccumRecursive(currentBud.formedBranchIndex);
                 break;
             default: // includes ABORT case - ignore this bud
                 break;
@@ -299,96 +1180,186 @@ float Tree::ComputeQAccumRecursive(TreeBranch& branch) {
             break;
         }
         }
-        currentBud.accumEnvironmentQuality = accumQ;
+        if (GetBudConst(br, bu).accumEnvironmentQuality != accumQ) {
+            GetBud(br, bu).accumEnvironmentQuality = accumQ;
+        }
     }
     return accumQ;
 }
 void Tree::ComputeBHModelBasipetalPass() {
     // TODO: This is a little inefficient and I should eventually memoize the information so we don't have to recompute branches.
-    ComputeQAccumRecursive(branches[0]); // ignore return value
+    ComputeQAccumRecursive(0); // ignore return value
 }
 
 // make this a non-member helper function in the cpp file
-void Tree::ComputeResourceFlowRecursive(TreeBranch& branch, float resource) {
-    for (unsigned int bu = 0; bu < (unsigned int)branch.buds.size(); ++bu) {
-        Bud& currentBud = branch.buds[bu];
+void Tree::ComputeResourceFlowRecursive(int br, float resource, const float lambda) {
+    const unsigned int numBuds = (unsigned int)GetBranchConst(br).GetNumBuds();
+    for (unsigned int bu = 0; bu < numBuds; ++bu) {
+        const Bud& currentBud = GetBudConst(br, bu);
+        float resourceBH = currentBud.resourceBH;
         switch (currentBud.type) {
         case TERMINAL:
-            currentBud.resourceBH = resource;
+            resourceBH = resource;
             break;
         case AXILLARY:
             switch (currentBud.fate) {
             case DORMANT:
-                currentBud.resourceBH = resource;
+                resourceBH = resource;
                 break;
                 // Have to scope w/ brackets for nontrivial cases, apparently: https://stackoverflow.com/questions/10381144/error-c2361-initialization-of-found-is-skipped-by-default-label
             case FORMED_BRANCH: { // It is assumed that these buds always occur at the 0th index in the vector
-                TreeBranch& axillaryBranch = branches[currentBud.formedBranchIndex];
-                const float Qm = branch.buds[bu + 1].accumEnvironmentQuality; // Q on main axis
-                const float Ql = axillaryBranch.buds[1].accumEnvironmentQuality; // Q on axillary axis
-                const float denom = LAMBDA * Qm + (1.0f - LAMBDA) * Ql;
-                currentBud.resourceBH = resource * (LAMBDA * Qm) / denom; // formula for main axis
-                ComputeResourceFlowRecursive(axillaryBranch, resource * (1.0f - LAMBDA) * Ql / denom); // call this function on the axillary branch with the other formula
-                resource = currentBud.resourceBH; // Resource reaching the remaining buds in this branch have the attenuated resource
+                const int axillaryBranchIdx = currentBud.formedBranchIndex;
+                const float Qm = GetBudConst(br, bu + 1).accumEnvironmentQuality; // Q on main axis
+                const float Ql = GetBudConst(axillaryBranchIdx, 1).accumEnvironmentQuality; // Q on axillary axis
+                const float denom = lambda * Qm + (1.0f - lambda) * Ql;
+                resourceBH = resource * (lambda * Qm) / denom; // formula for main axis
+                ComputeResourceFlowRecursive(axillaryBranchIdx, resource * (1.0f - lambda) * Ql / denom, lambda); // call this function on the axillary branch with the other formula
+                resource = resourceBH; // Resource reaching the remaining buds in this branch have the attenuated resource
                 break;
             }
             case FORMED_FLOWER:
-                currentBud.resourceBH = 0.0f;
+                resourceBH = 0.0f;
                 break;
             default: // FORMED_FLOWER or ABORT
-                currentBud.resourceBH = 0.0f;
+                resourceBH = 0.0f;
                 break;
 
             }
             break;
         }
+        if (GetBudConst(br, bu).resourceBH != resourceBH) {
+            GetBud(br, bu).resourceBH = resourceBH;
+        }
     }
 }
-void Tree::ComputeBHModelAcropetalPass() { // Recursive like basipetal pass, but will definitely need to memoize or something
+void Tree::ComputeBHModelAcropetalPass(const TreeParameters& treeParams) { // Recursive like basipetal pass, but will definitely need to memoize or something
                                      // pass in the first branch and the base amount of resource (v)
-    ComputeResourceFlowRecursive(branches[0], (branches[0].buds[0].type == TERMINAL) ? branches[0].buds[0].accumEnvironmentQuality * 1.0f : branches[0].buds[0].accumEnvironmentQuality * ALPHA);
+    const Bud& rootBud = GetBudConst(0, 0);
+    ComputeResourceFlowRecursive(0, (rootBud.type == TERMINAL) ? rootBud.accumEnvironmentQuality * 1.0f : rootBud.accumEnvironmentQuality * treeParams.BHAlpha, treeParams.BHLambda);
+}
+
+// Number of metamers a bud grows given the resource reaching it, 0 if it doesn't grow
+static int GetNumNewMetamers(const Bud& bud) {
+    const int numMetamers = static_cast<int>(std::floor(bud.resourceBH));
+    return (bud.type == TERMINAL || bud.fate == DORMANT) ? std::max(numMetamers, 0) : 0;
 }
 
 // Determine whether to grow new shoots and their length(s)
+// Runs in phases, so that the per-metamer work can be spread over threads while the tree still comes out exactly as if the buds were visited
+// one after the other (branch by branch, from the base of each branch up): new branches get their indices and bud slots in that order.
 void Tree::AppendNewShoots(int n, const TreeParameters& treeParams) {
-    const unsigned int numBranches = (unsigned int)branches.size();
-    for (unsigned int br = 0; br < numBranches; ++br) {
-        TreeBranch& currentBranch = branches[br];
-        std::vector<Bud>& buds = currentBranch.buds;
-        const unsigned int numBuds = (unsigned int)buds.size();
-        for (unsigned int bu = 0; bu < numBuds; ++bu) {
-            Bud& currentBud = buds[bu];
-            const int numMetamers = static_cast<int>(std::floor(currentBud.resourceBH));
-            if (numMetamers > 0) {
-                const float metamerLength = currentBud.resourceBH / (float)numMetamers * treeParams.internodeScale;
-                switch (currentBud.type) {
-                case TERMINAL: {
-                    didUpdate = true;
-                    currentBranch.AddAxillaryBuds(currentBud, numMetamers, metamerLength);
-                    break;
-                }
-                case AXILLARY: {
-                    if (currentBud.fate == DORMANT) {
-                        didUpdate = true;
-                        TreeBranch newBranch = TreeBranch(currentBud.point, currentBud.naturalGrowthDir, branches[br].axisOrder + 1, br);
-                        newBranch.AddAxillaryBuds(currentBud, numMetamers, metamerLength);
-                        branches.emplace_back(newBranch);
-                        currentBud.fate = FORMED_BRANCH;
-                        currentBud.formedBranchIndex = (int)branches.size() - 1;
-                    }
-                    break;
-                }
+    const unsigned int numBranches = branches.size();
+
+    // 1. Find the growing buds: list them per block of branches in one pass, then put the blocks one after the other
+    newShootBlocks.resize((numBranches + NEW_SHOOT_BRANCHES_PER_BLOCK - 1) / NEW_SHOOT_BRANCHES_PER_BLOCK); // kept between calls, for their capacity
+    ParallelForBlocks(numBranches, NEW_SHOOT_BRANCHES_PER_BLOCK, [&](unsigned int begin, unsigned int end) {
+        std::vector<NewShoot>& blockShoots = newShootBlocks[begin / NEW_SHOOT_BRANCHES_PER_BLOCK];
+        blockShoots.clear();
+        for (unsigned int br = begin; br < end; ++br) {
+            const TreeBranch& branch = GetBranchConst(br);
+            for (unsigned int bu = 0; bu < branch.numBuds; ++bu) {
+                const Bud& currentBud = buds.Get(branch.GetBudSlot(bu));
+                const int numMetamers = GetNumNewMetamers(currentBud);
+                if (numMetamers > 0) {
+                    NewShoot shoot = NewShoot();
+                    shoot.branchIdx = br;
+                    shoot.budIdx = bu;
+                    shoot.numMetamers = numMetamers;
+                    shoot.metamerLength = currentBud.resourceBH / (float)numMetamers * treeParams.internodeScale;
+                    blockShoots.push_back(shoot);
                 }
             }
         }
+    });
+    newShoots.clear();
+    for (unsigned int b = 0; b < (unsigned int)newShootBlocks.size(); ++b) {
+        newShoots.insert(newShoots.end(), newShootBlocks[b].begin(), newShootBlocks[b].end());
+    }
+    const unsigned int numNewShoots = (unsigned int)newShoots.size();
+    didUpdate = numNewShoots > 0;
+    if (didUpdate) { InvalidateStage(STAGE_RADII); }
+
+    // 2. In order: add the new branches and make room for the new buds. Afterwards no bud the next phase writes is shared with a snapshot.
+    for (unsigned int s = 0; s < numNewShoots; ++s) {
+        NewShoot& shoot = newShoots[s];
+        if (GetBudConst(shoot.branchIdx, shoot.budIdx).type == TERMINAL) {
+            ReserveBuds(shoot.branchIdx, GetBranchConst(shoot.branchIdx).GetNumBuds() + shoot.numMetamers);
+            const TreeBranch& branch = GetBranchConst(shoot.branchIdx);
+            buds.MakeUnique(branch.firstBudSlot, branch.numBuds + shoot.numMetamers);
+        } else {
+            const Bud formingBud = GetBudConst(shoot.branchIdx, shoot.budIdx); // by value: adding the branch may copy the chunk the bud is in
+            shoot.formedBranchIndex = AddBranch(formingBud.point, formingBud.naturalGrowthDir, GetBranchConst(shoot.branchIdx).axisOrder + 1, shoot.branchIdx, 1 + shoot.numMetamers);
+            buds.MakeUnique(GetBranchConst(shoot.formedBranchIndex).firstBudSlot, 1 + shoot.numMetamers);
+            buds.MakeUnique(GetBranchConst(shoot.branchIdx).GetBudSlot(shoot.budIdx), 1);
+        }
+    }
+
+    // 3. Write the new metamers. Each shoot only writes to its own bud slots, and nothing writes to the branch table.
+    if (treeParams.tropismDirWeight == 0.0f) {
+        WriteNewShoots<false>(treeParams);
+    } else {
+        WriteNewShoots<true>(treeParams);
+    }
+
+    // 4. In order: count the new buds in and activate them
+    const unsigned int numOrderedActiveBuds = (unsigned int)activeBuds.size();
+    for (unsigned int s = 0; s < numNewShoots; ++s) {
+        const NewShoot& shoot = newShoots[s];
+        const int grownBranchIdx = (shoot.formedBranchIndex == -1) ? shoot.branchIdx : shoot.formedBranchIndex;
+        TreeBranch& grownBranch = branches[grownBranchIdx];
+        const int firstNewBud = (int)grownBranch.numBuds - 1; // new buds are inserted in front of the terminal bud
+        grownBranch.numBuds += shoot.numMetamers;
+        grownBranch.terminalBudMoved = true;
+        for (int b = 0; b < shoot.numMetamers; ++b) {
+            ActivateBud(grownBranchIdx, firstNewBud + b);
+        }
+        ActivateBud(grownBranchIdx, -1); // the terminal bud moved, so it may perceive points again
     }
+    OrderActiveBuds(numOrderedActiveBuds);
+
+    // 5. Shadow model only: the new buds shade the voxels below them from the next iteration on
+    if (treeParams.environmentModel == ENVIRONMENT_SHADOW_PROPAGATION) {
+        CastNewShootShadows(treeParams);
+    }
+}
+
+template <bool WITH_TROPISM>
+void Tree::WriteNewShoots(const TreeParameters& treeParams) {
+    ParallelForBlocks((unsigned int)newShoots.size(), NEW_SHOOTS_PER_BLOCK, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int s = begin; s < end; ++s) {
+            const NewShoot& shoot = newShoots[s];
+            const Bud sourceBud = GetBudConst(shoot.branchIdx, shoot.budIdx); // by value: it may be the terminal bud that gets moved
+            if (shoot.formedBranchIndex == -1) {
+                WriteAxillaryBuds<WITH_TROPISM>(shoot.branchIdx, sourceBud, shoot.numMetamers, shoot.metamerLength, treeParams);
+            } else {
+                WriteAxillaryBuds<WITH_TROPISM>(shoot.formedBranchIndex, sourceBud, shoot.numMetamers, shoot.metamerLength, treeParams);
+                Bud& formingBud = GetBud(shoot.branchIdx, shoot.budIdx);
+                formingBud.fate = FORMED_BRANCH;
+                formingBud.formedBranchIndex = shoot.formedBranchIndex;
+            }
+        }
+    });
 }
 
+// How the pipe model combines the radius of a branch with the radius of a branch it forms: r = (r1^e + r2^e)^(1/e). Exponents 2 (area
+// preserving) and 3 (Murray's law) are common enough to get their own version without the three pow() calls.
+struct PipeModelPow {
+    float exponent;
+    float Combine(float r1, float r2) const { return std::pow(std::pow(r1, exponent) + std::pow(r2, exponent), 1.0f / exponent); }
+};
+struct PipeModelSquare {
+    float Combine(float r1, float r2) const { return std::sqrt(r1 * r1 + r2 * r2); }
+};
+struct PipeModelCube {
+    float Combine(float r1, float r2) const { return std::cbrt(r1 * r1 * r1 + r2 * r2 * r2); }
+};
+
 // Using the "pipe model" described in the paper, compute the radius of each branch
-float Tree::ComputeBranchRadiiRecursive(TreeBranch& branch, const TreeParameters& treeParams) {
-    float branchRadius = treeParams.minimumBranchRadius;
-    for (int bu = (int)branch.buds.size() - 1; bu >= 0; --bu) {
-        Bud& currentBud = branch.buds[bu];
+template <typename PipeModel>
+float Tree::ComputeBranchRadiiRecursive(int br, const PipeModel& pipeModel, const float minimumBranchRadius, const float maximumBranchRadius) {
+    float branchRadius = minimumBranchRadius;
+    for (int bu = (int)GetBranchConst(br).GetNumBuds() - 1; bu >= 0; --bu) {
+        const Bud& currentBud = GetBudConst(br, bu);
         switch (currentBud.type) {
         case TERMINAL:
             break;
@@ -399,7 +1370,7 @@ float Tree::ComputeBranchRadiiRecursive(TreeBranch& branch, const TreeParameters
                 // do nothing I think, only add at branching points. TODO verify
                 break;
             case FORMED_BRANCH:
-                branchRadius = std::pow(std::pow(branchRadius, PIPE_EXPONENT) + std::pow(ComputeBranchRadiiRecursive(branches[currentBud.formedBranchIndex], treeParams), PIPE_EXPONENT), 1.0f / PIPE_EXPONENT);
+                branchRadius = pipeModel.Combine(branchRadius, ComputeBranchRadiiRecursive(currentBud.formedBranchIndex, pipeModel, minimumBranchRadius, maximumBranchRadius));
                 break;
             case FORMED_FLOWER:
                 // don't change radius for now?
@@ -410,60 +1381,149 @@ float Tree::ComputeBranchRadiiRecursive(TreeBranch& branch, const TreeParameters
             break;
         }
         }
-        currentBud.branchRadius = std::min(branchRadius, treeParams.maximumBranchRadius);
+        const float budRadius = std::min(branchRadius, maximumBranchRadius);
+        if (GetBudConst(br, bu).branchRadius != budRadius) {
+            GetBud(br, bu).branchRadius = budRadius;
+        }
     }
     return branchRadius;
 }
 
 void Tree::ComputeBranchRadii(const TreeParameters& treeParams) {
-    ComputeBranchRadiiRecursive(branches[0], treeParams); // ignore return value
+    // return values ignored
+    if (treeParams.pipeModelExponent == 2.0f) {
+        ComputeBranchRadiiRecursive(0, PipeModelSquare(), treeParams.minimumBranchRadius, treeParams.maximumBranchRadius);
+    } else if (treeParams.pipeModelExponent == 3.0f) {
+        ComputeBranchRadiiRecursive(0, PipeModelCube(), treeParams.minimumBranchRadius, treeParams.maximumBranchRadius);
+    } else {
+        PipeModelPow pipeModel = PipeModelPow();
+        pipeModel.exponent = treeParams.pipeModelExponent;
+        ComputeBranchRadiiRecursive(0, pipeModel, treeParams.minimumBranchRadius, treeParams.maximumBranchRadius);
+    }
+    stageParameters.CopyStageFields(STAGE_RADII, treeParams);
+    dirtyStage = STAGE_MESH;
 }
 
-void Tree::ResetState(std::vector<AttractorPoint>& attractorPoints, bool useGPU) {
-    for (unsigned int br = 0; br < (unsigned int)branches.size(); ++br) {
-        std::vector<Bud>& buds = branches[br].buds;
-        for (int bu = 0; bu < buds.size(); ++bu) {
-            Bud& currentBud = buds[bu];
-            currentBud.accumEnvironmentQuality = 0.0f;
-            currentBud.environmentQuality = 0.0f;
-            currentBud.numNearbyAttrPts = 0;
-            currentBud.optimalGrowthDir = glm::vec3(0.0f);
-            currentBud.resourceBH = 0.0f;
+// Only active buds need resetting: a bud is retired with no perceived points, so its space colonization state is already zero, and the BH passes
+// overwrite accumEnvironmentQuality / resourceBH of every bud anyway.
+void Tree::ResetState(const TreeParameters& treeParams, bool useGPU) {
+    for (unsigned int a = 0; a < (unsigned int)activeBuds.size(); ++a) {
+        Bud& currentBud = GetActiveBud(activeBuds[a]);
+        currentBud.accumEnvironmentQuality = 0.0f;
+        currentBud.environmentQuality = 0.0f;
+        currentBud.numNearbyAttrPts = 0;
+        currentBud.numPerceivedAttrPts = 0;
+        currentBud.optimalGrowthDir = glm::vec3(0.0f);
+        currentBud.resourceBH = 0.0f;
+    }
+
+    if (!useGPU && !treeParams.incrementalSpaceColonization) { // the incremental pass resets just the points it looks at
+        std::fill(nearestBuds.begin(), nearestBuds.end(), NearestBud());
+    }
+}
+
+// Remove all attractor points that are too close to buds
+void Tree::RemoveAttractorPoints(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask) {
+    PROFILE_SCOPE("Remove Attractor Points");
+    const unsigned int numAttrPtsBefore = aliveMask.GetNumAlive();
+    std::vector<unsigned int> aliveIndices = std::vector<unsigned int>();
+    aliveMask.GetAliveIndices(aliveIndices);
+
+    // 1. Remove all attractor points that are too close to any bud. Retired buds have already cleared their surroundings at their current position.
+    if (UsePointCentricQueries((unsigned int)activeBuds.size(), BUD_BVH_UPDATE_COST, 1.0f, (unsigned int)aliveIndices.size(), 1, (float)activeBuds.size() * (float)aliveIndices.size())) {
+        UpdateBudBVH();
+        for (unsigned int i = 0; i < (unsigned int)aliveIndices.size(); ++i) {
+            const unsigned int ap = aliveIndices[i];
+            budBVH.ForEachBudNear(attractorPoints[ap].point, [&](int, int br, int bu) {
+                const Bud& currentBud = GetBudConst(br, bu);
+                const float budToPtDist = glm::length2(attractorPoints[ap].point - currentBud.point);
+                if (budToPtDist < KILL_RADIUS_SQUARED * currentBud.internodeLength * currentBud.internodeLength) {
+                    aliveMask.Kill(ap);
+                }
+            });
+        }
+        PROFILE_COUNTER("Points Killed", numAttrPtsBefore - aliveMask.GetNumAlive());
+        return;
+    }
+    for (unsigned int a = 0; a < (unsigned int)activeBuds.size(); ++a) {
+        const Bud& currentBud = GetActiveBud(activeBuds[a]);
+        for (unsigned int i = 0; i < (unsigned int)aliveIndices.size(); ++i) {
+            const unsigned int ap = aliveIndices[i];
+            const float budToPtDist = glm::length2(attractorPoints[ap].point - currentBud.point);
+            if (budToPtDist < KILL_RADIUS_SQUARED * currentBud.internodeLength * currentBud.internodeLength) {
+                aliveMask.Kill(ap); // This attractor point is close to the bud, remove it. Does nothing if an earlier bud already did.
+            }
         }
     }
+    PROFILE_COUNTER("Points Killed", numAttrPtsBefore - aliveMask.GetNumAlive());
+}
+
+/// Active bud list
+
+void Tree::ActivateBud(int br, int bu) {
+    const TreeBranch& branch = GetBranchConst(br);
+    const Bud& bud = GetBudConst(br, bu);
+    if (bud.internodeLength <= 0.0f) { return; } // can neither perceive nor kill anything
+    if (bu == -1) {
+        if (branch.terminalBudActive) { return; }
+        branches[br].terminalBudActive = true;
+    }
+    activeBuds.emplace_back(br, bu);
+    activeBuds.back().mortonCode = activeBudMortonFrame.Encode(bud.point);
+}
 
-    if (!useGPU) {
-        for (unsigned int ap = 0; ap < (unsigned int)attractorPoints.size(); ++ap) {
-            AttractorPoint& currentAttrPt = attractorPoints[ap];
-            currentAttrPt.nearestBudDist2 = 9999999.0f;
-            currentAttrPt.nearestBudBranchIdx = -1;
-            currentAttrPt.nearestBudIdx = -1;
+void Tree::RetireInactiveBuds() {
+    unsigned int numKept = 0;
+    for (unsigned int a = 0; a < (unsigned int)activeBuds.size(); ++a) {
+        const ActiveBudRef ref = activeBuds[a];
+        const Bud& currentBud = GetActiveBudConst(ref);
+        if (currentBud.fate == DORMANT && currentBud.internodeLength > 0.0f && currentBud.numPerceivedAttrPts > 0) {
+            activeBuds[numKept++] = ref;
+        } else if (ref.budIdx == -1) {
+            branches[ref.branchIdx].terminalBudActive = false;
         }
     }
+    activeBuds.erase(activeBuds.begin() + numKept, activeBuds.end());
 }
 
-// Remove all attractor points that are too close to buds
-void Tree::RemoveAttractorPoints(std::vector<AttractorPoint>& attractorPoints) {
-    // 1. Remove all attractor points that are too close to any bud
+void Tree::OrderActiveBuds(unsigned int numOrderedActiveBuds) {
+    const unsigned int numActiveBuds = (unsigned int)activeBuds.size();
+    if (numOrderedActiveBuds >= numActiveBuds) { return; }
+    if (numOrderedActiveBuds == 0) {
+        for (unsigned int a = 0; a < numActiveBuds; ++a) {
+            activeBuds[a].mortonCode = activeBudMortonFrame.Encode(GetActiveBudConst(activeBuds[a]).point);
+        }
+        RadixSortByKey(activeBuds, activeBudsScratch, [](const ActiveBudRef& ref) { return ref.mortonCode; });
+        return;
+    }
+    activeBudsScratch.assign(activeBuds.begin() + numOrderedActiveBuds, activeBuds.end());
+    std::vector<ActiveBudRef> newBudsScratch = std::vector<ActiveBudRef>();
+    RadixSortByKey(activeBudsScratch, newBudsScratch, [](const ActiveBudRef& ref) { return ref.mortonCode; });
+    std::copy(activeBudsScratch.begin(), activeBudsScratch.end(), activeBuds.begin() + numOrderedActiveBuds);
+    std::inplace_merge(activeBuds.begin(), activeBuds.begin() + numOrderedActiveBuds, activeBuds.end(),
+                       [](const ActiveBudRef& a, const ActiveBudRef& b) { return a.mortonCode < b.mortonCode; });
+}
+
+void Tree::ReactivateBuds(const glm::vec3& minPt, const glm::vec3& maxPt) {
+    if (minPt.x > maxPt.x || minPt.y > maxPt.y || minPt.z > maxPt.z) { return; } // empty box
     for (unsigned int br = 0; br < (unsigned int)branches.size(); ++br) {
-        const std::vector<Bud>& buds = branches[br].buds;
-        for (unsigned int bu = 0; bu < (unsigned int)buds.size(); ++bu) {
-
-            auto attrPtIter = attractorPoints.begin();
-            while (attrPtIter != attractorPoints.end()) {
-                const Bud& currentBud = buds[bu];
-                const float budToPtDist = glm::length2(attrPtIter->point - currentBud.point);
-                if (budToPtDist < 5.1f * currentBud.internodeLength * currentBud.internodeLength) { // ~2x internode length - use distance squared
-                    attrPtIter = attractorPoints.erase(attrPtIter); // This attractor point is close to the bud, remove it
-                } else {
-                    ++attrPtIter;
-                }
+        const unsigned int numBuds = (unsigned int)GetBranchConst(br).GetNumBuds();
+        for (unsigned int bu = 0; bu < numBuds; ++bu) {
+            const Bud& currentBud = GetBudConst(br, bu);
+            const glm::vec3 closestBoxPoint = glm::clamp(currentBud.point, minPt, maxPt);
+            if (glm::length2(currentBud.point - closestBoxPoint) < PERCEPTION_RADIUS_SQUARED * currentBud.internodeLength * currentBud.internodeLength) { // perception radius, see PerformSpaceColonizationCPU
+                ActivateBud(br, (bu == numBuds - 1) ? -1 : (int)bu);
             }
         }
     }
+    // Axillary buds that were already active got added twice
+    std::sort(activeBuds.begin(), activeBuds.end());
+    activeBuds.erase(std::unique(activeBuds.begin(), activeBuds.end()), activeBuds.end());
 }
 
-void Tree::create() {
+void Tree::BakeMeshes() {
+    PROFILE_SCOPE("Tree Mesh Creation");
+
     // Flush currently stored mesh
     treeMesh.clearData();
     leavesMesh.clearData();
@@ -487,14 +1547,14 @@ void Tree::create() {
     const std::vector<unsigned int>& leafMeshIndices = leafMesh.GetIndices();
 
     for (int br = 0; br < branches.size(); ++br) {
-        const std::vector<Bud>& buds = branches[br].GetBuds();
+        const unsigned int numBuds = GetBranchConst(br).GetNumBuds();
         int bu = 1;
-        for (; bu < buds.size(); ++bu) {
-            const Bud& currentBud = buds[bu];
+        for (; bu < numBuds; ++bu) {
+            const Bud& currentBud = GetBudConst(br, bu);
             const glm::vec3& internodeEndPoint = currentBud.point; // effectively, just the position of the bud at the end of the current internode
 
             // Compute the transformation for the current internode
-            glm::vec3 branchAxis = glm::normalize(internodeEndPoint - buds[bu - 1].point);
+            glm::vec3 branchAxis = glm::normalize(internodeEndPoint - GetBudConst(br, bu - 1).point);
             const float angle = std::acos(glm::dot(branchAxis, WORLD_UP_VECTOR));
             glm::mat4 branchTransform;
             if (angle > 0.01f) {
@@ -512,11 +1572,13 @@ void Tree::create() {
             // Create an overall transformation matrix of translation and rotation
             branchTransform = glm::translate(glm::mat4(1.0f), translation) * branchTransform * glm::scale(glm::mat4(1.0f), glm::vec3(currentBud.branchRadius * 0.02f, currentBud.internodeLength * 0.5f, currentBud.branchRadius * 0.02f));
             
+            const glm::mat4 branchNormalTransform = glm::inverse(glm::transpose(branchTransform)); // once per internode, not once per vertex
+
             std::vector<glm::vec3> branchMeshPointsTrans = std::vector<glm::vec3>();
             std::vector<glm::vec3> branchMeshNormalsTrans = std::vector<glm::vec3>();
             for (int i = 0; i < branchMeshPoints.size(); ++i) {
                 branchMeshPointsTrans.emplace_back(glm::vec3(branchTransform * glm::vec4(branchMeshPoints[i], 1.0f)));
-                const glm::vec3 transformedNormal = glm::normalize(glm::vec3(glm::inverse(glm::transpose(branchTransform)) * glm::vec4(branchMeshNormals[i], 0.0f)));
+                const glm::vec3 transformedNormal = glm::normalize(glm::vec3(branchNormalTransform * glm::vec4(branchMeshNormals[i], 0.0f)));
                 branchMeshNormalsTrans.emplace_back(transformedNormal);
             }
 
@@ -538,9 +1600,10 @@ void Tree::create() {
                 std::vector<glm::vec3> leafMeshPointsTrans = std::vector<glm::vec3>();
                 std::vector<glm::vec3> leafMeshNormalsTrans = std::vector<glm::vec3>();
                 const glm::mat4 leafTransform = glm::translate(glm::mat4(1.0f), internodeEndPoint) * glm::toMat4(glm::angleAxis(std::acos(glm::dot(currentBud.naturalGrowthDir, WORLD_UP_VECTOR)), glm::normalize(glm::cross(WORLD_UP_VECTOR, currentBud.naturalGrowthDir))));
+                const glm::mat4 leafNormalTransform = glm::inverse(glm::transpose(leafTransform));
                 for (int i = 0; i < leafMeshPoints.size(); ++i) {
                     leafMeshPointsTrans.emplace_back(glm::vec3(leafTransform * glm::vec4(leafMeshPoints[i] * leafScale, 1.0f)));
-                    const glm::vec3 transformedNormal = glm::normalize(glm::vec3(glm::inverse(glm::transpose(leafTransform)) * glm::vec4(leafMeshNormals[i], 0.0f)));
+                    const glm::vec3 transformedNormal = glm::normalize(glm::vec3(leafNormalTransform * glm::vec4(leafMeshNormals[i], 0.0f)));
                     leafMeshNormalsTrans.emplace_back(transformedNormal);
                 }
 
@@ -562,7 +1625,48 @@ void Tree::create() {
     leavesMesh.AddPositions(leafPoints);
     leavesMesh.AddNormals(leafNormals);
     leavesMesh.AddIndices(leafIndices);
+    if (dirtyStage >= STAGE_MESH) { dirtyStage = STAGE_GPU_BUFFERS; } // baked from out of date radii, the mesh stays out of date
+}
+
+void Tree::SwapMeshData(Mesh& otherTreeMesh, Mesh& otherLeavesMesh) {
+    treeMesh.SwapData(otherTreeMesh);
+    leavesMesh.SwapData(otherLeavesMesh);
+    if (dirtyStage >= STAGE_MESH) { dirtyStage = STAGE_GPU_BUFFERS; }
+}
+
+void Tree::UploadMeshes() {
     treeMesh.create();
     leavesMesh.create();
     hasBeenCreated = true;
+    if (dirtyStage >= STAGE_GPU_BUFFERS) { dirtyStage = STAGE_NONE; }
+}
+
+void Tree::UpdateStages(const TreeParameters& treeParams) {
+    if (!hasBeenCreated) { return; }
+    if (treeParams.GetChangedStages(stageParameters) & (1u << STAGE_RADII)) {
+        InvalidateStage(STAGE_RADII);
+    }
+    if (dirtyStage == STAGE_NONE) { return; }
+    PROFILE_SCOPE("Update Tree Stages");
+    if (dirtyStage <= STAGE_RADII) { ComputeBranchRadii(treeParams); }
+    if (dirtyStage <= STAGE_MESH) { BakeMeshes(); }
+    UploadMeshes();
 }
+
+void Tree::create() {
+    BakeMeshes();
+    UploadMeshes();
+}
+
+/// Point sources
+
+// Every kind of point source Tree can grow into besides a single cloud, so that the templates above can stay in this file
+template void Tree::IterateGrowth(AttractorPointComposite& pointSource, const TreeParameters& treeParams);
+template void Tree::IterateGrowth(QuantizedAttractorPoints& pointSource, const TreeParameters& treeParams);
+template void Tree::IterateGrowth(SharedAttractorPoints& pointSource, const TreeParameters& treeParams);
+template void Tree::BeginGrowth(AttractorPointComposite& pointSource, const TreeParameters& treeParams);
+template void Tree::BeginGrowth(QuantizedAttractorPoints& pointSource, const TreeParameters& treeParams);
+template void Tree::BeginGrowth(SharedAttractorPoints& pointSource, const TreeParameters& treeParams);
+template bool Tree::PerformGrowthIteration(AttractorPointComposite& pointSource, const TreeParameters& treeParams, int n);
+template bool Tree::PerformGrowthIteration(QuantizedAttractorPoints& pointSource, const TreeParameters& treeParams, int n);
+template bool Tree::PerformGrowthIteration(SharedAttractorPoints& pointSource, const TreeParameters& treeParams, int n);
@@ -5,13 +5,26 @@
 
 #include "Globals.h"
 #include "AttractorPointCloud.h"
+#include "AttractorPointComposite.h"
+#include "AttractorPointGrid.h"
+#include "AttractorPointLOD.h"
+#include "AttractorPointMask.h"
+#include "BudBVH.h"
+#include "CowChunkedArray.h"
+#include "MortonOrder.h"
+#include "QuantizedAttractorPoints.h"
+#include "ShadowGrid.h"
+#include "SharedAttractorPointIndex.h"
 #include "../CUDA/kernels.h"
 
+class AttractorBrickStore;
+
 #include <vector>
 #include <chrono>
 #include <ctime>
 
 /// User-defined Parameters for the growth simulation
+// These are the defaults of the matching TreeParameters fields, which are what the growth code reads
 
 // For Space Colonization
 #define INITIAL_NUM_ITERATIONS 25
@@ -19,6 +32,17 @@
 #define INITIAL_BUD_INTERNODE_RADIUS INITIAL_INTERNODE_SCALE
 #define COS_THETA 0.70710678118f // cos(pi/4)
 #define COS_THETA_SMALL 0.86602540378f // cos(pi6)
+#define PERCEPTION_RADIUS_SQUARED 14.0f // in internode lengths squared: a bud perceives the points within about 3.7 internodes of it
+#define PERCEPTION_RADIUS 3.74165738677f // sqrt(PERCEPTION_RADIUS_SQUARED)
+#define KILL_RADIUS_SQUARED 5.1f // in internode lengths squared: a bud removes the points within about 2.3 internodes of it
+#define NUM_RESOLUTION_LEVELS 1 // 1 grows into the full cloud only, see Tree::GrowCoarseLevels
+#define ITERATIONS_PER_RESOLUTION_LEVEL 5 // per coarse level
+
+// For Shadow Propagation (see ShadowGrid)
+#define SHADOW_FULL_LIGHT 1.0f // light exposure of a bud that nothing shades
+#define SHADOW_STRENGTH 0.03f // shadow a bud casts on the voxels right below it
+#define SHADOW_FALLOFF 2.0f // the shadow shrinks by this factor per layer down
+#define SHADOW_PYRAMID_DEPTH 6 // layers below the bud
 
 // For BH Model
 #define ALPHA 1.0f // proportionality constant for resource flow computation
@@ -28,6 +52,8 @@
 #define OPTIMAL_GROWTH_DIR_WEIGHT 0.4f
 #define TROPISM_DIR_WEIGHT 0.0f
 #define TROPISM_VECTOR glm::vec3(0.0f, -1.0f, 0.0f)
+#define NEW_SHOOT_BRANCHES_PER_BLOCK 256 // AppendNewShoots work per ParallelFor item when scanning the buds
+#define NEW_SHOOTS_PER_BLOCK 32 // and when writing the new metamers
 
 // For branch radius computation
 #define MINIMUM_BRANCH_RADIUS 0.1f // Radius of outermost branches
@@ -36,11 +62,33 @@
 
 #define INITIAL_NUM_ATTR_PTS 500000
 
+// Bud storage (see BudArena)
+#define BUD_ARENA_CHUNK_SIZE_LOG2 10 // 1024 buds per arena chunk
+#define MIN_BUD_SPAN_CLASS 2 // a branch gets room for at least 4 buds
+#define NUM_BUD_SPAN_CLASSES 32
+
 // Tree sketching
 #define INITIAL_BRUSH_RADIUS 0.1f//0.025f
 
 /// Definition of structures
 
+// The outputs of a tree, each computed from the ones before it: topology (branches and buds, grown by space colonization) -> branch radii
+// (pipe model) -> baked meshes -> GPU buffers. Editing a TreeParameters field makes the stage it feeds into and every later one out of date.
+// The stages after the topology are brought up to date on demand (see Tree::UpdateStages()), the topology only by growing the tree again.
+enum TREE_STAGE {
+    STAGE_TOPOLOGY,
+    STAGE_RADII,
+    STAGE_MESH,
+    STAGE_GPU_BUFFERS,
+    STAGE_NONE // everything up to date, or a parameter that no tree output depends on
+};
+
+// What a bud's environment quality and optimal growth direction come from
+enum ENVIRONMENT_MODEL {
+    ENVIRONMENT_SPACE_COLONIZATION, // the attractor points a bud perceives
+    ENVIRONMENT_SHADOW_PROPAGATION // the light reaching the bud through the shadows of the other buds, see ShadowGrid. The points only bound the grid.
+};
+
 struct TreeParameters {
     float internodeScale;
     float perceptionCosTheta;
@@ -56,22 +104,36 @@ struct TreeParameters {
     float brushRadius;
     int numSpaceColonizationIterations;
     int numAttractorPointsToGenerate;
-    bool enableDebugOutput;
-    bool reconstructUniformGridOnGPU;
-    bool resetAttractorPointState;
+    bool reconstructUniformGridOnGPU; // forces the next GPU space colonization to rebuild the device grid, which otherwise follows attractorPointsRevision
+    // GPU only: names the points grown into, so that the device grid can stay from one growth to the next (see AttractorPointCloud::GetLayoutRevision()).
+    // 0 if nothing keeps a revision for them: then every BeginGrowth() gets a grid of its own.
+    unsigned int attractorPointsRevision;
+    bool incrementalSpaceColonization; // CPU only: cache each bud's perceived points across iterations instead of testing every bud against every point
+    ENVIRONMENT_MODEL environmentModel; // the shadow model always runs on the CPU. Forests always use space colonization.
+    float shadowStrength;
+    float shadowFalloff;
+    int shadowPyramidDepth;
+    int numResolutionLevels; // coarse to fine growth: the full cloud plus this many minus one coarser levels of it (see AttractorPointLOD)
+    int iterationsPerResolutionLevel;
 
     TreeParameters() :
         internodeScale(INITIAL_INTERNODE_SCALE), perceptionCosTheta(COS_THETA), perceptionCosThetaSmall(COS_THETA_SMALL), BHAlpha(ALPHA), BHLambda(LAMBDA),
-        optimalGrowthDirWeight(OPTIMAL_GROWTH_DIR_WEIGHT), tropismDirWeight(TROPISM_DIR_WEIGHT), tropismVector(TROPISM_DIR_WEIGHT), minimumBranchRadius(MINIMUM_BRANCH_RADIUS),
+        optimalGrowthDirWeight(OPTIMAL_GROWTH_DIR_WEIGHT), tropismDirWeight(TROPISM_DIR_WEIGHT), tropismVector(TROPISM_VECTOR), minimumBranchRadius(MINIMUM_BRANCH_RADIUS),
         pipeModelExponent(PIPE_EXPONENT), maximumBranchRadius(MAXIMUM_BRANCH_RADIUS), brushRadius(INITIAL_BRUSH_RADIUS), numSpaceColonizationIterations(INITIAL_NUM_ITERATIONS),
-        numAttractorPointsToGenerate(INITIAL_NUM_ATTR_PTS), enableDebugOutput(true), reconstructUniformGridOnGPU(true), resetAttractorPointState(true) {}
+        numAttractorPointsToGenerate(INITIAL_NUM_ATTR_PTS), reconstructUniformGridOnGPU(false), attractorPointsRevision(0), incrementalSpaceColonization(true),
+        environmentModel(ENVIRONMENT_SPACE_COLONIZATION), shadowStrength(SHADOW_STRENGTH), shadowFalloff(SHADOW_FALLOFF), shadowPyramidDepth(SHADOW_PYRAMID_DEPTH),
+        numResolutionLevels(NUM_RESOLUTION_LEVELS), iterationsPerResolutionLevel(ITERATIONS_PER_RESOLUTION_LEVEL) {}
+
+    // Every field is listed with the stage it feeds into in Tree.cpp, so a new field needs an entry there
+    unsigned int GetChangedStages(const TreeParameters& other) const; // Bit (1 << stage) is set for each stage with a field that differs from other
+    void CopyStageFields(TREE_STAGE stage, const TreeParameters& other); // Copies just the fields of other that feed into the given stage
 };
 
 enum BUD_FATE {
     DORMANT,
     FORMED_BRANCH,
     FORMED_FLOWER,
-    ABORT // TODO: when does this happen?
+    ABORT // never grows, e.g. the buds SubdivideInternodes() adds
 };
 
 enum BUD_TYPE {
@@ -91,6 +153,8 @@ struct Bud {
     float internodeLength;
     float branchRadius;
     int numNearbyAttrPts;
+    int numPerceivedAttrPts; // attractor points inside the perception volume, whether or not this bud is their nearest. 0 means the bud can retire.
+                             // The shadow model sets it to 1 for a bud that gets any light.
     BUD_TYPE type;
     BUD_FATE fate;
 
@@ -98,44 +162,310 @@ struct Bud {
     Bud(const glm::vec3& p, const glm::vec3& nd, const glm::vec3& d, float q, float aq, float re,
         int i, float l, float br, int n, BUD_TYPE t, BUD_FATE f) :
         point(p), naturalGrowthDir(nd), optimalGrowthDir(d), environmentQuality(q), accumEnvironmentQuality(aq), resourceBH(re),
-        formedBranchIndex(i), internodeLength(l), branchRadius(br), numNearbyAttrPts(n), type(t), fate(f) {}
+        formedBranchIndex(i), internodeLength(l), branchRadius(br), numNearbyAttrPts(n), numPerceivedAttrPts(0), type(t), fate(f) {}
     Bud() : point(glm::vec3(0.0f)), naturalGrowthDir(glm::vec3(0.0f)), optimalGrowthDir(glm::vec3(0.0f)), environmentQuality(0.0f), accumEnvironmentQuality(0.0f), resourceBH(0.0f),
-        formedBranchIndex(-1), internodeLength(0.0f), branchRadius(0.0f), numNearbyAttrPts(0), type(TERMINAL), fate(ABORT) {}
+        formedBranchIndex(-1), internodeLength(0.0f), branchRadius(0.0f), numNearbyAttrPts(0), numPerceivedAttrPts(0), type(TERMINAL), fate(ABORT) {}
+};
+
+// An attractor point inside a bud's perception volume, cached by incremental space colonization
+struct PerceivedAttractorPoint {
+    unsigned int pointIdx;
+    float dist2; // squared distance from the bud
+    PerceivedAttractorPoint(unsigned int i, float d) : pointIdx(i), dist2(d) {}
+    bool operator<(const PerceivedAttractorPoint& other) const { return pointIdx < other.pointIdx; }
+};
+
+// A point in the perception volume of an active bud whose set has to be rebuilt, found by looking the bud up from the point in a BudBVH
+struct LookedUpAttractorPoint {
+    unsigned int activeBudIdx; // in the Tree's active bud list
+    PerceivedAttractorPoint perceived;
+    LookedUpAttractorPoint(unsigned int a, unsigned int i, float d) : activeBudIdx(a), perceived(i, d) {}
+    bool operator<(const LookedUpAttractorPoint& other) const {
+        return activeBudIdx < other.activeBudIdx || (activeBudIdx == other.activeBudIdx && perceived < other.perceived);
+    }
+};
+
+// The nearest bud that perceives an attractor point, found anew in every space colonization pass on the CPU. Kept next to the points
+// (one per point, same index) rather than in them, since the points are shared and read-only during growth.
+// treeIdx tells buds of different trees apart when several trees grow into one cloud (see Forest), 0 o.w.
+struct NearestBud {
+    float dist2; // squared
+    int treeIdx;
+    int branchIdx;
+    int budIdx;
+    NearestBud() : dist2(9999999.0f), treeIdx(-1), branchIdx(-1), budIdx(-1) {}
+};
+
+// Whether a bud at (tr, br, bu) with the given distance should replace an attractor point's current nearest bud. Ties go to the lowest
+// (tree, branch, bud) index, so the result doesn't depend on the order in which the active buds (or the trees of a Forest, or the workers of
+// a tiled growth) are visited.
+inline bool IsNearerBud(const NearestBud& nearest, const float budToPtDist2, const int tr, const int br, const int bu) {
+    if (budToPtDist2 != nearest.dist2) { return budToPtDist2 < nearest.dist2; }
+    if (tr != nearest.treeIdx) { return tr < nearest.treeIdx; }
+    return br < nearest.branchIdx || (br == nearest.branchIdx && bu < nearest.budIdx);
+}
+
+inline void SetNearestBud(NearestBud& nearest, const float budToPtDist2, const int tr, const int br, const int bu) {
+    nearest.dist2 = budToPtDist2;
+    nearest.treeIdx = tr;
+    nearest.branchIdx = br;
+    nearest.budIdx = bu;
+}
+
+#define NEAREST_BUD_PAGE_SIZE 1024 // points per page of NearestBudPages
+
+// Nearest bud scratch that only takes memory for the points some bud perceives, indexed like a std::vector<NearestBud>. Point indices are cut
+// into pages of NEAREST_BUD_PAGE_SIZE, and a page is allocated the first time one of its points is written to. With point indices that follow
+// space (see QuantizedAttractorPoints), that covers about the region the active buds reach rather than the whole cloud.
+class NearestBudPages {
+private:
+    std::vector<int> pageStarts; // into slots, -1 for a page that was never written to
+    std::vector<NearestBud> slots;
+
+public:
+    NearestBudPages() {
+        pageStarts = std::vector<int>();
+        slots = std::vector<NearestBud>();
+    }
+
+    void Reset(unsigned int numPoints) { // no pages allocated
+        pageStarts.assign((numPoints + NEAREST_BUD_PAGE_SIZE - 1) / NEAREST_BUD_PAGE_SIZE, -1);
+        slots.clear();
+    }
+    void Clear() { // frees everything
+        pageStarts = std::vector<int>();
+        slots = std::vector<NearestBud>();
+    }
+    unsigned int GetNumAllocatedPoints() const { return (unsigned int)slots.size(); }
+
+    NearestBud& operator[](unsigned int i) {
+        int& pageStart = pageStarts[i / NEAREST_BUD_PAGE_SIZE];
+        if (pageStart < 0) {
+            pageStart = (int)slots.size();
+            slots.resize(slots.size() + NEAREST_BUD_PAGE_SIZE);
+        }
+        return slots[pageStart + i % NEAREST_BUD_PAGE_SIZE];
+    }
+    const NearestBud& operator[](unsigned int i) const { return slots[pageStarts[i / NEAREST_BUD_PAGE_SIZE] + i % NEAREST_BUD_PAGE_SIZE]; } // only for points written to
+};
+
+// Entry in the Tree's list of active buds. A budIdx of -1 refers to the branch's terminal bud, whose index shifts as axillary buds are inserted in front of it.
+struct ActiveBudRef {
+    int branchIdx;
+    int budIdx;
+    // Incremental space colonization only: this bud's perceived points, sorted by point index, as a range of the Tree's perceived point pool.
+    // A start of -1 means the set has to be (re)built from the attractor point grid.
+    int perceivedStart;
+    int numPerceived;
+    unsigned int mortonCode; // of the bud's position when it was activated, see Tree::OrderActiveBuds()
+    int budBVHItem; // full CPU space colonization only: this bud's item in the Tree's BudBVH, -1 if it has none yet
+    ActiveBudRef() : ActiveBudRef(-1, -1) {} // e.g. to be read from a message, see Tree::ReadGrowthState()
+    ActiveBudRef(int br, int bu) : branchIdx(br), budIdx(bu), perceivedStart(-1), numPerceived(0), mortonCode(0), budBVHItem(-1) {}
+    bool operator<(const ActiveBudRef& other) const { return branchIdx < other.branchIdx || (branchIdx == other.branchIdx && budIdx < other.budIdx); }
+    bool operator==(const ActiveBudRef& other) const { return branchIdx == other.branchIdx && budIdx == other.budIdx; }
+};
+
+// A bud that grows new metamers in the current AppendNewShoots pass: either a terminal bud extending its own branch, or a dormant axillary bud
+// forming a new branch
+struct NewShoot {
+    int branchIdx;
+    int budIdx;
+    int numMetamers;
+    float metamerLength;
+    int formedBranchIndex; // index of the new branch, -1 for a terminal bud
+    NewShoot() : branchIdx(-1), budIdx(-1), numMetamers(0), metamerLength(0.0f), formedBranchIndex(-1) {}
 };
 
-// Wraps up necessary information regarding a tree branch.
+// A tree branch's entry in the Tree's branch table: where its buds live in the Tree's bud arena, plus its place in the branching structure.
+// A branch owns a span of arena slots. The terminal bud comes first, followed by the axillary buds from the base of the branch up, so growth only
+// ever appends axillary buds at the end of the span and the terminal bud never moves. Buds are still numbered from the base of the branch,
+// with the terminal bud last: GetBudSlot() does the mapping.
 class TreeBranch {
     friend class Tree;
 private:
-    std::vector<Bud> buds; // List of buds. Last bud is always the terminal bud.
-    glm::vec3 growthDirection; // World space direction in which this branch is oriented
+    unsigned int firstBudSlot; // arena slot of the terminal bud
+    unsigned int numBuds; // including the terminal bud
+    unsigned int budCapacity; // number of slots reserved for this branch, starting at firstBudSlot
     unsigned int axisOrder; // Order n (0, 1, ..., n) of this axis. Original trunk of a tree is 0, each branch supported by this branch has order 1, etc
-    int prevBranchIndex; // Index of the branch supporting this one in the 
+    int prevBranchIndex; // Index of the branch supporting this one
+    bool terminalBudActive; // whether the terminal bud is currently in the Tree's active bud list. Axillary buds never need this: they are only ever added once
+    bool terminalBudMoved; // set whenever the terminal bud grows, which invalidates its cached perception set
 
 public:
-    TreeBranch() : TreeBranch(glm::vec3(0.0f), glm::vec3(0.0f), 0, -1) {}
-    TreeBranch(const glm::vec3& p, const glm::vec3& d, int ao, int bi) :
-        growthDirection(d), axisOrder(ao), prevBranchIndex(bi) {
-        buds = std::vector<Bud>();
-        buds.emplace_back(p, glm::vec3(growthDirection), glm::vec3(0.0f), 0.0f, 0.0f, 0.0f, -1, INITIAL_BUD_INTERNODE_RADIUS, 0.0f, 0, TERMINAL, DORMANT); // add the terminal bud for this branch. Applies a prelim internode length (tweak, TODO)
-    }
-    const std::vector<Bud>& GetBuds() const { return buds; }
+    TreeBranch() : TreeBranch(0, 0, 0, -1) {}
+    TreeBranch(unsigned int first, unsigned int capacity, unsigned int ao, int bi) :
+        firstBudSlot(first), numBuds(1), budCapacity(capacity), axisOrder(ao), prevBranchIndex(bi), terminalBudActive(false), terminalBudMoved(false) {}
+    unsigned int GetNumBuds() const { return numBuds; }
+    // Arena slot of bud bu, -1 being the terminal bud
+    unsigned int GetBudSlot(int bu) const { return (bu == -1 || bu == (int)numBuds - 1) ? firstBudSlot : firstBudSlot + 1 + (unsigned int)bu; }
     int GetAxisOrder() const { return axisOrder; }
-    // Adds a certain number of axillary buds to the list of buds, starting at the index just before the terminal bud
-    void AddAxillaryBuds(const Bud& sourceBud, const int numBuds, const float internodeLength);
+};
+
+// Pool of bud slots shared by all branches of a tree, in chunks that never move and that copies of the arena share copy-on-write (see
+// CowChunkedArray). Each branch gets a span of slots whose size is a power of two. Once a branch outgrows its span, it moves to one twice as
+// large and its old span is kept for the next branch that needs one of that size. So buds only ever move when their branch doubles, slack stays
+// under half of the slots in use, and new metamers only cost a heap allocation whenever a whole chunk of slots runs out.
+class BudArena {
+private:
+    CowChunkedArray<Bud, BUD_ARENA_CHUNK_SIZE_LOG2> slots;
+    std::vector<unsigned int> freeSpans[NUM_BUD_SPAN_CLASSES]; // first slot of each span that is free for reuse, by log2 of its size
+
+public:
+    BudArena() {
+        slots = CowChunkedArray<Bud, BUD_ARENA_CHUNK_SIZE_LOG2>();
+    }
+    void Clear();
+    // Returns the first slot of a span with room for at least minSize buds, and its actual size in size
+    unsigned int AllocateSpan(unsigned int minSize, unsigned int& size);
+    void FreeSpan(unsigned int first, unsigned int size);
+
+    const Bud& Get(unsigned int slot) const { return slots[slot]; }
+    Bud& GetMutable(unsigned int slot) { return slots[slot]; } // copies the slot's chunk if it is shared
+    void MakeUnique(unsigned int first, unsigned int count) { slots.MakeUnique(first, first + count); } // see CowChunkedArray::MakeUnique()
+    unsigned int GetNumSlots() const { return slots.size(); }
+    // The slots and free spans as raw bytes, appended to a message, and read back from offset of one (see Tree::WriteGrowthState())
+    void Write(std::vector<unsigned char>& message) const;
+    bool Read(const std::vector<unsigned char>& message, size_t& offset); // Returns false if the message is too short
+};
+
+// The growth state of a tree at some point in time: everything a Tree needs to continue growing from there. Branches and buds are shared
+// copy-on-write with the tree the snapshot was taken from, so a snapshot costs next to nothing to take, keep around, or restore, even for a large tree.
+struct TreeGrowthSnapshot {
+    CowChunkedArray<TreeBranch> branches;
+    BudArena buds;
+    std::vector<ActiveBudRef> activeBuds;
+    TreeParameters stageParameters;
+    bool didUpdate;
+    TreeGrowthSnapshot() : didUpdate(false) {
+        branches = CowChunkedArray<TreeBranch>();
+        buds = BudArena();
+        activeBuds = std::vector<ActiveBudRef>();
+        stageParameters = TreeParameters();
+    }
 };
 
 // Wrap up branches into one Tree class. This class also organizes the simulation functions
 class Tree {
 private:
-    std::vector<TreeBranch> branches; // all branches in the tree
-    bool didUpdate; // flag indicating whether or not the tree changed form (aka gained a bud) during the most recent iteration of growth
+    // All branches in the tree, and the buds they own. Both are shared copy-on-write with snapshots and forks, so anything that only reads them
+    // goes through GetBranchConst(), GetBudConst() or GetActiveBudConst(): the non-const accessors copy the chunk they touch if it is shared.
+    CowChunkedArray<TreeBranch> branches;
+    BudArena buds;
+    // Buds that still take part in space colonization. A bud is retired once it can never perceive or kill an attractor point again: it stopped
+    // being DORMANT, has no internode, or its perception volume is empty. Since points are only ever removed during growth, only a bud that
+    // moves (a growing terminal bud) or new points (see ReactivateBuds()) can bring it back. Kept in Morton order of the buds' positions, so
+    // that buds visited one after the other query nearby parts of the attractor point grid.
+    std::vector<ActiveBudRef> activeBuds;
+    std::vector<ActiveBudRef> activeBudsScratch;
+    MortonFrame activeBudMortonFrame; // over the bounds of the points the tree grows into, set by PrepareGrowth()
+    unsigned int gpuPointsRevision; // what the device grid is keyed on while growing on the GPU, set by BeginGrowth()
+    // Incremental space colonization state. Perceived point sets are compacted from one pool into the other every iteration.
+    AttractorPointGrid attractorPointGrid;
+    std::vector<PerceivedAttractorPoint> perceivedPoints;
+    std::vector<PerceivedAttractorPoint> perceivedPointsNext;
+    BudBVH budBVH; // Full CPU space colonization state, between BeginGrowth and EndGrowth: the active buds, for point-centric queries
+    // Incremental space colonization state: once few points are left, the new and moved buds are found from the points, in a BudBVH of just
+    // those buds, rather than the points from the buds in the grid (see KillAttractorPointsNearMovedBuds())
+    BudBVH movedBudBVH; // rebuilt in every iteration that uses it
+    std::vector<unsigned int> movedBudIndices; // per item of movedBudBVH: its bud's index in the active bud list
+    std::vector<LookedUpAttractorPoint> lookedUpPoints; // in bud, then point order
+    bool lookUpInMovedBudBVH; // picked by KillAttractorPointsNearMovedBuds() for the current iteration, UpdatePerceivedAttractorPoints() follows it
+    // For the cost estimate: the fraction of the alive points that the most recent grid lookups visited per bud, and how many times
+    // log2(number of buds) nodes the most recent lookups in movedBudBVH visited per point, as the buds' spheres overlap (see BudBVH.h)
+    float gridLookupFraction;
+    float movedBudBVHOverlap;
+    std::vector<NearestBud> nearestBuds; // CPU space colonization scratch, one per attractor point. Only allocated between BeginGrowth and EndGrowth.
+    NearestBudPages nearestBudPages; // the same when growing into QuantizedAttractorPoints or a SharedAttractorPointIndex, only for the points the active buds perceive
+    ShadowGrid shadowGrid; // Shadow propagation state, between BeginGrowth and EndGrowth: built with the shadows of every bud, then updated with each new shoot
+    // AppendNewShoots scratch: the growing buds of each block of NEW_SHOOT_BRANCHES_PER_BLOCK branches, then all of them in branch, then bud order
+    std::vector<std::vector<NewShoot>> newShootBlocks;
+    std::vector<NewShoot> newShoots;
+    bool didUpdate; // flag indicating whether or not the tree changed form (aka gained a bud) during the most recent call to AppendNewShoots()
     bool hasBeenCreated;
+    // Staged outputs (see TREE_STAGE): the first stage that is out of date, and the parameters the stages were last computed with
+    TREE_STAGE dirtyStage;
+    TreeParameters stageParameters;
+    void InvalidateStage(TREE_STAGE stage) { if (stage < dirtyStage) { dirtyStage = stage; } }
+    bool IsBareRoot() const { return branches.size() == 1 && GetBranchConst(0).GetNumBuds() == 1; } // nothing grew yet
     void InitializeTree(glm::vec3 p) { // Initialize a tree to be a single branch
         branches.clear();
-        branches.reserve(65536);
-        branches.emplace_back(TreeBranch(p, glm::vec3(0.0f, 1.0f, 0.0f), 0, -1));
+        buds.Clear();
+        AddBranch(p, glm::vec3(0.0f, 1.0f, 0.0f), 0, -1, 1);
+        activeBuds.clear();
+        ActivateBud(0, -1);
+        InvalidateStage(STAGE_RADII);
     } 
+    // Bud bu of branch br, -1 being the terminal bud. Looks the branch up through the const table, so only the bud's own chunk may get copied.
+    Bud& GetBud(int br, int bu) { return buds.GetMutable(GetBranchConst(br).GetBudSlot(bu)); }
+    Bud& GetActiveBud(const ActiveBudRef& ref) { return GetBud(ref.branchIdx, ref.budIdx); }
+    const Bud& GetActiveBudConst(const ActiveBudRef& ref) const { return GetBudConst(ref.branchIdx, ref.budIdx); }
+    const TreeBranch& GetBranchConst(int br) const { return branches[br]; }
+    // Adds a branch consisting of just its terminal bud, with room for numBudsToReserve buds in total. Returns its index.
+    int AddBranch(const glm::vec3& p, const glm::vec3& growthDir, unsigned int axisOrder, int prevBranchIndex, unsigned int numBudsToReserve);
+    // Writes a certain number of axillary buds into the free slots of a branch's span, in front of its terminal bud, and moves the terminal bud.
+    // Only writes bud slots, so shoots of different branches may be written in parallel. The caller reserves the slots (see ReserveBuds()) and
+    // updates the branch's bud count afterwards. Specialized on whether tropism bends the new shoot at all.
+    template <bool WITH_TROPISM>
+    void WriteAxillaryBuds(int br, const Bud& sourceBud, const int numBuds, const float internodeLength, const TreeParameters& treeParams);
+    template <bool WITH_TROPISM>
+    void WriteNewShoots(const TreeParameters& treeParams); // WriteAxillaryBuds() for every shoot in newShoots, in parallel
+    void ReserveBuds(int br, unsigned int numBuds); // Moves the branch to a larger span if it can't hold numBuds buds
+    // Splits every internode at least twice as long as minInternodeLength into equal ones no shorter than it, e.g. so that a scaffold grown
+    // with long internodes consumes points like one grown with short ones. The buds in between are ABORTed: every one of them would get all
+    // the resource that flows past it (see ComputeResourceFlowRecursive) and sprout a huge shoot. The buds along a branch are renumbered,
+    // so every bud is retired: the next BeginGrowth() brings them back.
+    void SubdivideInternodes(float minInternodeLength);
+    // Whether an active bud's perception set has to be looked up anew: it is new, or a terminal bud that moved
+    bool NeedsPerceptionLookup(const ActiveBudRef& ref) const { return ref.perceivedStart < 0 || (ref.budIdx == -1 && GetBranchConst(ref.branchIdx).terminalBudMoved); }
+    void ActivateBud(int br, int bu); // Adds a bud to the active list, unless it has no internode (or is a terminal bud that is already active)
+    void RetireInactiveBuds(); // Drops every active bud that perceived no attractor point in the most recent space colonization pass
+    // Sorts the active buds by Morton code. Buds [numOrderedActiveBuds, end) are sorted by themselves and merged into the rest, which must be in
+    // order already; with 0, every bud's code is recomputed and the whole list sorted. A terminal bud that grew keeps its place until the next
+    // full sort: that only costs a little locality.
+    void OrderActiveBuds(unsigned int numOrderedActiveBuds);
+
+    // Everything BeginGrowth() does except building the attractor point grid
+    void PrepareGrowth(const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, const TreeParameters& treeParams, bool useGPU, bool reactivateBuds = true);
+    void InvalidatePerceivedAttractorPoints(); // Drops every cached perception set, e.g. before growing into another cloud
+    // Full CPU space colonization: each of its passes either loops over the active buds and tests every alive point, or loops over the alive
+    // points and looks up the buds that can reach each one in the BudBVH. Cost estimates from the two counts pick the cheaper way (see
+    // UsePointCentricQueries() in Tree.cpp). Both find the same points and sum them up in the same order, so the tree grows the same either way.
+    void UpdateBudBVH(); // Brings the BudBVH in line with the active buds: rebuilds it, or refits it and inserts the new buds
+    // Shadow propagation: the shadows of every bud, or of the buds the last AppendNewShoots() added. A shoot's first new bud sits where the bud
+    // that grew it used to be, which already cast its shadow, so each position casts once.
+    void CastShadows(const TreeParameters& treeParams);
+    void CastNewShootShadows(const TreeParameters& treeParams);
+
+    // The steps of PerformSpaceColonizationIncremental(). The grid, nearest bud scratch and this tree's index are passed in so that a Forest
+    // can run the same steps for several trees over one shared cloud: the steps that write to the mask or the scratch run for one tree at a
+    // time, the others can run concurrently.
+    void KillAttractorPointsNearMovedBuds(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const AttractorPointGrid& grid);
+    void UpdatePerceivedAttractorPoints(const std::vector<AttractorPoint>& attractorPoints, const AttractorPointMask& aliveMask, const AttractorPointGrid& grid, const TreeParameters& treeParams);
+    // The scratch is a std::vector<NearestBud> or NearestBudPages.
+    template <typename NearestBuds>
+    void ResetPerceivedAttractorPoints(NearestBuds& nearest) const;
+    template <typename NearestBuds>
+    void AssignPerceivedAttractorPoints(NearestBuds& nearest, int treeIdx) const;
+    template <typename PointSource, typename NearestBuds> // a point array, an AttractorPointComposite or QuantizedAttractorPoints
+    void AccumulateOptimalGrowthDirs(const PointSource& attractorPoints, const NearestBuds& nearest, int treeIdx);
+    // The steps that look points up, over anything with the point interface of an AttractorPointComposite. The overloads above pass one
+    // cloud's points, mask and grid as one (see SingleCloudPoints in Tree.cpp).
+    template <typename PointSource>
+    void KillAttractorPointsNearMovedBuds(PointSource& pointSource);
+    template <typename PointSource>
+    void UpdatePerceivedAttractorPoints(const PointSource& pointSource, const TreeParameters& treeParams);
+    // The scratch and grids BeginGrowth sets up for each kind of point source. A composite's members get grids of the right width if they have
+    // none yet; quantized points are their own grid, and a shared grid is built already.
+    void PrepareSpaceColonization(AttractorPointComposite& composite, const TreeParameters& treeParams);
+    void PrepareSpaceColonization(const QuantizedAttractorPoints& quantizedPoints, const TreeParameters& treeParams);
+    void PrepareSpaceColonization(const SharedAttractorPoints& sharedPoints, const TreeParameters& treeParams);
+    void PerformSpaceColonizationIncremental(AttractorPointComposite& composite, const TreeParameters& treeParams);
+    void PerformSpaceColonizationIncremental(QuantizedAttractorPoints& quantizedPoints, const TreeParameters& treeParams);
+    void PerformSpaceColonizationIncremental(SharedAttractorPoints& sharedPoints, const TreeParameters& treeParams);
+    void GrowShoots(int n, const TreeParameters& treeParams, bool useGPU); // Steps 2 to 4 of a growth iteration: BH model, new shoots, reset
+    void BuildShadowGrid(const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, const TreeParameters& treeParams); // and casts every bud's shadow
+
+    Tree(const Tree& source, const TreeGrowthSnapshot& snapshot); // Used by Fork(): reuses the loaded meshes of source instead of reading them from disk again
 
     // Internally stored meshes for drawing
 
@@ -152,9 +482,28 @@ private:
 
 public:
     friend class TreeApplication;
+    friend class Forest;
+    friend class TileWorker;
     Tree() : Tree(glm::vec3(0.0f)) {}
-    Tree(const glm::vec3& p) : didUpdate(false), hasBeenCreated(false), branchColor(glm::vec3(0.467f, 0.41f, 0.25f)), leafColor(glm::vec3(0.2f, 0.4f, 0.2f)) {
-        branches = std::vector<TreeBranch>();
+    Tree(const glm::vec3& p) : gpuPointsRevision(0), lookUpInMovedBudBVH(false), gridLookupFraction(0.0f), movedBudBVHOverlap(BUD_BVH_TYPICAL_OVERLAP), didUpdate(false), hasBeenCreated(false), dirtyStage(STAGE_RADII), branchColor(glm::vec3(0.467f, 0.41f, 0.25f)), leafColor(glm::vec3(0.2f, 0.4f, 0.2f)) {
+        stageParameters = TreeParameters();
+        branches = CowChunkedArray<TreeBranch>();
+        buds = BudArena();
+        activeBuds = std::vector<ActiveBudRef>();
+        activeBudsScratch = std::vector<ActiveBudRef>();
+        activeBudMortonFrame = MortonFrame();
+        attractorPointGrid = AttractorPointGrid();
+        perceivedPoints = std::vector<PerceivedAttractorPoint>();
+        perceivedPointsNext = std::vector<PerceivedAttractorPoint>();
+        budBVH = BudBVH();
+        movedBudBVH = BudBVH();
+        movedBudIndices = std::vector<unsigned int>();
+        lookedUpPoints = std::vector<LookedUpAttractorPoint>();
+        nearestBuds = std::vector<NearestBud>();
+        nearestBudPages = NearestBudPages();
+        shadowGrid = ShadowGrid();
+        newShootBlocks = std::vector<std::vector<NewShoot>>();
+        newShoots = std::vector<NewShoot>();
         InitializeTree(p);
         branchMesh = Mesh();
         leafMesh = Mesh();
@@ -166,7 +515,7 @@ public:
     void ResetTree() {
         didUpdate = false;
         hasBeenCreated = false;
-        InitializeTree(branches[0].GetBuds()[0].point); // Reset tree to its starting bud's point
+        InitializeTree(GetBudConst(0, 0).point); // Reset tree to its starting bud's point
     }
     void DestroyMeshes() {
         branchMesh.destroy();
@@ -177,26 +526,87 @@ public:
 
     const glm::vec3& GetBranchColor() const { return branchColor; }
     const glm::vec3& GetLeafColor() const { return leafColor; }
+    void SetBranchColor(const glm::vec3& c) { branchColor = c; } // Colors are only used when drawing, so they take effect right away
+    void SetLeafColor(const glm::vec3& c) { leafColor = c; }
+
+    // Re-runs the stages after the topology that are out of date, e.g. radii and meshes after a radius parameter changed. Does nothing for a
+    // tree that hasn't been created yet: whatever creates it runs every stage anyway.
+    void UpdateStages(const TreeParameters& treeParams);
+    // Whether parameters the growth depends on changed since the tree last grew. Those only apply to the next Iterate or Regrow.
+    bool IsTopologyOutdated(const TreeParameters& treeParams) const { return (treeParams.GetChangedStages(stageParameters) & (1u << STAGE_TOPOLOGY)) != 0; }
 
     // Tree Growth Functions (grouped by association)
-    const std::vector<TreeBranch>& GetBranches() const { return branches; }
-    void IterateGrowth(std::vector<AttractorPoint>& attractorPoints, glm::vec3& minAttrPt, glm::vec3& maxAttrPt, TreeParameters& treeParams, bool useGPU = false);
-    void PerformSpaceColonization(std::vector<AttractorPoint>& attractorPoints, glm::vec3& minAttrPt, glm::vec3& maxAttrPt, bool& reconstructUniformGrid, bool& resetAttrPtState, bool useGPU);
-    void PerformSpaceColonizationCPU(std::vector<AttractorPoint>& attractorPoints);
-    void PerformSpaceColonizationGPU(std::vector<AttractorPoint>& attractorPoints, glm::vec3& minAttrPt, glm::vec3& maxAttrPt, bool& reconstructUniformGrid, bool& resetAttrPtState);
-    void RemoveAttractorPoints(std::vector<AttractorPoint>& attractorPoints);
-
-    float ComputeQAccumRecursive(TreeBranch& branch);
+    const CowChunkedArray<TreeBranch>& GetBranches() const { return branches; }
+    const Bud& GetBudConst(int br, int bu) const { return buds.Get(GetBranchConst(br).GetBudSlot(bu)); } // Bud bu of branch br, -1 being the terminal bud
+    bool DidUpdate() const { return didUpdate; }
+    unsigned int GetNumActiveBuds() const { return (unsigned int)activeBuds.size(); }
+    void ReactivateBuds(const glm::vec3& minPt, const glm::vec3& maxPt); // Brings back every bud whose perception volume reaches into the given box, e.g. where points were added
+    // Grows into the given (read-only) points. Only the points set in aliveMask take part, and the ones the tree consumes are cleared from it,
+    // so calling this again with the same mask continues where the last call left off.
+    void IterateGrowth(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, TreeParameters& treeParams, bool useGPU = false);
+    // IterateGrowth over a store too large to keep in memory (see AttractorBrickStore). Only the bricks within reach of the active buds are paged
+    // in. Once a bud's perception volume reaches past them, growth stops, the store pages in around the active buds again and growth carries on,
+    // so every iteration sees every point some bud can perceive: the tree grows as it would with the whole cloud in memory.
+    void IterateGrowthOutOfCore(AttractorBrickStore& store, TreeParameters& treeParams, bool useGPU = false);
+    // IterateGrowth into a point source that keeps its own alive points, always with incremental space colonization on the CPU, like a Forest;
+    // the shadow model works as usual. The point source is one of
+    // - an AttractorPointComposite: several clouds at once, e.g. one per sketched stroke, as if they were one cloud. The points each member's
+    //   mask says are alive take part, and the ones the tree consumes are cleared from it.
+    // - QuantizedAttractorPoints: a cloud stored quantized, for clouds of many millions of points, with the nearest bud scratch only allocated
+    //   where buds perceive points (see NearestBudPages).
+    // - SharedAttractorPoints: a grid shared with other trees, e.g. the variants of a GrowthEnsemble, and this tree's own alive mask.
+    template <typename PointSource>
+    void IterateGrowth(PointSource& pointSource, const TreeParameters& treeParams);
+    // Coarse to fine growth, for a tree that is still just its root and treeParams.numResolutionLevels > 1: grows the tree into the coarse
+    // levels of the alive points (see AttractorPointLOD), coarsest first, iterationsPerResolutionLevel iterations each. Level l's internodes
+    // are as long as its cubes are wide, 2^l times the internode scale, so a few cheap iterations over a few points lay down the trunk and the
+    // main scaffold. After each level, the scaffold's internodes are split down to the next level's (see SubdivideInternodes()), so the
+    // finer points around it are left for new shoots. The points and the mask aren't touched: the first iteration into them removes what
+    // the scaffold's buds would have. Returns the number of iterations used, which count against numSpaceColonizationIterations. Called
+    // before BeginGrowth, by IterateGrowth and the like. The shadow model ignores it.
+    int GrowCoarseLevels(const std::vector<AttractorPoint>& attractorPoints, const AttractorPointMask& aliveMask, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, TreeParameters& treeParams, bool useGPU);
+    // Bounds of the perception volumes of the active buds. Returns false if there are none.
+    bool GetActiveBudPerceptionBounds(glm::vec3& minPt, glm::vec3& maxPt) const;
+    // One pass of the IterateGrowth loop, between BeginGrowth and EndGrowth. Returns false once the tree stopped growing or no points are left.
+    bool PerformGrowthIteration(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, TreeParameters& treeParams, int n, bool useGPU);
+    template <typename PointSource>
+    bool PerformGrowthIteration(PointSource& pointSource, const TreeParameters& treeParams, int n); // the same, for IterateGrowth into a point source
+    void TakeGrowthState(Tree& other); // Takes over the branches, active buds and stage state of other, e.g. a copy that was grown on another thread
+    // The same state as raw bytes, appended to a message, e.g. for a copy that was grown in another process (see TiledForest). ReadGrowthState
+    // takes it over from offset of the message and moves offset past it; it returns false, and leaves the tree as it was, if the message is too short.
+    void WriteGrowthState(std::vector<unsigned char>& message) const;
+    bool ReadGrowthState(const std::vector<unsigned char>& message, size_t& offset);
+    // Snapshots and forks, e.g. to try several continuations of a half-grown tree. Only valid outside of BeginGrowth / EndGrowth.
+    TreeGrowthSnapshot TakeSnapshot() const;
+    void RestoreSnapshot(const TreeGrowthSnapshot& snapshot); // Continues from the snapshot. The meshes are left as they are until the next create().
+    Tree Fork() const; // A new tree with the same growth state and loaded meshes, but no baked ones
+    // Set up / tear down around the growth iterations of one IterateGrowth call. Without reactivateBuds, retired buds stay retired, e.g. when
+    // the points are the same as in the previous call, only paged in differently.
+    void BeginGrowth(const std::vector<AttractorPoint>& attractorPoints, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, const TreeParameters& treeParams, bool useGPU,
+                     bool reactivateBuds = true);
+    // The same for a point source, whose bounds stand in for a cloud's (see PrepareSpaceColonization())
+    template <typename PointSource>
+    void BeginGrowth(PointSource& pointSource, const TreeParameters& treeParams);
+    void EndGrowth(const TreeParameters& treeParams, bool useGPU);
+    void PerformSpaceColonization(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, TreeParameters& treeParams, bool useGPU);
+    void PerformSpaceColonizationCPU(const std::vector<AttractorPoint>& attractorPoints, const AttractorPointMask& aliveMask, const TreeParameters& treeParams);
+    void PerformSpaceColonizationIncremental(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const TreeParameters& treeParams);
+    void PerformSpaceColonizationGPU(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask, const glm::vec3& minAttrPt, const glm::vec3& maxAttrPt, TreeParameters& treeParams);
+    void PerformShadowPropagation(const TreeParameters& treeParams); // The shadow model's counterpart of space colonization, see ENVIRONMENT_MODEL
+    void RemoveAttractorPoints(const std::vector<AttractorPoint>& attractorPoints, AttractorPointMask& aliveMask);
+
+    float ComputeQAccumRecursive(int br);
     void ComputeBHModelBasipetalPass();
-    void ComputeResourceFlowRecursive(TreeBranch& branch, float resource);
-    void ComputeBHModelAcropetalPass();
+    void ComputeResourceFlowRecursive(int br, float resource, const float lambda);
+    void ComputeBHModelAcropetalPass(const TreeParameters& treeParams);
 
     void AppendNewShoots(int n, const TreeParameters& treeParams);
 
-    float ComputeBranchRadiiRecursive(TreeBranch& branch, const TreeParameters& treeParams);
+    template <typename PipeModel> // see the PipeModel structs in Tree.cpp
+    float ComputeBranchRadiiRecursive(int br, const PipeModel& pipeModel, const float minimumBranchRadius, const float maximumBranchRadius);
     void ComputeBranchRadii(const TreeParameters& treeParams);
 
-    void ResetState(std::vector<AttractorPoint>& attractorPoints, bool useGPU); // Reset the state of each bud in the tree during the iterative algorithm
+    void ResetState(const TreeParameters& treeParams, bool useGPU); // Reset the state of each active bud in the tree during the iterative algorithm
 
     // Mesh handling
     void LoadBranchMesh(const char* filepath) { branchMesh.LoadFromFile(filepath); }
@@ -205,8 +615,17 @@ public:
         treeMesh.ExportToFile();
         leavesMesh.ExportToFile();
     }
+    // To <outputPrefix>tree_mesh.obj and <outputPrefix>leaves_mesh.obj, e.g. one prefix per tree of a batch. Returns false if either failed.
+    bool ExportAsObj(const std::string& outputPrefix) const {
+        const bool treeWritten = treeMesh.ExportToFile(outputPrefix + treeMesh.GetName() + ".obj");
+        const bool leavesWritten = leavesMesh.ExportToFile(outputPrefix + leavesMesh.GetName() + ".obj");
+        return treeWritten && leavesWritten;
+    }
     Mesh& GetTreeMesh() { return treeMesh; }
     Mesh& GetLeavesMesh() { return leavesMesh; }
-    void create(); // Assembles a mesh unioning all branches and a mesh unioning all leaves. Calls create() on each.
+    void BakeMeshes(); // Assembles a mesh unioning all branches and a mesh unioning all leaves. CPU only, no GL calls.
+    void SwapMeshData(Mesh& otherTreeMesh, Mesh& otherLeavesMesh); // Exchanges the baked (CPU-side) meshes, e.g. with ones baked on another thread
+    void UploadMeshes(); // Calls create() on the baked meshes
+    void create(); // Bakes the meshes and uploads them.
     bool HasBeenCreated() const { return hasBeenCreated; }
 };
@@ -1,54 +1,166 @@
 #include "TreeApplication.h"
+#include "../Profiling/Profiler.h"
+
+int TreeApplication::GetGrowthSessionIndex(int treeIndex, int cloudIndex) {
+    int sessionIndex = -1;
+    for (int s = 0; s < (int)growthSessions.size(); ++s) {
+        if (growthSessions[s].Matches(treeIndex, cloudIndex)) {
+            sessionIndex = s;
+            break;
+        }
+    }
+    if (sessionIndex == -1) {
+        growthSessions.emplace_back(GrowthSession(treeIndex, cloudIndex));
+        sessionIndex = (int)growthSessions.size() - 1;
+    }
+    growthSessions[sessionIndex].Prepare(sceneAttractorPointClouds[cloudIndex]);
+    return sessionIndex;
+}
+
+void TreeApplication::ForkSelectedTree() {
+    if (currentlySelectedTreeIndex == -1 || IsGrowing()) { return; }
+    const int sourceIndex = currentlySelectedTreeIndex;
+    sceneTrees.emplace_back(sceneTrees[sourceIndex].Fork());
+    currentlySelectedTreeIndex = (int)(sceneTrees.size()) - 1;
+    const unsigned int numSessions = (unsigned int)growthSessions.size();
+    for (unsigned int s = 0; s < numSessions; ++s) {
+        if (growthSessions[s].GetTreeIndex() == sourceIndex) {
+            growthSessions.emplace_back(growthSessions[s].Fork(currentlySelectedTreeIndex));
+        }
+    }
+    Tree& fork = sceneTrees[currentlySelectedTreeIndex];
+    if (sceneTrees[sourceIndex].HasBeenCreated()) {
+        fork.create();
+    }
+}
 
 void TreeApplication::IterateSelectedTreeInSelectedAttractorPointCloud() {
-    if (currentlySelectedTreeIndex != -1 && currentlySelectedAttractorPointCloudIndex != -1) {
-        auto start = std::chrono::system_clock::now();
-        /*#ifdef ENABLE_DEBUG_OUTPUT
-        auto start = std::chrono::system_clock::now();
-        #endif*/
-        bool prevState = treeParameters.resetAttractorPointState;
-        treeParameters.resetAttractorPointState = false;
-        AttractorPointCloud& currentAttrPtCloud = sceneAttractorPointClouds[currentlySelectedAttractorPointCloudIndex];
-        sceneTrees[currentlySelectedTreeIndex].IterateGrowth(currentAttrPtCloud.GetPointsCopy(), currentAttrPtCloud.GetMinPoint(), currentAttrPtCloud.GetMaxPoint(), treeParameters, true);
-        treeParameters.resetAttractorPointState = prevState;
-        /*#ifdef ENABLE_DEBUG_OUTPUT
-        auto end = std::chrono::system_clock::now();
-        std::chrono::duration<double> elapsed_seconds = end - start;
-        std::time_t end_time = std::chrono::system_clock::to_time_t(end);
-        std::cout << "Total Elapsed time for Tree Generation: " << elapsed_seconds.count() << "s\n";
-        #endif*/
-        auto end = std::chrono::system_clock::now();
-        std::chrono::duration<double> elapsed_seconds = end - start;
-        std::time_t end_time = std::chrono::system_clock::to_time_t(end);
-        std::cout << "Total Elapsed time for Tree Generation: " << elapsed_seconds.count() << "s\n";
-
-        sceneTrees[currentlySelectedTreeIndex].create();
+    if (currentlySelectedTreeIndex != -1 && currentlySelectedAttractorPointCloudIndex != -1 && !IsGrowing()) {
+        const int sessionIndex = GetGrowthSessionIndex(currentlySelectedTreeIndex, currentlySelectedAttractorPointCloudIndex);
+        StartBackgroundGrowth(currentlySelectedTreeIndex, sessionIndex, treeParameters);
     }
 }
 
 void TreeApplication::RegrowSelectedTreeInSelectedAttractorPointCloud() {
-    if (currentlySelectedTreeIndex != -1 && currentlySelectedAttractorPointCloudIndex != -1) {
-        auto start = std::chrono::system_clock::now();
-        /*#ifdef ENABLE_DEBUG_OUTPUT
-        auto start = std::chrono::system_clock::now();
-        #endif*/
-        Tree& currentTree = sceneTrees[currentlySelectedTreeIndex];
-        currentTree.ResetTree();
+    if (currentlySelectedTreeIndex != -1 && currentlySelectedAttractorPointCloudIndex != -1 && !IsGrowing()) {
+        sceneTrees[currentlySelectedTreeIndex].ResetTree();
+        const int sessionIndex = GetGrowthSessionIndex(currentlySelectedTreeIndex, currentlySelectedAttractorPointCloudIndex);
+        growthSessions[sessionIndex].Restart();
+        StartBackgroundGrowth(currentlySelectedTreeIndex, sessionIndex, treeParameters);
+    }
+}
+
+void TreeApplication::StartBackgroundGrowth(int treeIndex, int sessionIndex, const TreeParameters& params) {
+    AttractorPointCloud& currentAttrPtCloud = sceneAttractorPointClouds[currentlySelectedAttractorPointCloudIndex];
+    GrowthSession& session = growthSessions[sessionIndex];
+    TreeParameters cloudParams = params;
+    cloudParams.attractorPointsRevision = currentAttrPtCloud.GetLayoutRevision(); // the session's points are the cloud's, see GetGrowthSessionIndex()
+    growingTreeIndex = treeIndex;
+    growingSessionIndex = sessionIndex;
+    growthWorker->Start(sceneTrees[treeIndex], session.GetPoints(), std::move(session.GetAliveMask()), currentAttrPtCloud.GetMinPoint(), currentAttrPtCloud.GetMaxPoint(), cloudParams, true);
+}
+
+void TreeApplication::IterateSelectedTreeInAllAttractorPointClouds() {
+    if (currentlySelectedTreeIndex != -1 && !sceneAttractorPointClouds.empty() && !IsGrowing()) {
+        StartBackgroundCompositeGrowth(currentlySelectedTreeIndex, treeParameters);
+    }
+}
+
+void TreeApplication::RegrowSelectedTreeInAllAttractorPointClouds() {
+    if (currentlySelectedTreeIndex != -1 && !sceneAttractorPointClouds.empty() && !IsGrowing()) {
+        sceneTrees[currentlySelectedTreeIndex].ResetTree();
+        for (int c = 0; c < (int)sceneAttractorPointClouds.size(); ++c) {
+            growthSessions[GetGrowthSessionIndex(currentlySelectedTreeIndex, c)].Restart();
+        }
+        StartBackgroundCompositeGrowth(currentlySelectedTreeIndex, treeParameters);
+    }
+}
+
+// Lends each session's mask and grid to the composite, GrowthWorker::Finish() hands them back
+void TreeApplication::StartBackgroundCompositeGrowth(int treeIndex, const TreeParameters& params) {
+    AttractorPointComposite composite = AttractorPointComposite();
+    growingCompositeSessionIndices.clear();
+    for (int c = 0; c < (int)sceneAttractorPointClouds.size(); ++c) {
+        const int sessionIndex = GetGrowthSessionIndex(treeIndex, c);
+        GrowthSession& session = growthSessions[sessionIndex];
+        composite.AddCloud(session.GetPoints(), std::move(session.GetAliveMask()), std::move(session.GetGrid()), session.GetGridCellWidth());
+        growingCompositeSessionIndices.emplace_back(sessionIndex);
+    }
+    growingTreeIndex = treeIndex;
+    growingSessionIndex = -1;
+    growthWorker->Start(sceneTrees[treeIndex], std::move(composite), params);
+}
+
+bool TreeApplication::FinishBackgroundGrowth() {
+    if (growingTreeIndex == -1) {
+        return growthWorker->Finish(sceneTrees, growthSessions[growingSessionIndex].GetAliveMask());
+    }
+    Tree& growingTree = sceneTrees[growingTreeIndex];
+    if (growingSessionIndex != -1) {
+        return growthWorker->Finish(growingTree, growthSessions[growingSessionIndex].GetAliveMask());
+    }
+    AttractorPointComposite composite = AttractorPointComposite();
+    if (!growthWorker->Finish(growingTree, composite)) { return false; }
+    for (unsigned int m = 0; m < composite.GetNumMembers(); ++m) {
+        GrowthSession& session = growthSessions[growingCompositeSessionIndices[m]];
+        composite.TakeMember(m, session.GetAliveMask(), session.GetGrid(), session.GetGridCellWidth());
+    }
+    return true;
+}
+
+bool TreeApplication::IsTreeGrowing(unsigned int treeIndex) const {
+    if (!IsGrowing()) { return false; }
+    return (growingTreeIndex == -1) ? treeIndex < growthWorker->GetNumTrees() : (int)treeIndex == growingTreeIndex;
+}
+
+// Shows the newest snapshot of the growing trees, then the final trees once the worker is done. Only uploads to the GPU, never waits on the worker.
+void TreeApplication::UpdateBackgroundGrowth() {
+    if (!IsGrowing()) { return; }
+    const unsigned int numGrowingTrees = growthWorker->GetNumTrees();
+    std::unique_ptr<GrowthSnapshot> snapshot = growthWorker->TakeLatestSnapshot();
+    if (snapshot) {
+        PROFILE_SCOPE("Upload Growth Snapshot");
+        for (unsigned int t = 0; t < numGrowingTrees; ++t) {
+            Tree& growingTree = GetGrowingTree(t);
+            growingTree.SwapMeshData(snapshot->treeMeshes[t], snapshot->leavesMeshes[t]);
+            growingTree.UploadMeshes();
+        }
+    }
+    if (FinishBackgroundGrowth()) {
+        for (unsigned int t = 0; t < numGrowingTrees; ++t) {
+            GetGrowingTree(t).UploadMeshes();
+        }
+    }
+}
+
+void TreeApplication::UpdateTreeStages() {
+    for (unsigned int t = 0; t < (unsigned int)sceneTrees.size(); ++t) {
+        if (IsTreeGrowing(t)) { continue; } // its meshes are the worker's snapshots until Finish()
+        sceneTrees[t].UpdateStages(treeParameters);
+    }
+}
+
+// Grows copies of the trees on the worker, so the window keeps drawing the forest as it grows
+void TreeApplication::IterateForestInSelectedAttractorPointCloud() {
+    if (sceneTrees.size() > 0 && currentlySelectedAttractorPointCloudIndex != -1 && !IsGrowing()) {
         AttractorPointCloud& currentAttrPtCloud = sceneAttractorPointClouds[currentlySelectedAttractorPointCloudIndex];
-        treeParameters.resetAttractorPointState = true;
-        currentTree.IterateGrowth(currentAttrPtCloud.GetPointsCopy(), currentAttrPtCloud.GetMinPoint(), currentAttrPtCloud.GetMaxPoint(), treeParameters, true);
-        /*#ifdef ENABLE_DEBUG_OUTPUT
-        auto end = std::chrono::system_clock::now();
-        std::chrono::duration<double> elapsed_seconds = end - start;
-        std::time_t end_time = std::chrono::system_clock::to_time_t(end);
-        std::cout << "Total Elapsed time for Tree Generation: " << elapsed_seconds.count() << "s\n";
-        #endif*/
-        auto end = std::chrono::system_clock::now();
-        std::chrono::duration<double> elapsed_seconds = end - start;
-        std::time_t end_time = std::chrono::system_clock::to_time_t(end);
-        std::cout << "Total Elapsed time for Tree Generation: " << elapsed_seconds.count() << "s\n";
-        sceneTrees[currentlySelectedTreeIndex].create();
+        const int sessionIndex = GetGrowthSessionIndex(-1, currentlySelectedAttractorPointCloudIndex);
+        GrowthSession& session = growthSessions[sessionIndex];
+        growingTreeIndex = -1;
+        growingSessionIndex = sessionIndex;
+        growthWorker->Start(sceneTrees, session.GetPoints(), std::move(session.GetAliveMask()), currentAttrPtCloud.GetMinPoint(), currentAttrPtCloud.GetMaxPoint(), treeParameters);
+    }
+}
+
+void TreeApplication::RegrowForestInSelectedAttractorPointCloud() {
+    if (IsGrowing()) { return; }
+    for (unsigned int t = 0; t < (unsigned int)sceneTrees.size(); ++t) {
+        sceneTrees[t].ResetTree();
+    }
+    if (currentlySelectedAttractorPointCloudIndex != -1) {
+        growthSessions[GetGrowthSessionIndex(-1, currentlySelectedAttractorPointCloudIndex)].Restart();
     }
+    IterateForestInSelectedAttractorPointCloud();
 }
 
 void TreeApplication::ComputeWorldSpaceSketchPoints(const Camera& camera) {
@@ -59,7 +171,7 @@ void TreeApplication::ComputeWorldSpaceSketchPoints(const Camera& camera) {
     const glm::mat4 viewProjMat = camera.GetViewProj();
     const glm::mat4 invViewProjMat = glm::inverse(viewProjMat);
 
-    const glm::vec3& rootBudPoint = sceneTrees[currentlySelectedTreeIndex].branches[0].GetBuds()[0].point;
+    const glm::vec3& rootBudPoint = sceneTrees[currentlySelectedTreeIndex].GetBudConst(0, 0).point;
     glm::vec4 budPointProj = viewProjMat * glm::vec4(rootBudPoint, 1.0f);
     budPointProj /= budPointProj.w;
     //const glm::vec3 budPointView = (viewMat * glm::vec4(rootBudPoint, 1.0f));
@@ -99,4 +211,5 @@ void TreeApplication::ComputeWorldSpaceSketchPoints(const Camera& camera) {
 void TreeApplication::GenerateSketchAttractorPointCloud() {
     AddAttractorPointCloudToScene();
     GetSelectedAttractorPointCloud().GeneratePointsGivenSketchPoints(treeParameters.numAttractorPointsToGenerate, currentSketchPoints, treeParameters.brushRadius);
+    GetSelectedAttractorPointCloud().create();
 }
\ No newline at end of file
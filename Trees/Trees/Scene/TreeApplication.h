@@ -5,6 +5,10 @@
 #include "Tree.h"
 #include "AttractorPointCloud.h"
 #include "Camera.h"
+#include "GrowthSession.h"
+#include "../Threading/GrowthWorker.h"
+
+#include <memory>
 
 class TreeApplication {
 private:
@@ -12,19 +16,44 @@ private:
     std::vector<Tree> sceneTrees; // trees in the scene
     std::vector<AttractorPointCloud> sceneAttractorPointClouds; // attractor point clouds in the scene
     std::vector<glm::vec3> currentSketchPoints; // the sketch points in screen space of the current sketch stroke
+    glm::vec3 newTreeRootPoint; // where the next tree added from the UI is planted
 
     // App management variables
     int currentlySelectedTreeIndex;
     int currentlySelectedAttractorPointCloudIndex;
 
+    // What each tree (or the whole scene as a forest) has consumed of each cloud so far
+    std::vector<GrowthSession> growthSessions;
+    int GetGrowthSessionIndex(int treeIndex, int cloudIndex); // Adds the session if there is none yet
+
+    // Background growth of one tree, or of the whole scene as a forest, at a time
+    std::unique_ptr<GrowthWorker> growthWorker;
+    int growingTreeIndex; // -1 while growing a forest: then the first GrowthWorker::GetNumTrees() trees are growing
+    int growingSessionIndex; // -1 while growing into every cloud at once
+    std::vector<int> growingCompositeSessionIndices; // then the session of each member of the composite
+    void StartBackgroundGrowth(int treeIndex, int sessionIndex, const TreeParameters& params);
+    void StartBackgroundCompositeGrowth(int treeIndex, const TreeParameters& params);
+    bool FinishBackgroundGrowth(); // hands the trees and the alive masks back, see GrowthWorker::Finish()
+    bool IsTreeGrowing(unsigned int treeIndex) const;
+    Tree& GetGrowingTree(unsigned int t) { return sceneTrees[(growingTreeIndex == -1) ? (int)t : growingTreeIndex]; } // the t-th tree of the job
+
 public:
-    TreeApplication() : currentlySelectedTreeIndex(-1), currentlySelectedAttractorPointCloudIndex(-1) {
+    TreeApplication() : newTreeRootPoint(glm::vec3(0.0f)), currentlySelectedTreeIndex(-1), currentlySelectedAttractorPointCloudIndex(-1), growingTreeIndex(-1),
+        growingSessionIndex(-1) {
+        growthSessions = std::vector<GrowthSession>();
+        growingCompositeSessionIndices = std::vector<int>();
+        growthWorker = std::unique_ptr<GrowthWorker>(new GrowthWorker());
         treeParameters = TreeParameters();
         std::vector<Tree> sceneTrees = std::vector<Tree>();
         std::vector<AttractorPointCloud> sceneAttractorPointClouds = std::vector<AttractorPointCloud>();
     }
 
     void DestroyTrees() {
+        if (growthWorker->IsBusy()) {
+            growthWorker->Cancel();
+            growthWorker->Wait();
+            FinishBackgroundGrowth();
+        }
         for (unsigned int t = 0; t < (unsigned int)sceneTrees.size(); ++t) {
             sceneTrees[t].DestroyMeshes();
         }
@@ -36,10 +65,14 @@ public:
     }
 
     // Scene Editing Functions
-    void AddTreeToScene() {
-        sceneTrees.emplace_back(Tree());
+    void AddTreeToScene() { AddTreeToScene(glm::vec3(0.0f)); }
+    void AddTreeToScene(const glm::vec3& rootPoint) {
+        sceneTrees.emplace_back(Tree(rootPoint));
         currentlySelectedTreeIndex = (int)(sceneTrees.size()) - 1;
     }
+    // Adds a copy of the selected tree that continues from the same point: its branches are shared with the original until either one grows
+    void ForkSelectedTree();
+    glm::vec3& GetNewTreeRootPoint() { return newTreeRootPoint; }
     void AddAttractorPointCloudToScene() {
         sceneAttractorPointClouds.emplace_back(AttractorPointCloud());
         currentlySelectedAttractorPointCloudIndex = (int)(sceneAttractorPointClouds.size()) - 1;
@@ -57,6 +90,7 @@ public:
         }
         return Tree(); // a bad temporary tree!
     }
+    bool HasSelectedTree() const { return currentlySelectedTreeIndex != -1; }
     const Tree& GetSelectedTreeConst() const {
         if (currentlySelectedTreeIndex != -1) {
             return sceneTrees[currentlySelectedTreeIndex];
@@ -67,8 +101,24 @@ public:
     std::vector<glm::vec3>& GetSketchPoints() { return currentSketchPoints; }
     void ClearSketchPoints() { currentSketchPoints.clear(); }
 
+    // Tree growth runs in the background. Call UpdateBackgroundGrowth() once per frame to show its progress and pick up the result.
+    // Iterate continues growing into the points the tree left in the cloud, Regrow starts over from a single bud and the whole cloud.
     void IterateSelectedTreeInSelectedAttractorPointCloud();
     void RegrowSelectedTreeInSelectedAttractorPointCloud();
+    // The same, into every cloud in the scene at once, e.g. all the strokes sketched so far, without merging them (see AttractorPointComposite)
+    void IterateSelectedTreeInAllAttractorPointClouds();
+    void RegrowSelectedTreeInAllAttractorPointClouds();
+    void UpdateBackgroundGrowth();
+    // Brings the radii and meshes of every tree up to date with the current parameters. Costs next to nothing unless a parameter changed,
+    // so call it once per frame.
+    void UpdateTreeStages();
+    void CancelBackgroundGrowth() { growthWorker->Cancel(); }
+    bool IsGrowing() const { return growthWorker->IsBusy(); }
+    int GetNumGrowthIterationsDone() const { return growthWorker->GetNumIterationsDone(); }
+    int GetNumGrowthIterations() const { return growthWorker->GetNumIterations(); }
+    // Grow every tree in the scene together in the selected cloud, competing for its points (see Forest). In the background, like the above.
+    void IterateForestInSelectedAttractorPointCloud();
+    void RegrowForestInSelectedAttractorPointCloud();
     void ComputeWorldSpaceSketchPoints(const Camera& camera);
     void GenerateSketchAttractorPointCloud();
 
@@ -0,0 +1,113 @@
+#include "TreePreviewRenderer.h"
+#include "../Threading/Parallel.h"
+#include "../Profiling/Profiler.h"
+
+#include <cmath>
+
+// The same internodes and leaves as Tree::BakeMeshes, including where it stops
+void TreePreviewRenderer::Build(const Tree& tree) {
+    PROFILE_SCOPE("Build Tree Preview");
+    branchColor = tree.GetBranchColor();
+    leafColor = tree.GetLeafColor();
+    std::vector<Capsule> capsules = std::vector<Capsule>();
+    const CowChunkedArray<TreeBranch>& branches = tree.GetBranches();
+    for (unsigned int br = 0; br < (unsigned int)branches.size(); ++br) {
+        const unsigned int numBuds = branches[br].GetNumBuds();
+        for (unsigned int bu = 1; bu < numBuds; ++bu) {
+            const Bud& currentBud = tree.GetBudConst(br, bu);
+            const glm::vec3& internodeEndPoint = currentBud.point;
+            // The branch mesh is a cylinder of radius 1 scaled by 0.02 times the branch radius
+            capsules.emplace_back(Capsule(tree.GetBudConst(br, bu - 1).point, internodeEndPoint, currentBud.branchRadius * 0.02f, PREVIEW_BRANCH));
+
+            if (currentBud.type == AXILLARY && currentBud.fate != FORMED_BRANCH) {
+                const float leafScale = 0.05f * currentBud.internodeLength / currentBud.branchRadius;
+                if (leafScale < 0.01) { break; }
+                // The leaf mesh's blade runs about 1.1 along the growth direction and is about 0.9 wide
+                const glm::vec3 leafDir = glm::normalize(currentBud.naturalGrowthDir);
+                capsules.emplace_back(Capsule(internodeEndPoint + 0.3f * leafScale * leafDir, internodeEndPoint + 0.8f * leafScale * leafDir, 0.25f * leafScale, PREVIEW_LEAF));
+            }
+        }
+    }
+    bvh.Build(std::move(capsules));
+}
+
+/// Rendering
+
+void TreePreviewRenderer::RenderTile(unsigned int tileX, unsigned int tileY, unsigned int width, unsigned int height, const glm::vec3& eye, const glm::vec3& forward,
+                                     const glm::vec3& right, const glm::vec3& up, std::vector<unsigned char>& rgb) const {
+    const glm::vec3 lightDir = glm::normalize(TREE_PREVIEW_LIGHT_DIRECTION);
+    const std::vector<Capsule>& capsules = bvh.GetCapsules();
+    RayPacket packet;
+    RayPacket shadowPacket;
+    for (unsigned int py = tileY; py < tileY + TREE_PREVIEW_TILE_SIZE; py += RAY_PACKET_WIDTH) {
+        for (unsigned int px = tileX; px < tileX + TREE_PREVIEW_TILE_SIZE; px += RAY_PACKET_WIDTH) {
+            for (unsigned int i = 0; i < RAY_PACKET_SIZE; ++i) {
+                const unsigned int x = px + i % RAY_PACKET_WIDTH;
+                const unsigned int y = py + i / RAY_PACKET_WIDTH;
+                const float u = (2.0f * (x + 0.5f) / width - 1.0f) * (float)width / height;
+                const float v = 1.0f - 2.0f * (y + 0.5f) / height;
+                const bool inImage = x < width && y < height;
+                packet.SetRay(i, eye, glm::normalize(forward + u * right + v * up), inImage ? 999999.0f : 0.0f);
+            }
+            bvh.Intersect(packet);
+
+            for (unsigned int i = 0; i < RAY_PACKET_SIZE; ++i) {
+                const int c = packet.hitCapsule[i];
+                if (c < 0) {
+                    shadowPacket.SetRay(i, eye, lightDir, 0.0f);
+                    continue;
+                }
+                const glm::vec3 hitPoint = packet.GetHitPoint(i);
+                const glm::vec3 normal = CapsuleBVH::GetNormal(capsules[c], hitPoint);
+                shadowPacket.SetRay(i, hitPoint + TREE_PREVIEW_SHADOW_OFFSET * capsules[c].radius * normal, lightDir, 999999.0f);
+            }
+            bvh.IntersectAny(shadowPacket);
+
+            for (unsigned int i = 0; i < RAY_PACKET_SIZE; ++i) {
+                const unsigned int x = px + i % RAY_PACKET_WIDTH;
+                const unsigned int y = py + i / RAY_PACKET_WIDTH;
+                if (x >= width || y >= height) { continue; }
+                glm::vec3 color = TREE_PREVIEW_BACKGROUND_COLOR;
+                const int c = packet.hitCapsule[i];
+                if (c >= 0) {
+                    const Capsule& capsule = capsules[c];
+                    const glm::vec3 normal = CapsuleBVH::GetNormal(capsule, packet.GetHitPoint(i));
+                    float diffuse = glm::dot(normal, lightDir);
+                    if (capsule.material == PREVIEW_LEAF) { diffuse = std::abs(diffuse); } // thin blades, lit from either side
+                    const float lit = (shadowPacket.hitCapsule[i] < 0) ? std::max(diffuse, 0.0f) : 0.0f;
+                    color = ((capsule.material == PREVIEW_LEAF) ? leafColor : branchColor) * (TREE_PREVIEW_AMBIENT + (1.0f - TREE_PREVIEW_AMBIENT) * lit);
+                }
+                unsigned char* pixel = rgb.data() + 3 * ((size_t)y * width + x);
+                pixel[0] = (unsigned char)(255.0f * glm::clamp(color.x, 0.0f, 1.0f) + 0.5f);
+                pixel[1] = (unsigned char)(255.0f * glm::clamp(color.y, 0.0f, 1.0f) + 0.5f);
+                pixel[2] = (unsigned char)(255.0f * glm::clamp(color.z, 0.0f, 1.0f) + 0.5f);
+            }
+        }
+    }
+}
+
+void TreePreviewRenderer::Render(unsigned int width, unsigned int height, float azimuth, std::vector<unsigned char>& rgb) const {
+    PROFILE_SCOPE("Render Tree Preview");
+    rgb.resize((size_t)3 * width * height);
+    glm::vec3 minPt;
+    glm::vec3 maxPt;
+    bvh.GetBounds(minPt, maxPt);
+    const glm::vec3 center = 0.5f * (minPt + maxPt);
+    const float radius = std::max(0.5f * glm::length(maxPt - minPt), 0.001f);
+
+    // Far enough back that the tree's bounding sphere fits the narrower of the two fields of view
+    const float tanHalfFov = std::tan(0.5f * TREE_PREVIEW_FIELD_OF_VIEW);
+    const float tanHalfFovNarrow = tanHalfFov * std::min(1.0f, (float)width / std::max(height, 1u));
+    const float distance = radius / std::sin(std::atan(tanHalfFovNarrow));
+    const glm::vec3 toEye = glm::normalize(glm::vec3(-std::sin(azimuth), TREE_PREVIEW_ELEVATION, std::cos(azimuth)));
+    const glm::vec3 eye = center + distance * toEye;
+    const glm::vec3 forward = -toEye;
+    const glm::vec3 right = glm::normalize(glm::cross(forward, WORLD_UP_VECTOR)) * tanHalfFov;
+    const glm::vec3 up = glm::normalize(glm::cross(right, forward)) * tanHalfFov;
+
+    const unsigned int numTilesX = (width + TREE_PREVIEW_TILE_SIZE - 1) / TREE_PREVIEW_TILE_SIZE;
+    const unsigned int numTilesY = (height + TREE_PREVIEW_TILE_SIZE - 1) / TREE_PREVIEW_TILE_SIZE;
+    ParallelFor(numTilesX * numTilesY, [&](unsigned int t) {
+        RenderTile((t % numTilesX) * TREE_PREVIEW_TILE_SIZE, (t / numTilesX) * TREE_PREVIEW_TILE_SIZE, width, height, eye, forward, right, up, rgb);
+    });
+}
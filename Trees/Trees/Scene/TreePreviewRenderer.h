@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+
+#include "Tree.h"
+#include "../Raytracing/CapsuleBVH.h"
+
+#define TREE_PREVIEW_TILE_SIZE 16 // pixels on a side, the unit of work handed to a thread. A multiple of RAY_PACKET_WIDTH.
+#define TREE_PREVIEW_FIELD_OF_VIEW 0.7853981634f // vertical, 45 degrees like the application's camera
+#define TREE_PREVIEW_ELEVATION 0.3f // how far above the tree's center the camera looks from, relative to its distance on the ground
+#define TREE_PREVIEW_BACKGROUND_COLOR glm::vec3(0.85f, 0.88f, 0.92f)
+#define TREE_PREVIEW_LIGHT_DIRECTION glm::vec3(0.4f, 0.8f, 0.45f) // towards the light, normalized when used
+#define TREE_PREVIEW_AMBIENT 0.3f // the share of the light that also reaches surfaces facing away or in shadow
+#define TREE_PREVIEW_SHADOW_OFFSET 0.01f // shadow rays start this fraction of the capsule's radius off the surface, so they don't hit it
+
+enum PREVIEW_MATERIAL { PREVIEW_BRANCH, PREVIEW_LEAF };
+
+// Renders grown trees into RGB images on the CPU, e.g. thumbnails on machines without a GPU or a display (see PngWriter). Every internode is
+// a capsule from bud to bud with the branch's radius, and every leaf the mesh would have one capsule along its blade, so the tree looks
+// like its baked mesh without baking it. The image is traced in tiles spread over the cores, each tile in packets of neighboring primary
+// rays (see CapsuleBVH), with a shadow ray per hit towards a fixed directional light.
+class TreePreviewRenderer {
+private:
+    CapsuleBVH bvh;
+    glm::vec3 branchColor;
+    glm::vec3 leafColor;
+
+    void RenderTile(unsigned int tileX, unsigned int tileY, unsigned int width, unsigned int height, const glm::vec3& eye, const glm::vec3& forward,
+                    const glm::vec3& right, const glm::vec3& up, std::vector<unsigned char>& rgb) const;
+
+public:
+    TreePreviewRenderer() : branchColor(glm::vec3(0.0f)), leafColor(glm::vec3(0.0f)) {
+        bvh = CapsuleBVH();
+    }
+
+    // Reads the tree's branch radii, so call it after Tree::ComputeBranchRadii, e.g. once IterateGrowth returned
+    void Build(const Tree& tree);
+    unsigned int GetNumCapsules() const { return (unsigned int)bvh.GetCapsules().size(); }
+    // Renders the tree from the given azimuth (in radians, 0 looking along -z), a little from above and framed whole, into rgb: width * height
+    // pixels of three bytes each, row by row from the top
+    void Render(unsigned int width, unsigned int height, float azimuth, std::vector<unsigned char>& rgb) const;
+};
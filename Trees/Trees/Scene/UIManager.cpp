@@ -5,6 +5,10 @@
 #include "imgui_internal.h"
 #include "imconfig.h"
 #include "TreeApplication.h"
+#include "../Profiling/Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
 
 void UIManager::ImguiSetup(GLFWwindow* window) {
     ImGui::CreateContext();
@@ -14,25 +18,84 @@ void UIManager::ImguiSetup(GLFWwindow* window) {
     bool show_demo_window = true;
     bool show_another_window = false;
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
+    #ifdef ENABLE_PROFILING
+    lastProfileRefreshTime = -1.0;
+    #endif
 }
 
 void UIManager::HandleInput(TreeApplication& treeApp) {
     ImGui::SliderFloat("Internode Scale", &treeApp.GetTreeParameters().internodeScale, 0.0f, 10.0f);
+    ImGui::SliderFloat("Perception Cos Theta", &treeApp.GetTreeParameters().perceptionCosThetaSmall, 0.0f, 1.0f);
+    ImGui::SliderFloat("BH Lambda", &treeApp.GetTreeParameters().BHLambda, 0.0f, 1.0f);
+    ImGui::SliderFloat("Tropism Weight", &treeApp.GetTreeParameters().tropismDirWeight, -1.0f, 1.0f);
     ImGui::SliderFloat("Minimum Branch Radius", &treeApp.GetTreeParameters().minimumBranchRadius, 0.0f, 100.0f);
     ImGui::SliderFloat("Maximum Branch Radius", &treeApp.GetTreeParameters().maximumBranchRadius, 0.0f, 100.0f);
+    ImGui::SliderFloat("Pipe Model Exponent", &treeApp.GetTreeParameters().pipeModelExponent, 1.0f, 4.0f);
     ImGui::SliderInt("Num Space Col Iterations", &treeApp.GetTreeParameters().numSpaceColonizationIterations, 0, 10000);
     ImGui::SliderInt("Num Attr Pts to Gen", &treeApp.GetTreeParameters().numAttractorPointsToGenerate, 0, 5000000);
-    //ImGui::Checkbox("Enable Debug Output", &treeApp.GetTreeParameters().enableDebugOutput);
+    const char* environmentModelNames[] = { "Attractor Points", "Shadow Propagation" }; // in ENVIRONMENT_MODEL order
+    ImGui::Combo("Environment", (int*)&treeApp.GetTreeParameters().environmentModel, environmentModelNames, 2);
+    if (treeApp.GetTreeParameters().environmentModel == ENVIRONMENT_SHADOW_PROPAGATION) {
+        ImGui::SliderFloat("Shadow Strength", &treeApp.GetTreeParameters().shadowStrength, 0.0f, 0.5f);
+        ImGui::SliderFloat("Shadow Falloff", &treeApp.GetTreeParameters().shadowFalloff, 1.0f, 4.0f);
+        ImGui::SliderInt("Shadow Depth", &treeApp.GetTreeParameters().shadowPyramidDepth, 1, 16);
+    } else {
+        ImGui::SliderInt("Resolution Levels", &treeApp.GetTreeParameters().numResolutionLevels, 1, 5);
+        ImGui::SliderInt("Iterations Per Coarse Level", &treeApp.GetTreeParameters().iterationsPerResolutionLevel, 1, 20);
+    }
+    // Radius parameters and colors show up right away (see TreeApplication::UpdateTreeStages()), growth parameters need the tree to grow again
+    if (treeApp.HasSelectedTree()) {
+        Tree& selectedTree = treeApp.GetSelectedTree();
+        glm::vec3 branchColor = selectedTree.GetBranchColor();
+        if (ImGui::ColorEdit3("Branch Color", &branchColor.x)) {
+            selectedTree.SetBranchColor(branchColor);
+        }
+        glm::vec3 leafColor = selectedTree.GetLeafColor();
+        if (ImGui::ColorEdit3("Leaf Color", &leafColor.x)) {
+            selectedTree.SetLeafColor(leafColor);
+        }
+        if (!treeApp.IsGrowing() && selectedTree.IsTopologyOutdated(treeApp.GetTreeParametersConst())) {
+            ImGui::Text("Growth parameters changed: Iterate or Regrow to apply them");
+        }
+    }
     if (ImGui::Button("Iterate Tree")) {
         treeApp.IterateSelectedTreeInSelectedAttractorPointCloud();
     }
     if (ImGui::Button("Regrow Tree")) {
         treeApp.RegrowSelectedTreeInSelectedAttractorPointCloud();
     }
+    if (ImGui::Button("Iterate Tree In All Clouds")) {
+        treeApp.IterateSelectedTreeInAllAttractorPointClouds();
+    }
+    if (ImGui::Button("Regrow Tree In All Clouds")) {
+        treeApp.RegrowSelectedTreeInAllAttractorPointClouds();
+    }
+    if (treeApp.IsGrowing()) {
+        char progressText[64];
+        snprintf(progressText, sizeof(progressText), "Iteration %d / %d", treeApp.GetNumGrowthIterationsDone(), treeApp.GetNumGrowthIterations());
+        ImGui::ProgressBar((float)treeApp.GetNumGrowthIterationsDone() / (float)std::max(1, treeApp.GetNumGrowthIterations()), ImVec2(-1.0f, 0.0f), progressText);
+        if (ImGui::Button("Cancel Growth")) {
+            treeApp.CancelBackgroundGrowth();
+        }
+    }
+    ImGui::InputFloat3("New Tree Root", &treeApp.GetNewTreeRootPoint().x);
+    if (ImGui::Button("Add Tree")) {
+        treeApp.AddTreeToScene(treeApp.GetNewTreeRootPoint());
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Fork Tree")) {
+        treeApp.ForkSelectedTree();
+    }
+    if (ImGui::Button("Iterate Forest")) {
+        treeApp.IterateForestInSelectedAttractorPointCloud();
+    }
+    if (ImGui::Button("Regrow Forest")) {
+        treeApp.RegrowForestInSelectedAttractorPointCloud();
+    }
     if (ImGui::Button("Add Attr Pt Cloud")) {
         treeApp.AddAttractorPointCloudToScene();
         treeApp.GetSelectedAttractorPointCloud().GeneratePoints(treeApp.GetTreeParameters().numAttractorPointsToGenerate);
-        treeApp.GetTreeParameters().reconstructUniformGridOnGPU = true;
+        treeApp.GetSelectedAttractorPointCloud().create();
     }
     if (ImGui::Button("Show/Hide Current Attr Pt Cloud")) {
         treeApp.GetSelectedAttractorPointCloud().ToggleDisplay();
@@ -41,3 +104,81 @@ void UIManager::HandleInput(TreeApplication& treeApp) {
         treeApp.ExportTreeAsObj();
     }
 }
+
+#ifdef ENABLE_PROFILING
+#define PROFILE_PANEL_HISTORY_LENGTH 128
+#define PROFILE_PANEL_REFRESH_INTERVAL 0.5
+
+void UIManager::RefreshProfileHistory() {
+    std::vector<Profiler::ZoneEvent> zones = std::vector<Profiler::ZoneEvent>();
+    std::vector<Profiler::CounterEvent> counters = std::vector<Profiler::CounterEvent>();
+    Profiler::CollectEvents(zones, counters);
+
+    // Events come out grouped per thread, so sort by time before keeping the most recent samples of each zone / counter
+    std::sort(zones.begin(), zones.end(), [](const Profiler::ZoneEvent& a, const Profiler::ZoneEvent& b) { return a.endNs < b.endNs; });
+    std::sort(counters.begin(), counters.end(), [](const Profiler::CounterEvent& a, const Profiler::CounterEvent& b) { return a.timeNs < b.timeNs; });
+
+    profileZoneHistory.clear();
+    profileCounterHistory.clear();
+    for (unsigned int i = 0; i < (unsigned int)zones.size(); ++i) {
+        profileZoneHistory[zones[i].name].emplace_back((float)((zones[i].endNs - zones[i].startNs) * 1e-6));
+    }
+    for (unsigned int i = 0; i < (unsigned int)counters.size(); ++i) {
+        profileCounterHistory[counters[i].name].emplace_back((float)counters[i].value);
+    }
+    for (auto& history : profileZoneHistory) {
+        if (history.second.size() > PROFILE_PANEL_HISTORY_LENGTH) {
+            history.second.erase(history.second.begin(), history.second.end() - PROFILE_PANEL_HISTORY_LENGTH);
+        }
+    }
+    for (auto& history : profileCounterHistory) {
+        if (history.second.size() > PROFILE_PANEL_HISTORY_LENGTH) {
+            history.second.erase(history.second.begin(), history.second.end() - PROFILE_PANEL_HISTORY_LENGTH);
+        }
+    }
+}
+#endif
+
+void UIManager::DrawProfilerPanel() {
+    #ifdef ENABLE_PROFILING
+    if (lastProfileRefreshTime < 0.0 || ImGui::GetTime() - lastProfileRefreshTime > PROFILE_PANEL_REFRESH_INTERVAL) {
+        RefreshProfileHistory();
+        lastProfileRefreshTime = ImGui::GetTime();
+    }
+
+    ImGui::Begin("Performance");
+    if (ImGui::Button("Export Chrome Trace")) {
+        Profiler::ExportChromeTrace("profile_trace.json");
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear Profile")) {
+        Profiler::Clear();
+        RefreshProfileHistory();
+    }
+
+    // One bar per recorded occurrence of each phase, most recent on the right
+    if (ImGui::CollapsingHeader("Phases (ms)", ImGuiTreeNodeFlags_DefaultOpen)) {
+        for (const auto& history : profileZoneHistory) {
+            const std::vector<float>& samples = history.second;
+            float sum = 0.0f;
+            float maxSample = 0.0f;
+            for (unsigned int i = 0; i < (unsigned int)samples.size(); ++i) {
+                sum += samples[i];
+                maxSample = std::max(maxSample, samples[i]);
+            }
+            char overlay[64];
+            snprintf(overlay, sizeof(overlay), "last %.2f  avg %.2f  max %.2f", samples.back(), sum / samples.size(), maxSample);
+            ImGui::PlotHistogram(history.first.c_str(), samples.data(), (int)samples.size(), 0, overlay, 0.0f, maxSample, ImVec2(0, 50));
+        }
+    }
+    if (ImGui::CollapsingHeader("Counters", ImGuiTreeNodeFlags_DefaultOpen)) {
+        for (const auto& history : profileCounterHistory) {
+            const std::vector<float>& samples = history.second;
+            char overlay[64];
+            snprintf(overlay, sizeof(overlay), "last %.0f", samples.back());
+            ImGui::PlotLines(history.first.c_str(), samples.data(), (int)samples.size(), 0, overlay, FLT_MAX, FLT_MAX, ImVec2(0, 40));
+        }
+    }
+    ImGui::End();
+    #endif
+}
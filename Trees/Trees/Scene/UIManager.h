@@ -2,11 +2,24 @@
 
 #include "imgui.h"
 #include "imgui_impl_glfw_glad.h"
+#include "Globals.h"
+
+#include <map>
+#include <string>
+#include <vector>
 
 struct GLFWwindow;
 class TreeApplication;
 
 class UIManager {
+private:
+    #ifdef ENABLE_PROFILING
+    // Most recent samples per profiler zone (durations in ms) and per counter, refreshed a few times a second
+    std::map<std::string, std::vector<float>> profileZoneHistory;
+    std::map<std::string, std::vector<float>> profileCounterHistory;
+    double lastProfileRefreshTime;
+    void RefreshProfileHistory();
+    #endif
 public:
     UIManager(GLFWwindow* window) { ImguiSetup(window); }
     void ImguiSetup(GLFWwindow* window);
@@ -22,4 +35,5 @@ public:
         ImGui::DestroyContext();
     }
     void HandleInput(TreeApplication& treeApp);
+    void DrawProfilerPanel(); // Per-phase timing histograms and counters. Does nothing unless ENABLE_PROFILING is defined.
 };
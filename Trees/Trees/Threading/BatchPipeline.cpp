@@ -0,0 +1,153 @@
+#include "BatchPipeline.h"
+#include "Parallel.h"
+#include "../Scene/TreePreviewRenderer.h"
+#include "../Raytracing/PngWriter.h"
+#include "../Profiling/Profiler.h"
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+static double SecondsSince(const std::chrono::steady_clock::time_point& start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+BatchPipeline::BatchPipeline(unsigned int growthThreads, unsigned int bakeThreads) : wallSeconds(0.0), numWriteFailures(0), nextTree(0),
+    numGrowthThreadsRunning(0), numBakeThreadsRunning(0) {
+    const unsigned int numCores = std::max(1u, std::thread::hardware_concurrency());
+    numGrowthThreads = (growthThreads > 0) ? growthThreads : numCores;
+    numBakeThreads = (bakeThreads > 0) ? bakeThreads : std::max(1u, numGrowthThreads / 4);
+}
+
+/// Stages
+
+void BatchPipeline::RunGrowthThread(unsigned int numTrees, const BatchTreeSource& source, BoundedQueue<std::unique_ptr<BatchTree>>& grown, BatchStageStats& threadStats) {
+    IsInsideParallelFor() = true;
+    for (unsigned int i = nextTree++; i < numTrees; i = nextTree++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::unique_ptr<BatchTree> batchTree = std::unique_ptr<BatchTree>(new BatchTree());
+        batchTree->index = i;
+        source(i, *batchTree);
+        {
+            PROFILE_SCOPE("Batch Growth");
+            if (batchTree->aliveMask.GetNumPoints() != (unsigned int)batchTree->attractorPoints->size()) {
+                batchTree->aliveMask.Reset((unsigned int)batchTree->attractorPoints->size());
+            }
+            batchTree->tree->IterateGrowth(*batchTree->attractorPoints, batchTree->aliveMask, batchTree->minAttrPt, batchTree->maxAttrPt, batchTree->treeParams, false);
+        }
+        batchTree->aliveMask = AttractorPointMask(); // not needed past growth, no use holding on to it while the tree waits
+        threadStats.busySeconds += SecondsSince(start);
+        ++threadStats.numTrees;
+
+        start = std::chrono::steady_clock::now();
+        grown.Push(std::move(batchTree));
+        threadStats.blockedSeconds += SecondsSince(start);
+    }
+    if (--numGrowthThreadsRunning == 0) { grown.Close(); }
+}
+
+void BatchPipeline::RunBakeThread(BoundedQueue<std::unique_ptr<BatchTree>>& grown, BoundedQueue<std::unique_ptr<BatchTree>>& baked, BatchStageStats& threadStats) {
+    IsInsideParallelFor() = true;
+    std::unique_ptr<BatchTree> batchTree;
+    while (true) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const bool gotTree = grown.Pop(batchTree);
+        threadStats.starvedSeconds += SecondsSince(start);
+        if (!gotTree) { break; }
+
+        start = std::chrono::steady_clock::now();
+        {
+            PROFILE_SCOPE("Batch Bake Meshes");
+            batchTree->tree->BakeMeshes();
+        }
+        if (batchTree->previewSize > 0) {
+            PROFILE_SCOPE("Batch Render Preview");
+            TreePreviewRenderer previewRenderer;
+            previewRenderer.Build(*batchTree->tree);
+            previewRenderer.Render(batchTree->previewSize, batchTree->previewSize, 0.0f, batchTree->previewPixels);
+        }
+        threadStats.busySeconds += SecondsSince(start);
+        ++threadStats.numTrees;
+
+        start = std::chrono::steady_clock::now();
+        baked.Push(std::move(batchTree));
+        threadStats.blockedSeconds += SecondsSince(start);
+    }
+    if (--numBakeThreadsRunning == 0) { baked.Close(); }
+}
+
+void BatchPipeline::RunWriteThread(BoundedQueue<std::unique_ptr<BatchTree>>& baked, BatchStageStats& threadStats) {
+    std::unique_ptr<BatchTree> batchTree;
+    while (true) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const bool gotTree = baked.Pop(batchTree);
+        threadStats.starvedSeconds += SecondsSince(start);
+        if (!gotTree) { break; }
+
+        start = std::chrono::steady_clock::now();
+        {
+            PROFILE_SCOPE("Batch Export");
+            if (!batchTree->tree->ExportAsObj(batchTree->outputPrefix)) { ++numWriteFailures; }
+            if (batchTree->previewSize > 0 &&
+                !PngWriter::Write(batchTree->outputPrefix + "preview.png", batchTree->previewSize, batchTree->previewSize, batchTree->previewPixels)) {
+                ++numWriteFailures;
+            }
+            batchTree.reset(); // the last stage, so the tree's memory goes back right away
+        }
+        threadStats.busySeconds += SecondsSince(start);
+        ++threadStats.numTrees;
+    }
+}
+
+/// Running a batch
+
+bool BatchPipeline::Run(unsigned int numTrees, const BatchTreeSource& source) {
+    PROFILE_SCOPE("Batch Pipeline");
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    nextTree = 0;
+    numGrowthThreadsRunning = numGrowthThreads;
+    numBakeThreadsRunning = numBakeThreads;
+    numWriteFailures = 0;
+    BoundedQueue<std::unique_ptr<BatchTree>> grown(BATCH_PIPELINE_QUEUE_CAPACITY * numBakeThreads);
+    BoundedQueue<std::unique_ptr<BatchTree>> baked(BATCH_PIPELINE_QUEUE_CAPACITY);
+
+    // One stats entry per thread, so the threads never share one. Summed per stage at the end.
+    std::vector<BatchStageStats> threadStats = std::vector<BatchStageStats>(numGrowthThreads + numBakeThreads + 1);
+    std::vector<std::thread> threads = std::vector<std::thread>();
+    for (unsigned int t = 0; t < numGrowthThreads; ++t) {
+        threads.emplace_back(&BatchPipeline::RunGrowthThread, this, numTrees, std::cref(source), std::ref(grown), std::ref(threadStats[t]));
+    }
+    for (unsigned int t = 0; t < numBakeThreads; ++t) {
+        threads.emplace_back(&BatchPipeline::RunBakeThread, this, std::ref(grown), std::ref(baked), std::ref(threadStats[numGrowthThreads + t]));
+    }
+    RunWriteThread(baked, threadStats.back()); // the calling thread writes
+    for (unsigned int t = 0; t < (unsigned int)threads.size(); ++t) {
+        threads[t].join();
+    }
+    wallSeconds = SecondsSince(start);
+
+    const char* stageNames[] = { "Growth", "Bake Meshes", "Write OBJs" };
+    const unsigned int stageThreads[] = { numGrowthThreads, numBakeThreads, 1 };
+    unsigned int t = 0;
+    for (unsigned int s = 0; s < GetNumStages(); ++s) {
+        stats[s] = BatchStageStats();
+        stats[s].name = stageNames[s];
+        stats[s].numThreads = stageThreads[s];
+        for (unsigned int i = 0; i < stageThreads[s]; ++i, ++t) {
+            stats[s].numTrees += threadStats[t].numTrees;
+            stats[s].busySeconds += threadStats[t].busySeconds;
+            stats[s].starvedSeconds += threadStats[t].starvedSeconds;
+            stats[s].blockedSeconds += threadStats[t].blockedSeconds;
+        }
+    }
+    return numWriteFailures == 0;
+}
+
+void BatchPipeline::PrintStats() const {
+    std::cout << "Batch of " << stats[2].numTrees << " trees in " << wallSeconds << " s" << std::endl;
+    for (unsigned int s = 0; s < GetNumStages(); ++s) {
+        const BatchStageStats& stage = stats[s];
+        std::cout << "  " << stage.name << ": " << stage.numThreads << " threads, " << (int)(100.0 * stage.Utilization(wallSeconds)) << "% busy, "
+                  << stage.starvedSeconds << " s starved, " << stage.blockedSeconds << " s blocked" << std::endl;
+    }
+}
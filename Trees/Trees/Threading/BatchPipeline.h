@@ -0,0 +1,84 @@
+#pragma once
+
+#include "../Scene/Tree.h"
+#include "BoundedQueue.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define BATCH_PIPELINE_QUEUE_CAPACITY 4 // trees waiting between two stages, per thread of the stage taking them
+
+// One tree on its way through a BatchPipeline
+struct BatchTree {
+    unsigned int index; // in the batch
+    std::unique_ptr<Tree> tree;
+    std::shared_ptr<const std::vector<AttractorPoint>> attractorPoints; // read-only, so any number of trees may share one cloud
+    AttractorPointMask aliveMask; // all alive if left empty
+    glm::vec3 minAttrPt;
+    glm::vec3 maxAttrPt;
+    TreeParameters treeParams;
+    std::string outputPrefix; // the meshes are written to <outputPrefix><mesh name>.obj, see Tree::ExportAsObj
+    unsigned int previewSize; // pixels on a side of the thumbnail written to <outputPrefix>preview.png, 0 for none
+    std::vector<unsigned char> previewPixels; // rendered by the baking stage, see TreePreviewRenderer
+    BatchTree() : index(0), minAttrPt(glm::vec3(0.0f)), maxAttrPt(glm::vec3(0.0f)), outputPrefix(""), previewSize(0) {
+        aliveMask = AttractorPointMask();
+        treeParams = TreeParameters();
+        previewPixels = std::vector<unsigned char>();
+    }
+};
+
+// Fills in the i-th tree of a batch: its starting tree, points and parameters. Called on a growth thread, in no particular order, so it must
+// not touch shared state unguarded. Copying a loaded tree (or Tree::Fork) reuses its branch and leaf meshes instead of reading them again.
+typedef std::function<void(unsigned int i, BatchTree& batchTree)> BatchTreeSource;
+
+// Where a stage's threads spent a BatchPipeline::Run, summed over its threads
+struct BatchStageStats {
+    const char* name;
+    unsigned int numThreads;
+    unsigned int numTrees;
+    double busySeconds; // doing the stage's work
+    double starvedSeconds; // waiting for the previous stage
+    double blockedSeconds; // waiting for the next stage to make room
+    BatchStageStats() : name(""), numThreads(0), numTrees(0), busySeconds(0.0), starvedSeconds(0.0), blockedSeconds(0.0) {}
+    // The fraction of the stage's thread time spent working. The stage close to 1 is the bottleneck, the others wait on it.
+    double Utilization(double wallSeconds) const { return (wallSeconds > 0.0 && numThreads > 0) ? busySeconds / (wallSeconds * numThreads) : 0.0; }
+};
+
+// Grows, meshes and exports a batch of trees, e.g. thousands of variants for a scene, with the three steps running at the same time on
+// different trees: a pool of growth threads feeds a pool of mesh baking threads, which feeds one thread writing the OBJs (and the preview thumbnails, if the trees ask for them). One tree after
+// the other takes as long as all the steps added up; pipelined, a batch takes about as long as its slowest stage, whose threads never wait
+// on the others. The stages are connected by BoundedQueues, so a stage that gets ahead blocks instead of piling up grown trees in memory.
+// Growth and baking run headless on the CPU: the trees are never uploaded. Inside a stage, a tree's own parallel passes run serially, the
+// stage's threads are already working on other trees.
+class BatchPipeline {
+private:
+    unsigned int numGrowthThreads;
+    unsigned int numBakeThreads;
+    BatchStageStats stats[3]; // growth, baking, writing
+    double wallSeconds;
+    unsigned int numWriteFailures;
+
+    std::atomic<unsigned int> nextTree; // the next index for a growth thread to take
+    std::atomic<unsigned int> numGrowthThreadsRunning; // the last one closes the growth stage's output queue, and likewise for baking
+    std::atomic<unsigned int> numBakeThreadsRunning;
+
+    void RunGrowthThread(unsigned int numTrees, const BatchTreeSource& source, BoundedQueue<std::unique_ptr<BatchTree>>& grown, BatchStageStats& threadStats);
+    void RunBakeThread(BoundedQueue<std::unique_ptr<BatchTree>>& grown, BoundedQueue<std::unique_ptr<BatchTree>>& baked, BatchStageStats& threadStats);
+    void RunWriteThread(BoundedQueue<std::unique_ptr<BatchTree>>& baked, BatchStageStats& threadStats);
+
+public:
+    // 0 threads for growth means one per core. Baking is a fraction of growth's cost, so a quarter as many threads by default.
+    BatchPipeline(unsigned int growthThreads = 0, unsigned int bakeThreads = 0);
+
+    // Runs the whole batch and returns once every tree is written. Returns false if any OBJ or preview could not be written.
+    bool Run(unsigned int numTrees, const BatchTreeSource& source);
+
+    // Of the last Run
+    const BatchStageStats& GetStageStats(unsigned int stage) const { return stats[stage]; }
+    unsigned int GetNumStages() const { return 3; }
+    double GetWallSeconds() const { return wallSeconds; }
+    void PrintStats() const;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// A queue between the stages of a pipeline (see BatchPipeline) that holds at most a fixed number of items. A producer that finds it full
+// blocks until a consumer takes one, so a fast stage can never run further ahead of a slow one than the capacity allows: memory stays
+// bounded no matter how many items go through. Any number of producers and consumers.
+template <typename T>
+class BoundedQueue {
+private:
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    std::deque<T> items;
+    unsigned int capacity;
+    bool closed; // no more pushes, see Close()
+
+public:
+    BoundedQueue(unsigned int c) : capacity(std::max(1u, c)), closed(false) {
+        items = std::deque<T>();
+    }
+
+    // Blocks while the queue is full. Returns false, without taking the item, if the queue was closed.
+    bool Push(T&& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return closed || (unsigned int)items.size() < capacity; });
+        if (closed) { return false; }
+        items.emplace_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+    // Blocks while the queue is empty. Returns false once the queue is closed and every item was taken.
+    bool Pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) { return false; }
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+    // Called once the last producer is done. Consumers still get the items queued so far.
+    void Close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+    unsigned int GetCapacity() const { return capacity; }
+};
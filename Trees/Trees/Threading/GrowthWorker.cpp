@@ -0,0 +1,174 @@
+#include "GrowthWorker.h"
+#include "Parallel.h"
+#include "../Scene/Forest.h"
+#include "../Profiling/Profiler.h"
+
+void GrowthWorker::Start(const Tree& sourceTree, const std::shared_ptr<const std::vector<AttractorPoint>>& points, AttractorPointMask&& mask, const glm::vec3& minPt, const glm::vec3& maxPt,
+                         const TreeParameters& params, bool gpu) {
+    if (IsBusy()) { return; }
+    attractorPoints = points;
+    aliveMask = std::move(mask);
+    minAttrPt = minPt;
+    maxAttrPt = maxPt;
+    growIntoComposite = false;
+    growForest = false;
+    useGPU = gpu;
+    trees.emplace_back(sourceTree);
+    StartThread(params);
+}
+
+void GrowthWorker::Start(const Tree& sourceTree, AttractorPointComposite&& points, const TreeParameters& params) {
+    if (IsBusy()) { return; }
+    composite = std::move(points);
+    growIntoComposite = true;
+    growForest = false;
+    useGPU = false;
+    trees.emplace_back(sourceTree);
+    StartThread(params);
+}
+
+void GrowthWorker::Start(const std::vector<Tree>& sourceTrees, const std::shared_ptr<const std::vector<AttractorPoint>>& points, AttractorPointMask&& mask, const glm::vec3& minPt,
+                         const glm::vec3& maxPt, const TreeParameters& params) {
+    if (IsBusy() || sourceTrees.empty()) { return; }
+    attractorPoints = points;
+    aliveMask = std::move(mask);
+    minAttrPt = minPt;
+    maxAttrPt = maxPt;
+    growIntoComposite = false;
+    growForest = true;
+    useGPU = false;
+    trees.reserve(sourceTrees.size());
+    for (unsigned int t = 0; t < (unsigned int)sourceTrees.size(); ++t) {
+        trees.emplace_back(sourceTrees[t]);
+    }
+    StartThread(params);
+}
+
+void GrowthWorker::StartThread(const TreeParameters& params) {
+    treeParams = params;
+    if (growIntoComposite) {
+        treeParams.incrementalSpaceColonization = true; // the only mode that grows into a composite, see Tree::IterateGrowth
+    }
+    cancelRequested = false;
+    done = false;
+    numIterationsDone = 0;
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        latestSnapshot.reset();
+    }
+    thread = std::thread(&GrowthWorker::Run, this);
+}
+
+void GrowthWorker::Run() {
+    {
+        PROFILE_SCOPE("Background Growth");
+        if (growForest) {
+            Forest forest = Forest(trees);
+            forest.BeginGrowth(*attractorPoints, minAttrPt, maxAttrPt, treeParams);
+            for (int n = 0; n < treeParams.numSpaceColonizationIterations && !cancelRequested; ++n) {
+                const bool keepGrowing = forest.PerformGrowthIteration(*attractorPoints, aliveMask, n);
+                numIterationsDone = n + 1;
+                if (!keepGrowing) { break; }
+                PublishSnapshot(n + 1);
+            }
+            forest.EndGrowth();
+        } else {
+            Tree& tree = trees[0];
+            int n = 0;
+            if (growIntoComposite) {
+                tree.BeginGrowth(composite, treeParams);
+            } else {
+                n = tree.GrowCoarseLevels(*attractorPoints, aliveMask, minAttrPt, maxAttrPt, treeParams, useGPU);
+                numIterationsDone = n;
+                tree.BeginGrowth(*attractorPoints, minAttrPt, maxAttrPt, treeParams, useGPU);
+            }
+            for (; n < treeParams.numSpaceColonizationIterations && !cancelRequested; ++n) {
+                const bool keepGrowing = growIntoComposite ? tree.PerformGrowthIteration(composite, treeParams, n)
+                                                           : tree.PerformGrowthIteration(*attractorPoints, aliveMask, minAttrPt, maxAttrPt, treeParams, n, useGPU);
+                numIterationsDone = n + 1;
+                if (!keepGrowing) { break; }
+                PublishSnapshot(n + 1);
+            }
+            tree.EndGrowth(treeParams, useGPU);
+        }
+        ParallelFor((unsigned int)trees.size(), [this](unsigned int t) {
+            trees[t].ComputeBranchRadii(treeParams);
+            trees[t].BakeMeshes();
+        });
+    }
+    done = true;
+}
+
+void GrowthWorker::PublishSnapshot(int n) {
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        if (latestSnapshot) { return; } // the render thread hasn't picked up the previous one yet
+    }
+    PROFILE_SCOPE("Publish Growth Snapshot");
+    const unsigned int numTrees = (unsigned int)trees.size();
+    std::unique_ptr<GrowthSnapshot> snapshot = std::unique_ptr<GrowthSnapshot>(new GrowthSnapshot());
+    snapshot->numIterationsDone = n;
+    snapshot->treeMeshes.resize(numTrees);
+    snapshot->leavesMeshes.resize(numTrees);
+    ParallelFor(numTrees, [&](unsigned int t) {
+        trees[t].ComputeBranchRadii(treeParams); // radii only matter for meshing, so computing them mid-growth doesn't change the result
+        trees[t].BakeMeshes();
+        snapshot->treeMeshes[t].SwapData(trees[t].GetTreeMesh());
+        snapshot->leavesMeshes[t].SwapData(trees[t].GetLeavesMesh());
+    });
+    for (unsigned int t = 0; t < numTrees; ++t) {
+        snapshot->numBranches += (unsigned int)trees[t].GetBranches().size();
+    }
+
+    std::lock_guard<std::mutex> lock(snapshotMutex);
+    latestSnapshot = std::move(snapshot);
+}
+
+std::unique_ptr<GrowthSnapshot> GrowthWorker::TakeLatestSnapshot() {
+    std::unique_lock<std::mutex> lock(snapshotMutex, std::try_to_lock);
+    if (!lock.owns_lock()) { return nullptr; }
+    return std::move(latestSnapshot);
+}
+
+bool GrowthWorker::Finish(Tree& targetTree, AttractorPointMask& targetMask) {
+    if (!IsBusy() || !done || growIntoComposite || growForest) { return false; }
+    Wait();
+    targetMask = std::move(aliveMask);
+    attractorPoints.reset();
+    FinishTree(0, targetTree);
+    EndJob();
+    return true;
+}
+
+bool GrowthWorker::Finish(Tree& targetTree, AttractorPointComposite& targetComposite) {
+    if (!IsBusy() || !done || !growIntoComposite) { return false; }
+    Wait();
+    targetComposite = std::move(composite);
+    composite = AttractorPointComposite();
+    FinishTree(0, targetTree);
+    EndJob();
+    return true;
+}
+
+bool GrowthWorker::Finish(std::vector<Tree>& targetTrees, AttractorPointMask& targetMask) {
+    if (!IsBusy() || !done || !growForest) { return false; }
+    Wait();
+    targetMask = std::move(aliveMask);
+    attractorPoints.reset();
+    for (unsigned int t = 0; t < (unsigned int)std::min(trees.size(), targetTrees.size()); ++t) {
+        FinishTree(t, targetTrees[t]);
+    }
+    EndJob();
+    return true;
+}
+
+void GrowthWorker::FinishTree(unsigned int t, Tree& targetTree) {
+    targetTree.TakeGrowthState(trees[t]);
+    targetTree.SwapMeshData(trees[t].GetTreeMesh(), trees[t].GetLeavesMesh());
+}
+
+void GrowthWorker::EndJob() {
+    trees.clear();
+    std::lock_guard<std::mutex> lock(snapshotMutex);
+    latestSnapshot.reset(); // older than the final meshes
+}
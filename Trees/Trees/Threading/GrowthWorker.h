@@ -0,0 +1,97 @@
+#pragma once
+
+#include "../Scene/Tree.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// What the render thread gets to see of the trees that are growing in the background: their meshes as of some iteration, already baked on the
+// worker so that picking a snapshot up only costs the GL upload.
+struct GrowthSnapshot {
+    int numIterationsDone;
+    unsigned int numBranches; // of all trees together
+    std::vector<Mesh> treeMeshes; // CPU-side data only, no GL buffers. One per tree of the job, in the order Start() got them.
+    std::vector<Mesh> leavesMeshes;
+    GrowthSnapshot() : numIterationsDone(0), numBranches(0) {
+        treeMeshes = std::vector<Mesh>();
+        leavesMeshes = std::vector<Mesh>();
+    }
+};
+
+// Runs Tree::IterateGrowth for a copy of a tree on a background thread, so the render loop keeps going while it grows, into one cloud or into a
+// composite of several. Or Forest::IterateGrowth for copies of several trees that compete for one cloud.
+// After each iteration the worker publishes a snapshot, unless the previous one hasn't been picked up yet: there is at most one snapshot in
+// flight, so a slow render thread just sees fewer intermediate steps and the worker never bakes meshes nobody will look at.
+// Usage from the render thread: Start(), then every frame TakeLatestSnapshot() and Finish() until the latter returns true.
+class GrowthWorker {
+private:
+    std::thread thread;
+    // The copies being grown, one unless growing a forest. Only the worker thread touches them between Start() and the end of Run().
+    std::vector<Tree> trees;
+    std::shared_ptr<const std::vector<AttractorPoint>> attractorPoints; // shared with the cloud, read-only
+    AttractorPointMask aliveMask; // taken over from the caller until Finish()
+    AttractorPointComposite composite; // the same, when growing into several clouds
+    bool growIntoComposite;
+    bool growForest;
+    glm::vec3 minAttrPt;
+    glm::vec3 maxAttrPt;
+    TreeParameters treeParams;
+    bool useGPU;
+
+    std::atomic<bool> cancelRequested;
+    std::atomic<bool> done; // set by the worker thread as its last action
+    std::atomic<int> numIterationsDone;
+
+    std::mutex snapshotMutex;
+    std::unique_ptr<GrowthSnapshot> latestSnapshot; // guarded by snapshotMutex. Null once taken.
+
+    void Run();
+    void PublishSnapshot(int n);
+    void StartThread(const TreeParameters& params);
+    void FinishTree(unsigned int t, Tree& targetTree); // the common part of every Finish(), per tree
+    void EndJob();
+
+public:
+    GrowthWorker() : growIntoComposite(false), growForest(false), minAttrPt(glm::vec3(0.0f)), maxAttrPt(glm::vec3(0.0f)), useGPU(false), cancelRequested(false), done(false), numIterationsDone(0) {
+        trees = std::vector<Tree>();
+        aliveMask = AttractorPointMask();
+        composite = AttractorPointComposite();
+        treeParams = TreeParameters();
+    }
+    ~GrowthWorker() {
+        Cancel();
+        Wait();
+    }
+
+    // Starts growing a copy of sourceTree into the alive points of the given cloud. The mask is taken over by the worker until Finish().
+    // Does nothing if a job is already in progress.
+    void Start(const Tree& sourceTree, const std::shared_ptr<const std::vector<AttractorPoint>>& points, AttractorPointMask&& mask, const glm::vec3& minPt, const glm::vec3& maxPt,
+               const TreeParameters& params, bool gpu);
+    // Starts growing a copy of sourceTree into several clouds at once (see Tree::IterateGrowth), on the CPU. The composite is taken over by
+    // the worker until Finish().
+    void Start(const Tree& sourceTree, AttractorPointComposite&& points, const TreeParameters& params);
+    // Starts growing copies of sourceTrees together into the alive points of the given cloud, on the CPU, so that they compete for it (see
+    // Forest). The mask is taken over by the worker until Finish().
+    void Start(const std::vector<Tree>& sourceTrees, const std::shared_ptr<const std::vector<AttractorPoint>>& points, AttractorPointMask&& mask, const glm::vec3& minPt,
+               const glm::vec3& maxPt, const TreeParameters& params);
+    // Asks the worker to stop after the current iteration. The tree grown so far is still handed back by Finish().
+    void Cancel() { cancelRequested = true; }
+    // Whether a job was started and hasn't been handed back through Finish() yet
+    bool IsBusy() const { return !trees.empty(); }
+    unsigned int GetNumTrees() const { return (unsigned int)trees.size(); } // being grown by the current job
+    int GetNumIterationsDone() const { return numIterationsDone; }
+    int GetNumIterations() const { return treeParams.numSpaceColonizationIterations; }
+
+    void Wait() { if (thread.joinable()) { thread.join(); } } // Blocks until the job is done, e.g. after Cancel() on shutdown
+
+    // Never blocks: returns null if there is no new snapshot, or if the worker happens to be publishing one right now
+    std::unique_ptr<GrowthSnapshot> TakeLatestSnapshot();
+    // If the job is done, joins the worker and moves the grown branches and baked meshes into targetTree (without uploading them), and the
+    // alive mask, minus the points the tree consumed, back into targetMask. Returns false while the job is still running.
+    bool Finish(Tree& targetTree, AttractorPointMask& targetMask);
+    bool Finish(Tree& targetTree, AttractorPointComposite& targetComposite); // for a job started with a composite
+    bool Finish(std::vector<Tree>& targetTrees, AttractorPointMask& targetMask); // for a forest: targetTrees[t] gets the t-th tree Start() got
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <type_traits>
+
+// Set on every thread while it runs items of a ParallelFor. A ParallelFor started from inside one (e.g. a tree's own parallel passes while a
+// Forest grows its trees in parallel) runs serially on the calling thread, since all threads are busy already.
+inline bool& IsInsideParallelFor() {
+    static thread_local bool insideParallelFor = false;
+    return insideParallelFor;
+}
+
+// The state a ParallelFor shares with the pool threads helping it: they take the next item until none is left
+template <typename F>
+struct ParallelForItems {
+    F* f;
+    unsigned int numItems;
+    std::atomic<unsigned int> nextItem;
+
+    static void Work(void* context) {
+        ParallelForItems& items = *(ParallelForItems*)context;
+        IsInsideParallelFor() = true;
+        for (unsigned int i = items.nextItem++; i < items.numItems; i = items.nextItem++) {
+            (*items.f)(i);
+        }
+        IsInsideParallelFor() = false;
+    }
+};
+
+// Calls f(i) for every i in [0, numItems) on up to std::thread::hardware_concurrency() threads, the calling thread included, and returns once
+// every call has finished. Items are handed out one at a time, so items of very different cost (e.g. a big and a small tree) still balance.
+// The other threads come from ThreadPool::Shared(). f must be safe to call concurrently for different items.
+template <typename F>
+void ParallelFor(unsigned int numItems, F&& f) {
+    const unsigned int numThreads = std::min(numItems, std::max(1u, std::thread::hardware_concurrency()));
+    if (numThreads <= 1 || IsInsideParallelFor()) {
+        for (unsigned int i = 0; i < numItems; ++i) {
+            f(i);
+        }
+        return;
+    }
+
+    typedef typename std::remove_reference<F>::type Function;
+    ParallelForItems<Function> items;
+    items.f = &f;
+    items.numItems = numItems;
+    items.nextItem = 0;
+    ThreadPool::Shared().Run(numThreads - 1, &ParallelForItems<Function>::Work, &items);
+}
+
+// ParallelFor over blocks of blockSize consecutive items, for items too cheap to be handed out one at a time: calls f(begin, end) once per block
+template <typename F>
+void ParallelForBlocks(unsigned int numItems, unsigned int blockSize, F&& f) {
+    const unsigned int numBlocks = (numItems + blockSize - 1) / blockSize;
+    ParallelFor(numBlocks, [&](unsigned int b) { f(b * blockSize, std::min(numItems, (b + 1) * blockSize)); });
+}
@@ -0,0 +1,67 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool() : stopping(false) {
+    jobs = std::deque<Job>();
+    threads = std::vector<std::thread>();
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobQueued.notify_all();
+    for (unsigned int t = 0; t < (unsigned int)threads.size(); ++t) {
+        threads[t].join();
+    }
+}
+
+ThreadPool& ThreadPool::Shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::RunThread() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        jobQueued.wait(lock, [this]() { return stopping || !jobs.empty(); });
+        if (stopping) { break; }
+        const Job job = jobs.front();
+        jobs.pop_front();
+        ++job.batch->numRunning;
+        lock.unlock();
+        job.work(job.context);
+        lock.lock();
+        if (--job.batch->numRunning == 0) {
+            jobFinished.notify_all();
+        }
+    }
+}
+
+void ThreadPool::Run(unsigned int numHelpers, Work work, void* context) {
+    Batch batch;
+    batch.numRunning = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while ((unsigned int)threads.size() < numHelpers) {
+            threads.emplace_back(&ThreadPool::RunThread, this);
+        }
+        for (unsigned int h = 0; h < numHelpers; ++h) {
+            jobs.push_back({ work, context, &batch });
+        }
+    }
+    if (numHelpers == 1) {
+        jobQueued.notify_one();
+    } else if (numHelpers > 1) {
+        jobQueued.notify_all();
+    }
+
+    work(context);
+
+    // work only returns once nothing is left to take, so the helpers that have not started yet would find nothing to do
+    std::unique_lock<std::mutex> lock(mutex);
+    for (std::deque<Job>::iterator it = jobs.begin(); it != jobs.end();) {
+        it = (it->batch == &batch) ? jobs.erase(it) : it + 1;
+    }
+    jobFinished.wait(lock, [&]() { return batch.numRunning == 0; });
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The worker threads behind ParallelFor and WorkStealingPool, shared by the whole process. Threads are started the first time a run asks for
+// them and then kept, sleeping on a condition variable between runs, so a parallel pass costs a wake up instead of creating and joining a
+// thread per core (AppendNewShoots alone runs a few passes per growth iteration).
+// Only for work that never waits on other work of the same run: a helper may start late or not at all (see Run), so stages that block on each
+// other (BatchPipeline's stages, TiledForest's tiles) keep their own threads.
+class ThreadPool {
+public:
+    typedef void (*Work)(void* context);
+
+private:
+    struct Batch {
+        unsigned int numRunning; // helpers taken off the queue and not finished yet
+    };
+    struct Job {
+        Work work;
+        void* context;
+        Batch* batch;
+    };
+    std::mutex mutex; // guards everything below
+    std::condition_variable jobQueued;
+    std::condition_variable jobFinished;
+    std::deque<Job> jobs;
+    std::vector<std::thread> threads;
+    bool stopping;
+
+    void RunThread();
+
+    ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+public:
+    ~ThreadPool();
+
+    static ThreadPool& Shared();
+
+    // Calls work(context) on the calling thread and on up to numHelpers pool threads, and returns once every call has finished. Helpers that
+    // have not started by the time the calling thread is done are dropped, so work must pull its items from shared state (e.g. an atomic
+    // counter) rather than expect a fixed number of calls. The pool grows to numHelpers threads if it has fewer.
+    void Run(unsigned int numHelpers, Work work, void* context);
+};
@@ -0,0 +1,171 @@
+#include "TileTransport.h"
+
+void LoopbackTransportHub::Post(int fromRank, int toRank, const std::vector<unsigned char>& message) {
+    Mailbox& mailbox = mailboxes[toRank * numRanks + fromRank];
+    {
+        std::lock_guard<std::mutex> lock(mailbox.mutex);
+        mailbox.messages.push_back(message);
+    }
+    mailbox.arrived.notify_one();
+}
+
+void LoopbackTransportHub::Take(int fromRank, int toRank, std::vector<unsigned char>& message) {
+    Mailbox& mailbox = mailboxes[toRank * numRanks + fromRank];
+    std::unique_lock<std::mutex> lock(mailbox.mutex);
+    mailbox.arrived.wait(lock, [&]() { return !mailbox.messages.empty(); });
+    message.swap(mailbox.messages.front());
+    mailbox.messages.pop_front();
+}
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // macOS: SO_NOSIGPIPE is set on the socket instead
+#endif
+
+typedef unsigned long long MessageLength; // in front of every message on the wire
+
+SocketTransport::SocketTransport(int r, const std::vector<int>& sockets) : rank(r) {
+    peers = std::vector<Peer>(sockets.size());
+    for (int p = 0; p < (int)peers.size(); ++p) {
+        Peer& peer = peers[p];
+        peer.socket = (p == rank) ? -1 : sockets[p];
+        peer.outgoing = std::vector<unsigned char>();
+        peer.outgoingStart = 0;
+        peer.incoming = std::vector<unsigned char>();
+        peer.incomingStart = 0;
+        peer.hungUp = false;
+        if (peer.socket != -1) {
+            fcntl(peer.socket, F_SETFL, fcntl(peer.socket, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+            const int noSigPipe = 1;
+            setsockopt(peer.socket, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+        }
+    }
+}
+
+SocketTransport::~SocketTransport() {
+    for (unsigned int p = 0; p < (unsigned int)peers.size(); ++p) {
+        if (peers[p].socket != -1) { close(peers[p].socket); }
+    }
+}
+
+void SocketTransport::Send(int toRank, const std::vector<unsigned char>& message) {
+    Peer& peer = peers[toRank];
+    std::vector<unsigned char>& queue = (toRank == rank) ? peer.incoming : peer.outgoing;
+    const MessageLength length = (MessageLength)message.size();
+    const size_t offset = queue.size();
+    queue.resize(offset + sizeof(MessageLength) + message.size());
+    std::memcpy(queue.data() + offset, &length, sizeof(MessageLength));
+    if (message.size() > 0) {
+        std::memcpy(queue.data() + offset + sizeof(MessageLength), message.data(), message.size());
+    }
+    if (toRank != rank) { WriteOutgoing(peer); }
+}
+
+bool SocketTransport::Receive(int fromRank, std::vector<unsigned char>& message) {
+    Peer& peer = peers[fromRank];
+    while (!TakeMessage(peer, message)) {
+        if (fromRank == rank || peer.hungUp) { return false; } // nothing more is coming
+        Pump();
+    }
+    return true;
+}
+
+bool SocketTransport::Flush() {
+    for (;;) {
+        bool pending = false;
+        for (unsigned int p = 0; p < (unsigned int)peers.size(); ++p) {
+            const Peer& peer = peers[p];
+            if (peer.socket == -1 || peer.outgoingStart == peer.outgoing.size()) { continue; }
+            if (peer.hungUp) { return false; }
+            pending = true;
+        }
+        if (!pending) { return true; }
+        Pump();
+    }
+}
+
+bool SocketTransport::TakeMessage(Peer& peer, std::vector<unsigned char>& message) {
+    const size_t numBytes = peer.incoming.size() - peer.incomingStart;
+    if (numBytes < sizeof(MessageLength)) { return false; }
+    MessageLength length = 0;
+    std::memcpy(&length, peer.incoming.data() + peer.incomingStart, sizeof(MessageLength));
+    if (numBytes - sizeof(MessageLength) < length) { return false; }
+    const unsigned char* first = peer.incoming.data() + peer.incomingStart + sizeof(MessageLength);
+    message.assign(first, first + length);
+    peer.incomingStart += sizeof(MessageLength) + (size_t)length;
+    if (peer.incomingStart == peer.incoming.size()) {
+        peer.incoming.clear();
+        peer.incomingStart = 0;
+    } else if (peer.incomingStart > peer.incoming.size() / 2) {
+        peer.incoming.erase(peer.incoming.begin(), peer.incoming.begin() + peer.incomingStart);
+        peer.incomingStart = 0;
+    }
+    return true;
+}
+
+void SocketTransport::WriteOutgoing(Peer& peer) {
+    while (!peer.hungUp && peer.outgoingStart < peer.outgoing.size()) {
+        const ssize_t numWritten = send(peer.socket, peer.outgoing.data() + peer.outgoingStart, peer.outgoing.size() - peer.outgoingStart, MSG_NOSIGNAL);
+        if (numWritten < 0) {
+            if (errno == EINTR) { continue; }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) { peer.hungUp = true; }
+            break;
+        }
+        peer.outgoingStart += (size_t)numWritten;
+    }
+    if (peer.outgoingStart == peer.outgoing.size()) {
+        peer.outgoing.clear();
+        peer.outgoingStart = 0;
+    } else if (peer.outgoingStart > peer.outgoing.size() / 2) {
+        peer.outgoing.erase(peer.outgoing.begin(), peer.outgoing.begin() + peer.outgoingStart);
+        peer.outgoingStart = 0;
+    }
+}
+
+void SocketTransport::ReadIncoming(Peer& peer) {
+    unsigned char buffer[65536];
+    while (!peer.hungUp) {
+        const ssize_t numRead = recv(peer.socket, buffer, sizeof(buffer), 0);
+        if (numRead < 0) {
+            if (errno == EINTR) { continue; }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) { peer.hungUp = true; }
+            break;
+        }
+        if (numRead == 0) {
+            peer.hungUp = true;
+            break;
+        }
+        peer.incoming.insert(peer.incoming.end(), buffer, buffer + numRead);
+    }
+}
+
+void SocketTransport::Pump() {
+    std::vector<pollfd> fds = std::vector<pollfd>();
+    std::vector<int> fdRanks = std::vector<int>();
+    for (int p = 0; p < (int)peers.size(); ++p) {
+        const Peer& peer = peers[p];
+        if (peer.socket == -1 || peer.hungUp) { continue; }
+        pollfd fd = pollfd();
+        fd.fd = peer.socket;
+        fd.events = (short)(POLLIN | ((peer.outgoingStart < peer.outgoing.size()) ? POLLOUT : 0));
+        fds.push_back(fd);
+        fdRanks.push_back(p);
+    }
+    if (fds.empty()) { return; }
+    if (poll(fds.data(), (nfds_t)fds.size(), -1) < 0) { return; } // e.g. EINTR: the caller just pumps again
+
+    for (unsigned int f = 0; f < (unsigned int)fds.size(); ++f) {
+        Peer& peer = peers[fdRanks[f]];
+        if (fds[f].revents & POLLOUT) { WriteOutgoing(peer); }
+        if (fds[f].revents & (POLLIN | POLLHUP | POLLERR)) { ReadIncoming(peer); }
+    }
+}
+#endif
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// How the workers of a tiled growth (see TileWorker) talk to each other: numbered ranks that send each other messages of raw bytes. Messages
+// from one rank to another arrive in the order they were sent. LoopbackTransport connects ranks within one process, one per thread;
+// SocketTransport connects ranks that run in processes of their own, one per process.
+class TileTransport {
+public:
+    virtual ~TileTransport() {}
+    virtual int GetRank() const = 0;
+    virtual int GetNumRanks() const = 0;
+    // Never blocks, so every rank can send all of its messages of a round before receiving any. A rank may send to itself.
+    virtual void Send(int toRank, const std::vector<unsigned char>& message) = 0;
+    // Blocks until the next message from fromRank has arrived, and replaces the contents of message with it. Returns false if it never will,
+    // e.g. because the process of fromRank died.
+    virtual bool Receive(int fromRank, std::vector<unsigned char>& message) = 0;
+};
+
+// Appends the records to a message, preceded by their count. Records go as raw bytes, so both ends have to run on the same kind of machine.
+template <typename T>
+void WriteRecords(std::vector<unsigned char>& message, const std::vector<T>& records) {
+    const unsigned int numRecords = (unsigned int)records.size();
+    const size_t offset = message.size();
+    message.resize(offset + sizeof(unsigned int) + numRecords * sizeof(T));
+    std::memcpy(message.data() + offset, &numRecords, sizeof(unsigned int));
+    if (numRecords > 0) {
+        std::memcpy(message.data() + offset + sizeof(unsigned int), records.data(), numRecords * sizeof(T));
+    }
+}
+
+// Appends the records that WriteRecords() wrote at offset to records, and moves offset past them. Returns false if the message is too short.
+template <typename T>
+bool ReadRecords(const std::vector<unsigned char>& message, size_t& offset, std::vector<T>& records) {
+    unsigned int numRecords = 0;
+    if (offset + sizeof(unsigned int) > message.size()) { return false; }
+    std::memcpy(&numRecords, message.data() + offset, sizeof(unsigned int));
+    if ((message.size() - offset - sizeof(unsigned int)) / sizeof(T) < numRecords) { return false; }
+    offset += sizeof(unsigned int);
+    const size_t first = records.size();
+    records.resize(first + numRecords);
+    if (numRecords > 0) {
+        std::memcpy(records.data() + first, message.data() + offset, numRecords * sizeof(T));
+    }
+    offset += numRecords * sizeof(T);
+    return true;
+}
+
+// The mailboxes of a set of loopback ranks, one queue per sender and receiver. Must outlive the LoopbackTransports using it.
+class LoopbackTransportHub {
+private:
+    struct Mailbox {
+        std::mutex mutex;
+        std::condition_variable arrived;
+        std::deque<std::vector<unsigned char>> messages;
+    };
+    int numRanks;
+    std::unique_ptr<Mailbox[]> mailboxes; // messages from rank f to rank t queue up in mailboxes[t * numRanks + f]
+
+public:
+    LoopbackTransportHub(int n) : numRanks(n), mailboxes(new Mailbox[n * n]) {}
+    int GetNumRanks() const { return numRanks; }
+    void Post(int fromRank, int toRank, const std::vector<unsigned char>& message);
+    void Take(int fromRank, int toRank, std::vector<unsigned char>& message);
+};
+
+// One rank of a LoopbackTransportHub. Messages are copied, never shared, so ranks behave as if they were separate processes.
+class LoopbackTransport : public TileTransport {
+private:
+    LoopbackTransportHub& hub;
+    int rank;
+
+public:
+    LoopbackTransport(LoopbackTransportHub& h, int r) : hub(h), rank(r) {}
+    int GetRank() const override { return rank; }
+    int GetNumRanks() const override { return hub.GetNumRanks(); }
+    void Send(int toRank, const std::vector<unsigned char>& message) override { hub.Post(rank, toRank, message); }
+    bool Receive(int fromRank, std::vector<unsigned char>& message) override {
+        hub.Take(fromRank, rank, message);
+        return true;
+    }
+};
+
+#ifndef _WIN32
+// One rank of a set of processes that are connected pairwise by stream sockets, e.g. from socketpair() before fork() (see
+// TiledForest::IterateGrowthInProcesses). Messages go over the wire with a length in front. The sockets are non-blocking and both directions
+// are buffered here: Send only queues, Receive writes out whatever is queued for every rank while it waits, so no two ranks can end up
+// blocked on writing to each other. Not available on Windows.
+class SocketTransport : public TileTransport {
+private:
+    struct Peer {
+        int socket; // -1 for this rank itself, whose messages go straight to incoming
+        std::vector<unsigned char> outgoing; // messages not written to the socket yet, from outgoingStart on
+        size_t outgoingStart;
+        std::vector<unsigned char> incoming; // bytes read from the socket but not received yet, from incomingStart on
+        size_t incomingStart;
+        bool hungUp; // the other end was closed, or the socket failed
+    };
+    int rank;
+    std::vector<Peer> peers;
+
+    bool TakeMessage(Peer& peer, std::vector<unsigned char>& message); // Returns false if incoming doesn't hold a whole message yet
+    void WriteOutgoing(Peer& peer); // as much as the socket takes without blocking
+    void ReadIncoming(Peer& peer); // as much as the socket has
+    void Pump(); // Waits until some socket can be written or read, then writes and reads all that can be
+
+public:
+    // sockets[r] is connected to rank r, for every rank but this one. Takes over the sockets, and closes them when destroyed.
+    SocketTransport(int r, const std::vector<int>& sockets);
+    ~SocketTransport();
+    SocketTransport(const SocketTransport&) = delete;
+    SocketTransport& operator=(const SocketTransport&) = delete;
+    int GetRank() const override { return rank; }
+    int GetNumRanks() const override { return (int)peers.size(); }
+    void Send(int toRank, const std::vector<unsigned char>& message) override;
+    bool Receive(int fromRank, std::vector<unsigned char>& message) override;
+    // Blocks until every message sent so far has been written to its socket, e.g. before the process exits. Returns false if a rank hung up.
+    bool Flush();
+};
+#endif
@@ -0,0 +1,94 @@
+#include "WorkStealingPool.h"
+#include "Parallel.h"
+#include "ThreadPool.h"
+
+WorkStealingPool::WorkStealingPool(unsigned int numThreads) : nextWorker(0), numPending(0), numQueued(0), nextHelper(0), numSteals(0) {
+    numWorkers = (numThreads > 0) ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+    workers = std::unique_ptr<Worker[]>(new Worker[numWorkers]);
+}
+
+void WorkStealingPool::Push(Task task) {
+    Push(nextWorker, std::move(task));
+    nextWorker = (nextWorker + 1) % numWorkers;
+}
+
+void WorkStealingPool::Push(unsigned int worker, Task task) {
+    ++numPending; // before the task can be taken, so no worker sees zero pending while it is queued
+    {
+        std::lock_guard<std::mutex> lock(workers[worker].mutex);
+        workers[worker].tasks.emplace_back(std::move(task));
+        ++numQueued;
+    }
+    WakeWorkers(false);
+}
+
+// Taking idleMutex first means a worker is either still checking (and sees the new count) or already waiting (and gets the notification)
+void WorkStealingPool::WakeWorkers(bool all) {
+    std::lock_guard<std::mutex> lock(idleMutex);
+    if (all) {
+        idleCondition.notify_all();
+    } else {
+        idleCondition.notify_one();
+    }
+}
+
+bool WorkStealingPool::PopOwn(unsigned int worker, Task& task) {
+    std::lock_guard<std::mutex> lock(workers[worker].mutex);
+    if (workers[worker].tasks.empty()) { return false; }
+    task = std::move(workers[worker].tasks.back());
+    workers[worker].tasks.pop_back();
+    --numQueued;
+    return true;
+}
+
+// Tries the other workers in turn, starting with the next one, so thieves spread out over their victims
+bool WorkStealingPool::Steal(unsigned int worker, Task& task) {
+    for (unsigned int i = 1; i < numWorkers; ++i) {
+        Worker& victim = workers[(worker + i) % numWorkers];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tasks.empty()) { continue; }
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        --numQueued;
+        ++numSteals;
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::RunWorker(unsigned int worker) {
+    IsInsideParallelFor() = true;
+    Task task;
+    while (true) {
+        if (PopOwn(worker, task) || Steal(worker, task)) {
+            task(worker);
+            task = Task();
+            if (--numPending == 0) { // after the task pushed its continuations, if any
+                WakeWorkers(true); // everything is done, so the sleeping workers can return
+            }
+            continue;
+        }
+        // The pending tasks are running elsewhere and may still push more
+        std::unique_lock<std::mutex> lock(idleMutex);
+        idleCondition.wait(lock, [this]() { return numPending == 0 || numQueued > 0; });
+        if (numPending == 0) { break; }
+    }
+    IsInsideParallelFor() = false;
+}
+
+// Every thread of the run, the calling one included, takes the next worker index as it starts. One that starts after everything is done finds
+// nothing pending and returns right away.
+void WorkStealingPool::RunHelper(void* context) {
+    WorkStealingPool& pool = *(WorkStealingPool*)context;
+    const unsigned int worker = pool.nextHelper++;
+    if (worker < pool.numWorkers) {
+        pool.RunWorker(worker);
+    }
+}
+
+void WorkStealingPool::Run() {
+    nextHelper = 0;
+    const bool wasInsideParallelFor = IsInsideParallelFor();
+    ThreadPool::Shared().Run(numWorkers - 1, &WorkStealingPool::RunHelper, this);
+    IsInsideParallelFor() = wasInsideParallelFor;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Runs tasks on a fixed number of workers, each with its own deque of tasks. A worker runs its newest task first, so a task that pushes its own
+// continuation (e.g. the next few growth iterations of the same tree) keeps running on the same thread while its data is still in that core's
+// cache. A worker whose deque ran dry steals the oldest task of another worker, the one least likely to be in anyone's cache. For coarse tasks:
+// the deques are guarded by a mutex each. A worker that finds nothing to run or steal sleeps until a task is pushed or the last one finishes,
+// so the tail of a run (a few long tasks) leaves the other cores free.
+// The calling thread of Run() is one of the workers and the others are threads of ThreadPool::Shared(), so a run starts no threads of its own.
+// Workers whose thread is busy elsewhere (e.g. a Run() from inside a ParallelFor) just never join, and their tasks get stolen.
+// Like ParallelFor, tasks run with IsInsideParallelFor() set, so parallel passes inside a task run serially on its worker.
+class WorkStealingPool {
+public:
+    typedef std::function<void(unsigned int worker)> Task; // gets the index of the worker running it, to push continuations onto
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    std::unique_ptr<Worker[]> workers;
+    unsigned int numWorkers;
+    unsigned int nextWorker; // for tasks pushed before Run(), round robin
+    std::atomic<unsigned int> numPending; // pushed and not finished yet
+    std::atomic<unsigned int> numQueued; // pushed and not taken by a worker yet
+    std::mutex idleMutex; // guards the sleeping workers' checks of numQueued and numPending against missing a wake up
+    std::condition_variable idleCondition;
+    std::atomic<unsigned int> nextHelper; // worker index for the next thread that joins a Run()
+    std::atomic<unsigned long long> numSteals;
+
+    bool PopOwn(unsigned int worker, Task& task);
+    bool Steal(unsigned int worker, Task& task);
+    void RunWorker(unsigned int worker);
+    void WakeWorkers(bool all);
+    static void RunHelper(void* context);
+
+public:
+    // numThreads 0 means std::thread::hardware_concurrency()
+    WorkStealingPool(unsigned int numThreads = 0);
+
+    unsigned int GetNumWorkers() const { return numWorkers; }
+    unsigned long long GetNumSteals() const { return numSteals; }
+    // From outside Run(), deals the task out to the workers in turn. From inside a task, pass the task's worker to keep it local.
+    void Push(Task task);
+    void Push(unsigned int worker, Task task);
+    // Runs every task, including the ones tasks push, and returns once all of them are done
+    void Run();
+};
@@ -140,6 +140,9 @@ int main() {
         processInput(window);
         uiMgr.ImguiNewFrame();
         uiMgr.HandleInput(treeApp);
+        uiMgr.DrawProfilerPanel();
+        treeApp.UpdateBackgroundGrowth();
+        treeApp.UpdateTreeStages();
 
         // Handle Cursor Move / mouse drag
         double cursor_xpos, cursor_ypos;